@@ -3,6 +3,8 @@
 
 #include <ppltasks.h>
 
+#include "Common/Profiler.h"
+
 using namespace SonarPropagation;
 
 using namespace concurrency;
@@ -98,10 +100,14 @@ void App::Load(Platform::String^ entryPoint)
 // This method is called after the window becomes active.
 void App::Run()
 {
+	Graphics::Utils::Profiler::SetThreadName("Main");
+
 	while (!m_windowClosed)
 	{
 		if (m_windowVisible)
 		{
+			SONAR_PROFILE_SCOPE("Frame");
+
 			CoreWindow::GetForCurrentThread()->Dispatcher->ProcessEvents(CoreProcessEventsOption::ProcessAllIfPresent);
 
 			auto commandQueue = GetDeviceResources()->GetCommandQueue();
@@ -115,11 +121,17 @@ void App::Run()
 			{
 				if (m_main->Render())
 				{
+					SONAR_PROFILE_SCOPE("Present");
 					GetDeviceResources()->Present();
 				}
 			}
 			PIXEndEvent(commandQueue);
 
+			// Keeps the per-thread event rings from overflowing during long captures.
+			if (Graphics::Utils::Profiler::IsCapturing())
+			{
+				Graphics::Utils::Profiler::Collect();
+			}
 		}
 		else
 		{
@@ -0,0 +1,175 @@
+#include "pch.h"
+#include "BenchmarkFixtures.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace {
+	const double c_pi = 3.14159265358979323846;
+	const double c_waterDepth = 5000.0;
+}
+
+uint64_t SonarPropagation::Benchmarks::FixtureRandom::Next()
+{
+	uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+double SonarPropagation::Benchmarks::FixtureRandom::Uniform(double minimum, double maximum)
+{
+	// 53 random bits give every representable double in [0, 1).
+	const double unit = (Next() >> 11) * (1.0 / 9007199254740992.0);
+	return minimum + unit * (maximum - minimum);
+}
+
+const char* SonarPropagation::Benchmarks::GetReferenceProfileName(ReferenceProfile profile)
+{
+	switch (profile) {
+	case ReferenceProfile::Isovelocity:		return "isovelocity";
+	case ReferenceProfile::LinearGradient:	return "linear";
+	case ReferenceProfile::Munk:			return "munk";
+	case ReferenceProfile::MackenzieTable:	return "mackenzie_table";
+	default:								return "unknown";
+	}
+}
+
+const std::vector<SonarPropagation::Benchmarks::EnvironmentPoint>& SonarPropagation::Benchmarks::GetEnvironmentPoints()
+{
+	static const std::vector<EnvironmentPoint> points = [] {
+		FixtureRandom random(0x50A4);
+		std::vector<EnvironmentPoint> result(4096);
+		for (auto& point : result) {
+			point.temperature = random.Uniform(0.0, 30.0);
+			point.salinity = random.Uniform(30.0, 40.0);
+			point.depth = random.Uniform(0.0, 8000.0);
+		}
+		return result;
+	}();
+	return points;
+}
+
+const SonarPropagation::Sonar::SoundSpeedProfile& SonarPropagation::Benchmarks::GetReferenceProfile(ReferenceProfile profile)
+{
+	static const Sonar::SoundSpeedProfile isovelocity = Sonar::SoundSpeedProfile::Isovelocity(1500.0);
+	static const Sonar::SoundSpeedProfile linear = Sonar::SoundSpeedProfile::LinearGradient(1500.0, 0.017);
+	static const Sonar::SoundSpeedProfile munk = Sonar::SoundSpeedProfile::Munk();
+	static const Sonar::SoundSpeedProfile mackenzie = Sonar::SoundSpeedProfile::FromFormula(
+		Sonar::SoundSpeedFormula::Mackenzie, 4.0, 34.7, c_waterDepth, 1.0);
+
+	switch (profile) {
+	case ReferenceProfile::Isovelocity:		return isovelocity;
+	case ReferenceProfile::LinearGradient:	return linear;
+	case ReferenceProfile::Munk:			return munk;
+	default:								return mackenzie;
+	}
+}
+
+std::vector<SonarPropagation::Sonar::RayState> SonarPropagation::Benchmarks::MakeLaunchFan(const Sonar::SoundSpeedProfile& profile, double sourceDepth,
+	uint32_t count, double minAngleDegrees, double maxAngleDegrees)
+{
+	std::vector<Sonar::RayState> rays(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		const double t = count > 1 ? static_cast<double>(i) / (count - 1) : 0.5;
+		const double angle = (minAngleDegrees + t * (maxAngleDegrees - minAngleDegrees)) * c_pi / 180.0;
+		rays[i] = Sonar::InitializeRay(profile, 0.0, sourceDepth, angle);
+	}
+	return rays;
+}
+
+const std::string& SonarPropagation::Benchmarks::GetGridObj(uint32_t cells)
+{
+	static std::map<uint32_t, std::unique_ptr<std::string>> cache;
+
+	auto found = cache.find(cells);
+	if (found != cache.end()) {
+		return *found->second;
+	}
+
+	FixtureRandom random(cells);
+	std::ostringstream obj;
+	obj.precision(6);
+
+	const uint32_t side = cells + 1;
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			obj << "v " << x << ' ' << random.Uniform(-1.0, 1.0) << ' ' << y << '\n';
+		}
+	}
+	for (uint32_t i = 0; i < side * side; ++i) {
+		obj << "vn 0 1 0\n";
+	}
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			obj << "vt " << static_cast<double>(x) / cells << ' ' << static_cast<double>(y) / cells << '\n';
+		}
+	}
+
+	// OBJ indices are one based.
+	for (uint32_t y = 0; y < cells; ++y) {
+		for (uint32_t x = 0; x < cells; ++x) {
+			const uint32_t a = y * side + x + 1;
+			const uint32_t b = a + 1;
+			const uint32_t c = a + side;
+			const uint32_t d = c + 1;
+			obj << "f " << a << '/' << a << '/' << a << ' ' << c << '/' << c << '/' << c << ' ' << b << '/' << b << '/' << b << '\n';
+			obj << "f " << b << '/' << b << '/' << b << ' ' << c << '/' << c << '/' << c << ' ' << d << '/' << d << '/' << d << '\n';
+		}
+	}
+
+	auto inserted = cache.emplace(cells, std::unique_ptr<std::string>(new std::string(obj.str())));
+	return *inserted.first->second;
+}
+
+const SonarPropagation::Sonar::Heightfield& SonarPropagation::Benchmarks::GetBathymetryGrid(uint32_t cells)
+{
+	static std::map<uint32_t, std::unique_ptr<Sonar::Heightfield>> cache;
+
+	auto found = cache.find(cells);
+	if (found != cache.end()) {
+		return *found->second;
+	}
+
+	FixtureRandom random(cells);
+	const uint32_t side = cells + 1;
+	std::vector<float> heights(static_cast<size_t>(side) * side);
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			const double ridges = 600.0 * std::sin(x * 0.004) * std::cos(y * 0.006);
+			heights[static_cast<size_t>(y) * side + x] = static_cast<float>(-4000.0 + ridges + random.Uniform(-1.0, 1.0));
+		}
+	}
+
+	auto inserted = cache.emplace(cells, std::unique_ptr<Sonar::Heightfield>(new Sonar::Heightfield(side, side, 10.0, std::move(heights))));
+	return *inserted.first->second;
+}
+
+const std::string& SonarPropagation::Benchmarks::GetCastArchive(uint32_t casts)
+{
+	static std::map<uint32_t, std::unique_ptr<std::string>> cache;
+
+	auto found = cache.find(casts);
+	if (found != cache.end()) {
+		return *found->second;
+	}
+
+	FixtureRandom random(casts);
+	std::ostringstream archive;
+	archive.setf(std::ios::fixed);
+	archive.precision(3);
+
+	for (uint32_t cast = 0; cast < casts; ++cast) {
+		archive << "cast ctd-" << cast << " range=" << cast * 500 << '\n';
+		const double surfaceTemperature = random.Uniform(12.0, 22.0);
+		for (uint32_t depth = 0; depth <= 2000; ++depth) {
+			const double temperature = 4.0 + (surfaceTemperature - 4.0) / (1.0 + std::exp((depth - 200.0) / 40.0));
+			archive << depth << ' ' << temperature + random.Uniform(-0.01, 0.01) << ' ' << 35.0 + random.Uniform(-0.2, 0.2) << '\n';
+		}
+	}
+
+	auto inserted = cache.emplace(casts, std::unique_ptr<std::string>(new std::string(archive.str())));
+	return *inserted.first->second;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Sonar/Heightfield.h"
+#include "Sonar/RayIntegrator.h"
+
+namespace SonarPropagation {
+	namespace Benchmarks {
+
+		/// <summary>
+		/// SplitMix64; fixtures must come out identical on every machine and compiler, which the
+		/// distributions of &lt;random&gt; do not guarantee.
+		/// </summary>
+		class FixtureRandom {
+		public:
+			explicit FixtureRandom(uint64_t seed) : m_state(seed) {}
+
+			uint64_t Next();
+
+			/// <summary>
+			/// Uniform in [minimum, maximum).
+			/// </summary>
+			double Uniform(double minimum, double maximum);
+
+		private:
+			uint64_t m_state;
+		};
+
+		struct EnvironmentPoint {
+			double temperature;
+			double salinity;
+			double depth;
+		};
+
+		enum class ReferenceProfile : uint32_t {
+			Isovelocity,
+			LinearGradient,
+			Munk,
+			MackenzieTable
+		};
+
+		const char* GetReferenceProfileName(ReferenceProfile profile);
+
+		/// <summary>
+		/// 4096 points spread over the validity range of the Mackenzie equation.
+		/// </summary>
+		const std::vector<EnvironmentPoint>& GetEnvironmentPoints();
+
+		/// <summary>
+		/// Reference profiles over a 5000 m water column; built once.
+		/// </summary>
+		const Sonar::SoundSpeedProfile& GetReferenceProfile(ReferenceProfile profile);
+
+		/// <summary>
+		/// count rays from one source, launch angles evenly spaced between the limits (degrees).
+		/// </summary>
+		std::vector<Sonar::RayState> MakeLaunchFan(const Sonar::SoundSpeedProfile& profile, double sourceDepth,
+			uint32_t count, double minAngleDegrees = -20.0, double maxAngleDegrees = 20.0);
+
+		/// <summary>
+		/// Wavefront OBJ text of a cells x cells grid with normals and texture coordinates and a
+		/// deterministic height field; built once per size.
+		/// </summary>
+		const std::string& GetGridObj(uint32_t cells);
+
+		/// <summary>
+		/// Seabed of (cells + 1) x (cells + 1) heights 10 m apart: a 4000 m deep plain with ridges and a
+		/// metre of noise; built once per size.
+		/// </summary>
+		const Sonar::Heightfield& GetBathymetryGrid(uint32_t cells);
+
+		/// <summary>
+		/// Cast file text of casts CTD casts, one every 500 m of range, each with a row every metre down
+		/// to 2000 m and a thermocline around 200 m; built once per count.
+		/// </summary>
+		const std::string& GetCastArchive(uint32_t casts);
+	}
+}
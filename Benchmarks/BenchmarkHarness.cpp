@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+namespace {
+
+	std::vector<SonarPropagation::Benchmarks::BenchmarkRegistry::Entry>& GetRegistry() {
+		// Function local, since registrations run during static initialization of other files.
+		static std::vector<SonarPropagation::Benchmarks::BenchmarkRegistry::Entry> registry;
+		return registry;
+	}
+
+	double RunOnce(SonarPropagation::Benchmarks::BenchmarkFunction function, SonarPropagation::Benchmarks::BenchmarkState& state) {
+		const auto start = std::chrono::steady_clock::now();
+		function(state);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Grows the iteration count until one run takes at least the minimum repetition time.
+	uint64_t Calibrate(SonarPropagation::Benchmarks::BenchmarkFunction function, double minSeconds) {
+		uint64_t iterations = 1;
+		for (;;) {
+			SonarPropagation::Benchmarks::BenchmarkState state(iterations);
+			const double seconds = RunOnce(function, state);
+			if (seconds >= minSeconds || iterations >= (1ull << 40)) {
+				return iterations;
+			}
+
+			const double scale = seconds > 0.0 ? 1.4 * minSeconds / seconds : 100.0;
+			iterations = static_cast<uint64_t>(std::ceil(iterations * std::min(std::max(scale, 2.0), 100.0)));
+		}
+	}
+
+	void WriteJsonString(std::ostream& stream, const std::string& value) {
+		stream << '"';
+		for (char character : value) {
+			if (character == '"' || character == '\\') {
+				stream << '\\';
+			}
+			stream << character;
+		}
+		stream << '"';
+	}
+}
+
+void SonarPropagation::Benchmarks::BenchmarkRegistry::Register(const char* name, BenchmarkFunction function)
+{
+	GetRegistry().push_back({ name, function });
+}
+
+std::vector<SonarPropagation::Benchmarks::BenchmarkRegistry::Entry> SonarPropagation::Benchmarks::BenchmarkRegistry::GetEntries()
+{
+	std::vector<Entry> entries = GetRegistry();
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+	return entries;
+}
+
+std::vector<SonarPropagation::Benchmarks::BenchmarkResult> SonarPropagation::Benchmarks::RunBenchmarks(const BenchmarkOptions& options, std::ostream& log)
+{
+	std::vector<BenchmarkResult> results;
+
+	for (const auto& entry : BenchmarkRegistry::GetEntries()) {
+		if (!options.filter.empty() && entry.name.find(options.filter) == std::string::npos) {
+			continue;
+		}
+
+		BenchmarkResult result;
+		result.name = entry.name;
+		result.iterations = Calibrate(entry.function, options.minRepetitionSeconds);
+
+		for (uint32_t i = 0; i < options.warmupRepetitions; ++i) {
+			BenchmarkState state(result.iterations);
+			RunOnce(entry.function, state);
+		}
+
+		for (uint32_t i = 0; i < options.repetitions; ++i) {
+			BenchmarkState state(result.iterations);
+			const double seconds = RunOnce(entry.function, state);
+			result.itemsPerIteration = state.GetItemsPerIteration();
+			result.nanosecondsPerIteration.push_back(seconds * 1e9 / result.iterations);
+		}
+
+		std::vector<double> sorted = result.nanosecondsPerIteration;
+		std::sort(sorted.begin(), sorted.end());
+
+		double total = 0.0;
+		for (double sample : sorted) {
+			total += sample;
+		}
+
+		const size_t count = sorted.size();
+		result.min = sorted.front();
+		result.max = sorted.back();
+		result.median = count % 2 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+		result.mean = total / count;
+
+		double variance = 0.0;
+		for (double sample : sorted) {
+			variance += (sample - result.mean) * (sample - result.mean);
+		}
+		result.stddev = count > 1 ? std::sqrt(variance / (count - 1)) : 0.0;
+
+		log << std::left << std::setw(36) << result.name << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(1) << result.median << " ns/iter"
+			<< std::setw(8) << std::setprecision(1) << (result.median > 0.0 ? 100.0 * result.stddev / result.median : 0.0) << "% cv"
+			<< std::setw(14) << std::setprecision(2) << result.itemsPerIteration * 1e3 / result.median << " Mitems/s\n";
+		log.flush();
+
+		results.push_back(std::move(result));
+	}
+
+	return results;
+}
+
+void SonarPropagation::Benchmarks::WriteJson(std::ostream& stream, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options)
+{
+	stream << std::setprecision(9);
+	stream << "{\n  \"format\": 1,\n";
+	stream << "  \"context\": { \"repetitions\": " << options.repetitions
+		<< ", \"warmup\": " << options.warmupRepetitions
+		<< ", \"min_repetition_seconds\": " << options.minRepetitionSeconds
+		<< ", \"hardware_threads\": " << std::thread::hardware_concurrency() << " },\n";
+	stream << "  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchmarkResult& result = results[i];
+
+		stream << (i ? ",\n" : "\n") << "    { \"name\": ";
+		WriteJsonString(stream, result.name);
+		stream << ", \"iterations\": " << result.iterations
+			<< ", \"items_per_iteration\": " << result.itemsPerIteration
+			<< ", \"ns_per_iteration\": { \"min\": " << result.min
+			<< ", \"median\": " << result.median
+			<< ", \"mean\": " << result.mean
+			<< ", \"stddev\": " << result.stddev
+			<< ", \"max\": " << result.max << " }, \"samples\": [";
+
+		for (size_t sample = 0; sample < result.nanosecondsPerIteration.size(); ++sample) {
+			stream << (sample ? ", " : "") << result.nanosecondsPerIteration[sample];
+		}
+		stream << "] }";
+	}
+
+	stream << "\n  ]\n}\n";
+}
+
+void SonarPropagation::Benchmarks::UseCharPointer(const volatile char* pointer)
+{
+	(void)pointer;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace SonarPropagation {
+	namespace Benchmarks {
+
+		/// <summary>
+		/// Passed to a benchmark function, which runs its measured body GetIterations() times.
+		/// Setup shared between runs belongs in the fixtures, which build their data once.
+		/// </summary>
+		class BenchmarkState {
+		public:
+			explicit BenchmarkState(uint64_t iterations) : m_iterations(iterations) {}
+
+			uint64_t GetIterations() const { return m_iterations; }
+
+			/// <summary>
+			/// Logical items (ray steps, samples, vertices...) processed per iteration, for throughput.
+			/// </summary>
+			void SetItemsPerIteration(double items) { m_itemsPerIteration = items; }
+			double GetItemsPerIteration() const { return m_itemsPerIteration; }
+
+		private:
+			uint64_t m_iterations;
+			double m_itemsPerIteration = 1.0;
+		};
+
+		using BenchmarkFunction = void(*)(BenchmarkState&);
+
+		struct BenchmarkOptions {
+			// Substring a benchmark name has to contain; empty runs everything.
+			std::string filter;
+			uint32_t warmupRepetitions = 2;
+			uint32_t repetitions = 15;
+			// Each repetition runs at least this long, so timer resolution does not matter.
+			double minRepetitionSeconds = 0.05;
+		};
+
+		struct BenchmarkResult {
+			std::string name;
+			uint64_t iterations = 0;
+			double itemsPerIteration = 1.0;
+			std::vector<double> nanosecondsPerIteration;
+
+			double min = 0.0;
+			double median = 0.0;
+			double mean = 0.0;
+			double stddev = 0.0;
+			double max = 0.0;
+		};
+
+		/// <summary>
+		/// Benchmarks registered by SONAR_BENCHMARK, sorted by name.
+		/// </summary>
+		class BenchmarkRegistry {
+		public:
+			static void Register(const char* name, BenchmarkFunction function);
+
+			struct Entry {
+				std::string name;
+				BenchmarkFunction function;
+			};
+
+			static std::vector<Entry> GetEntries();
+		};
+
+		struct BenchmarkRegistration {
+			BenchmarkRegistration(const char* name, BenchmarkFunction function) {
+				BenchmarkRegistry::Register(name, function);
+			}
+		};
+
+		/// <summary>
+		/// Calibrates the iteration count of every matching benchmark, runs the warmup repetitions and
+		/// then the measured ones. Progress goes to log.
+		/// </summary>
+		std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options, std::ostream& log);
+
+		/// <summary>
+		/// Writes the results as JSON, the input of compare_benchmarks.py.
+		/// </summary>
+		void WriteJson(std::ostream& stream, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options);
+
+		void UseCharPointer(const volatile char* pointer);
+
+		/// <summary>
+		/// Keeps the compiler from discarding a value that is otherwise unused.
+		/// </summary>
+		template <typename T>
+		inline void DoNotOptimize(const T& value)
+		{
+#if defined(_MSC_VER)
+			UseCharPointer(&reinterpret_cast<const volatile char&>(value));
+			_ReadWriteBarrier();
+#else
+			asm volatile("" : : "r,m"(value) : "memory");
+#endif
+		}
+	}
+}
+
+#define SONAR_BENCHMARK_CONCAT_INNER(a, b) a##b
+#define SONAR_BENCHMARK_CONCAT(a, b) SONAR_BENCHMARK_CONCAT_INNER(a, b)
+
+/// Registers a function taking a BenchmarkState& under the given name.
+#define SONAR_BENCHMARK(name, function) \
+	static ::SonarPropagation::Benchmarks::BenchmarkRegistration SONAR_BENCHMARK_CONCAT(s_benchmark, __LINE__)(name, function)
@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+	void PrintUsage() {
+		std::cout <<
+			"Usage: SonarBenchmarks [options]\n"
+			"  --filter <text>        run the benchmarks whose name contains text\n"
+			"  --repetitions <n>      measured repetitions per benchmark (default 15)\n"
+			"  --warmup <n>           unmeasured repetitions before them (default 2)\n"
+			"  --min-time <seconds>   minimum duration of one repetition (default 0.05)\n"
+			"  --json <path>          write the results as JSON\n"
+			"  --list                 print the benchmark names and exit\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace SonarPropagation::Benchmarks;
+
+	BenchmarkOptions options;
+	std::string jsonPath;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+
+		if (!std::strcmp(argv[i], "--filter") && hasValue) {
+			options.filter = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--repetitions") && hasValue) {
+			options.repetitions = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (!std::strcmp(argv[i], "--warmup") && hasValue) {
+			options.warmupRepetitions = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+		}
+		else if (!std::strcmp(argv[i], "--min-time") && hasValue) {
+			options.minRepetitionSeconds = std::atof(argv[++i]);
+		}
+		else if (!std::strcmp(argv[i], "--json") && hasValue) {
+			jsonPath = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--list")) {
+			for (const auto& entry : BenchmarkRegistry::GetEntries()) {
+				std::cout << entry.name << '\n';
+			}
+			return 0;
+		}
+		else {
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	try {
+		std::vector<BenchmarkResult> results = RunBenchmarks(options, std::cout);
+
+		if (!jsonPath.empty()) {
+			std::ofstream file(jsonPath.c_str());
+			if (!file) {
+				std::cerr << "Could not write " << jsonPath << '\n';
+				return 1;
+			}
+			WriteJson(file, results, options);
+		}
+	}
+	catch (const std::exception& exception) {
+		std::cerr << "Benchmark failed: " << exception.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+#include "BenchmarkFixtures.h"
+
+#include "DXR/ShaderTableLayout.h"
+#include "Sonar/MeshSimplifier.h"
+#include "Sonar/TileCache.h"
+
+#include <cmath>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "Common/thirdparty/tiny_obj_loader.h"
+
+using namespace SonarPropagation::Benchmarks;
+using namespace SonarPropagation::Graphics::DXR;
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	//--------------------------------------------------------------------------------------
+	// OBJ parsing through tinyobjloader, as in ObjectLibrary::LoadWavefront()
+
+	template <uint32_t Cells>
+	void ParseGridObj(BenchmarkState& state) {
+		const std::string& obj = GetGridObj(Cells);
+		state.SetItemsPerIteration(static_cast<double>(Cells) * Cells * 2);
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			tinyobj::ObjReader reader;
+			tinyobj::ObjReaderConfig config;
+			config.triangulate = false;
+
+			if (!reader.ParseFromString(obj, std::string(), config)) {
+				throw std::runtime_error("Benchmark OBJ fixture failed to parse: " + reader.Error());
+			}
+			DoNotOptimize(reader.GetShapes().size());
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Heightfield bathymetry: pyramid construction, and a fan of rays from a source at 100 m going
+	// down at 2 to 20 degrees towards every bearing, which crosses hundreds of cells before it lands.
+
+	template <uint32_t Cells>
+	void BuildHeightfield(BenchmarkState& state) {
+		const Heightfield& grid = GetBathymetryGrid(Cells);
+		state.SetItemsPerIteration(static_cast<double>(Cells) * Cells);
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			Heightfield copy(grid.GetColumns(), grid.GetRows(), grid.GetCellSize(), grid.GetHeights());
+			DoNotOptimize(copy.GetPyramid().data());
+		}
+	}
+
+	template <uint32_t Cells>
+	void IntersectHeightfield(BenchmarkState& state) {
+		const uint32_t rayCount = 1024;
+		const Heightfield& grid = GetBathymetryGrid(Cells);
+		state.SetItemsPerIteration(rayCount);
+
+		const double centre = Cells * grid.GetCellSize() * 0.5;
+		std::vector<Vector3> directions(rayCount);
+		for (uint32_t ray = 0; ray < rayCount; ++ray) {
+			const double bearing = ray * 2.399963;
+			const double elevation = (2.0 + 18.0 * ray / rayCount) * 3.14159265358979323846 / 180.0;
+			directions[ray] = { std::cos(elevation) * std::cos(bearing), -std::sin(elevation), std::cos(elevation) * std::sin(bearing) };
+		}
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			uint32_t hits = 0;
+			for (const Vector3& direction : directions) {
+				HeightfieldHit hit;
+				hits += grid.Intersect({ centre, -100.0, centre }, direction, 0.0, 1e9, hit);
+			}
+			DoNotOptimize(hits);
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Bottom of a 100 km track streamed through a cache of four 256 x 256 cell tiles, two tiles of
+	// prefetch ahead. Tiles are copies of the bathymetry fixture, so this is the cache and the
+	// extraction without the disk.
+
+	void StreamTiledTrack(BenchmarkState& state) {
+		const uint32_t tileCells = 256;
+		const Heightfield& grid = GetBathymetryGrid(tileCells);
+		const double maxRange = 100000.0;
+		const double spacing = 10.0;
+		state.SetItemsPerIteration(maxRange / spacing + 1);
+
+		TileSet tiles(grid.GetCellSize(), tileCells);
+		for (int32_t column = 0; column * tiles.GetTileExtent() <= maxRange; ++column) {
+			tiles.AddTile({ column, 0 }, std::string());
+		}
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			TileCache cache([&grid](const TileKey&) { return grid; }, 4 * grid.GetMemorySize());
+			const BottomProfile bottom = ExtractBottomProfile(tiles, cache, { 0.0, 0.0, 1000.0 }, 0.0, maxRange, spacing,
+				5000.0, 2.0 * tiles.GetTileExtent());
+			DoNotOptimize(bottom.GetDepths().data());
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Level of detail chain of the bathymetry fixture as a triangle mesh, two triangles a cell,
+	// simplified chunk by chunk on every hardware thread.
+
+	template <uint32_t Cells>
+	void BuildGridLodChain(BenchmarkState& state) {
+		const Heightfield& grid = GetBathymetryGrid(Cells);
+		state.SetItemsPerIteration(static_cast<double>(Cells) * Cells * 2);
+
+		std::vector<Float3> positions;
+		std::vector<uint32_t> indices;
+		for (uint32_t row = 0; row <= Cells; ++row) {
+			for (uint32_t column = 0; column <= Cells; ++column) {
+				positions.push_back({ static_cast<float>(column * grid.GetCellSize()), grid.GetHeights()[row * (Cells + 1) + column],
+					static_cast<float>(row * grid.GetCellSize()) });
+			}
+		}
+		for (uint32_t row = 0; row < Cells; ++row) {
+			for (uint32_t column = 0; column < Cells; ++column) {
+				const uint32_t corner = row * (Cells + 1) + column;
+				indices.insert(indices.end(), { corner, corner + 1, corner + Cells + 1, corner + 1, corner + Cells + 2, corner + Cells + 1 });
+			}
+		}
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			const std::vector<MeshLevel> lods = BuildLodChain(positions, indices, SimplifySettings());
+			DoNotOptimize(lods.data());
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Shader binding table layout with one hit group per instance
+
+	template <uint32_t HitGroups>
+	void FinalizeShaderTableLayout(BenchmarkState& state) {
+		state.SetItemsPerIteration(HitGroups + 3);
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			ShaderTableLayout layout;
+			layout.AddRecord(ShaderTableSection::RayGeneration, L"SonarRayGen", 2);
+			layout.AddRecord(ShaderTableSection::Miss, L"Miss", 0);
+			layout.AddRecord(ShaderTableSection::Miss, L"SonarMiss", 0);
+			for (uint32_t group = 0; group < HitGroups; ++group) {
+				layout.AddRecord(ShaderTableSection::HitGroup, group % 2 ? L"SonarHitGroup" : L"HitGroup", 1 + group % 3);
+			}
+
+			layout.Finalize();
+			DoNotOptimize(layout.GetTotalSize());
+		}
+	}
+}
+
+SONAR_BENCHMARK("obj/parse_grid_64", ParseGridObj<64>);
+SONAR_BENCHMARK("obj/parse_grid_256", ParseGridObj<256>);
+
+SONAR_BENCHMARK("heightfield/build_1024", BuildHeightfield<1024>);
+SONAR_BENCHMARK("heightfield/intersect_1024", IntersectHeightfield<1024>);
+SONAR_BENCHMARK("heightfield/intersect_8192", IntersectHeightfield<8192>);
+SONAR_BENCHMARK("tiles/stream_track_100km", StreamTiledTrack);
+
+SONAR_BENCHMARK("lod/build_chain_256", BuildGridLodChain<256>);
+
+SONAR_BENCHMARK("sbt/layout_64", FinalizeShaderTableLayout<64>);
+SONAR_BENCHMARK("sbt/layout_4096", FinalizeShaderTableLayout<4096>);
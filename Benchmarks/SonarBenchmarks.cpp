@@ -0,0 +1,276 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+#include "BenchmarkFixtures.h"
+
+#include <sstream>
+
+#include "Sonar/CastIngest.h"
+#include "Sonar/RayMarch.h"
+#include "Sonar/RayPacket.h"
+#include "Sonar/ReceiverGrid.h"
+#include "Sonar/TrajectoryStore.h"
+
+using namespace SonarPropagation::Benchmarks;
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	const uint32_t c_stepRayCount = 1024;
+	const double c_stepSize = 5.0;
+
+	//--------------------------------------------------------------------------------------
+	// Sound speed evaluation
+
+	void MackenzieFormula(BenchmarkState& state) {
+		const auto& points = GetEnvironmentPoints();
+		state.SetItemsPerIteration(static_cast<double>(points.size()));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			double sum = 0.0;
+			for (const auto& point : points) {
+				sum += MackenzieSoundSpeed(point.temperature, point.salinity, point.depth);
+			}
+			DoNotOptimize(sum);
+		}
+	}
+
+	void CompactMackenzieFormula(BenchmarkState& state) {
+		const auto& points = GetEnvironmentPoints();
+		state.SetItemsPerIteration(static_cast<double>(points.size()));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			double sum = 0.0;
+			for (const auto& point : points) {
+				sum += CompactMackenzieSoundSpeed(point.temperature, point.depth);
+			}
+			DoNotOptimize(sum);
+		}
+	}
+
+	void MackenzieBatch(BenchmarkState& state) {
+		const auto& points = GetEnvironmentPoints();
+		state.SetItemsPerIteration(static_cast<double>(points.size()));
+
+		std::vector<double> temperatures, salinities, depths;
+		for (const auto& point : points) {
+			temperatures.push_back(point.temperature);
+			salinities.push_back(point.salinity);
+			depths.push_back(point.depth);
+		}
+		std::vector<double> speeds(points.size());
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			ConvertToSoundSpeed(SoundSpeedFormula::Mackenzie, temperatures.data(), salinities.data(), depths.data(),
+				speeds.data(), speeds.size());
+			DoNotOptimize(speeds.back());
+		}
+	}
+
+	template <ReferenceProfile Profile>
+	void EvaluateProfile(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(Profile);
+		const auto& points = GetEnvironmentPoints();
+		state.SetItemsPerIteration(static_cast<double>(points.size()));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			double sum = 0.0;
+			for (const auto& point : points) {
+				const SoundSpeedSample sample = profile.Evaluate(point.depth * 0.625);
+				sum += sample.c + sample.dcdz;
+			}
+			DoNotOptimize(sum);
+		}
+	}
+
+	// Parsing, conversion and resampling of a cast file, per row.
+	void IngestCastArchive(BenchmarkState& state) {
+		const uint32_t casts = 16;
+		const std::string& archive = GetCastArchive(casts);
+		state.SetItemsPerIteration(casts * 2001.0);
+
+		CastIngestSettings settings;
+		settings.maxDepth = 2000.0;
+		settings.rangeBinWidth = 2000.0;
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			std::istringstream stream(archive);
+			SoundSpeedProfileSet profiles = IngestCasts(stream, "archive", settings);
+			DoNotOptimize(profiles);
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// One RK4 step of a fan of rays. Every iteration steps the same inputs, so the work is
+	// identical however many iterations the harness picks.
+
+	template <typename Real>
+	const std::vector<RayStateT<Real>>& GetStepFan() {
+		static const std::vector<RayStateT<Real>> fan = [] {
+			std::vector<RayStateT<Real>> result;
+			for (const RayState& ray : MakeLaunchFan(GetReferenceProfile(ReferenceProfile::Munk), 1000.0, c_stepRayCount)) {
+				result.push_back({ static_cast<Real>(ray.r), static_cast<Real>(ray.z), static_cast<Real>(ray.xi),
+					static_cast<Real>(ray.zeta), static_cast<Real>(ray.tau) });
+			}
+			return result;
+		}();
+		return fan;
+	}
+
+	template <typename Real>
+	void Rk4StepScalar(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(ReferenceProfile::Munk);
+		const auto& fan = GetStepFan<Real>();
+		std::vector<RayStateT<Real>> next(fan.size());
+		state.SetItemsPerIteration(static_cast<double>(fan.size()));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			for (size_t ray = 0; ray < fan.size(); ++ray) {
+				next[ray] = IntegrateStep(profile, fan[ray], static_cast<Real>(c_stepSize));
+			}
+			DoNotOptimize(next.back());
+		}
+	}
+
+	void Rk4StepSimd(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(ReferenceProfile::Munk);
+		const auto& fan = GetStepFan<float>();
+		state.SetItemsPerIteration(static_cast<double>(fan.size()));
+
+		std::vector<RayPacket4> packets(fan.size() / RayPacket4::c_width);
+		std::vector<RayPacket4> next(packets.size());
+		for (size_t packet = 0; packet < packets.size(); ++packet) {
+			LoadPacket(packets[packet], &fan[packet * RayPacket4::c_width], RayPacket4::c_width);
+		}
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			for (size_t packet = 0; packet < packets.size(); ++packet) {
+				next[packet] = packets[packet];
+				IntegrateStep4(profile, next[packet], static_cast<float>(c_stepSize));
+			}
+			DoNotOptimize(next.back());
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Complete marches of a 16 ray fan over 10 km of range
+
+	template <ReferenceProfile Profile>
+	void MarchFan(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(Profile);
+		const std::vector<RayState> fan = MakeLaunchFan(profile, 1000.0, 16);
+
+		RayMarchConfig config;
+		config.stepSize = c_stepSize;
+		config.bottomDepth = 5000.0;
+		config.maxRange = 10000.0;
+		config.maxBounces = 1000;
+
+		uint64_t steps = 0;
+		for (const RayState& ray : fan) {
+			steps += RayMarch(profile, ray, config).steps;
+		}
+		state.SetItemsPerIteration(static_cast<double>(steps));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			for (const RayState& ray : fan) {
+				RayMarchResult result = RayMarch(profile, ray, config);
+				DoNotOptimize(result);
+			}
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// The same munk fan captured by 10^5 receivers on a 100 x 1000 grid over its 10 km x 5000 m,
+	// looked up through the spatial hash at every step.
+
+	void CaptureReceivers(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(ReferenceProfile::Munk);
+		const std::vector<RayState> fan = MakeLaunchFan(profile, 1000.0, 16);
+
+		RayMarchConfig config;
+		config.stepSize = c_stepSize;
+		config.bottomDepth = 5000.0;
+		config.maxRange = 10000.0;
+		config.maxBounces = 1000;
+
+		std::vector<ReceiverPoint> points;
+		for (uint32_t column = 0; column < 100; ++column) {
+			for (uint32_t row = 0; row < 1000; ++row) {
+				points.push_back({ (column + 0.5) * 100.0, (row + 0.5) * 5.0, 10.0 });
+			}
+		}
+		const ReceiverGrid receivers(std::move(points));
+
+		uint64_t steps = 0;
+		for (const RayState& ray : fan) {
+			steps += RayMarch(profile, ray, config).steps;
+		}
+		state.SetItemsPerIteration(static_cast<double>(steps));
+
+		std::vector<ReceiverArrival> arrivals;
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			arrivals.clear();
+			for (uint32_t ray = 0; ray < fan.size(); ++ray) {
+				ReceiverCapture capture(receivers, ray, arrivals);
+				RayMarch(profile, fan[ray], config, [&capture](const RayState& from, const RayState& to, const RayMarchResult& progress) {
+					capture.AddSegment(from.r, from.z, from.tau, to.r, to.z, to.tau, progress.surfaceBounces, progress.bottomBounces, 1.0);
+					return true;
+				});
+				capture.Finish();
+			}
+			DoNotOptimize(arrivals.data());
+		}
+	}
+
+	// The same munk fan decimated and encoded step by step into a store, as the trajectory cache keeps it.
+
+	void EncodePaths(BenchmarkState& state) {
+		const SoundSpeedProfile& profile = GetReferenceProfile(ReferenceProfile::Munk);
+		const std::vector<RayState> fan = MakeLaunchFan(profile, 1000.0, 16);
+
+		RayMarchConfig config;
+		config.stepSize = c_stepSize;
+		config.bottomDepth = 5000.0;
+		config.maxRange = 10000.0;
+		config.maxBounces = 1000;
+
+		uint64_t steps = 0;
+		for (const RayState& ray : fan) {
+			steps += RayMarch(profile, ray, config).steps;
+		}
+		state.SetItemsPerIteration(static_cast<double>(steps));
+
+		for (uint64_t i = 0; i < state.GetIterations(); ++i) {
+			TrajectoryStore store;
+			for (const RayState& ray : fan) {
+				PathEncoder path;
+				path.Add({ ray.r, ray.z, ray.tau, 0.0, 0, 0 });
+				RayMarch(profile, ray, config, [&path](const RayState&, const RayState& to, const RayMarchResult& progress) {
+					path.Add({ to.r, to.z, to.tau, 1.0, progress.surfaceBounces, progress.bottomBounces });
+					return true;
+				});
+				path.Finish();
+				store.Add(path);
+			}
+			DoNotOptimize(store.GetBytes());
+		}
+	}
+}
+
+SONAR_BENCHMARK("ssp/mackenzie", MackenzieFormula);
+SONAR_BENCHMARK("ssp/compact_mackenzie", CompactMackenzieFormula);
+SONAR_BENCHMARK("ssp/mackenzie_batch", MackenzieBatch);
+SONAR_BENCHMARK("ssp/ingest_casts", IngestCastArchive);
+SONAR_BENCHMARK("ssp/profile_munk", EvaluateProfile<ReferenceProfile::Munk>);
+SONAR_BENCHMARK("ssp/profile_table", EvaluateProfile<ReferenceProfile::MackenzieTable>);
+
+SONAR_BENCHMARK("rk4/scalar_double", Rk4StepScalar<double>);
+SONAR_BENCHMARK("rk4/scalar_float", Rk4StepScalar<float>);
+SONAR_BENCHMARK("rk4/simd4_float", Rk4StepSimd);
+
+SONAR_BENCHMARK("raymarch/isovelocity", MarchFan<ReferenceProfile::Isovelocity>);
+SONAR_BENCHMARK("raymarch/linear", MarchFan<ReferenceProfile::LinearGradient>);
+SONAR_BENCHMARK("raymarch/munk", MarchFan<ReferenceProfile::Munk>);
+SONAR_BENCHMARK("raymarch/mackenzie_table", MarchFan<ReferenceProfile::MackenzieTable>);
+SONAR_BENCHMARK("raymarch/munk_receivers_100k", CaptureReceivers);
+SONAR_BENCHMARK("raymarch/munk_encode_paths", EncodePaths);
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Compares two SonarBenchmarks JSON files.
+
+    compare_benchmarks.py baseline.json current.json [--threshold 5]
+
+A benchmark counts as changed only if its median moved by more than the threshold (percent)
+and by more than the combined noise of both runs (two standard deviations of each). The exit
+code is 1 if any benchmark regressed, so the script can gate a CI job.
+"""
+
+import argparse
+import json
+import math
+import sys
+
+
+def load(path):
+    with open(path) as file:
+        data = json.load(file)
+    if data.get("format") != 1:
+        raise SystemExit(f"{path}: unsupported benchmark format {data.get('format')}")
+    return {entry["name"]: entry for entry in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=5.0, help="minimum change in percent")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print(f"{'benchmark':36} {'baseline ns':>14} {'current ns':>14} {'change':>9}  verdict")
+
+    for name in sorted(set(baseline) | set(current)):
+        if name not in current:
+            print(f"{name:36} {'':>14} {'':>14} {'':>9}  removed")
+            continue
+        if name not in baseline:
+            print(f"{name:36} {'':>14} {current[name]['ns_per_iteration']['median']:14.1f} {'':>9}  new")
+            continue
+
+        old = baseline[name]["ns_per_iteration"]
+        new = current[name]["ns_per_iteration"]
+        change = 100.0 * (new["median"] - old["median"]) / old["median"]
+        noise = 100.0 * 2.0 * math.hypot(old["stddev"], new["stddev"]) / old["median"]
+
+        if abs(change) <= max(args.threshold, noise):
+            verdict = "same"
+        elif change > 0:
+            verdict = "SLOWER"
+            regressions += 1
+        else:
+            verdict = "faster"
+
+        print(f"{name:36} {old['median']:14.1f} {new['median']:14.1f} {change:+8.1f}%  {verdict}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) regressed beyond {args.threshold}% and the measurement noise")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,12 @@
+#pragma once
+
+// Stand-in for the application's pch.h. The benchmarks only build the portable parts of the tree,
+// which include "pch.h" like every other translation unit; with this directory first on the include
+// path they get the standard library instead of the D3D12 and WinRT headers.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
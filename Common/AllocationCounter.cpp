@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+	std::atomic<uint64_t> g_totalAllocations(0);
+	std::atomic<uint64_t> g_totalBytes(0);
+	thread_local uint64_t t_threadAllocations = 0;
+}
+
+bool SonarPropagation::Graphics::Utils::AllocationCounter::IsEnabled()
+{
+#if defined(SONAR_COUNT_ALLOCATIONS)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t SonarPropagation::Graphics::Utils::AllocationCounter::GetTotalAllocations()
+{
+	return g_totalAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t SonarPropagation::Graphics::Utils::AllocationCounter::GetThreadAllocations()
+{
+	return t_threadAllocations;
+}
+
+uint64_t SonarPropagation::Graphics::Utils::AllocationCounter::GetTotalBytes()
+{
+	return g_totalBytes.load(std::memory_order_relaxed);
+}
+
+void SonarPropagation::Graphics::Utils::AllocationCounter::Record(size_t bytes)
+{
+	g_totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	g_totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+	++t_threadAllocations;
+}
+
+#if defined(SONAR_COUNT_ALLOCATIONS)
+
+//--------------------------------------------------------------------------------------
+// Counting replacements for the global allocation functions.
+
+void* operator new(size_t size)
+{
+	SonarPropagation::Graphics::Utils::AllocationCounter::Record(size);
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	SonarPropagation::Graphics::Utils::AllocationCounter::Record(size);
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Counts general-purpose heap allocations made through the global operator new.
+			/// The counting operators are only compiled in when SONAR_COUNT_ALLOCATIONS is defined
+			/// (Debug configurations); otherwise every counter reads zero and IsEnabled() is false.
+			/// </summary>
+			class AllocationCounter {
+			public:
+				/// <summary>
+				/// True if the global operator new is being counted in this build.
+				/// </summary>
+				static bool IsEnabled();
+
+				/// <summary>
+				/// Total number of allocations since startup, across all threads.
+				/// </summary>
+				static uint64_t GetTotalAllocations();
+
+				/// <summary>
+				/// Number of allocations made by the calling thread since startup.
+				/// </summary>
+				static uint64_t GetThreadAllocations();
+
+				/// <summary>
+				/// Total number of bytes requested since startup, across all threads.
+				/// </summary>
+				static uint64_t GetTotalBytes();
+
+				/// <summary>
+				/// Called by the counting operator new.
+				/// </summary>
+				static void Record(size_t bytes);
+			};
+
+			/// <summary>
+			/// Test hook measuring the allocations made by the current thread inside a scope.
+			/// Wrap a steady-state frame or simulation step in one of these and check
+			/// GetAllocations() == 0.
+			/// </summary>
+			class ScopedAllocationCounter {
+			public:
+				ScopedAllocationCounter() : m_start(AllocationCounter::GetThreadAllocations()) {}
+
+				uint64_t GetAllocations() const {
+					return AllocationCounter::GetThreadAllocations() - m_start;
+				}
+
+			private:
+				uint64_t m_start;
+			};
+		}
+	}
+}
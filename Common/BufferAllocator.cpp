@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "BufferAllocator.h"
+
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------
+// BufferAllocator implementation
+
+SonarPropagation::Graphics::Utils::BufferAllocator::BufferAllocator(
+	ID3D12Device* device,
+	D3D12_HEAP_TYPE heapType,
+	UINT64 pageSize,
+	D3D12_RESOURCE_FLAGS flags
+) : m_device(device), m_heapType(heapType), m_pageSize(pageSize), m_flags(flags)
+{
+}
+
+SonarPropagation::Graphics::Utils::BufferAllocator::~BufferAllocator()
+{
+	for (auto& page : m_pages) {
+		if (page.mapped) {
+			page.resource->Unmap(0, nullptr);
+		}
+	}
+}
+
+uint32_t SonarPropagation::Graphics::Utils::BufferAllocator::CreatePage(UINT64 size)
+{
+	Page page;
+
+	// Upload heaps must start in GENERIC_READ; DEFAULT heap buffers start in COMMON and
+	// get promoted implicitly on first use.
+	D3D12_RESOURCE_STATES initialState = m_heapType == D3D12_HEAP_TYPE_UPLOAD
+		? D3D12_RESOURCE_STATE_GENERIC_READ
+		: D3D12_RESOURCE_STATE_COMMON;
+
+	CD3DX12_HEAP_PROPERTIES heapProperties(m_heapType);
+	CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size, m_flags);
+
+	DX::ThrowIfFailed(m_device->CreateCommittedResource(
+		&heapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&bufferDesc,
+		initialState,
+		nullptr,
+		IID_PPV_ARGS(&page.resource)));
+
+	NAME_D3D12_OBJECT(page.resource);
+
+	if (m_heapType == D3D12_HEAP_TYPE_UPLOAD) {
+		CD3DX12_RANGE readRange(0, 0);
+		DX::ThrowIfFailed(page.resource->Map(0, &readRange, reinterpret_cast<void**>(&page.mapped)));
+	}
+
+	page.ranges.reset(new RangeAllocator(size, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT));
+
+	m_pages.push_back(std::move(page));
+	return static_cast<uint32_t>(m_pages.size() - 1);
+}
+
+SonarPropagation::Graphics::Utils::BufferAllocation SonarPropagation::Graphics::Utils::BufferAllocator::Allocate(UINT64 size, UINT64 alignment)
+{
+	BufferAllocation allocation;
+
+	RangeAllocation range;
+	uint32_t pageIndex = 0;
+
+	for (; pageIndex < m_pages.size(); ++pageIndex) {
+		range = m_pages[pageIndex].ranges->Allocate(size, alignment);
+		if (range.IsValid()) {
+			break;
+		}
+	}
+
+	if (!range.IsValid()) {
+		// Pages are carved in units of the acceleration structure alignment, so a dedicated page
+		// for a large request has to be a whole number of them.
+		UINT64 pageAlignment = std::max<UINT64>(alignment, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		UINT64 alignedSize = (size + pageAlignment - 1) & ~(pageAlignment - 1);
+		pageIndex = CreatePage(std::max(m_pageSize, alignedSize));
+		range = m_pages[pageIndex].ranges->Allocate(size, alignment);
+
+		if (!range.IsValid()) {
+			throw std::bad_alloc();
+		}
+	}
+
+	Page& page = m_pages[pageIndex];
+
+	allocation.resource = page.resource.Get();
+	allocation.offset = range.offset;
+	allocation.size = range.size;
+	allocation.gpuAddress = page.resource->GetGPUVirtualAddress() + range.offset;
+	allocation.cpuAddress = page.mapped ? page.mapped + range.offset : nullptr;
+	allocation.page = pageIndex;
+	allocation.range = range;
+
+	return allocation;
+}
+
+void SonarPropagation::Graphics::Utils::BufferAllocator::Free(BufferAllocation& allocation)
+{
+	if (!allocation.IsValid()) {
+		return;
+	}
+
+	m_pages[allocation.page].ranges->Free(allocation.range);
+	allocation = BufferAllocation();
+}
+
+void SonarPropagation::Graphics::Utils::BufferAllocator::MarkWritten(const BufferAllocation& allocation)
+{
+	if (allocation.IsValid()) {
+		m_pages[allocation.page].written = true;
+	}
+}
+
+void SonarPropagation::Graphics::Utils::BufferAllocator::FinishWrites(ID3D12GraphicsCommandList* commandList, D3D12_RESOURCE_STATES readState)
+{
+	std::vector<CD3DX12_RESOURCE_BARRIER> barriers;
+
+	for (auto& page : m_pages) {
+		if (page.written) {
+			barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+				page.resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, readState));
+			page.written = false;
+		}
+	}
+
+	if (!barriers.empty()) {
+		commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+	}
+}
+
+SonarPropagation::Graphics::Utils::RangeAllocatorStats SonarPropagation::Graphics::Utils::BufferAllocator::GetStats() const
+{
+	RangeAllocatorStats total;
+
+	for (const auto& page : m_pages) {
+		RangeAllocatorStats stats = page.ranges->GetStats();
+		total.totalSize += stats.totalSize;
+		total.usedSize += stats.usedSize;
+		total.freeSize += stats.freeSize;
+		total.allocationCount += stats.allocationCount;
+		total.freeRangeCount += stats.freeRangeCount;
+		total.largestFreeRange = std::max(total.largestFreeRange, stats.largestFreeRange);
+	}
+
+	return total;
+}
+
+//--------------------------------------------------------------------------------------
+// StagingRing implementation
+
+SonarPropagation::Graphics::Utils::StagingRing::StagingRing(ID3D12Device* device, UINT64 size)
+	: m_device(device), m_ring(size)
+{
+	m_buffer = nv_helpers_dx12::CreateBuffer(
+		device, size, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	NAME_D3D12_OBJECT(m_buffer);
+
+	CD3DX12_RANGE readRange(0, 0);
+	DX::ThrowIfFailed(m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_mapped)));
+}
+
+SonarPropagation::Graphics::Utils::StagingRing::~StagingRing()
+{
+	m_buffer->Unmap(0, nullptr);
+}
+
+void SonarPropagation::Graphics::Utils::StagingRing::Upload(
+	ID3D12GraphicsCommandList* commandList,
+	BufferAllocator& destinationAllocator,
+	const BufferAllocation& destination,
+	const void* data,
+	UINT64 size
+) {
+	UINT64 offset = 0;
+
+	if (m_ring.Allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset)) {
+		memcpy(m_mapped + offset, data, size);
+		commandList->CopyBufferRegion(destination.resource, destination.offset, m_buffer.Get(), offset, size);
+	}
+	else {
+		TemporaryBuffer temporary;
+		temporary.resource = nv_helpers_dx12::CreateBuffer(
+			m_device, size, D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		temporary.fenceValue = 0;
+		temporary.submitted = false;
+
+		uint8_t* mapped;
+		CD3DX12_RANGE readRange(0, 0);
+		DX::ThrowIfFailed(temporary.resource->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+		memcpy(mapped, data, size);
+		temporary.resource->Unmap(0, nullptr);
+
+		commandList->CopyBufferRegion(destination.resource, destination.offset, temporary.resource.Get(), 0, size);
+		m_temporaryBuffers.push_back(temporary);
+	}
+
+	destinationAllocator.MarkWritten(destination);
+}
+
+void SonarPropagation::Graphics::Utils::StagingRing::Submit(UINT64 fenceValue)
+{
+	m_ring.Submit(fenceValue);
+
+	for (auto& temporary : m_temporaryBuffers) {
+		if (!temporary.submitted) {
+			temporary.fenceValue = fenceValue;
+			temporary.submitted = true;
+		}
+	}
+}
+
+void SonarPropagation::Graphics::Utils::StagingRing::Reclaim(UINT64 completedFenceValue)
+{
+	m_ring.Reclaim(completedFenceValue);
+
+	m_temporaryBuffers.erase(
+		std::remove_if(m_temporaryBuffers.begin(), m_temporaryBuffers.end(),
+			[completedFenceValue](const TemporaryBuffer& temporary) {
+				return temporary.submitted && temporary.fenceValue <= completedFenceValue;
+			}),
+		m_temporaryBuffers.end());
+}
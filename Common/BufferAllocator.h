@@ -0,0 +1,158 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "RangeAllocator.h"
+#include "RingAllocator.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// A sub-allocated range of a buffer page.
+			/// </summary>
+			struct BufferAllocation {
+				ID3D12Resource* resource = nullptr;
+				UINT64 offset = 0;
+				UINT64 size = 0;
+				D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
+
+				// Only set for allocations in an UPLOAD heap; the page stays mapped.
+				uint8_t* cpuAddress = nullptr;
+
+				uint32_t page = RangeAllocation::c_invalidNode;
+				RangeAllocation range;
+
+				bool IsValid() const { return resource != nullptr; }
+			};
+
+			/// <summary>
+			/// Sub-allocates aligned ranges out of large committed buffers ("pages").
+			/// Placement is done by a RangeAllocator per page, so one CreateCommittedResource call
+			/// serves many meshes or constant buffers. Allocations larger than a page get a
+			/// dedicated page of their own.
+			/// </summary>
+			class BufferAllocator {
+			public:
+				/// <summary>
+				/// Constructor for the BufferAllocator.
+				/// </summary>
+				/// <param name="device"></param>
+				/// <param name="heapType">DEFAULT for GPU-only data, UPLOAD for CPU-written data.</param>
+				/// <param name="pageSize">Size of each committed buffer.</param>
+				/// <param name="flags">Resource flags of the pages.</param>
+				BufferAllocator(
+					ID3D12Device* device,
+					D3D12_HEAP_TYPE heapType,
+					UINT64 pageSize = 64ull * 1024 * 1024,
+					D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE
+				);
+
+				~BufferAllocator();
+
+				BufferAllocator(const BufferAllocator&) = delete;
+				BufferAllocator& operator=(const BufferAllocator&) = delete;
+
+				/// <summary>
+				/// Allocates a range of at least size bytes.
+				/// </summary>
+				BufferAllocation Allocate(UINT64 size, UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+				/// <summary>
+				/// Returns a range to its page. The allocation is invalidated.
+				/// </summary>
+				void Free(BufferAllocation& allocation);
+
+				/// <summary>
+				/// Marks the page of an allocation as written by a copy in the current command list.
+				/// </summary>
+				void MarkWritten(const BufferAllocation& allocation);
+
+				/// <summary>
+				/// Records the barriers moving every written page from COPY_DEST to readState.
+				/// Buffers decay back to COMMON once the command list completes, so no further
+				/// tracking is needed.
+				/// </summary>
+				void FinishWrites(ID3D12GraphicsCommandList* commandList, D3D12_RESOURCE_STATES readState);
+
+				/// <summary>
+				/// Combined statistics over all pages.
+				/// </summary>
+				RangeAllocatorStats GetStats() const;
+
+				size_t GetPageCount() const { return m_pages.size(); }
+
+			private:
+				struct Page {
+					Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+					std::unique_ptr<RangeAllocator> ranges;
+					uint8_t* mapped = nullptr;
+					bool written = false;
+				};
+
+				uint32_t CreatePage(UINT64 size);
+
+				ID3D12Device* m_device;
+				D3D12_HEAP_TYPE m_heapType;
+				UINT64 m_pageSize;
+				D3D12_RESOURCE_FLAGS m_flags;
+
+				std::vector<Page> m_pages;
+			};
+
+			/// <summary>
+			/// Persistently mapped UPLOAD ring used to stage data into DEFAULT heap allocations.
+			/// Staging memory is recycled once the fence value passed to Submit() has completed.
+			/// </summary>
+			class StagingRing {
+			public:
+				StagingRing(ID3D12Device* device, UINT64 size = 32ull * 1024 * 1024);
+				~StagingRing();
+
+				StagingRing(const StagingRing&) = delete;
+				StagingRing& operator=(const StagingRing&) = delete;
+
+				/// <summary>
+				/// Copies data into the ring and records a copy into the destination allocation.
+				/// Uploads larger than the free part of the ring fall back to a temporary buffer.
+				/// </summary>
+				void Upload(
+					ID3D12GraphicsCommandList* commandList,
+					BufferAllocator& destinationAllocator,
+					const BufferAllocation& destination,
+					const void* data,
+					UINT64 size
+				);
+
+				/// <summary>
+				/// Tags every upload recorded since the last call with the given fence value.
+				/// </summary>
+				void Submit(UINT64 fenceValue);
+
+				/// <summary>
+				/// Recycles staging memory of uploads whose fence value has completed.
+				/// </summary>
+				void Reclaim(UINT64 completedFenceValue);
+
+				UINT64 GetSize() const { return m_ring.GetSize(); }
+				UINT64 GetUsedSize() const { return m_ring.GetUsedSize(); }
+
+			private:
+				struct TemporaryBuffer {
+					Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+					UINT64 fenceValue;
+					bool submitted;
+				};
+
+				ID3D12Device* m_device;
+				Microsoft::WRL::ComPtr<ID3D12Resource> m_buffer;
+				uint8_t* m_mapped = nullptr;
+				RingAllocator m_ring;
+
+				std::vector<TemporaryBuffer> m_temporaryBuffers;
+			};
+		}
+	}
+}
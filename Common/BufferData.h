@@ -1,10 +1,16 @@
 #pragma once 
 
+#include "BufferAllocator.h"
+
 
 struct BufferData {
 	Microsoft::WRL::ComPtr<ID3D12Resource> vertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
 
+	// Sub-allocated ranges inside vertexBuffer / indexBuffer.
+	SonarPropagation::Graphics::Utils::BufferAllocation vertexAllocation;
+	SonarPropagation::Graphics::Utils::BufferAllocation indexAllocation;
+
 	UINT vertexCount;
 	UINT indexCount;
 
@@ -37,27 +37,6 @@ SonarPropagation::Graphics::Utils::Camera::~Camera()
 
 }
 
-void SonarPropagation::Graphics::Utils::Camera::CreateCameraBuffer(ComPtr<ID3D12Device> device)
-{
-	uint32_t nbMatrix = 4;
-	m_cameraBufferSize = nbMatrix * sizeof(XMMATRIX);
-
-	m_cameraBuffer = nv_helpers_dx12::CreateBuffer(
-		device.Get(), m_cameraBufferSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-
-	m_cameraHeap = CreateDescriptorHeap(
-		device.Get(), 1, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
-
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-	cbvDesc.BufferLocation = m_cameraBuffer->GetGPUVirtualAddress();
-	cbvDesc.SizeInBytes = m_cameraBufferSize;
-
-	D3D12_CPU_DESCRIPTOR_HANDLE srvHandle =
-		m_cameraHeap->GetCPUDescriptorHandleForHeapStart();
-	device->CreateConstantBufferView(&cbvDesc, srvHandle);
-}
-
 void SonarPropagation::Graphics::Utils::Camera::UpdateViewMatrix()
 {
 	XMVECTOR det;
@@ -78,11 +57,6 @@ void SonarPropagation::Graphics::Utils::Camera::UpdateProjectionMatrix()
 void SonarPropagation::Graphics::Utils::Camera::UpdateCameraBuffer()
 {
 	allMatrices = { m_viewMatrix,m_projectionMatrix, m_viewMatrixInv, m_projectionMatrixInv };
-
-	uint8_t* pData;
-	DX::ThrowIfFailed(m_cameraBuffer->Map(0, nullptr, (void**)&pData));
-	memcpy(pData, allMatrices.data(), m_cameraBufferSize);
-	m_cameraBuffer->Unmap(0, nullptr);
 }
 
 void SonarPropagation::Graphics::Utils::Camera::UpdateParameters()
@@ -142,7 +116,7 @@ void SonarPropagation::Graphics::Utils::Camera::RenderCameraImGui() {
 		std::vector<float> camRightFloat = { XMVectorGetX(m_right) , XMVectorGetY(m_right), XMVectorGetZ(m_right) };
 		std::vector<float> camUpFloat = { XMVectorGetX(m_up) , XMVectorGetY(m_up), XMVectorGetZ(m_up) };
 
-		int camBufferSize = m_cameraBufferSize;
+		int camBufferSize = GetCameraBufferSize();
 
 		ImGui::InputFloat3("Camera Eye", camEyeFloat.data(), "%.3f", ImGuiInputTextFlags_ReadOnly);
 		ImGui::InputFloat3("Camera Target", camTargetFloat.data(), "%.3f", ImGuiInputTextFlags_ReadOnly);
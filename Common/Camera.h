@@ -75,13 +75,7 @@ namespace SonarPropagation {
 				}
 
 				/// <summary>
-				/// Creates the camera buffer.
-				/// </summary>
-				/// <param name="device"></param>
-				void CreateCameraBuffer(ComPtr<ID3D12Device> device);
-
-				/// <summary>
-				/// Updates the camera buffer.
+				/// Gathers the matrices the renderer copies into its per-frame camera constants.
 				/// </summary>
 				void UpdateCameraBuffer();
 
@@ -91,27 +85,19 @@ namespace SonarPropagation {
 				void RenderCameraImGui();
 
 				/// <summary>
-				/// Getter for the camera buffer.
-				/// </summary>
-				/// <returns></returns>
-				inline ComPtr<ID3D12Resource> GetCameraBuffer() const {
-					return m_cameraBuffer;
-				}
-
-				/// <summary>
-				/// Getter for the camera heap.
+				/// Getter for the size of the camera data.
 				/// </summary>
 				/// <returns></returns>
-				inline ComPtr<ID3D12DescriptorHeap> GetCameraHeap() const {
-					return m_cameraHeap;
+				inline uint32_t GetCameraBufferSize() const {
+					return static_cast<uint32_t>(sizeof(allMatrices));
 				}
 
 				/// <summary>
-				/// Getter for the camera buffer size.
+				/// Matrices as of the last UpdateCameraBuffer(), laid out like the camera constants.
 				/// </summary>
 				/// <returns></returns>
-				inline uint32_t GetCameraBufferSize() const {
-					return m_cameraBufferSize;
+				inline const void* GetCameraData() const {
+					return allMatrices.data();
 				}
 
 				/// <summary>
@@ -200,11 +186,6 @@ namespace SonarPropagation {
 				XMMATRIX m_projectionMatrixInv;
 
 				std::array<XMMATRIX,4> allMatrices;
-
-				ComPtr<ID3D12Resource> m_cameraBuffer;
-				ComPtr<ID3D12DescriptorHeap> m_cameraHeap;
-
-				uint32_t m_cameraBufferSize = 0;
 			};
 
 		}
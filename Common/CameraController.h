@@ -30,7 +30,6 @@ namespace SonarPropagation {
 				/// <param name="camera"></param>
 				inline void AddCamera(Camera *camera) 
 				{
-					camera->CreateCameraBuffer(m_device);
 					m_cameras.push_back(camera);
 
 				}
@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "DescriptorAllocator.h"
+
+SonarPropagation::Graphics::Utils::DescriptorAllocator::DescriptorAllocator(
+	ID3D12Device* device,
+	D3D12_DESCRIPTOR_HEAP_TYPE type,
+	uint32_t capacity,
+	bool shaderVisible
+) : m_capacity(capacity), m_shaderVisible(shaderVisible), m_slots(capacity, 1)
+{
+	m_heap.Attach(SonarPropagation::Graphics::Common::CreateDescriptorHeap(device, capacity, type, shaderVisible));
+	NAME_D3D12_OBJECT(m_heap);
+
+	m_cpuStart = m_heap->GetCPUDescriptorHandleForHeapStart();
+	m_gpuStart = shaderVisible ? m_heap->GetGPUDescriptorHandleForHeapStart() : D3D12_GPU_DESCRIPTOR_HANDLE{ 0 };
+	m_incrementSize = device->GetDescriptorHandleIncrementSize(type);
+}
+
+SonarPropagation::Graphics::Utils::DescriptorRange SonarPropagation::Graphics::Utils::DescriptorAllocator::Allocate(uint32_t count)
+{
+	DescriptorRange result;
+
+	result.range = m_slots.Allocate(count);
+	if (!result.range.IsValid()) {
+		throw std::bad_alloc();
+	}
+
+	result.first = static_cast<uint32_t>(result.range.offset);
+	result.count = count;
+	return result;
+}
+
+void SonarPropagation::Graphics::Utils::DescriptorAllocator::Free(DescriptorRange& range)
+{
+	m_slots.Free(range.range);
+	range = DescriptorRange();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE SonarPropagation::Graphics::Utils::DescriptorAllocator::GetCpuHandle(const DescriptorRange& range, uint32_t index) const
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE handle = m_cpuStart;
+	handle.ptr += static_cast<SIZE_T>(range.first + index) * m_incrementSize;
+	return handle;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE SonarPropagation::Graphics::Utils::DescriptorAllocator::GetGpuHandle(const DescriptorRange& range, uint32_t index) const
+{
+	if (!m_shaderVisible) {
+		throw std::logic_error("GPU handles are only available for shader visible descriptor heaps");
+	}
+
+	D3D12_GPU_DESCRIPTOR_HANDLE handle = m_gpuStart;
+	handle.ptr += static_cast<UINT64>(range.first + index) * m_incrementSize;
+	return handle;
+}
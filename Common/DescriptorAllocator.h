@@ -0,0 +1,69 @@
+#pragma once
+
+#include "RangeAllocator.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// A contiguous range of descriptor slots handed out by the DescriptorAllocator.
+			/// </summary>
+			struct DescriptorRange {
+				uint32_t first = 0;
+				uint32_t count = 0;
+				RangeAllocation range;
+
+				bool IsValid() const { return range.IsValid(); }
+			};
+
+			/// <summary>
+			/// Persistent descriptor heap with stable slots. The heap is created once and slot
+			/// ranges are placed by a RangeAllocator, so descriptors can be rewritten in place
+			/// instead of recreating the heap (and every GPU handle stored in the SBT).
+			/// </summary>
+			class DescriptorAllocator {
+			public:
+				/// <summary>
+				/// Constructor for the DescriptorAllocator.
+				/// </summary>
+				/// <param name="device"></param>
+				/// <param name="type">Descriptor heap type.</param>
+				/// <param name="capacity">Number of descriptor slots.</param>
+				/// <param name="shaderVisible">Whether the heap can be bound with SetDescriptorHeaps.</param>
+				DescriptorAllocator(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t capacity, bool shaderVisible);
+
+				DescriptorAllocator(const DescriptorAllocator&) = delete;
+				DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+				/// <summary>
+				/// Allocates count contiguous slots. Throws std::bad_alloc when the heap is full.
+				/// </summary>
+				DescriptorRange Allocate(uint32_t count = 1);
+
+				/// <summary>
+				/// Returns the slots to the heap. The caller has to make sure the GPU no longer reads them.
+				/// </summary>
+				void Free(DescriptorRange& range);
+
+				D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle(const DescriptorRange& range, uint32_t index = 0) const;
+				D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle(const DescriptorRange& range, uint32_t index = 0) const;
+
+				ID3D12DescriptorHeap* GetHeap() const { return m_heap.Get(); }
+				uint32_t GetCapacity() const { return m_capacity; }
+				RangeAllocatorStats GetStats() const { return m_slots.GetStats(); }
+
+			private:
+				Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_heap;
+				D3D12_CPU_DESCRIPTOR_HANDLE m_cpuStart;
+				D3D12_GPU_DESCRIPTOR_HANDLE m_gpuStart;
+				UINT m_incrementSize;
+				uint32_t m_capacity;
+				bool m_shaderVisible;
+
+				// Slot bookkeeping, one unit per descriptor.
+				RangeAllocator m_slots;
+			};
+		}
+	}
+}
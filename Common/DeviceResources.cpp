@@ -71,7 +71,7 @@ DX::DeviceResources::DeviceResources(DXGI_FORMAT backBufferFormat, DXGI_FORMAT d
 	m_fenceEvent(0),
 	m_backBufferFormat(backBufferFormat),
 	m_depthBufferFormat(depthBufferFormat),
-	m_fenceValues{},
+	m_frameRing(c_frameCount),
 	m_d3dRenderTargetSize(),
 	m_outputSize(),
 	m_logicalSize(),
@@ -165,8 +165,8 @@ void DX::DeviceResources::CreateDeviceResources()
 	}
 
 	// Create synchronization objects.
-	DX::ThrowIfFailed(m_d3dDevice->CreateFence(m_fenceValues[m_currentFrame], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-	m_fenceValues[m_currentFrame]++;
+	// Fence values handed out by m_frameRing start at 1.
+	DX::ThrowIfFailed(m_d3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
 
 	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 	if (m_fenceEvent == nullptr)
@@ -185,8 +185,8 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 	for (UINT n = 0; n < c_frameCount; n++)
 	{
 		m_renderTargets[n] = nullptr;
-		m_fenceValues[n] = m_fenceValues[m_currentFrame];
 	}
+	m_frameRing.ResetSlots();
 
 	UpdateRenderTargetSize();
 
@@ -286,6 +286,7 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 	// Create render target views of the swap chain back buffer.
 	{
 		m_currentFrame = m_swapChain->GetCurrentBackBufferIndex();
+		m_frameRing.BeginFrame(m_currentFrame);
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
 		for (UINT n = 0; n < c_frameCount; n++)
 		{
@@ -477,36 +478,43 @@ void DX::DeviceResources::Present()
 // Wait for pending GPU work to complete.
 void DX::DeviceResources::WaitForGpu()
 {
-	// Schedule a Signal command in the queue.
-	DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValues[m_currentFrame]));
+	WaitForFenceValue(Signal());
+}
 
-	// Wait until the fence has been crossed.
-	DX::ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_currentFrame], m_fenceEvent));
-	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+// Schedule a Signal command in the queue and return its fence value.
+UINT64 DX::DeviceResources::Signal()
+{
+	const UINT64 fenceValue = m_frameRing.Signal();
+	DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+	return fenceValue;
+}
 
-	// Increment the fence value for the current frame.
-	m_fenceValues[m_currentFrame]++;
+// Block until the GPU has crossed the fence value.
+void DX::DeviceResources::WaitForFenceValue(UINT64 fenceValue)
+{
+	if (m_fence->GetCompletedValue() < fenceValue)
+	{
+		DX::ThrowIfFailed(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent));
+		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+	}
+}
+
+UINT64 DX::DeviceResources::GetCompletedFenceValue() const
+{
+	return m_fence->GetCompletedValue();
 }
 
 // Prepare to render the next frame.
 void DX::DeviceResources::MoveToNextFrame()
 {
 	// Schedule a Signal command in the queue.
-	const UINT64 currentFenceValue = m_fenceValues[m_currentFrame];
-	DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentFenceValue));
+	DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_frameRing.EndFrame()));
 
 	// Advance the frame index.
 	m_currentFrame = m_swapChain->GetCurrentBackBufferIndex();
 
-	// Check to see if the next frame is ready to start.
-	if (m_fence->GetCompletedValue() < m_fenceValues[m_currentFrame])
-	{
-		DX::ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_currentFrame], m_fenceEvent));
-		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
-	}
-
-	// Set the fence value for the next frame.
-	m_fenceValues[m_currentFrame] = currentFenceValue + 1;
+	// Wait until the resources of the next frame are free and the frame latency allows to start it.
+	WaitForFenceValue(m_frameRing.BeginFrame(m_currentFrame));
 }
 
 // This method determines the rotation between the display device's native Orientation and the
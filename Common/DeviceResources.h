@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "FrameRing.h"
+
 namespace DX
 {
 	static const UINT c_frameCount = 3;		// Use triple buffering.
@@ -17,6 +19,14 @@ namespace DX
 		void Present();
 		void WaitForGpu();
 
+		// Frames in flight. Work recorded for the current frame completes with GetCurrentFrameFenceValue().
+		UINT64 Signal();
+		void WaitForFenceValue(UINT64 fenceValue);
+		UINT64 GetCompletedFenceValue() const;
+		UINT64 GetCurrentFrameFenceValue() const						{ return m_frameRing.GetCurrentFenceValue(); }
+		void SetMaxFrameLatency(UINT maxLatency)						{ m_frameRing.SetMaxLatency(maxLatency); }
+		UINT GetMaxFrameLatency() const									{ return m_frameRing.GetMaxLatency(); }
+
 		// The size of the render target, in pixels.
 		Windows::Foundation::Size	GetOutputSize() const				{ return m_outputSize; }
 
@@ -77,7 +87,7 @@ namespace DX
 
 		// CPU/GPU Synchronization.
 		Microsoft::WRL::ComPtr<ID3D12Fence>				m_fence;
-		UINT64											m_fenceValues[c_frameCount];
+		SonarPropagation::Graphics::Utils::FrameRing	m_frameRing;
 		HANDLE											m_fenceEvent;
 
 		// Cached reference to the Window.
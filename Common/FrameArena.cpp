@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "FrameArena.h"
+
+SonarPropagation::Graphics::Utils::FrameArena::FrameArena(size_t capacity)
+	: m_buffer(new uint8_t[capacity]),
+	m_capacity(capacity)
+{
+	m_stats.bytesReserved = capacity;
+	m_stats.blockCount = 1;
+}
+
+SonarPropagation::Graphics::Utils::FrameArena::~FrameArena()
+{
+}
+
+void* SonarPropagation::Graphics::Utils::FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	// Align the address rather than the offset; the buffer itself is only aligned to max_align_t.
+	const uintptr_t base = reinterpret_cast<uintptr_t>(m_buffer.get());
+	size_t alignedOffset = static_cast<size_t>(((base + m_offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base);
+
+	if (alignedOffset + bytes <= m_capacity) {
+		m_offset = alignedOffset + bytes;
+		m_stats.OnAllocate(bytes);
+		return m_buffer.get() + alignedOffset;
+	}
+
+	// Out of space for this frame: serve the request from the heap and remember to grow.
+	m_overflow.emplace_back(new uint8_t[bytes + alignment]);
+	uintptr_t raw = reinterpret_cast<uintptr_t>(m_overflow.back().get());
+	uintptr_t aligned = (raw + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+	m_overflowBytes += bytes + alignment;
+	++m_overflowCount;
+	m_stats.OnAllocate(bytes);
+
+	return reinterpret_cast<void*>(aligned);
+}
+
+void SonarPropagation::Graphics::Utils::FrameArena::Reset()
+{
+	if (!m_overflow.empty()) {
+		m_overflow.clear();
+
+		size_t newCapacity = m_capacity * 2;
+		while (newCapacity < m_capacity + m_overflowBytes) {
+			newCapacity *= 2;
+		}
+
+		m_buffer.reset(new uint8_t[newCapacity]);
+		m_capacity = newCapacity;
+		m_overflowBytes = 0;
+		m_stats.bytesReserved = newCapacity;
+	}
+
+	m_offset = 0;
+	m_stats.totalDeallocations += m_stats.liveAllocations;
+	m_stats.liveAllocations = 0;
+	m_stats.bytesInUse = 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "PoolAllocator.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Non-owning view over an array allocated from a FrameArena.
+			/// </summary>
+			template <typename T>
+			struct FrameArray {
+				T* data = nullptr;
+				size_t size = 0;
+
+				T* begin() const { return data; }
+				T* end() const { return data + size; }
+				T& operator[](size_t i) const { return data[i]; }
+			};
+
+			/// <summary>
+			/// Linear allocator for transient per-frame data.
+			/// Allocations are bumped out of a single buffer and released all at once by Reset().
+			/// If a frame outgrows the buffer, the overflow is served from the heap and the buffer
+			/// is grown on the next Reset(), so the steady state allocates nothing.
+			/// Only trivially destructible types may be placed in the arena.
+			/// </summary>
+			class FrameArena {
+			public:
+				/// <summary>
+				/// Constructor for the arena.
+				/// </summary>
+				/// <param name="capacity">Initial capacity in bytes.</param>
+				explicit FrameArena(size_t capacity = 64 * 1024);
+
+				~FrameArena();
+
+				FrameArena(const FrameArena&) = delete;
+				FrameArena& operator=(const FrameArena&) = delete;
+
+				/// <summary>
+				/// Allocates raw, aligned memory that lives until the next Reset().
+				/// </summary>
+				void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+				/// <summary>
+				/// Allocates an uninitialized array of trivially destructible elements.
+				/// </summary>
+				template <typename T>
+				FrameArray<T> AllocateArray(size_t count) {
+					static_assert(std::is_trivially_destructible<T>::value, "FrameArena does not run destructors.");
+					FrameArray<T> result;
+					result.data = static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+					result.size = count;
+					return result;
+				}
+
+				/// <summary>
+				/// Allocates an array initialized from the given values.
+				/// </summary>
+				template <typename T>
+				FrameArray<T> MakeArray(std::initializer_list<T> values) {
+					FrameArray<T> result = AllocateArray<T>(values.size());
+					size_t i = 0;
+					for (const T& value : values) {
+						new (&result.data[i++]) T(value);
+					}
+					return result;
+				}
+
+				/// <summary>
+				/// Releases every allocation made since the previous Reset().
+				/// </summary>
+				void Reset();
+
+				size_t Capacity() const { return m_capacity; }
+
+				/// <summary>
+				/// Number of allocations that did not fit and went to the heap since construction.
+				/// </summary>
+				size_t GetOverflowCount() const { return m_overflowCount; }
+
+				const AllocationStats& GetStats() const { return m_stats; }
+
+			private:
+				std::unique_ptr<uint8_t[]> m_buffer;
+				size_t m_capacity = 0;
+				size_t m_offset = 0;
+
+				std::vector<std::unique_ptr<uint8_t[]>> m_overflow;
+				size_t m_overflowBytes = 0;
+				size_t m_overflowCount = 0;
+
+				AllocationStats m_stats;
+			};
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "FrameResources.h"
+
+#include <stdexcept>
+
+//--------------------------------------------------------------------------------------
+// FrameConstantBuffer implementation
+
+SonarPropagation::Graphics::Utils::FrameConstantBuffer::FrameConstantBuffer(ID3D12Device* device, UINT size, uint32_t frameCount)
+	: m_size((size + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1) & ~(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)),
+	m_pending(frameCount, false)
+{
+	m_buffer = nv_helpers_dx12::CreateBuffer(
+		device, m_size, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_COMMON, nv_helpers_dx12::kDefaultHeapProps);
+	NAME_D3D12_OBJECT(m_buffer);
+
+	m_uploadBuffer = nv_helpers_dx12::CreateBuffer(
+		device, static_cast<UINT64>(m_size) * frameCount, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+	NAME_D3D12_OBJECT(m_uploadBuffer);
+
+	CD3DX12_RANGE readRange(0, 0);
+	DX::ThrowIfFailed(m_uploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_mapped)));
+}
+
+SonarPropagation::Graphics::Utils::FrameConstantBuffer::~FrameConstantBuffer()
+{
+	m_uploadBuffer->Unmap(0, nullptr);
+}
+
+void SonarPropagation::Graphics::Utils::FrameConstantBuffer::Write(uint32_t frameIndex, const void* data, UINT size)
+{
+	if (size > m_size) {
+		throw std::invalid_argument("FrameConstantBuffer: constants larger than the buffer");
+	}
+
+	memcpy(m_mapped + static_cast<size_t>(frameIndex) * m_size, data, size);
+	m_pending[frameIndex] = true;
+}
+
+void SonarPropagation::Graphics::Utils::FrameConstantBuffer::RecordUpload(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex)
+{
+	if (!m_pending[frameIndex]) {
+		return;
+	}
+
+	// The buffer decays to COMMON after every ExecuteCommandLists, so the copy promotes it implicitly.
+	commandList->CopyBufferRegion(m_buffer.Get(), 0, m_uploadBuffer.Get(), static_cast<UINT64>(frameIndex) * m_size, m_size);
+
+	CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+		m_buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	commandList->ResourceBarrier(1, &barrier);
+
+	m_pending[frameIndex] = false;
+}
+
+//--------------------------------------------------------------------------------------
+// ReadbackRing implementation
+
+SonarPropagation::Graphics::Utils::ReadbackRing::ReadbackRing(ID3D12Device* device, UINT64 size, uint32_t frameCount)
+	: m_frames(frameCount), m_capacity(size)
+{
+	CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_READBACK);
+	CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+
+	for (auto& frame : m_frames) {
+		DX::ThrowIfFailed(device->CreateCommittedResource(
+			&heapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&bufferDesc,
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&frame.buffer)));
+
+		NAME_D3D12_OBJECT(frame.buffer);
+	}
+}
+
+void SonarPropagation::Graphics::Utils::ReadbackRing::RecordCopy(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex,
+	ID3D12Resource* source, UINT64 sourceOffset, UINT64 size, UINT64 fenceValue)
+{
+	if (size > m_capacity) {
+		throw std::invalid_argument("ReadbackRing: copy larger than the readback buffer");
+	}
+
+	commandList->CopyBufferRegion(m_frames[frameIndex].buffer.Get(), 0, source, sourceOffset, size);
+	MarkWritten(frameIndex, size, fenceValue);
+}
+
+void SonarPropagation::Graphics::Utils::ReadbackRing::MarkWritten(uint32_t frameIndex, UINT64 size, UINT64 fenceValue)
+{
+	Frame& frame = m_frames[frameIndex];
+	frame.size = size;
+	frame.fenceValue = fenceValue;
+	frame.unread = true;
+}
+
+bool SonarPropagation::Graphics::Utils::ReadbackRing::ReadNext(UINT64 completedFenceValue, std::vector<uint8_t>& data, UINT64* fenceValue)
+{
+	Frame* next = nullptr;
+
+	for (auto& frame : m_frames) {
+		if (frame.unread && frame.fenceValue <= completedFenceValue &&
+			(!next || frame.fenceValue < next->fenceValue)) {
+			next = &frame;
+		}
+	}
+
+	if (!next) {
+		return false;
+	}
+	next->unread = false;
+
+	CD3DX12_RANGE readRange(0, static_cast<SIZE_T>(next->size));
+	uint8_t* mapped = nullptr;
+	DX::ThrowIfFailed(next->buffer->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+	data.assign(mapped, mapped + next->size);
+
+	CD3DX12_RANGE writeRange(0, 0);
+	next->buffer->Unmap(0, &writeRange);
+
+	if (fenceValue) {
+		*fenceValue = next->fenceValue;
+	}
+	return true;
+}
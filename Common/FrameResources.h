@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Constant buffer that the CPU can rewrite every frame while earlier frames are still in flight.
+			/// Each frame writes its own slice of an upload buffer, and RecordUpload() copies the slice into a
+			/// default heap buffer on the command queue, so descriptors can keep pointing at one address.
+			/// </summary>
+			class FrameConstantBuffer {
+			public:
+				/// <summary>
+				/// Constructor for the FrameConstantBuffer.
+				/// </summary>
+				/// <param name="size">Size of the constants; rounded up to 256 bytes.</param>
+				/// <param name="frameCount">Number of frames in flight.</param>
+				FrameConstantBuffer(ID3D12Device* device, UINT size, uint32_t frameCount = DX::c_frameCount);
+				~FrameConstantBuffer();
+
+				FrameConstantBuffer(const FrameConstantBuffer&) = delete;
+				FrameConstantBuffer& operator=(const FrameConstantBuffer&) = delete;
+
+				/// <summary>
+				/// Writes the constants of a frame. The slice must not be in use by the GPU, which holds for the
+				/// current frame index of DeviceResources.
+				/// </summary>
+				void Write(uint32_t frameIndex, const void* data, UINT size);
+
+				/// <summary>
+				/// Copies the frame's constants into the GPU buffer if they were written, and transitions it
+				/// for reading. Must be recorded before any work that reads the constants.
+				/// </summary>
+				void RecordUpload(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex);
+
+				D3D12_GPU_VIRTUAL_ADDRESS GetGpuAddress() const { return m_buffer->GetGPUVirtualAddress(); }
+				UINT GetSize() const { return m_size; }
+
+			private:
+				Microsoft::WRL::ComPtr<ID3D12Resource> m_buffer;
+				Microsoft::WRL::ComPtr<ID3D12Resource> m_uploadBuffer;
+				uint8_t* m_mapped = nullptr;
+				UINT m_size;
+				std::vector<bool> m_pending;
+			};
+
+			/// <summary>
+			/// One readback buffer per frame in flight. A frame records a copy (or a query resolve) into its
+			/// buffer, and the CPU reads it frames later, once the fence of that frame has completed,
+			/// instead of waiting for the GPU.
+			/// </summary>
+			class ReadbackRing {
+			public:
+				/// <summary>
+				/// Constructor for the ReadbackRing.
+				/// </summary>
+				/// <param name="size">Capacity of each frame's buffer in bytes.</param>
+				/// <param name="frameCount">Number of frames in flight.</param>
+				ReadbackRing(ID3D12Device* device, UINT64 size, uint32_t frameCount = DX::c_frameCount);
+
+				ReadbackRing(const ReadbackRing&) = delete;
+				ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+				/// <summary>
+				/// Readback buffer of the frame, for commands such as ResolveQueryData. Call MarkWritten() afterwards.
+				/// </summary>
+				ID3D12Resource* GetBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].buffer.Get(); }
+
+				/// <summary>
+				/// Records a copy of a buffer range into the frame's readback buffer.
+				/// </summary>
+				void RecordCopy(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex,
+					ID3D12Resource* source, UINT64 sourceOffset, UINT64 size, UINT64 fenceValue);
+
+				/// <summary>
+				/// Declares that the frame's buffer holds size bytes once fenceValue completes.
+				/// </summary>
+				void MarkWritten(uint32_t frameIndex, UINT64 size, UINT64 fenceValue);
+
+				/// <summary>
+				/// Copies out the oldest completed readback that has not been read yet, so that calling it until
+				/// it returns false reads every completed frame in order. Returns false if there is none.
+				/// </summary>
+				bool ReadNext(UINT64 completedFenceValue, std::vector<uint8_t>& data, UINT64* fenceValue = nullptr);
+
+				UINT64 GetCapacity() const { return m_capacity; }
+
+			private:
+				struct Frame {
+					Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+					UINT64 size = 0;
+					UINT64 fenceValue = 0;
+					bool unread = false;
+				};
+
+				std::vector<Frame> m_frames;
+				UINT64 m_capacity;
+			};
+		}
+	}
+}
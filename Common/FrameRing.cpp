@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "FrameRing.h"
+
+#include <stdexcept>
+
+SonarPropagation::Graphics::Utils::FrameRing::FrameRing(uint32_t slotCount, uint32_t maxLatency)
+	: m_slotFenceValues(slotCount, 0), m_maxLatency(slotCount)
+{
+	if (slotCount == 0) {
+		throw std::invalid_argument("FrameRing needs at least one slot");
+	}
+
+	if (maxLatency != 0) {
+		SetMaxLatency(maxLatency);
+	}
+}
+
+uint64_t SonarPropagation::Graphics::Utils::FrameRing::BeginFrame(uint32_t slot)
+{
+	if (slot >= GetSlotCount()) {
+		throw std::out_of_range("FrameRing slot out of range");
+	}
+
+	m_currentSlot = slot;
+
+	// The slot's resources are free once the frame that last used them has completed.
+	uint64_t waitValue = m_slotFenceValues[slot];
+
+	// With a latency of N, at most N - 1 earlier frames may still be executing while this one is recorded.
+	if (m_frameFenceValues.size() >= m_maxLatency) {
+		waitValue = std::max(waitValue, m_frameFenceValues[m_frameFenceValues.size() - m_maxLatency]);
+	}
+
+	return waitValue;
+}
+
+uint64_t SonarPropagation::Graphics::Utils::FrameRing::EndFrame()
+{
+	uint64_t fenceValue = Signal();
+
+	m_slotFenceValues[m_currentSlot] = fenceValue;
+
+	m_frameFenceValues.push_back(fenceValue);
+	while (m_frameFenceValues.size() > GetSlotCount()) {
+		m_frameFenceValues.pop_front();
+	}
+
+	return fenceValue;
+}
+
+void SonarPropagation::Graphics::Utils::FrameRing::ResetSlots()
+{
+	std::fill(m_slotFenceValues.begin(), m_slotFenceValues.end(), 0);
+	m_frameFenceValues.clear();
+}
+
+void SonarPropagation::Graphics::Utils::FrameRing::SetMaxLatency(uint32_t maxLatency)
+{
+	m_maxLatency = std::max(1u, std::min(maxLatency, GetSlotCount()));
+}
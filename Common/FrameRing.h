@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Device independent bookkeeping for frames in flight. Every frame owns a slot (command
+			/// allocator, constant buffer slice, readback buffer, ...) and ends with a fence signal.
+			/// Before a slot is recorded again, the CPU has to wait for the fence value returned by
+			/// BeginFrame(), which also enforces the maximum frame latency.
+			/// Fence values increase monotonically starting at 1; 0 means "nothing to wait for".
+			/// </summary>
+			class FrameRing {
+			public:
+				/// <summary>
+				/// Constructor for the FrameRing.
+				/// </summary>
+				/// <param name="slotCount">Number of per-frame resource sets.</param>
+				/// <param name="maxLatency">Frames the CPU may run ahead of the GPU; clamped to [1, slotCount].</param>
+				explicit FrameRing(uint32_t slotCount, uint32_t maxLatency = 0);
+
+				/// <summary>
+				/// Makes the slot current and returns the fence value that has to be completed before
+				/// its resources can be reused.
+				/// </summary>
+				uint64_t BeginFrame(uint32_t slot);
+
+				/// <summary>
+				/// Same as BeginFrame() with the slot after the current one, for callers without a swap chain.
+				/// </summary>
+				uint64_t BeginNextFrame() { return BeginFrame((m_currentSlot + 1) % GetSlotCount()); }
+
+				/// <summary>
+				/// Ends the current frame. Returns the fence value the caller has to signal on the queue.
+				/// </summary>
+				uint64_t EndFrame();
+
+				/// <summary>
+				/// Reserves a fence value outside of the frame cycle, e.g. to wait for the queue to drain.
+				/// </summary>
+				uint64_t Signal() { return m_nextFenceValue++; }
+
+				/// <summary>
+				/// Fence value EndFrame() will return for the current frame. Resources used by the current
+				/// frame can be released once this value is completed.
+				/// </summary>
+				uint64_t GetCurrentFenceValue() const { return m_nextFenceValue; }
+
+				/// <summary>
+				/// Last fence value handed out by EndFrame() or Signal(), or 0.
+				/// </summary>
+				uint64_t GetLastSignaledValue() const { return m_nextFenceValue - 1; }
+
+				/// <summary>
+				/// Forgets the fences of every slot. Only valid once the GPU is idle.
+				/// </summary>
+				void ResetSlots();
+
+				void SetMaxLatency(uint32_t maxLatency);
+				uint32_t GetMaxLatency() const { return m_maxLatency; }
+
+				uint32_t GetCurrentSlot() const { return m_currentSlot; }
+				uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_slotFenceValues.size()); }
+
+			private:
+				std::vector<uint64_t> m_slotFenceValues;
+				std::deque<uint64_t> m_frameFenceValues;
+				uint32_t m_currentSlot = 0;
+				uint32_t m_maxLatency;
+				uint64_t m_nextFenceValue = 1;
+			};
+
+			/// <summary>
+			/// Objects that have to outlive the GPU work referencing them, released in fence order.
+			/// </summary>
+			template <typename T>
+			class FenceRetireQueue {
+			public:
+				/// <summary>
+				/// Keeps the object alive until fenceValue is completed.
+				/// </summary>
+				void Retire(T object, uint64_t fenceValue) {
+					m_objects.push_back(std::make_pair(fenceValue, std::move(object)));
+				}
+
+				/// <summary>
+				/// Releases every object whose fence value is less than or equal to completedFenceValue.
+				/// </summary>
+				void Collect(uint64_t completedFenceValue) {
+					m_objects.erase(
+						std::remove_if(m_objects.begin(), m_objects.end(),
+							[completedFenceValue](const std::pair<uint64_t, T>& entry) { return entry.first <= completedFenceValue; }),
+						m_objects.end());
+				}
+
+				size_t GetSize() const { return m_objects.size(); }
+
+			private:
+				std::vector<std::pair<uint64_t, T>> m_objects;
+			};
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "GpuTimer.h"
+
+#include <stdexcept>
+
+SonarPropagation::Graphics::Utils::GpuTimer::GpuTimer(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t scopeCount, uint32_t frameCount)
+	: m_scopeCount(scopeCount), m_frames(frameCount)
+{
+	if (scopeCount == 0 || scopeCount > 32) {
+		throw std::invalid_argument("GpuTimer scope count must be between 1 and 32");
+	}
+
+	// Timestamps are optional: copy queues on some hardware do not support them.
+	UINT64 frequency = 0;
+	if (FAILED(queue->GetTimestampFrequency(&frequency)) || frequency == 0) {
+		return;
+	}
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = scopeCount * 2;
+	if (FAILED(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&m_queryHeap)))) {
+		m_queryHeap = nullptr;
+		return;
+	}
+	NAME_D3D12_OBJECT(m_queryHeap);
+
+	m_readback = std::make_unique<ReadbackRing>(device, static_cast<UINT64>(scopeCount) * 2 * sizeof(UINT64), frameCount);
+	m_ticksPerMillisecond = static_cast<double>(frequency) / 1000.0;
+}
+
+void SonarPropagation::Graphics::Utils::GpuTimer::Begin(ID3D12GraphicsCommandList* commandList, uint32_t scope)
+{
+	if (!IsAvailable()) {
+		return;
+	}
+
+	commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, scope * 2);
+	m_openMask |= 1u << scope;
+}
+
+void SonarPropagation::Graphics::Utils::GpuTimer::End(ID3D12GraphicsCommandList* commandList, uint32_t scope)
+{
+	if (!IsAvailable() || !(m_openMask & (1u << scope))) {
+		return;
+	}
+
+	commandList->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, scope * 2 + 1);
+	m_openMask &= ~(1u << scope);
+	m_endedMask |= 1u << scope;
+}
+
+void SonarPropagation::Graphics::Utils::GpuTimer::Resolve(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex, UINT64 fenceValue)
+{
+	if (!IsAvailable()) {
+		return;
+	}
+
+	ID3D12Resource* buffer = m_readback->GetBuffer(frameIndex);
+
+	// Only scopes written this frame; resolving queries that were never ended is undefined.
+	for (uint32_t scope = 0; scope < m_scopeCount; ++scope) {
+		if (m_endedMask & (1u << scope)) {
+			commandList->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, scope * 2, 2,
+				buffer, static_cast<UINT64>(scope) * 2 * sizeof(UINT64));
+		}
+	}
+
+	m_readback->MarkWritten(frameIndex, static_cast<UINT64>(m_scopeCount) * 2 * sizeof(UINT64), fenceValue);
+	m_frames[frameIndex].fenceValue = fenceValue;
+	m_frames[frameIndex].scopeMask = m_endedMask;
+
+	m_openMask = 0;
+	m_endedMask = 0;
+}
+
+bool SonarPropagation::Graphics::Utils::GpuTimer::Collect(UINT64 completedFenceValue)
+{
+	UINT64 fenceValue = 0;
+	if (!IsAvailable() || !m_readback->ReadNext(completedFenceValue, m_data, &fenceValue)) {
+		return false;
+	}
+
+	m_collectedMask = 0;
+	for (const auto& frame : m_frames) {
+		if (frame.fenceValue == fenceValue) {
+			m_collectedMask = frame.scopeMask;
+			break;
+		}
+	}
+	return true;
+}
+
+bool SonarPropagation::Graphics::Utils::GpuTimer::GetMilliseconds(uint32_t scope, double& milliseconds) const
+{
+	if (scope >= m_scopeCount || !(m_collectedMask & (1u << scope))) {
+		return false;
+	}
+
+	const UINT64* timestamps = reinterpret_cast<const UINT64*>(m_data.data()) + static_cast<size_t>(scope) * 2;
+	if (timestamps[1] < timestamps[0]) {
+		return false;
+	}
+
+	milliseconds = static_cast<double>(timestamps[1] - timestamps[0]) / m_ticksPerMillisecond;
+	return true;
+}
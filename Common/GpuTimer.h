@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "FrameResources.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// GPU durations of a fixed set of scopes, measured with timestamp queries on one command queue.
+			/// Each frame resolves its queries into its own slot of a ReadbackRing, so results arrive a few
+			/// frames late without ever waiting for the GPU. If the queue cannot report timestamps the timer
+			/// stays unavailable and every call is a no-op.
+			/// </summary>
+			class GpuTimer {
+			public:
+				/// <summary>
+				/// Constructor for the GpuTimer.
+				/// </summary>
+				/// <param name="queue">Queue the timed command lists are executed on.</param>
+				/// <param name="scopeCount">Number of scopes; at most 32.</param>
+				/// <param name="frameCount">Number of frames in flight.</param>
+				GpuTimer(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t scopeCount, uint32_t frameCount = DX::c_frameCount);
+
+				GpuTimer(const GpuTimer&) = delete;
+				GpuTimer& operator=(const GpuTimer&) = delete;
+
+				bool IsAvailable() const { return m_queryHeap != nullptr; }
+
+				void Begin(ID3D12GraphicsCommandList* commandList, uint32_t scope);
+				void End(ID3D12GraphicsCommandList* commandList, uint32_t scope);
+
+				/// <summary>
+				/// Records the resolve of every scope ended since the last Resolve(). Must be the last timing
+				/// command of the frame's command list; the results are ready once fenceValue completes.
+				/// </summary>
+				void Resolve(ID3D12GraphicsCommandList* commandList, uint32_t frameIndex, UINT64 fenceValue);
+
+				/// <summary>
+				/// Loads the oldest completed frame not collected yet; call it until it returns false to see
+				/// every frame. Returns false once every completed frame has been collected.
+				/// </summary>
+				bool Collect(UINT64 completedFenceValue);
+
+				/// <summary>
+				/// Duration of a scope in the frame loaded by the last successful Collect().
+				/// Returns false if the scope was not timed in that frame.
+				/// </summary>
+				bool GetMilliseconds(uint32_t scope, double& milliseconds) const;
+
+			private:
+				struct FrameRecord {
+					UINT64 fenceValue = 0;
+					uint32_t scopeMask = 0;
+				};
+
+				Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_queryHeap;
+				std::unique_ptr<ReadbackRing> m_readback;
+				uint32_t m_scopeCount;
+				double m_ticksPerMillisecond = 0.0;
+
+				uint32_t m_openMask = 0;
+				uint32_t m_endedMask = 0;
+				std::vector<FrameRecord> m_frames;
+
+				std::vector<uint8_t> m_data;
+				uint32_t m_collectedMask = 0;
+			};
+		}
+	}
+}
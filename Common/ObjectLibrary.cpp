@@ -1,10 +1,13 @@
 #include "pch.h"
 #include "ObjectLibrary.h"
+#include "Profiler.h"
+#include <algorithm>
 #include <iostream>
 #include "thirdparty/tiny_obj_loader.h"
 
 
 size_t SonarPropagation::Graphics::Utils::ObjectLibrary::LoadWavefront(const std::string& filename) {
+	SONAR_PROFILE_SCOPE("ObjectLibrary::LoadWavefront");
 	tinyobj::ObjReaderConfig readerConfig;
 
 	tinyobj::ObjReader reader;
@@ -73,4 +76,107 @@ size_t SonarPropagation::Graphics::Utils::ObjectLibrary::LoadWavefront(const std
 	return LoadPredefined<VertexPositionNormalUV>(objVertices, objIndices);
 }
 
+void SonarPropagation::Graphics::Utils::ObjectLibrary::BeginUpload(ID3D12GraphicsCommandList* commandList) {
+	m_uploadCommandList = commandList;
+}
+
+void SonarPropagation::Graphics::Utils::ObjectLibrary::EndUpload(D3D12_RESOURCE_STATES readState) {
+	if (!m_uploadCommandList) {
+		throw std::logic_error("ObjectLibrary::EndUpload called without BeginUpload");
+	}
+
+	m_meshAllocator.FinishWrites(m_uploadCommandList, readState);
+	m_stagingRing.Submit(++m_uploadBatch);
+	m_uploadCommandList = nullptr;
+}
+
+void SonarPropagation::Graphics::Utils::ObjectLibrary::OnUploadCompleted() {
+	m_stagingRing.Reclaim(m_uploadBatch);
+}
 
+void SonarPropagation::Graphics::Utils::ObjectLibrary::ReleaseModel(size_t modelIndex) {
+	Scene::Model& model = m_objects[modelIndex];
+
+	m_meshAllocator.Free(model.m_bufferData.vertexAllocation);
+	m_meshAllocator.Free(model.m_bufferData.indexAllocation);
+	model.m_bufferData = BufferData();
+	model.m_asBuffers = SonarPropagation::Graphics::DXR::AccelerationStructureBuffers();
+}
+
+size_t SonarPropagation::Graphics::Utils::ObjectLibrary::LoadHeightfield(const SonarPropagation::Sonar::Heightfield& heightfield) {
+	SONAR_PROFILE_SCOPE("ObjectLibrary::LoadHeightfield");
+
+	const uint32_t levelCount = heightfield.GetLevelCount();
+	const uint32_t tileLevel = std::min(c_heightfieldTileLevel, levelCount);
+
+	HeightfieldConstants constants = {};
+	constants.columns = heightfield.GetColumns();
+	constants.rows = heightfield.GetRows();
+	constants.cellSize = static_cast<float>(heightfield.GetCellSize());
+	constants.tileLevel = tileLevel;
+	constants.tileColumns = heightfield.GetLevelColumns(tileLevel);
+	for (uint32_t level = 0; level <= tileLevel; ++level) {
+		constants.levelOffsets[level] = level > 0 ? static_cast<uint32_t>(heightfield.GetLevelOffset(level)) : 0;
+		constants.levelColumns[level] = heightfield.GetLevelColumns(level);
+		constants.levelRows[level] = heightfield.GetLevelRows(level);
+	}
+
+	// One box per tile, as tall as the heights under it; flat tiles get a sliver of thickness.
+	const double cellSize = heightfield.GetCellSize();
+	const double tileSize = cellSize * (1u << tileLevel);
+	const float thickness = static_cast<float>(cellSize * 1e-3);
+	std::vector<D3D12_RAYTRACING_AABB> aabbs;
+	aabbs.reserve(static_cast<size_t>(constants.tileColumns) * heightfield.GetLevelRows(tileLevel));
+	for (uint32_t row = 0; row < heightfield.GetLevelRows(tileLevel); ++row) {
+		for (uint32_t column = 0; column < constants.tileColumns; ++column) {
+			const Sonar::HeightRange range = heightfield.GetNodeRange(tileLevel, column, row);
+			D3D12_RAYTRACING_AABB aabb;
+			aabb.MinX = static_cast<float>(column * tileSize);
+			aabb.MinY = range.min - thickness;
+			aabb.MinZ = static_cast<float>(row * tileSize);
+			aabb.MaxX = static_cast<float>(std::min((column + 1) * tileSize, heightfield.GetCellColumns() * cellSize));
+			aabb.MaxY = range.max + thickness;
+			aabb.MaxZ = static_cast<float>(std::min((row + 1) * tileSize, heightfield.GetCellRows() * cellSize));
+			aabbs.push_back(aabb);
+		}
+	}
+
+	HeightfieldResources resources;
+	resources.heightAllocation = UploadBuffer(heightfield.GetHeights().data(), heightfield.GetHeights().size() * sizeof(float));
+
+	// A grid of one cell has no pyramid; the shader never reads it then, but the root SRV needs an address.
+	const Sonar::HeightRange emptyPyramid = { 0.0f, 0.0f };
+	const std::vector<Sonar::HeightRange>& pyramid = heightfield.GetPyramid();
+	resources.pyramidAllocation = pyramid.empty()
+		? UploadBuffer(&emptyPyramid, sizeof(emptyPyramid))
+		: UploadBuffer(pyramid.data(), pyramid.size() * sizeof(Sonar::HeightRange));
+
+	resources.constantsAllocation = UploadBuffer(&constants, sizeof(constants));
+	resources.aabbAllocation = UploadBuffer(aabbs.data(), aabbs.size() * sizeof(D3D12_RAYTRACING_AABB));
+	resources.aabbCount = static_cast<UINT>(aabbs.size());
+
+	m_heightfields.push_back(std::move(resources));
+	return m_heightfields.size() - 1;
+}
+
+void SonarPropagation::Graphics::Utils::ObjectLibrary::ReleaseHeightfield(size_t heightfieldIndex) {
+	HeightfieldResources& resources = m_heightfields[heightfieldIndex];
+
+	m_meshAllocator.Free(resources.heightAllocation);
+	m_meshAllocator.Free(resources.pyramidAllocation);
+	m_meshAllocator.Free(resources.constantsAllocation);
+	m_meshAllocator.Free(resources.aabbAllocation);
+	resources = HeightfieldResources();
+}
+
+SonarPropagation::Graphics::Utils::BufferAllocation SonarPropagation::Graphics::Utils::ObjectLibrary::UploadBuffer(const void* data, UINT64 size) {
+	SONAR_PROFILE_SCOPE("ObjectLibrary::UploadBuffer");
+	if (!m_uploadCommandList) {
+		throw std::logic_error("ObjectLibrary: meshes can only be loaded between BeginUpload and EndUpload");
+	}
+
+	BufferAllocation allocation = m_meshAllocator.Allocate(size);
+	m_stagingRing.Upload(m_uploadCommandList, m_meshAllocator, allocation, data, size);
+
+	return allocation;
+}
@@ -5,6 +5,8 @@
 #include <string>
 //#include "thirdparty/tiny_obj_loader.h"
 #include "Scene.h"
+#include "BufferAllocator.h"
+#include "../Sonar/Heightfield.h"
 
 
 namespace SonarPropagation
@@ -13,121 +15,129 @@ namespace SonarPropagation
 	{
 		namespace Utils
 		{
+			/// <summary>
+			/// GPU copy of a heightfield: the heights, the min/max pyramid, the constants that describe both
+			/// and one box per tile of cells, which is all the BLAS holds. Rays entering a box run the
+			/// intersection shader of Heightfield.hlsl over the cells of the tile.
+			/// </summary>
+			struct HeightfieldResources {
+				BufferAllocation heightAllocation;
+				BufferAllocation pyramidAllocation;
+				BufferAllocation constantsAllocation;
+				BufferAllocation aabbAllocation;
+				UINT aabbCount = 0;
+
+				SonarPropagation::Graphics::DXR::AccelerationStructureBuffers m_asBuffers;
+
+				bool IsASInstanciated() const {
+					return m_asBuffers.pResult != nullptr
+						&& m_asBuffers.pScratch != nullptr;
+				}
+			};
+
 			class ObjectLibrary {
 			public: 
-				ObjectLibrary(ID3D12Device* device) : m_device(device) {};
+				ObjectLibrary(ID3D12Device* device) :
+					m_device(device),
+					m_meshAllocator(device, D3D12_HEAP_TYPE_DEFAULT),
+					m_stagingRing(device)
+				{};
 				~ObjectLibrary() {};
 
+				/// <summary>
+				/// Starts recording mesh uploads into the given command list. Geometry is staged through
+				/// a persistently mapped ring and copied into sub-allocated DEFAULT heap pages.
+				/// </summary>
+				void BeginUpload(ID3D12GraphicsCommandList* commandList);
+
+				/// <summary>
+				/// Records the barriers making the uploaded geometry readable by acceleration structure
+				/// builds and shaders. The command list has to be executed before the data is used.
+				/// </summary>
+				void EndUpload(D3D12_RESOURCE_STATES readState = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+				/// <summary>
+				/// Recycles the staging memory once the upload command list has finished executing.
+				/// </summary>
+				void OnUploadCompleted();
 				
 				size_t LoadWavefront(const std::string& filename);
 				
 				template<typename V>
-				size_t LoadPredefined(const std::vector<V> vertices, const std::vector<UINT> indices)
+				size_t LoadPredefined(const std::vector<V>& vertices, const std::vector<UINT>& indices)
 				{
-					UINT bufferSize = vertices.size() * sizeof(V);
+					size_t modelIndex = LoadPredefined<V>(vertices);
+					BufferData& bufferData = m_objects[modelIndex].m_bufferData;
 
-					size_t modelIndex = m_objects.size();
-					m_objects.push_back(Scene::Model());
-
-					{
-						DX::ThrowIfFailed(
-							m_device->CreateCommittedResource(
-								&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-								D3D12_HEAP_FLAG_NONE,
-								&CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-								D3D12_RESOURCE_STATE_GENERIC_READ,
-								nullptr,
-								IID_PPV_ARGS(&(m_objects[modelIndex].m_bufferData.vertexBuffer))
-							)
-						);
-
-						UINT8* pVertexDataBegin;
-						CD3DX12_RANGE readRange(0, 0);
-
-						DX::ThrowIfFailed(m_objects[modelIndex].m_bufferData.vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-						memcpy(pVertexDataBegin, vertices.data(), bufferSize);
-						m_objects[modelIndex].m_bufferData.vertexBuffer->Unmap(0, nullptr);
-
-						m_objects[modelIndex].m_bufferData.vertexBufferView.BufferLocation = m_objects[modelIndex].m_bufferData.vertexBuffer->GetGPUVirtualAddress();
-						m_objects[modelIndex].m_bufferData.vertexBufferView.StrideInBytes = sizeof(V);
-						m_objects[modelIndex].m_bufferData.vertexBufferView.SizeInBytes = bufferSize;
-
-						//NAME_D3D12_OBJECT(model->m_bufferData.vertexBuffer);
-					}
-
-					{
-						CD3DX12_HEAP_PROPERTIES heapProperties(D3D12_HEAP_TYPE_UPLOAD);
-						CD3DX12_RANGE readRangeUp(0, 0);
-						const UINT indexBufferSize = static_cast<UINT>(indices.size()) * sizeof(UINT);
-
-						CD3DX12_RESOURCE_DESC bufferResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
-						DX::ThrowIfFailed(m_device->CreateCommittedResource(
-							&heapProperties,
-							D3D12_HEAP_FLAG_NONE,
-							&bufferResourceDesc,
-							D3D12_RESOURCE_STATE_GENERIC_READ,
-							nullptr,
-							IID_PPV_ARGS(&(m_objects[modelIndex].m_bufferData.indexBuffer))
-						));
-
-						UINT8* pIndexDataBegin;
-						DX::ThrowIfFailed(m_objects[modelIndex].m_bufferData.indexBuffer->Map(0, &readRangeUp, reinterpret_cast<void**>(&pIndexDataBegin)));
-						memcpy(pIndexDataBegin, indices.data(), indexBufferSize);
-						m_objects[modelIndex].m_bufferData.indexBuffer->Unmap(0, nullptr);
-
-						m_objects[modelIndex].m_bufferData.indexBufferView.BufferLocation = m_objects[modelIndex].m_bufferData.indexBuffer->GetGPUVirtualAddress();
-						m_objects[modelIndex].m_bufferData.indexBufferView.Format = DXGI_FORMAT_R32_UINT;
-						m_objects[modelIndex].m_bufferData.indexBufferView.SizeInBytes = indexBufferSize;
-
-						//NAME_D3D12_OBJECT(m_objects[modelIndex].m_bufferData.indexBuffer);
-					}
+					const UINT indexBufferSize = static_cast<UINT>(indices.size() * sizeof(UINT));
 
+					bufferData.indexAllocation = UploadBuffer(indices.data(), indexBufferSize);
+					bufferData.indexBuffer = bufferData.indexAllocation.resource;
+					bufferData.indexCount = static_cast<UINT>(indices.size());
 
+					bufferData.indexBufferView.BufferLocation = bufferData.indexAllocation.gpuAddress;
+					bufferData.indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+					bufferData.indexBufferView.SizeInBytes = indexBufferSize;
 
 					return modelIndex;
 				}
 
 				template<typename V>
-				size_t LoadPredefined(const std::vector<V> vertices)
+				size_t LoadPredefined(const std::vector<V>& vertices)
 				{
-					UINT bufferSize = vertices.size() * sizeof(V);
+					const UINT bufferSize = static_cast<UINT>(vertices.size() * sizeof(V));
 					
 					size_t modelIndex = m_objects.size();
 					m_objects.push_back(Scene::Model());
+					BufferData& bufferData = m_objects[modelIndex].m_bufferData;
+
+					bufferData.vertexAllocation = UploadBuffer(vertices.data(), bufferSize);
+					bufferData.vertexBuffer = bufferData.vertexAllocation.resource;
+					bufferData.vertexCount = static_cast<UINT>(vertices.size());
 
-					{
-						DX::ThrowIfFailed(
-							m_device->CreateCommittedResource(
-								&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-								D3D12_HEAP_FLAG_NONE,
-								&CD3DX12_RESOURCE_DESC::Buffer(bufferSize),
-								D3D12_RESOURCE_STATE_GENERIC_READ,
-								nullptr,
-								IID_PPV_ARGS(&(m_objects[modelIndex].m_bufferData.vertexBuffer))
-							)
-						);
+					bufferData.vertexBufferView.BufferLocation = bufferData.vertexAllocation.gpuAddress;
+					bufferData.vertexBufferView.StrideInBytes = sizeof(V);
+					bufferData.vertexBufferView.SizeInBytes = bufferSize;
 
-						UINT8* pVertexDataBegin;
-						CD3DX12_RANGE readRange(0, 0);
+					return modelIndex;
+				}
 
-						DX::ThrowIfFailed(m_objects[modelIndex].m_bufferData.vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-						memcpy(pVertexDataBegin, vertices.data(), bufferSize);
-						m_objects[modelIndex].m_bufferData.vertexBuffer->Unmap(0, nullptr);
+				/// <summary>
+				/// Returns the geometry and acceleration structure of a model to the allocators. The slot stays
+				/// in m_objects so that other model indices do not move; it can no longer be drawn. The GPU must
+				/// be done with the model.
+				/// </summary>
+				void ReleaseModel(size_t modelIndex);
 
-						m_objects[modelIndex].m_bufferData.vertexBufferView.BufferLocation = bufferData.vertexBuffer->GetGPUVirtualAddress();
-						m_objects[modelIndex].m_bufferData.vertexBufferView.StrideInBytes = sizeof(V);
-						m_objects[modelIndex].m_bufferData.vertexBufferView.SizeInBytes = bufferSize;
+				/// <summary>
+				/// Uploads a heightfield. Tiles are 2^c_heightfieldTileLevel cells square, so a 20k x 20k grid
+				/// is a BLAS of 400k boxes instead of 800M triangles.
+				/// </summary>
+				size_t LoadHeightfield(const SonarPropagation::Sonar::Heightfield& heightfield);
 
-						//NAME_D3D12_OBJECT(model->m_bufferData.vertexBuffer);
-					}
+				/// <summary>
+				/// Like ReleaseModel(), for heightfields.
+				/// </summary>
+				void ReleaseHeightfield(size_t heightfieldIndex);
 
-					return modelIndex;
-				}
+				static const uint32_t c_heightfieldTileLevel = 5;
 
+				const BufferAllocator& GetMeshAllocator() const { return m_meshAllocator; }
 
 				std::vector<Scene::Model> m_objects;
+				std::vector<HeightfieldResources> m_heightfields;
 
 				ID3D12Device* m_device;
+
+			private:
+				BufferAllocation UploadBuffer(const void* data, UINT64 size);
+
+				// Geometry of every model shares a few large DEFAULT heap buffers.
+				BufferAllocator m_meshAllocator;
+				StagingRing m_stagingRing;
+
+				ID3D12GraphicsCommandList* m_uploadCommandList = nullptr;
+				UINT64 m_uploadBatch = 0;
 			};
 
 		}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Allocation statistics shared by the pool and arena allocators.
+			/// </summary>
+			struct AllocationStats {
+				size_t liveAllocations = 0;
+				size_t peakAllocations = 0;
+				size_t totalAllocations = 0;
+				size_t totalDeallocations = 0;
+				size_t bytesInUse = 0;
+				size_t peakBytesInUse = 0;
+				size_t bytesReserved = 0;
+				size_t blockCount = 0;
+
+				inline void OnAllocate(size_t bytes) {
+					++liveAllocations;
+					++totalAllocations;
+					bytesInUse += bytes;
+					if (liveAllocations > peakAllocations) peakAllocations = liveAllocations;
+					if (bytesInUse > peakBytesInUse) peakBytesInUse = bytesInUse;
+				}
+
+				inline void OnDeallocate(size_t bytes) {
+					--liveAllocations;
+					++totalDeallocations;
+					bytesInUse -= bytes;
+				}
+			};
+
+			/// <summary>
+			/// Typed pool allocator for long-lived objects.
+			/// Storage is reserved in fixed-size blocks which are never moved, so the returned
+			/// pointers stay valid for the lifetime of the pool. Freed slots are recycled through
+			/// an intrusive free list, so once the pool is warm, Create/Destroy never touch the heap.
+			/// </summary>
+			/// <typeparam name="T">Pooled type</typeparam>
+			template <typename T>
+			class PoolAllocator {
+			public:
+				/// <summary>
+				/// Constructor for the pool.
+				/// </summary>
+				/// <param name="objectsPerBlock">Number of objects reserved whenever the pool grows.</param>
+				explicit PoolAllocator(size_t objectsPerBlock = 64)
+					: m_objectsPerBlock(objectsPerBlock > 0 ? objectsPerBlock : 1) {}
+
+				/// <summary>
+				/// Destructor for the pool. Destroys every object still alive.
+				/// </summary>
+				~PoolAllocator() { Clear(); }
+
+				PoolAllocator(const PoolAllocator&) = delete;
+				PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+				PoolAllocator(PoolAllocator&& other) noexcept { *this = std::move(other); }
+
+				PoolAllocator& operator=(PoolAllocator&& other) noexcept {
+					if (this != &other) {
+						Clear();
+						m_objectsPerBlock = other.m_objectsPerBlock;
+						m_blocks = std::move(other.m_blocks);
+						m_freeList = other.m_freeList;
+						m_stats = other.m_stats;
+						other.m_freeList = nullptr;
+						other.m_stats = AllocationStats();
+					}
+					return *this;
+				}
+
+				/// <summary>
+				/// Constructs a new object inside the pool.
+				/// </summary>
+				template <typename... Args>
+				T* Create(Args&&... args) {
+					if (!m_freeList) {
+						Grow();
+					}
+
+					Slot* slot = m_freeList;
+					m_freeList = slot->next;
+
+					T* object = new (&slot->storage) T(std::forward<Args>(args)...);
+					slot->alive = true;
+					m_stats.OnAllocate(sizeof(T));
+					return object;
+				}
+
+				/// <summary>
+				/// Destroys an object previously created by this pool and recycles its slot.
+				/// </summary>
+				void Destroy(T* object) {
+					if (!object) {
+						return;
+					}
+
+					Slot* slot = reinterpret_cast<Slot*>(object);
+					object->~T();
+					slot->alive = false;
+					slot->next = m_freeList;
+					m_freeList = slot;
+					m_stats.OnDeallocate(sizeof(T));
+				}
+
+				/// <summary>
+				/// Reserves enough blocks to hold at least the given number of objects.
+				/// </summary>
+				void Reserve(size_t objectCount) {
+					while (Capacity() < objectCount) {
+						Grow();
+					}
+				}
+
+				/// <summary>
+				/// Destroys every live object, keeping the reserved blocks for reuse.
+				/// </summary>
+				void Reset() {
+					m_freeList = nullptr;
+					for (auto& block : m_blocks) {
+						for (size_t i = m_objectsPerBlock; i-- > 0;) {
+							Slot& slot = block[i];
+							if (slot.alive) {
+								reinterpret_cast<T*>(&slot.storage)->~T();
+								slot.alive = false;
+								m_stats.OnDeallocate(sizeof(T));
+							}
+							slot.next = m_freeList;
+							m_freeList = &slot;
+						}
+					}
+				}
+
+				/// <summary>
+				/// Destroys every live object and releases all blocks.
+				/// </summary>
+				void Clear() {
+					Reset();
+					m_blocks.clear();
+					m_freeList = nullptr;
+					m_stats.bytesReserved = 0;
+					m_stats.blockCount = 0;
+				}
+
+				size_t Capacity() const { return m_blocks.size() * m_objectsPerBlock; }
+
+				const AllocationStats& GetStats() const { return m_stats; }
+
+			private:
+				struct Slot {
+					typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+					Slot* next = nullptr;
+					bool alive = false;
+				};
+
+				static_assert(offsetof(Slot, storage) == 0, "Pool slots must start with the object storage.");
+
+				void Grow() {
+					m_blocks.emplace_back(new Slot[m_objectsPerBlock]);
+					Slot* block = m_blocks.back().get();
+
+					for (size_t i = m_objectsPerBlock; i-- > 0;) {
+						block[i].next = m_freeList;
+						m_freeList = &block[i];
+					}
+
+					m_stats.bytesReserved += m_objectsPerBlock * sizeof(Slot);
+					m_stats.blockCount = m_blocks.size();
+				}
+
+				size_t m_objectsPerBlock = 64;
+				std::vector<std::unique_ptr<Slot[]>> m_blocks;
+				Slot* m_freeList = nullptr;
+				AllocationStats m_stats;
+			};
+		}
+	}
+}
@@ -0,0 +1,329 @@
+#include "pch.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+	enum class EventType : uint32_t {
+		Begin,
+		End
+	};
+
+	struct ProfileEvent {
+		const char* name;
+		uint64_t timestamp;
+		EventType type;
+	};
+
+	/// <summary>
+	/// Single producer (the owning thread), single consumer (Collect() under the registry lock).
+	/// </summary>
+	class EventRing {
+	public:
+		static const size_t c_capacity = 1 << 16;
+
+		EventRing(uint32_t threadId) : m_events(c_capacity), m_threadId(threadId) {}
+
+		bool Push(const ProfileEvent& event) {
+			const uint64_t head = m_head.load(std::memory_order_relaxed);
+			if (head - m_tail.load(std::memory_order_acquire) >= c_capacity) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			m_events[head & (c_capacity - 1)] = event;
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		template <typename F>
+		void Drain(F consume) {
+			const uint64_t head = m_head.load(std::memory_order_acquire);
+			uint64_t tail = m_tail.load(std::memory_order_relaxed);
+
+			for (; tail != head; ++tail) {
+				consume(m_events[tail & (c_capacity - 1)]);
+			}
+
+			m_tail.store(tail, std::memory_order_release);
+		}
+
+		// A scope whose begin was dropped must not record its end either, or it would close its parent.
+		void PushBegin(const ProfileEvent& event) {
+			if (m_droppedDepth > 0 || !Push(event)) {
+				++m_droppedDepth;
+			}
+		}
+
+		void PushEnd(const ProfileEvent& event) {
+			if (m_droppedDepth > 0) {
+				--m_droppedDepth;
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			Push(event);
+		}
+
+		uint64_t TakeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+		uint32_t GetThreadId() const { return m_threadId; }
+
+		std::atomic<const char*> name{ nullptr };
+
+		// Set by the owning thread when it exits; its ring goes once the remaining events are collected.
+		std::atomic<bool> retired{ false };
+
+	private:
+		std::vector<ProfileEvent> m_events;
+		std::atomic<uint64_t> m_head{ 0 };
+		std::atomic<uint64_t> m_tail{ 0 };
+		std::atomic<uint64_t> m_dropped{ 0 };
+		uint32_t m_threadId;
+
+		// Only touched by the producer.
+		uint32_t m_droppedDepth = 0;
+	};
+
+	struct CapturedEvent {
+		ProfileEvent event;
+		uint32_t threadId;
+	};
+
+	struct ProfilerState {
+		std::atomic<bool> capturing{ false };
+
+		std::mutex mutex;
+		std::vector<std::shared_ptr<EventRing>> rings;
+		uint32_t nextThreadId = 1;
+		// Names of the threads whose rings are gone, by thread id.
+		std::vector<std::pair<uint32_t, const char*>> retiredNames;
+		std::vector<CapturedEvent> events;
+		uint64_t dropped = 0;
+		uint64_t origin = 0;
+	};
+
+	ProfilerState& GetState() {
+		static ProfilerState state;
+		return state;
+	}
+
+	uint64_t Now() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	// Rings stay registered after their thread exits until its last events are collected, so short lived
+	// workers (e.g. one set per propagation) do not keep a ring each for the rest of the process.
+	struct ThreadRing {
+		~ThreadRing() {
+			if (ring) {
+				ring->retired.store(true, std::memory_order_release);
+			}
+		}
+
+		std::shared_ptr<EventRing> ring;
+	};
+
+	EventRing& GetThreadRing() {
+		thread_local ThreadRing thread;
+		if (!thread.ring) {
+			ProfilerState& state = GetState();
+			std::lock_guard<std::mutex> lock(state.mutex);
+			thread.ring = std::make_shared<EventRing>(state.nextThreadId++);
+			state.rings.push_back(thread.ring);
+		}
+		return *thread.ring;
+	}
+
+	void CollectLocked(ProfilerState& state) {
+		for (auto ring = state.rings.begin(); ring != state.rings.end();) {
+			const bool retired = (*ring)->retired.load(std::memory_order_acquire);
+			const uint32_t threadId = (*ring)->GetThreadId();
+			(*ring)->Drain([&state, threadId](const ProfileEvent& event) {
+				state.events.push_back({ event, threadId });
+			});
+			state.dropped += (*ring)->TakeDropped();
+
+			if (!retired) {
+				++ring;
+				continue;
+			}
+			if (const char* name = (*ring)->name.load(std::memory_order_relaxed)) {
+				state.retiredNames.push_back({ threadId, name });
+			}
+			ring = state.rings.erase(ring);
+		}
+	}
+
+	void WriteJsonString(std::ostream& stream, const char* text) {
+		stream << '"';
+		for (const char* c = text; *c; ++c) {
+			switch (*c) {
+			case '"': stream << "\\\""; break;
+			case '\\': stream << "\\\\"; break;
+			case '\n': stream << "\\n"; break;
+			default:
+				if (static_cast<unsigned char>(*c) >= 0x20) {
+					stream << *c;
+				}
+			}
+		}
+		stream << '"';
+	}
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::BeginCapture()
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	// Drop whatever was buffered before this capture, and the rings of the threads that exited since.
+	CollectLocked(state);
+	state.events.clear();
+	state.dropped = 0;
+	state.origin = Now();
+	state.capturing.store(true, std::memory_order_release);
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::EndCapture()
+{
+	ProfilerState& state = GetState();
+	state.capturing.store(false, std::memory_order_release);
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	CollectLocked(state);
+}
+
+bool SonarPropagation::Graphics::Utils::Profiler::IsCapturing()
+{
+	return GetState().capturing.load(std::memory_order_relaxed);
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::Collect()
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	CollectLocked(state);
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::SetThreadName(const char* name)
+{
+	GetThreadRing().name.store(name, std::memory_order_relaxed);
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::BeginScope(const char* name)
+{
+	GetThreadRing().PushBegin({ name, Now(), EventType::Begin });
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::EndScope()
+{
+	GetThreadRing().PushEnd({ nullptr, Now(), EventType::End });
+}
+
+void SonarPropagation::Graphics::Utils::Profiler::WriteChromeTrace(std::ostream& stream)
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	auto separator = [&stream, &first]() {
+		if (!first) {
+			stream << ",\n";
+		}
+		first = false;
+	};
+
+	std::vector<std::pair<uint32_t, const char*>> names = state.retiredNames;
+	for (const auto& ring : state.rings) {
+		names.push_back({ ring->GetThreadId(), ring->name.load(std::memory_order_relaxed) });
+	}
+	for (const auto& name : names) {
+		if (name.second) {
+			separator();
+			stream << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << name.first << ",\"args\":{\"name\":";
+			WriteJsonString(stream, name.second);
+			stream << "}}";
+		}
+	}
+
+	// Events of one thread are in order. Unmatched ends (from a capture that started inside a scope) are
+	// skipped, and scopes still open at the end are closed at the last timestamp.
+	std::vector<std::vector<const char*>> openScopes(state.nextThreadId);
+	uint64_t lastTimestamp = state.origin;
+
+	stream.setf(std::ios::fixed);
+	stream.precision(3);
+
+	for (const auto& captured : state.events) {
+		const ProfileEvent& event = captured.event;
+		if (event.timestamp < state.origin) {
+			continue;
+		}
+
+		auto& open = openScopes[captured.threadId];
+		if (event.type == EventType::End && open.empty()) {
+			continue;
+		}
+
+		separator();
+		double microseconds = (event.timestamp - state.origin) / 1000.0;
+		lastTimestamp = std::max(lastTimestamp, event.timestamp);
+
+		if (event.type == EventType::Begin) {
+			open.push_back(event.name);
+			stream << "{\"ph\":\"B\",\"name\":";
+			WriteJsonString(stream, event.name);
+		}
+		else {
+			open.pop_back();
+			stream << "{\"ph\":\"E\"";
+		}
+		stream << ",\"pid\":1,\"tid\":" << captured.threadId << ",\"ts\":" << microseconds << "}";
+	}
+
+	for (size_t threadId = 0; threadId < openScopes.size(); ++threadId) {
+		for (size_t i = 0; i < openScopes[threadId].size(); ++i) {
+			separator();
+			stream << "{\"ph\":\"E\",\"pid\":1,\"tid\":" << threadId << ",\"ts\":" << (lastTimestamp - state.origin) / 1000.0 << "}";
+		}
+	}
+
+	stream << "\n]}\n";
+}
+
+bool SonarPropagation::Graphics::Utils::Profiler::WriteChromeTrace(const std::wstring& path)
+{
+#if defined(_WIN32)
+	std::ofstream file(path.c_str());
+#else
+	std::ofstream file(std::string(path.begin(), path.end()).c_str());
+#endif
+	if (!file) {
+		return false;
+	}
+
+	WriteChromeTrace(file);
+	return static_cast<bool>(file);
+}
+
+SonarPropagation::Graphics::Utils::ProfilerStats SonarPropagation::Graphics::Utils::Profiler::GetStats()
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	ProfilerStats stats;
+	stats.collectedEvents = state.events.size();
+	stats.droppedEvents = state.dropped;
+	stats.threadCount = state.nextThreadId - 1;
+	return stats;
+}
@@ -0,0 +1,361 @@
+#include "pch.h"
+#include "RangeAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+	inline uint32_t LowestBit(uint32_t value) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return index;
+#else
+		return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+	}
+
+	inline uint32_t HighestBit(uint64_t value) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return index;
+#else
+		return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+	}
+
+	const uint32_t c_invalid = SonarPropagation::Graphics::Utils::RangeAllocation::c_invalidNode;
+}
+
+SonarPropagation::Graphics::Utils::RangeAllocator::RangeAllocator(uint64_t size, uint64_t granularity)
+	: m_size(size), m_granularity(granularity)
+{
+	if (granularity == 0 || (granularity & (granularity - 1)) != 0) {
+		throw std::invalid_argument("RangeAllocator granularity must be a power of two");
+	}
+
+	Reset();
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::Reset()
+{
+	m_nodes.clear();
+	m_unusedNodes.clear();
+	m_firstLevelBitmap = 0;
+	m_usedUnits = 0;
+	m_allocationCount = 0;
+
+	for (uint32_t fl = 0; fl < c_firstLevelCount; ++fl) {
+		m_secondLevelBitmaps[fl] = 0;
+		for (uint32_t sl = 0; sl < c_secondLevelCount; ++sl) {
+			m_freeHeads[fl][sl] = c_invalid;
+		}
+	}
+
+	uint64_t units = m_size / m_granularity;
+	if (units == 0) {
+		return;
+	}
+
+	uint32_t node = NewNode();
+	m_nodes[node].offset = 0;
+	m_nodes[node].size = units;
+	InsertFree(node);
+}
+
+SonarPropagation::Graphics::Utils::RangeAllocation SonarPropagation::Graphics::Utils::RangeAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	RangeAllocation result;
+	if (size == 0) {
+		return result;
+	}
+
+	uint64_t units = (size + m_granularity - 1) / m_granularity;
+	uint64_t alignmentUnits = alignment > m_granularity ? alignment / m_granularity : 1;
+
+	uint32_t node = FindFreeNode(units, alignment);
+	if (node == c_invalid) {
+		return result;
+	}
+
+	RemoveFree(node);
+
+	// Split off the padding in front of the node if a larger alignment was requested.
+	if (alignmentUnits > 1) {
+		uint64_t alignedOffset = (m_nodes[node].offset + alignment - 1) & ~(alignment - 1);
+		uint64_t paddingUnits = (alignedOffset - m_nodes[node].offset) / m_granularity;
+
+		if (paddingUnits > 0) {
+			uint32_t padding = NewNode();
+			Node& n = m_nodes[node];
+			Node& p = m_nodes[padding];
+
+			p.offset = n.offset;
+			p.size = paddingUnits;
+			p.prevPhysical = n.prevPhysical;
+			p.nextPhysical = node;
+			if (p.prevPhysical != c_invalid) {
+				m_nodes[p.prevPhysical].nextPhysical = padding;
+			}
+
+			n.prevPhysical = padding;
+			n.offset = alignedOffset;
+			n.size -= paddingUnits;
+
+			InsertFree(padding);
+		}
+	}
+
+	Split(node, units);
+
+	m_nodes[node].used = true;
+	m_usedUnits += m_nodes[node].size;
+	++m_allocationCount;
+
+	result.offset = m_nodes[node].offset;
+	result.size = m_nodes[node].size * m_granularity;
+	result.node = node;
+	return result;
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::Free(const RangeAllocation& allocation)
+{
+	if (!allocation.IsValid()) {
+		return;
+	}
+
+	uint32_t node = allocation.node;
+	if (node >= m_nodes.size() || !m_nodes[node].used) {
+		throw std::logic_error("RangeAllocator::Free called with a range that is not allocated");
+	}
+
+	m_nodes[node].used = false;
+	m_usedUnits -= m_nodes[node].size;
+	--m_allocationCount;
+
+	// Merge with the previous range.
+	uint32_t prev = m_nodes[node].prevPhysical;
+	if (prev != c_invalid && !m_nodes[prev].used) {
+		RemoveFree(prev);
+		m_nodes[prev].size += m_nodes[node].size;
+		m_nodes[prev].nextPhysical = m_nodes[node].nextPhysical;
+		if (m_nodes[node].nextPhysical != c_invalid) {
+			m_nodes[m_nodes[node].nextPhysical].prevPhysical = prev;
+		}
+		ReleaseNode(node);
+		node = prev;
+	}
+
+	// Merge with the next range.
+	uint32_t next = m_nodes[node].nextPhysical;
+	if (next != c_invalid && !m_nodes[next].used) {
+		RemoveFree(next);
+		m_nodes[node].size += m_nodes[next].size;
+		m_nodes[node].nextPhysical = m_nodes[next].nextPhysical;
+		if (m_nodes[next].nextPhysical != c_invalid) {
+			m_nodes[m_nodes[next].nextPhysical].prevPhysical = node;
+		}
+		ReleaseNode(next);
+	}
+
+	InsertFree(node);
+}
+
+SonarPropagation::Graphics::Utils::RangeAllocatorStats SonarPropagation::Graphics::Utils::RangeAllocator::GetStats() const
+{
+	RangeAllocatorStats stats;
+	stats.totalSize = (m_size / m_granularity) * m_granularity;
+	stats.usedSize = m_usedUnits * m_granularity;
+	stats.freeSize = stats.totalSize - stats.usedSize;
+	stats.allocationCount = m_allocationCount;
+
+	for (uint32_t fl = 0; fl < c_firstLevelCount; ++fl) {
+		for (uint32_t sl = 0; sl < c_secondLevelCount; ++sl) {
+			for (uint32_t node = m_freeHeads[fl][sl]; node != c_invalid; node = m_nodes[node].nextFree) {
+				++stats.freeRangeCount;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, m_nodes[node].size * m_granularity);
+			}
+		}
+	}
+
+	return stats;
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::Mapping(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const
+{
+	if (units < c_secondLevelCount) {
+		firstLevel = 0;
+		secondLevel = static_cast<uint32_t>(units);
+		return;
+	}
+
+	uint32_t msb = HighestBit(units);
+	firstLevel = msb - c_secondLevelBits + 1;
+	secondLevel = static_cast<uint32_t>((units >> (msb - c_secondLevelBits)) ^ c_secondLevelCount);
+}
+
+bool SonarPropagation::Graphics::Utils::RangeAllocator::FindSizeClass(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const
+{
+	// Round the request up to the next size class, so any range in the class found is large enough.
+	if (units >= c_secondLevelCount) {
+		units += (1ull << (HighestBit(units) - c_secondLevelBits)) - 1;
+	}
+
+	Mapping(units, firstLevel, secondLevel);
+	if (firstLevel >= c_firstLevelCount) {
+		return false;
+	}
+
+	uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (!secondLevelMap) {
+		uint32_t firstLevelMap = firstLevel + 1 < c_firstLevelCount ? m_firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+		if (!firstLevelMap) {
+			return false;
+		}
+
+		firstLevel = LowestBit(firstLevelMap);
+		secondLevelMap = m_secondLevelBitmaps[firstLevel];
+	}
+
+	secondLevel = LowestBit(secondLevelMap);
+	return true;
+}
+
+bool SonarPropagation::Graphics::Utils::RangeAllocator::Fits(uint32_t node, uint64_t units, uint64_t alignment) const
+{
+	const Node& n = m_nodes[node];
+	uint64_t paddingUnits = 0;
+	if (alignment > m_granularity) {
+		paddingUnits = (((n.offset + alignment - 1) & ~(alignment - 1)) - n.offset) / m_granularity;
+	}
+	return n.size >= units + paddingUnits;
+}
+
+uint32_t SonarPropagation::Graphics::Utils::RangeAllocator::FindFreeNode(uint64_t units, uint64_t alignment) const
+{
+	uint64_t alignmentUnits = alignment > m_granularity ? alignment / m_granularity : 1;
+	uint64_t searchUnits = units + alignmentUnits - 1;
+
+	uint32_t fl, sl;
+	if (FindSizeClass(searchUnits, fl, sl)) {
+		return m_freeHeads[fl][sl];
+	}
+
+	// Nothing in the classes guaranteed to fit. The classes from the one of the request up to the
+	// rounded one may still hold a range that does, e.g. a page sized exactly for the request.
+	uint32_t lastFl, lastSl;
+	uint64_t roundedUnits = searchUnits;
+	if (roundedUnits >= c_secondLevelCount) {
+		roundedUnits += (1ull << (HighestBit(roundedUnits) - c_secondLevelBits)) - 1;
+	}
+	Mapping(roundedUnits, lastFl, lastSl);
+
+	Mapping(units, fl, sl);
+	for (; fl < c_firstLevelCount && fl <= lastFl; ++fl, sl = 0) {
+		uint32_t secondLevelMap = m_secondLevelBitmaps[fl] & (~0u << sl);
+		if (fl == lastFl) {
+			secondLevelMap &= (1u << lastSl) - 1;
+		}
+
+		for (; secondLevelMap; secondLevelMap &= secondLevelMap - 1) {
+			for (uint32_t node = m_freeHeads[fl][LowestBit(secondLevelMap)]; node != c_invalid; node = m_nodes[node].nextFree) {
+				if (Fits(node, units, alignment)) {
+					return node;
+				}
+			}
+		}
+	}
+
+	return c_invalid;
+}
+
+uint32_t SonarPropagation::Graphics::Utils::RangeAllocator::NewNode()
+{
+	if (!m_unusedNodes.empty()) {
+		uint32_t node = m_unusedNodes.back();
+		m_unusedNodes.pop_back();
+		m_nodes[node] = Node();
+		return node;
+	}
+
+	m_nodes.emplace_back();
+	return static_cast<uint32_t>(m_nodes.size() - 1);
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::ReleaseNode(uint32_t node)
+{
+	m_unusedNodes.push_back(node);
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::InsertFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(m_nodes[node].size, fl, sl);
+
+	uint32_t head = m_freeHeads[fl][sl];
+	m_nodes[node].prevFree = c_invalid;
+	m_nodes[node].nextFree = head;
+	if (head != c_invalid) {
+		m_nodes[head].prevFree = node;
+	}
+
+	m_freeHeads[fl][sl] = node;
+	m_firstLevelBitmap |= 1u << fl;
+	m_secondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::RemoveFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(m_nodes[node].size, fl, sl);
+
+	Node& n = m_nodes[node];
+	if (n.prevFree != c_invalid) {
+		m_nodes[n.prevFree].nextFree = n.nextFree;
+	}
+	else {
+		m_freeHeads[fl][sl] = n.nextFree;
+	}
+
+	if (n.nextFree != c_invalid) {
+		m_nodes[n.nextFree].prevFree = n.prevFree;
+	}
+
+	n.prevFree = n.nextFree = c_invalid;
+
+	if (m_freeHeads[fl][sl] == c_invalid) {
+		m_secondLevelBitmaps[fl] &= ~(1u << sl);
+		if (!m_secondLevelBitmaps[fl]) {
+			m_firstLevelBitmap &= ~(1u << fl);
+		}
+	}
+}
+
+void SonarPropagation::Graphics::Utils::RangeAllocator::Split(uint32_t node, uint64_t units)
+{
+	if (m_nodes[node].size <= units) {
+		return;
+	}
+
+	uint32_t rest = NewNode();
+	Node& n = m_nodes[node];
+	Node& r = m_nodes[rest];
+
+	r.offset = n.offset + units * m_granularity;
+	r.size = n.size - units;
+	r.prevPhysical = node;
+	r.nextPhysical = n.nextPhysical;
+	if (r.nextPhysical != c_invalid) {
+		m_nodes[r.nextPhysical].prevPhysical = rest;
+	}
+
+	n.size = units;
+	n.nextPhysical = rest;
+
+	InsertFree(rest);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// A range handed out by the RangeAllocator.
+			/// </summary>
+			struct RangeAllocation {
+				static const uint32_t c_invalidNode = 0xFFFFFFFF;
+
+				uint64_t offset = 0;
+				uint64_t size = 0;
+				uint32_t node = c_invalidNode;
+
+				bool IsValid() const { return node != c_invalidNode; }
+			};
+
+			/// <summary>
+			/// Utilization and fragmentation of a RangeAllocator.
+			/// </summary>
+			struct RangeAllocatorStats {
+				uint64_t totalSize = 0;
+				uint64_t usedSize = 0;
+				uint64_t freeSize = 0;
+				uint64_t largestFreeRange = 0;
+				uint32_t allocationCount = 0;
+				uint32_t freeRangeCount = 0;
+
+				/// <summary>
+				/// Share of the total size currently handed out.
+				/// </summary>
+				double Utilization() const {
+					return totalSize ? static_cast<double>(usedSize) / totalSize : 0.0;
+				}
+
+				/// <summary>
+				/// 0 when all free space is one contiguous range, approaching 1 as it gets split up.
+				/// </summary>
+				double Fragmentation() const {
+					return freeSize ? 1.0 - static_cast<double>(largestFreeRange) / freeSize : 0.0;
+				}
+			};
+
+			/// <summary>
+			/// Device independent two-level segregated fit (TLSF) allocator for offset ranges.
+			/// It never touches the memory it manages, so the same placement logic can sub-allocate
+			/// GPU buffers, descriptor ranges or anything else addressed by offset.
+			/// Allocation and free are O(1). Only when no size class above a request has a free range are the
+			/// ranges of the classes below searched (see FindFreeNode()), so a range sized exactly for the
+			/// request is still found. Freed ranges are merged with free neighbours immediately.
+			/// </summary>
+			class RangeAllocator {
+			public:
+				/// <summary>
+				/// Constructor for the RangeAllocator.
+				/// </summary>
+				/// <param name="size">Size of the managed range.</param>
+				/// <param name="granularity">
+				/// Power of two unit every offset and size is rounded to. Requested alignments up to
+				/// the granularity are free; larger ones are served by splitting off the padding.
+				/// </param>
+				RangeAllocator(uint64_t size, uint64_t granularity = 256);
+
+				/// <summary>
+				/// Allocates a range. Returns an invalid allocation if no free range is large enough.
+				/// </summary>
+				RangeAllocation Allocate(uint64_t size, uint64_t alignment = 0);
+
+				/// <summary>
+				/// Returns a range to the allocator.
+				/// </summary>
+				void Free(const RangeAllocation& allocation);
+
+				/// <summary>
+				/// Frees every allocation at once.
+				/// </summary>
+				void Reset();
+
+				uint64_t GetSize() const { return m_size; }
+				uint64_t GetGranularity() const { return m_granularity; }
+
+				/// <summary>
+				/// Walks the ranges and computes the utilization and fragmentation statistics.
+				/// </summary>
+				RangeAllocatorStats GetStats() const;
+
+			private:
+				static const uint32_t c_secondLevelBits = 4;
+				static const uint32_t c_secondLevelCount = 1u << c_secondLevelBits;
+				static const uint32_t c_firstLevelCount = 32;
+
+				struct Node {
+					uint64_t offset = 0;
+					uint64_t size = 0;			// In units of m_granularity.
+					uint32_t prevPhysical = RangeAllocation::c_invalidNode;
+					uint32_t nextPhysical = RangeAllocation::c_invalidNode;
+					uint32_t prevFree = RangeAllocation::c_invalidNode;
+					uint32_t nextFree = RangeAllocation::c_invalidNode;
+					bool used = false;
+				};
+
+				void Mapping(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const;
+				bool FindSizeClass(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const;
+				bool Fits(uint32_t node, uint64_t units, uint64_t alignment) const;
+
+				/// <summary>
+				/// A free node that can hold units at the alignment, or c_invalidNode. Takes the head of the
+				/// first size class above the request in O(1); only if there is none are the ranges of the
+				/// classes in between checked one by one.
+				/// </summary>
+				uint32_t FindFreeNode(uint64_t units, uint64_t alignment) const;
+
+				uint32_t NewNode();
+				void ReleaseNode(uint32_t node);
+
+				void InsertFree(uint32_t node);
+				void RemoveFree(uint32_t node);
+
+				/// <summary>
+				/// Splits the node so it is exactly units long; the remainder becomes a free node.
+				/// </summary>
+				void Split(uint32_t node, uint64_t units);
+
+				uint64_t m_size;
+				uint64_t m_granularity;
+
+				std::vector<Node> m_nodes;
+				std::vector<uint32_t> m_unusedNodes;
+
+				uint32_t m_firstLevelBitmap = 0;
+				uint32_t m_secondLevelBitmaps[c_firstLevelCount] = {};
+				uint32_t m_freeHeads[c_firstLevelCount][c_secondLevelCount];
+
+				uint64_t m_usedUnits = 0;
+				uint32_t m_allocationCount = 0;
+			};
+		}
+	}
+}
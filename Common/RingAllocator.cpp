@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "RingAllocator.h"
+
+SonarPropagation::Graphics::Utils::RingAllocator::RingAllocator(uint64_t size)
+	: m_size(size), m_batches(16)
+{
+}
+
+bool SonarPropagation::Graphics::Utils::RingAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	if (size == 0 || size > m_size) {
+		return false;
+	}
+
+	if (m_used == 0) {
+		m_head = m_tail = 0;
+	}
+
+	if (alignment == 0) {
+		alignment = 1;
+	}
+
+	uint64_t aligned = (m_head + alignment - 1) & ~(alignment - 1);
+	uint64_t consumed = 0;
+
+	if (m_head >= m_tail && !(m_used == m_size)) {
+		// Free space is [head, size) followed by [0, tail).
+		if (aligned + size <= m_size) {
+			offset = aligned;
+			consumed = aligned - m_head + size;
+		}
+		else if (size <= m_tail) {
+			// Skip the end of the ring and wrap around.
+			offset = 0;
+			consumed = (m_size - m_head) + size;
+		}
+		else {
+			return false;
+		}
+	}
+	else {
+		// Free space is [head, tail).
+		if (aligned + size > m_tail) {
+			return false;
+		}
+		offset = aligned;
+		consumed = aligned - m_head + size;
+	}
+
+	m_head = offset + size;
+	if (m_head == m_size) {
+		m_head = 0;
+	}
+
+	m_used += consumed;
+	m_openBatchBytes += consumed;
+	if (m_used > m_peakUsed) {
+		m_peakUsed = m_used;
+	}
+
+	return true;
+}
+
+void SonarPropagation::Graphics::Utils::RingAllocator::Submit(uint64_t fenceValue)
+{
+	if (m_openBatchBytes == 0) {
+		return;
+	}
+
+	PushBatch({ fenceValue, m_head, m_openBatchBytes });
+	m_openBatchBytes = 0;
+}
+
+void SonarPropagation::Graphics::Utils::RingAllocator::Reclaim(uint64_t completedFenceValue)
+{
+	while (m_batchCount > 0) {
+		const Batch& batch = m_batches[m_firstBatch];
+		if (batch.fenceValue > completedFenceValue) {
+			break;
+		}
+
+		m_tail = batch.end;
+		m_used -= batch.bytes;
+
+		m_firstBatch = (m_firstBatch + 1) % m_batches.size();
+		--m_batchCount;
+	}
+}
+
+void SonarPropagation::Graphics::Utils::RingAllocator::Reset()
+{
+	m_head = m_tail = m_used = 0;
+	m_openBatchBytes = 0;
+	m_firstBatch = m_batchCount = 0;
+}
+
+void SonarPropagation::Graphics::Utils::RingAllocator::PushBatch(const Batch& batch)
+{
+	if (m_batchCount == m_batches.size()) {
+		std::vector<Batch> grown(m_batches.size() * 2);
+		for (size_t i = 0; i < m_batchCount; ++i) {
+			grown[i] = m_batches[(m_firstBatch + i) % m_batches.size()];
+		}
+		m_batches.swap(grown);
+		m_firstBatch = 0;
+	}
+
+	m_batches[(m_firstBatch + m_batchCount) % m_batches.size()] = batch;
+	++m_batchCount;
+}
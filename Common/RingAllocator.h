@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Device independent ring of offsets for transient GPU data such as staging uploads or
+			/// per-frame constants. Allocations are grouped into batches by Submit(fenceValue) and a
+			/// batch is reclaimed once the GPU reports the fence value as completed.
+			/// </summary>
+			class RingAllocator {
+			public:
+				/// <summary>
+				/// Constructor for the RingAllocator.
+				/// </summary>
+				/// <param name="size">Size of the ring in bytes.</param>
+				explicit RingAllocator(uint64_t size);
+
+				/// <summary>
+				/// Allocates a contiguous range. Returns false if the ring is too full.
+				/// </summary>
+				bool Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+
+				/// <summary>
+				/// Closes the current batch; it will be reclaimed once fenceValue is completed.
+				/// </summary>
+				void Submit(uint64_t fenceValue);
+
+				/// <summary>
+				/// Reclaims every batch whose fence value is less than or equal to completedFenceValue.
+				/// </summary>
+				void Reclaim(uint64_t completedFenceValue);
+
+				/// <summary>
+				/// Drops every allocation, submitted or not.
+				/// </summary>
+				void Reset();
+
+				uint64_t GetSize() const { return m_size; }
+				uint64_t GetUsedSize() const { return m_used; }
+				uint64_t GetPeakUsedSize() const { return m_peakUsed; }
+				size_t GetPendingBatchCount() const { return m_batchCount; }
+
+			private:
+				struct Batch {
+					uint64_t fenceValue;
+					uint64_t end;
+					uint64_t bytes;
+				};
+
+				void PushBatch(const Batch& batch);
+
+				uint64_t m_size;
+				uint64_t m_head = 0;
+				uint64_t m_tail = 0;
+				uint64_t m_used = 0;
+				uint64_t m_peakUsed = 0;
+				uint64_t m_openBatchBytes = 0;
+
+				// Circular queue of submitted batches, grown only when full.
+				std::vector<Batch> m_batches;
+				size_t m_firstBatch = 0;
+				size_t m_batchCount = 0;
+			};
+		}
+	}
+}
@@ -1,5 +1,6 @@
 ﻿#include "pch.h"
 #include "Scene.h"
+#include <algorithm>
 
 //--------------------------------------------------------------------------------------
 // Scene::Object implementation
@@ -66,15 +67,26 @@ SonarPropagation::Graphics::Utils::Scene::Model::Model(BufferData bufferData)
 	: m_bufferData(bufferData) {}
 
 SonarPropagation::Graphics::Utils::Scene::Model::~Model() {
-	for (auto& object : m_objects) {
-		delete object;
-	}
+	// The instance pool destroys the remaining objects.
 	m_objects.clear();
 }
 
 
-void SonarPropagation::Graphics::Utils::Scene::Model::AddInstance(Object* object) {
+SonarPropagation::Graphics::Utils::Scene::Object* SonarPropagation::Graphics::Utils::Scene::Model::AddInstance(Transform transform) {
+	Object* object = m_instancePool.Create(transform);
 	m_objects.push_back(object);
+	return object;
+}
+
+void SonarPropagation::Graphics::Utils::Scene::Model::RemoveInstance(Object* object) {
+	auto it = std::find(m_objects.begin(), m_objects.end(), object);
+	if (it == m_objects.end()) {
+		return;
+	}
+
+	*it = m_objects.back();
+	m_objects.pop_back();
+	m_instancePool.Destroy(object);
 }
 
 //--------------------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 #include "ObjectType.h"
 #include "..\DXR\AccelerationStructures.h"
 #include "DirectXHelper.h"
+#include "PoolAllocator.h"
 using namespace DX;
 
 namespace SonarPropagation {
@@ -51,16 +52,32 @@ namespace SonarPropagation {
 					Model(BufferData bufferData);
 					~Model();
 
+					Model(Model&&) = default;
+					Model& operator=(Model&&) = default;
+
+					// A BLAS has no instance descriptors, so the result buffer is what tells whether it was built.
 					bool IsASInstanciated() const { 
-						return m_asBuffers.pInstanceDesc !=  nullptr 
-							&& m_asBuffers.pResult != nullptr 
+						return m_asBuffers.pResult != nullptr 
 							&& m_asBuffers.pScratch != nullptr;
-						
-						; }
-					void AddInstance(Object* object);
+					}
+
+					/// <summary>
+					/// Creates a new instance of the model inside the model's instance pool.
+					/// The returned pointer stays valid until the model is destroyed.
+					/// </summary>
+					/// <param name="transform"></param>
+					/// <returns></returns>
+					Object* AddInstance(Transform transform);
+
+					/// <summary>
+					/// Removes an instance and returns its slot to the instance pool.
+					/// </summary>
+					/// <param name="object"></param>
+					void RemoveInstance(Object* object);
 
 					BufferData m_bufferData;
 					std::vector<Object*> m_objects;
+					PoolAllocator<Object> m_instancePool;
 					SonarPropagation::Graphics::DXR::AccelerationStructureBuffers m_asBuffers;
 
 				};
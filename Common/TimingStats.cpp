@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "TimingStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+	// Nearest-rank percentile of a sorted, non-empty range.
+	double Percentile(const std::vector<float>& sorted, double fraction) {
+		size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+	void WriteCsvRow(std::ostream& stream, const char* stage, const char* timeline,
+		const SonarPropagation::Graphics::Utils::TimingSummary& summary) {
+		stream << stage << ',' << timeline << ',' << summary.count << ',' << summary.mean << ','
+			<< summary.p50 << ',' << summary.p95 << ',' << summary.p99 << ',' << summary.max << '\n';
+	}
+}
+
+const char* SonarPropagation::Graphics::Utils::GetTimingStageName(TimingStage stage)
+{
+	switch (stage) {
+	case TimingStage::Frame:					return "Frame";
+	case TimingStage::Update:					return "Update";
+	case TimingStage::AccelerationStructures:	return "AS refit";
+	case TimingStage::ShaderTable:				return "SBT";
+	case TimingStage::Dispatch:					return "Dispatch";
+	case TimingStage::Present:					return "Present";
+	case TimingStage::CpuPropagation:			return "CPU propagation";
+	case TimingStage::SceneBuild:				return "Scene build";
+	default:									return "Unknown";
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// RollingHistogram implementation
+
+SonarPropagation::Graphics::Utils::RollingHistogram::RollingHistogram(size_t capacity)
+	: m_samples(capacity)
+{
+	if (capacity == 0) {
+		throw std::invalid_argument("RollingHistogram capacity must not be zero");
+	}
+	m_sorted.reserve(capacity);
+}
+
+void SonarPropagation::Graphics::Utils::RollingHistogram::Add(double milliseconds)
+{
+	m_samples[m_next] = static_cast<float>(milliseconds);
+	m_next = (m_next + 1) % m_samples.size();
+	m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void SonarPropagation::Graphics::Utils::RollingHistogram::Clear()
+{
+	m_next = 0;
+	m_count = 0;
+}
+
+SonarPropagation::Graphics::Utils::TimingSummary SonarPropagation::Graphics::Utils::RollingHistogram::GetSummary() const
+{
+	TimingSummary summary;
+	if (m_count == 0) {
+		return summary;
+	}
+
+	// Until the window is full the samples are exactly the first m_count slots.
+	m_sorted.assign(m_samples.begin(), m_samples.begin() + m_count);
+	std::sort(m_sorted.begin(), m_sorted.end());
+
+	double total = 0.0;
+	for (float sample : m_sorted) {
+		total += sample;
+	}
+
+	summary.count = m_count;
+	summary.mean = total / m_count;
+	summary.p50 = Percentile(m_sorted, 0.50);
+	summary.p95 = Percentile(m_sorted, 0.95);
+	summary.p99 = Percentile(m_sorted, 0.99);
+	summary.max = m_sorted.back();
+	return summary;
+}
+
+//--------------------------------------------------------------------------------------
+// FrameTimingStats implementation
+
+SonarPropagation::Graphics::Utils::FrameTimingStats::FrameTimingStats(size_t windowSize)
+	: m_cpu(static_cast<size_t>(TimingStage::Count), RollingHistogram(windowSize)),
+	m_gpu(static_cast<size_t>(TimingStage::Count), RollingHistogram(windowSize))
+{
+}
+
+void SonarPropagation::Graphics::Utils::FrameTimingStats::AddCpuSample(TimingStage stage, double milliseconds)
+{
+	m_cpu[static_cast<size_t>(stage)].Add(milliseconds);
+}
+
+void SonarPropagation::Graphics::Utils::FrameTimingStats::AddGpuSample(TimingStage stage, double milliseconds)
+{
+	m_gpu[static_cast<size_t>(stage)].Add(milliseconds);
+}
+
+SonarPropagation::Graphics::Utils::TimingSummary SonarPropagation::Graphics::Utils::FrameTimingStats::GetCpuSummary(TimingStage stage) const
+{
+	return m_cpu[static_cast<size_t>(stage)].GetSummary();
+}
+
+SonarPropagation::Graphics::Utils::TimingSummary SonarPropagation::Graphics::Utils::FrameTimingStats::GetGpuSummary(TimingStage stage) const
+{
+	return m_gpu[static_cast<size_t>(stage)].GetSummary();
+}
+
+void SonarPropagation::Graphics::Utils::FrameTimingStats::Clear()
+{
+	for (auto& histogram : m_cpu) {
+		histogram.Clear();
+	}
+	for (auto& histogram : m_gpu) {
+		histogram.Clear();
+	}
+}
+
+void SonarPropagation::Graphics::Utils::FrameTimingStats::WriteCsv(std::ostream& stream) const
+{
+	stream << "stage,timeline,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(TimingStage::Count); ++i) {
+		const char* name = GetTimingStageName(static_cast<TimingStage>(i));
+
+		if (m_cpu[i].GetCount() > 0) {
+			WriteCsvRow(stream, name, "cpu", m_cpu[i].GetSummary());
+		}
+		if (m_gpu[i].GetCount() > 0) {
+			WriteCsvRow(stream, name, "gpu", m_gpu[i].GetSummary());
+		}
+	}
+}
+
+bool SonarPropagation::Graphics::Utils::FrameTimingStats::WriteCsv(const std::wstring& path) const
+{
+#if defined(_WIN32)
+	std::ofstream file(path.c_str());
+#else
+	std::ofstream file(std::string(path.begin(), path.end()).c_str());
+#endif
+	if (!file) {
+		return false;
+	}
+
+	WriteCsv(file);
+	return static_cast<bool>(file);
+}
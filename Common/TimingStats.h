@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Utils {
+
+			/// <summary>
+			/// Stages of a frame that are timed separately.
+			/// </summary>
+			enum class TimingStage : uint32_t {
+				Frame,
+				Update,
+				AccelerationStructures,
+				ShaderTable,
+				Dispatch,
+				Present,
+				CpuPropagation,
+				SceneBuild,
+				Count
+			};
+
+			const char* GetTimingStageName(TimingStage stage);
+
+			/// <summary>
+			/// Percentiles of the samples currently in a RollingHistogram, in milliseconds.
+			/// </summary>
+			struct TimingSummary {
+				size_t count = 0;
+				double mean = 0.0;
+				double p50 = 0.0;
+				double p95 = 0.0;
+				double p99 = 0.0;
+				double max = 0.0;
+			};
+
+			/// <summary>
+			/// Keeps the last capacity samples of a duration. Percentiles are exact over that window, so a
+			/// single slow frame shows up in max and a recurring stall in p99 long before it moves the mean.
+			/// </summary>
+			class RollingHistogram {
+			public:
+				explicit RollingHistogram(size_t capacity = 1024);
+
+				void Add(double milliseconds);
+				void Clear();
+
+				/// <summary>
+				/// Sorts a copy of the window; meant for once-per-frame display, not for hot loops.
+				/// </summary>
+				TimingSummary GetSummary() const;
+
+				size_t GetCount() const { return m_count; }
+
+			private:
+				std::vector<float> m_samples;
+				size_t m_next = 0;
+				size_t m_count = 0;
+				mutable std::vector<float> m_sorted;
+			};
+
+			/// <summary>
+			/// CPU and GPU rolling histograms of every TimingStage.
+			/// </summary>
+			class FrameTimingStats {
+			public:
+				explicit FrameTimingStats(size_t windowSize = 1024);
+
+				void AddCpuSample(TimingStage stage, double milliseconds);
+				void AddGpuSample(TimingStage stage, double milliseconds);
+
+				TimingSummary GetCpuSummary(TimingStage stage) const;
+				TimingSummary GetGpuSummary(TimingStage stage) const;
+
+				void Clear();
+
+				/// <summary>
+				/// Writes one row per stage and timeline that has samples:
+				/// stage,timeline,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms
+				/// </summary>
+				void WriteCsv(std::ostream& stream) const;
+
+				/// <summary>
+				/// Writes the CSV to a file. Returns false if the file cannot be written.
+				/// </summary>
+				bool WriteCsv(const std::wstring& path) const;
+
+			private:
+				std::vector<RollingHistogram> m_cpu;
+				std::vector<RollingHistogram> m_gpu;
+			};
+
+			/// <summary>
+			/// Adds the CPU time of its lifetime to a stage of a FrameTimingStats.
+			/// </summary>
+			class StageTimer {
+			public:
+				StageTimer(FrameTimingStats& stats, TimingStage stage)
+					: m_stats(stats), m_stage(stage), m_start(std::chrono::steady_clock::now()) {}
+
+				~StageTimer() {
+					std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+					m_stats.AddCpuSample(m_stage, elapsed.count());
+				}
+
+				StageTimer(const StageTimer&) = delete;
+				StageTimer& operator=(const StageTimer&) = delete;
+
+			private:
+				FrameTimingStats& m_stats;
+				TimingStage m_stage;
+				std::chrono::steady_clock::time_point m_start;
+			};
+		}
+	}
+}
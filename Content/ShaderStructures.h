@@ -34,4 +34,19 @@ namespace SonarPropagation
 	{
 		DirectX::XMFLOAT3 pos;
 	};
+
+	// Constant buffer of a heightfield, as read by Heightfield.hlsl. Pyramid level k > 0 starts at
+	// levelOffsets[k] and is levelColumns[k] nodes wide; a tile is a level tileLevel node.
+	struct HeightfieldConstants
+	{
+		uint32_t columns;
+		uint32_t rows;
+		float cellSize;
+		uint32_t tileLevel;
+		uint32_t tileColumns;
+		uint32_t padding[3];
+		uint32_t levelOffsets[8];
+		uint32_t levelColumns[8];
+		uint32_t levelRows[8];
+	};
 }
\ No newline at end of file
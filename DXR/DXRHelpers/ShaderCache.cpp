@@ -0,0 +1,419 @@
+#include "pch.h"
+#include "ShaderCache.h"
+#include "Common/Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+	const char c_fileMagic[4] = { 'S', 'P', 'S', 'C' };
+	const uint32_t c_fileVersion = 1;
+
+	/// <summary>
+	/// Two independent 64 bit hashes (FNV-1a and a multiply-xorshift), giving a 128 bit key.
+	/// </summary>
+	class KeyHasher {
+	public:
+		void Update(const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				m_fnv = (m_fnv ^ bytes[i]) * 0x100000001B3ull;
+				m_mix = (m_mix + bytes[i]) * 0x9E3779B97F4A7C15ull;
+				m_mix ^= m_mix >> 29;
+			}
+		}
+
+		void Update(const std::string& value) {
+			uint64_t size = value.size();
+			Update(&size, sizeof(size));
+			Update(value.data(), value.size());
+		}
+
+		void Update(const std::wstring& value) {
+			// Hash UTF-16/32 code units as 32 bit values so the key is the same on every platform.
+			uint64_t size = value.size();
+			Update(&size, sizeof(size));
+			for (wchar_t c : value) {
+				uint32_t unit = static_cast<uint32_t>(c);
+				Update(&unit, sizeof(unit));
+			}
+		}
+
+		std::string Hex() const {
+			char buffer[33];
+			snprintf(buffer, sizeof(buffer), "%016llx%016llx",
+				static_cast<unsigned long long>(m_fnv), static_cast<unsigned long long>(m_mix));
+			return buffer;
+		}
+
+	private:
+		uint64_t m_fnv = 0xCBF29CE484222325ull;
+		uint64_t m_mix = 0x2545F4914F6CDD1Dull;
+	};
+
+	std::string Narrow(const std::wstring& value) {
+		return std::string(value.begin(), value.end());
+	}
+
+	bool ReadFile(const std::wstring& path, std::string& contents) {
+#if defined(_WIN32)
+		std::ifstream file(path.c_str(), std::ios::binary);
+#else
+		std::ifstream file(Narrow(path).c_str(), std::ios::binary);
+#endif
+		if (!file) {
+			return false;
+		}
+
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	/// <summary>
+	/// Collapses "." and ".." components and unifies separators, so every include is visited once.
+	/// </summary>
+	std::wstring NormalizePath(const std::wstring& path) {
+		std::vector<std::wstring> parts;
+		std::wstring part;
+
+		for (size_t i = 0; i <= path.size(); ++i) {
+			if (i == path.size() || path[i] == L'/' || path[i] == L'\\') {
+				if (part == L"..") {
+					if (!parts.empty() && parts.back() != L"..") {
+						parts.pop_back();
+					}
+					else {
+						parts.push_back(part);
+					}
+				}
+				else if (!part.empty() && part != L".") {
+					parts.push_back(part);
+				}
+				part.clear();
+			}
+			else {
+				part += path[i];
+			}
+		}
+
+		std::wstring result = !path.empty() && (path[0] == L'/' || path[0] == L'\\') ? L"/" : L"";
+		for (size_t i = 0; i < parts.size(); ++i) {
+			if (i > 0) {
+				result += L'/';
+			}
+			result += parts[i];
+		}
+
+		return result;
+	}
+
+	std::wstring DirectoryOf(const std::wstring& path) {
+		size_t separator = path.find_last_of(L"/\\");
+		return separator == std::wstring::npos ? L"" : path.substr(0, separator + 1);
+	}
+
+	/// <summary>
+	/// Returns the quoted or angled names of the #include directives of a source file.
+	/// Commented out includes are skipped; includes inside #if blocks are kept, which can only
+	/// cause an unnecessary cache miss.
+	/// </summary>
+	std::vector<std::wstring> FindIncludes(const std::string& source) {
+		std::vector<std::wstring> includes;
+		std::istringstream lines(source);
+		std::string line;
+
+		while (std::getline(lines, line)) {
+			size_t position = line.find_first_not_of(" \t");
+			if (position == std::string::npos || line[position] != '#') {
+				continue;
+			}
+
+			position = line.find_first_not_of(" \t", position + 1);
+			if (position == std::string::npos || line.compare(position, 7, "include") != 0) {
+				continue;
+			}
+
+			size_t open = line.find_first_of("\"<", position + 7);
+			if (open == std::string::npos) {
+				continue;
+			}
+
+			size_t close = line.find_first_of(line[open] == '"' ? "\"" : ">", open + 1);
+			if (close == std::string::npos) {
+				continue;
+			}
+
+			std::string name = line.substr(open + 1, close - open - 1);
+			includes.push_back(std::wstring(name.begin(), name.end()));
+		}
+
+		return includes;
+	}
+
+	void HashSourceTree(const std::wstring& path, std::set<std::wstring>& visited, KeyHasher& hasher) {
+		std::wstring normalized = NormalizePath(path);
+		if (!visited.insert(normalized).second) {
+			return;
+		}
+
+		hasher.Update(normalized);
+
+		std::string contents;
+		if (!ReadFile(normalized, contents)) {
+			// The compiler will report the missing file; hashing the fact keeps the key stable.
+			hasher.Update(std::string("<missing>"));
+			return;
+		}
+
+		hasher.Update(contents);
+
+		std::wstring directory = DirectoryOf(normalized);
+		for (const auto& include : FindIncludes(contents)) {
+			HashSourceTree(directory + include, visited, hasher);
+		}
+	}
+
+	void CreateDirectoryIfMissing(const std::wstring& directory) {
+#if defined(_WIN32)
+		CreateDirectoryW(directory.c_str(), nullptr);
+#else
+		mkdir(Narrow(directory).c_str(), 0755);
+#endif
+	}
+
+	std::wstring EntryPath(const std::wstring& directory, const std::string& key, const std::wstring& suffix) {
+		return directory + L"/" + std::wstring(key.begin(), key.end()) + suffix;
+	}
+}
+
+SonarPropagation::Graphics::Common::ShaderCache::ShaderCache(const std::wstring& directory, CompileFunction compile)
+	: m_directory(directory), m_compile(compile)
+{
+	if (!m_directory.empty()) {
+		CreateDirectoryIfMissing(m_directory);
+	}
+}
+
+std::string SonarPropagation::Graphics::Common::ShaderCache::ComputeKey(const ShaderCompileRequest& request)
+{
+	KeyHasher hasher;
+
+	std::set<std::wstring> visited;
+	HashSourceTree(request.fileName, visited, hasher);
+
+	hasher.Update(request.entryPoint);
+	hasher.Update(request.profile);
+
+	uint64_t count = request.arguments.size();
+	hasher.Update(&count, sizeof(count));
+	for (const auto& argument : request.arguments) {
+		hasher.Update(argument);
+	}
+
+	count = request.defines.size();
+	hasher.Update(&count, sizeof(count));
+	for (const auto& define : request.defines) {
+		hasher.Update(define.first);
+		hasher.Update(define.second);
+	}
+
+	return hasher.Hex();
+}
+
+std::string SonarPropagation::Graphics::Common::ShaderCache::HashBytecode(const void* data, size_t size)
+{
+	KeyHasher hasher;
+	hasher.Update(data, size);
+	return hasher.Hex();
+}
+
+SonarPropagation::Graphics::Common::ShaderBytecodePtr SonarPropagation::Graphics::Common::ShaderCache::GetOrCompile(const ShaderCompileRequest& request)
+{
+	SONAR_PROFILE_SCOPE("ShaderCache::GetOrCompile");
+	const std::string key = ComputeKey(request);
+
+	std::promise<ShaderBytecodePtr> promise;
+	std::shared_future<ShaderBytecodePtr> future;
+	bool owner = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto entry = m_entries.find(key);
+		if (entry != m_entries.end()) {
+			++m_stats.memoryHits;
+			future = entry->second;
+		}
+		else {
+			future = promise.get_future().share();
+			m_entries[key] = future;
+			owner = true;
+		}
+	}
+
+	// Another thread owns this key; wait for its result (or its exception).
+	if (!owner) {
+		return future.get();
+	}
+
+	try {
+		ShaderBytecode bytecode;
+
+		if (LoadFromDisk(key, bytecode)) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_stats.diskHits;
+		}
+		else {
+			bytecode = m_compile(request);
+			StoreToDisk(key, bytecode);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_stats.compilations;
+		}
+
+		ShaderBytecodePtr result = std::make_shared<const ShaderBytecode>(std::move(bytecode));
+		promise.set_value(result);
+		return result;
+	}
+	catch (...) {
+		{
+			// Failed compilations are not cached, so fixing the shader and retrying works.
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_entries.erase(key);
+		}
+
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+}
+
+std::vector<SonarPropagation::Graphics::Common::ShaderBytecodePtr> SonarPropagation::Graphics::Common::ShaderCache::GetOrCompileAll(const std::vector<ShaderCompileRequest>& requests)
+{
+	std::vector<std::future<ShaderBytecodePtr>> tasks;
+	tasks.reserve(requests.size());
+
+	for (const auto& request : requests) {
+		tasks.push_back(std::async(std::launch::async, [this, &request]() {
+			return GetOrCompile(request);
+			}));
+	}
+
+	std::vector<ShaderBytecodePtr> results;
+	results.reserve(tasks.size());
+
+	// Wait for every task before rethrowing, so none outlives the requests it references.
+	std::exception_ptr error;
+	for (auto& task : tasks) {
+		try {
+			results.push_back(task.get());
+		}
+		catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+			results.push_back(nullptr);
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	return results;
+}
+
+void SonarPropagation::Graphics::Common::ShaderCache::ClearMemory()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+SonarPropagation::Graphics::Common::ShaderCacheStats SonarPropagation::Graphics::Common::ShaderCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+bool SonarPropagation::Graphics::Common::ShaderCache::LoadFromDisk(const std::string& key, ShaderBytecode& bytecode) const
+{
+	if (m_directory.empty()) {
+		return false;
+	}
+
+	std::string contents;
+	if (!ReadFile(EntryPath(m_directory, key, L".dxil"), contents)) {
+		return false;
+	}
+
+	const size_t headerSize = sizeof(c_fileMagic) + sizeof(uint32_t) + sizeof(uint64_t);
+	if (contents.size() < headerSize || memcmp(contents.data(), c_fileMagic, sizeof(c_fileMagic)) != 0) {
+		return false;
+	}
+
+	uint32_t version;
+	uint64_t size;
+	memcpy(&version, contents.data() + sizeof(c_fileMagic), sizeof(version));
+	memcpy(&size, contents.data() + sizeof(c_fileMagic) + sizeof(version), sizeof(size));
+
+	// Truncated or outdated entries are treated as misses and get overwritten.
+	if (version != c_fileVersion || contents.size() - headerSize != size) {
+		return false;
+	}
+
+	bytecode.assign(contents.begin() + headerSize, contents.end());
+	return true;
+}
+
+void SonarPropagation::Graphics::Common::ShaderCache::StoreToDisk(const std::string& key, const ShaderBytecode& bytecode) const
+{
+	if (m_directory.empty()) {
+		return;
+	}
+
+	// Write to a unique temporary file first, so readers never see a partial entry.
+	std::wostringstream suffix;
+	suffix << L"." << std::hash<std::thread::id>()(std::this_thread::get_id()) << L".tmp";
+
+	const std::wstring temporaryPath = EntryPath(m_directory, key, suffix.str());
+	const std::wstring finalPath = EntryPath(m_directory, key, L".dxil");
+
+	{
+#if defined(_WIN32)
+		std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+#else
+		std::ofstream file(Narrow(temporaryPath).c_str(), std::ios::binary | std::ios::trunc);
+#endif
+		if (!file) {
+			return;
+		}
+
+		uint64_t size = bytecode.size();
+		file.write(c_fileMagic, sizeof(c_fileMagic));
+		file.write(reinterpret_cast<const char*>(&c_fileVersion), sizeof(c_fileVersion));
+		file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		file.write(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
+	}
+
+#if defined(_WIN32)
+	if (!MoveFileExW(temporaryPath.c_str(), finalPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileW(temporaryPath.c_str());
+	}
+#else
+	if (std::rename(Narrow(temporaryPath).c_str(), Narrow(finalPath).c_str()) != 0) {
+		std::remove(Narrow(temporaryPath).c_str());
+	}
+#endif
+}
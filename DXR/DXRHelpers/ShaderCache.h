@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Common {
+
+			/// <summary>
+			/// Everything that determines the DXIL produced for a shader library.
+			/// </summary>
+			struct ShaderCompileRequest {
+				std::wstring fileName;
+				std::wstring entryPoint;
+				std::wstring profile = L"lib_6_3";
+				std::vector<std::wstring> arguments = { L"-Zi", L"-Qembed_debug", L"-Od" };
+				std::vector<std::pair<std::wstring, std::wstring>> defines;
+			};
+
+			typedef std::vector<uint8_t> ShaderBytecode;
+			typedef std::shared_ptr<const ShaderBytecode> ShaderBytecodePtr;
+
+			/// <summary>
+			/// Hit and miss counters of a ShaderCache.
+			/// </summary>
+			struct ShaderCacheStats {
+				uint64_t memoryHits = 0;
+				uint64_t diskHits = 0;
+				uint64_t compilations = 0;
+			};
+
+			/// <summary>
+			/// Content addressed cache of compiled shader libraries.
+			/// The key hashes the source file, every file it transitively #includes, the defines,
+			/// the profile, the entry point and the compiler arguments, so editing any of them
+			/// misses the cache while an unchanged shader is served from memory or from disk.
+			/// The cache itself does not know about DXC: compilation is a callback, which keeps the
+			/// hashing and storage testable on any platform.
+			/// </summary>
+			class ShaderCache {
+			public:
+				typedef std::function<ShaderBytecode(const ShaderCompileRequest&)> CompileFunction;
+
+				/// <summary>
+				/// Constructor for the ShaderCache.
+				/// </summary>
+				/// <param name="directory">Directory for the on-disk cache; empty keeps the cache in memory only.</param>
+				/// <param name="compile">Called for every cache miss. May run on several threads at once.</param>
+				ShaderCache(const std::wstring& directory, CompileFunction compile);
+
+				/// <summary>
+				/// Returns the bytecode for the request, compiling it only on a cache miss.
+				/// Concurrent requests for the same key wait for a single compilation.
+				/// </summary>
+				ShaderBytecodePtr GetOrCompile(const ShaderCompileRequest& request);
+
+				/// <summary>
+				/// Compiles independent libraries in parallel. The result order matches the requests.
+				/// </summary>
+				std::vector<ShaderBytecodePtr> GetOrCompileAll(const std::vector<ShaderCompileRequest>& requests);
+
+				/// <summary>
+				/// Computes the cache key of a request as a 32 character hex string.
+				/// </summary>
+				static std::string ComputeKey(const ShaderCompileRequest& request);
+
+				/// <summary>
+				/// Hashes compiled bytecode with the same 128 bit hash, as a 32 character hex string.
+				/// </summary>
+				static std::string HashBytecode(const void* data, size_t size);
+
+				/// <summary>
+				/// Drops the in-memory entries. Disk entries are kept.
+				/// </summary>
+				void ClearMemory();
+
+				ShaderCacheStats GetStats() const;
+
+			private:
+				bool LoadFromDisk(const std::string& key, ShaderBytecode& bytecode) const;
+				void StoreToDisk(const std::string& key, const ShaderBytecode& bytecode) const;
+
+				std::wstring m_directory;
+				CompileFunction m_compile;
+
+				mutable std::mutex m_mutex;
+				std::map<std::string, std::shared_future<ShaderBytecodePtr>> m_entries;
+				ShaderCacheStats m_stats;
+			};
+		}
+	}
+}
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "ShaderLibraryManifest.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+	// Manifests are generated from MSBuild item metadata and only ever contain ASCII.
+	std::wstring Widen(const std::string& value) {
+		return std::wstring(value.begin(), value.end());
+	}
+
+	std::string Narrow(const std::wstring& value) {
+		std::string result;
+		for (wchar_t c : value) {
+			result.push_back(static_cast<char>(c));
+		}
+		return result;
+	}
+
+	std::vector<std::wstring> SplitList(const std::string& value) {
+		std::vector<std::wstring> items;
+		std::stringstream stream(value);
+		std::string item;
+		while (std::getline(stream, item, ';')) {
+			if (!item.empty()) {
+				items.push_back(Widen(item));
+			}
+		}
+		return items;
+	}
+
+	uint32_t ParseSize(const std::string& value, size_t line) {
+		try {
+			size_t end = 0;
+			unsigned long size = std::stoul(value, &end);
+			if (end == value.size()) {
+				return static_cast<uint32_t>(size);
+			}
+		}
+		catch (const std::exception&) {
+		}
+		throw std::runtime_error("Shader library manifest: invalid size '" + value + "' on line " + std::to_string(line));
+	}
+
+	// Paths in the manifest are relative; lookups compare the file name only, case insensitively.
+	std::wstring FileNameKey(const std::wstring& path) {
+		size_t separator = path.find_last_of(L"\\/");
+		std::wstring name = separator == std::wstring::npos ? path : path.substr(separator + 1);
+		std::transform(name.begin(), name.end(), name.begin(), towlower);
+		return name;
+	}
+}
+
+bool SonarPropagation::Graphics::Common::ShaderLibraryInfo::ExportsAll(const std::vector<std::wstring>& names) const
+{
+	for (const auto& name : names) {
+		if (std::find(exports.begin(), exports.end(), name) == exports.end()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+SonarPropagation::Graphics::Common::ShaderLibraryManifest SonarPropagation::Graphics::Common::ShaderLibraryManifest::Parse(std::istream& stream)
+{
+	ShaderLibraryManifest manifest;
+	bool hasVersion = false;
+
+	std::string text;
+	size_t lineNumber = 0;
+
+	while (std::getline(stream, text)) {
+		++lineNumber;
+
+		std::istringstream line(text);
+		std::string keyword;
+		if (!(line >> keyword) || keyword[0] == '#') {
+			continue;
+		}
+
+		if (keyword == "format") {
+			uint32_t version = 0;
+			if (!(line >> version) || version != c_shaderLibraryFormatVersion) {
+				throw std::runtime_error("Shader library manifest: unsupported format version on line " + std::to_string(lineNumber));
+			}
+			hasVersion = true;
+		}
+		else if (keyword == "library") {
+			if (!hasVersion) {
+				throw std::runtime_error("Shader library manifest: missing format version");
+			}
+
+			ShaderLibraryInfo library;
+			std::string blobFile;
+			if (!(line >> blobFile)) {
+				throw std::runtime_error("Shader library manifest: missing blob name on line " + std::to_string(lineNumber));
+			}
+			library.blobFile = Widen(blobFile);
+
+			std::string field;
+			while (line >> field) {
+				size_t equals = field.find('=');
+				if (equals == std::string::npos) {
+					throw std::runtime_error("Shader library manifest: malformed field '" + field + "' on line " + std::to_string(lineNumber));
+				}
+
+				std::string key = field.substr(0, equals);
+				std::string value = field.substr(equals + 1);
+
+				if (key == "source") {
+					library.sourceFile = Widen(value);
+				}
+				else if (key == "exports") {
+					library.exports = SplitList(value);
+				}
+				else if (key == "payload") {
+					library.payloadSize = ParseSize(value, lineNumber);
+				}
+				else if (key == "attributes") {
+					library.attributeSize = ParseSize(value, lineNumber);
+				}
+				// Unknown fields are ignored so newer build scripts can add metadata within a format version.
+			}
+
+			if (library.sourceFile.empty() || library.exports.empty()) {
+				throw std::runtime_error("Shader library manifest: library '" + blobFile + "' has no source or exports");
+			}
+
+			manifest.m_libraries.push_back(std::move(library));
+		}
+		else {
+			throw std::runtime_error("Shader library manifest: unknown keyword '" + keyword + "' on line " + std::to_string(lineNumber));
+		}
+	}
+
+	if (!hasVersion) {
+		throw std::runtime_error("Shader library manifest: missing format version");
+	}
+
+	return manifest;
+}
+
+SonarPropagation::Graphics::Common::ShaderLibraryManifest SonarPropagation::Graphics::Common::ShaderLibraryManifest::Load(const std::wstring& path)
+{
+#if defined(_WIN32)
+	std::ifstream file(path);
+#else
+	std::ifstream file(Narrow(path));
+#endif
+	if (!file) {
+		throw std::runtime_error("Shader library manifest: cannot open " + Narrow(path));
+	}
+	return Parse(file);
+}
+
+const SonarPropagation::Graphics::Common::ShaderLibraryInfo* SonarPropagation::Graphics::Common::ShaderLibraryManifest::Find(const std::wstring& sourceFile) const
+{
+	std::wstring key = FileNameKey(sourceFile);
+	for (const auto& library : m_libraries) {
+		if (FileNameKey(library.sourceFile) == key) {
+			return &library;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Common {
+
+			/// <summary>
+			/// Version of the manifest written by Shaders/ShaderLibraries.targets.
+			/// Must match SonarShaderLibraryFormatVersion there.
+			/// </summary>
+			const uint32_t c_shaderLibraryFormatVersion = 1;
+
+			/// <summary>
+			/// Reflection data of one precompiled shader library.
+			/// </summary>
+			struct ShaderLibraryInfo {
+				std::wstring blobFile;
+				std::wstring sourceFile;
+				std::vector<std::wstring> exports;
+				uint32_t payloadSize = 0;
+				uint32_t attributeSize = 0;
+
+				/// <summary>
+				/// True if every name in the list is exported by the library.
+				/// </summary>
+				bool ExportsAll(const std::vector<std::wstring>& names) const;
+			};
+
+			/// <summary>
+			/// Describes the libraries produced by the offline shader build.
+			/// The file is line based: a "format N" header followed by one line per library,
+			/// "library Blob.dxil source=Blob.hlsl exports=A;B payload=16 attributes=8".
+			/// </summary>
+			class ShaderLibraryManifest {
+			public:
+				/// <summary>
+				/// Parses a manifest. Throws std::runtime_error on malformed input or a format version mismatch.
+				/// </summary>
+				static ShaderLibraryManifest Parse(std::istream& stream);
+
+				/// <summary>
+				/// Loads and parses a manifest file. Throws std::runtime_error if it cannot be read.
+				/// </summary>
+				static ShaderLibraryManifest Load(const std::wstring& path);
+
+				/// <summary>
+				/// Finds the library compiled from the given source file, or nullptr.
+				/// </summary>
+				const ShaderLibraryInfo* Find(const std::wstring& sourceFile) const;
+
+				const std::vector<ShaderLibraryInfo>& GetLibraries() const { return m_libraries; }
+
+			private:
+				std::vector<ShaderLibraryInfo> m_libraries;
+			};
+		}
+	}
+}
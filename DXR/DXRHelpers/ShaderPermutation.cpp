@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "ShaderPermutation.h"
+#include "Common/Profiler.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+	std::wstring FormatFloat(float value) {
+		std::wostringstream stream;
+		stream.precision(9);
+		stream << value;
+
+		// HLSL needs a decimal point to treat the literal as floating point.
+		std::wstring text = stream.str();
+		if (text.find_first_of(L".eE") == std::wstring::npos) {
+			text += L".0";
+		}
+		return text;
+	}
+}
+
+std::vector<std::pair<std::wstring, std::wstring>> SonarPropagation::Graphics::Common::SonarKernelPermutation::GetDefines() const
+{
+	return {
+		{ L"SONAR_STEP_SIZE", FormatFloat(stepSize) },
+		{ L"SONAR_MAX_STEPS", std::to_wstring(maxSteps) },
+		{ L"SONAR_MAX_DEPTH", FormatFloat(maxDepth) },
+		{ L"SONAR_BOUNDARY_OFFSET", FormatFloat(boundaryOffset) },
+		{ L"SONAR_RK_TABLEAU", std::to_wstring(static_cast<uint32_t>(tableau)) },
+		{ L"SONAR_SSP_MODEL", std::to_wstring(static_cast<uint32_t>(soundSpeedModel)) },
+		{ L"SONAR_MAX_BOUNCES", std::to_wstring(maxBounces) },
+		{ L"SONAR_PRECISION", std::to_wstring(static_cast<uint32_t>(precision)) },
+	};
+}
+
+std::wstring SonarPropagation::Graphics::Common::SonarKernelPermutation::GetKey() const
+{
+	static const wchar_t* tableaus[] = { L"euler", L"midpoint", L"rk4" };
+	static const wchar_t* models[] = { L"mackenzie", L"compact" };
+
+	std::wostringstream key;
+	key << tableaus[static_cast<uint32_t>(tableau)]
+		<< L"_" << models[static_cast<uint32_t>(soundSpeedModel)]
+		<< L"_h" << FormatFloat(stepSize)
+		<< L"_n" << maxSteps
+		<< L"_d" << FormatFloat(maxDepth)
+		<< L"_o" << FormatFloat(boundaryOffset)
+		<< L"_b" << maxBounces
+		<< (precision == KernelPrecision::Half ? L"_fp16" : L"_fp32");
+	return key.str();
+}
+
+SonarPropagation::Graphics::Common::ShaderPermutationLibrary::ShaderPermutationLibrary(ShaderCache& cache,
+	const std::vector<ShaderCompileRequest>& sources)
+	: m_cache(cache), m_sources(sources)
+{
+}
+
+std::vector<SonarPropagation::Graphics::Common::ShaderCompileRequest> SonarPropagation::Graphics::Common::ShaderPermutationLibrary::GetRequests(
+	const SonarKernelPermutation& permutation) const
+{
+	const auto defines = permutation.GetDefines();
+
+	std::vector<ShaderCompileRequest> requests = m_sources;
+	for (auto& request : requests) {
+		request.defines.insert(request.defines.end(), defines.begin(), defines.end());
+	}
+	return requests;
+}
+
+void SonarPropagation::Graphics::Common::ShaderPermutationLibrary::Precompile(const std::vector<SonarKernelPermutation>& permutations)
+{
+	SONAR_PROFILE_SCOPE("PrecompilePermutations");
+	std::vector<std::wstring> keys;
+	std::vector<ShaderCompileRequest> requests;
+
+	for (const auto& permutation : permutations) {
+		std::wstring key = permutation.GetKey();
+		if (m_libraries.count(key) || std::find(keys.begin(), keys.end(), key) != keys.end()) {
+			continue;
+		}
+
+		keys.push_back(key);
+
+		const auto permutationRequests = GetRequests(permutation);
+		requests.insert(requests.end(), permutationRequests.begin(), permutationRequests.end());
+	}
+
+	if (requests.empty()) {
+		return;
+	}
+
+	std::vector<ShaderBytecodePtr> bytecodes = m_cache.GetOrCompileAll(requests);
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		m_libraries[keys[i]].assign(
+			bytecodes.begin() + i * m_sources.size(),
+			bytecodes.begin() + (i + 1) * m_sources.size());
+	}
+}
+
+const std::vector<SonarPropagation::Graphics::Common::ShaderBytecodePtr>& SonarPropagation::Graphics::Common::ShaderPermutationLibrary::Get(
+	const SonarKernelPermutation& permutation)
+{
+	std::wstring key = permutation.GetKey();
+
+	auto entry = m_libraries.find(key);
+	if (entry == m_libraries.end()) {
+		Precompile({ permutation });
+		entry = m_libraries.find(key);
+	}
+
+	return entry->second;
+}
+
+bool SonarPropagation::Graphics::Common::ShaderPermutationLibrary::Contains(const SonarKernelPermutation& permutation) const
+{
+	return m_libraries.count(permutation.GetKey()) > 0;
+}
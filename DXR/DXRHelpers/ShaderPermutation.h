@@ -0,0 +1,107 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ShaderCache.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace Common {
+
+			/// <summary>
+			/// Runge-Kutta tableaus available to the ray marching integrator (SONAR_RK_TABLEAU).
+			/// </summary>
+			enum class IntegratorTableau : uint32_t {
+				Euler = 0,
+				Midpoint = 1,
+				RungeKutta4 = 2
+			};
+
+			/// <summary>
+			/// Sound speed profile models (SONAR_SSP_MODEL).
+			/// </summary>
+			enum class SoundSpeedModel : uint32_t {
+				Mackenzie = 0,
+				CompactMackenzie = 1
+			};
+
+			/// <summary>
+			/// Precision of the integrator state (SONAR_PRECISION).
+			/// </summary>
+			enum class KernelPrecision : uint32_t {
+				Full = 0,
+				Half = 1
+			};
+
+			/// <summary>
+			/// Compile-time configuration of the sonar kernels. Each distinct value set is compiled
+			/// into its own set of libraries, so the integrator runs with folded constants.
+			/// The defaults match Shaders/SonarShaders/SonarConfig.hlsl.
+			/// </summary>
+			struct SonarKernelPermutation {
+				float stepSize = 1.0f;
+				uint32_t maxSteps = 100000;
+				float maxDepth = 6800.0f;
+				float boundaryOffset = 10.0f;
+				IntegratorTableau tableau = IntegratorTableau::RungeKutta4;
+				SoundSpeedModel soundSpeedModel = SoundSpeedModel::Mackenzie;
+				uint32_t maxBounces = 8;
+				KernelPrecision precision = KernelPrecision::Full;
+
+				/// <summary>
+				/// Defines passed to DXC for this permutation.
+				/// </summary>
+				std::vector<std::pair<std::wstring, std::wstring>> GetDefines() const;
+
+				/// <summary>
+				/// Readable key identifying the permutation, e.g. "rk4_mackenzie_h1.0_n100000_d6800.0_o10.0_b8_fp32".
+				/// </summary>
+				std::wstring GetKey() const;
+			};
+
+			/// <summary>
+			/// Compiled libraries of a set of shader files for every requested permutation, looked up by
+			/// permutation key. Compilation goes through the shader cache; permutations requested
+			/// together are compiled in parallel. Holds bytecode only, so it builds without DXC.
+			/// </summary>
+			class ShaderPermutationLibrary {
+			public:
+				/// <summary>
+				/// Constructor for the ShaderPermutationLibrary.
+				/// </summary>
+				/// <param name="cache">Cache compiling the libraries; must outlive the permutation library.</param>
+				/// <param name="sources">Shader libraries compiled for each permutation. Their defines are
+				/// extended with the permutation defines.</param>
+				ShaderPermutationLibrary(ShaderCache& cache, const std::vector<ShaderCompileRequest>& sources);
+
+				/// <summary>
+				/// Compiles every permutation not compiled yet, all in one GetOrCompileAll batch.
+				/// </summary>
+				void Precompile(const std::vector<SonarKernelPermutation>& permutations);
+
+				/// <summary>
+				/// Returns the libraries of a permutation, in the order of the sources.
+				/// Compiles the permutation if it was not precompiled.
+				/// </summary>
+				const std::vector<ShaderBytecodePtr>& Get(const SonarKernelPermutation& permutation);
+
+				/// <summary>
+				/// Builds the compile requests of a permutation, in the order of the sources.
+				/// </summary>
+				std::vector<ShaderCompileRequest> GetRequests(const SonarKernelPermutation& permutation) const;
+
+				bool Contains(const SonarKernelPermutation& permutation) const;
+
+				size_t GetPermutationCount() const { return m_libraries.size(); }
+
+			private:
+				ShaderCache& m_cache;
+				std::vector<ShaderCompileRequest> m_sources;
+				std::map<std::wstring, std::vector<ShaderBytecodePtr>> m_libraries;
+			};
+		}
+	}
+}
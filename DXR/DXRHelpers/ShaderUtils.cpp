@@ -1,45 +1,101 @@
 #include "pch.h"
 #include "ShaderUtils.h"
+#include "Common/Profiler.h"
 
+#include <fstream>
+#include <iterator>
 
-IDxcBlob* SonarPropagation::Graphics::Common::CompileShader(LPCWSTR fileName) {
-	static IDxcCompiler* pCompiler = nullptr;
-	static IDxcLibrary* pLibrary = nullptr;
-	static IDxcIncludeHandler* dxcIncludeHandler;
 
-	HRESULT hr;
-	UINT32 code(0);
-	IDxcBlobEncoding* pShaderText(nullptr);
+namespace {
+	/// <summary>
+	/// DXC objects are not thread safe, so every compiling thread gets its own set.
+	/// </summary>
+	struct DxcContext {
+		ComPtr<IDxcCompiler> compiler;
+		ComPtr<IDxcLibrary> library;
+		ComPtr<IDxcIncludeHandler> includeHandler;
 
-	// Initialize the DXC compiler and compiler helper
-	if (!pCompiler)
-	{
-		DX::ThrowIfFailed(DxcCreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), (void**)&pCompiler));
-		DX::ThrowIfFailed(DxcCreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), (void**)&pLibrary));
-		DX::ThrowIfFailed(pLibrary->CreateIncludeHandler(&dxcIncludeHandler));
+		DxcContext() {
+			DX::ThrowIfFailed(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler)));
+			DX::ThrowIfFailed(DxcCreateInstance(CLSID_DxcLibrary, IID_PPV_ARGS(&library)));
+			DX::ThrowIfFailed(library->CreateIncludeHandler(&includeHandler));
+		}
+	};
+
+	DxcContext& GetDxcContext() {
+		thread_local DxcContext context;
+		return context;
 	}
 
-	TCHAR pwd[MAX_PATH];
-	GetCurrentDirectory(MAX_PATH, pwd);
+	// Layout folder of the offline built libraries, relative to the package install folder.
+	const wchar_t* c_shaderLibraryDirectory = L"ShaderLibraries\\";
+
+	/// <summary>
+	/// Reads the manifest once; null if the offline build did not run for this package.
+	/// </summary>
+	const SonarPropagation::Graphics::Common::ShaderLibraryManifest* GetShaderLibraryManifest() {
+		static std::unique_ptr<SonarPropagation::Graphics::Common::ShaderLibraryManifest> manifest = []() {
+			std::unique_ptr<SonarPropagation::Graphics::Common::ShaderLibraryManifest> result;
+			try {
+				result.reset(new SonarPropagation::Graphics::Common::ShaderLibraryManifest(
+					SonarPropagation::Graphics::Common::ShaderLibraryManifest::Load(std::wstring(c_shaderLibraryDirectory) + L"ShaderLibraries.manifest")));
+			}
+			catch (const std::runtime_error& error) {
+				OutputDebugStringA(error.what());
+				OutputDebugStringA("\n");
+			}
+			return result;
+		}();
+		return manifest.get();
+	}
 
+	bool ReadBlobFile(const std::wstring& path, SonarPropagation::Graphics::Common::ShaderBytecode& bytecode) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		bytecode.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return !bytecode.empty();
+	}
 
-	hr = pLibrary->CreateBlobFromFile(fileName, &code, &pShaderText);
-	//Utils::Validate(hr, L"Error: failed to create blob from shader file!");
+	std::wstring GetShaderCacheDirectory() {
+		// The package install folder is read-only; compiled libraries go to the local cache folder.
+		return std::wstring(Windows::Storage::ApplicationData::Current->LocalCacheFolder->Path->Data()) + L"\\ShaderCache";
+	}
+}
 
+SonarPropagation::Graphics::Common::ShaderBytecode SonarPropagation::Graphics::Common::CompileShaderWithDxc(const ShaderCompileRequest& request) {
+	SONAR_PROFILE_SCOPE("CompileShaderWithDxc");
+	DxcContext& dxc = GetDxcContext();
 
-	// Compile
-	IDxcOperationResult* pResult;
-	std::vector<LPCWSTR> args = { L"-Zi",L"-Qembed_debug", L"-Od" };
+	HRESULT hr;
+	UINT32 code(0);
+	ComPtr<IDxcBlobEncoding> pShaderText;
 
-	DX::ThrowIfFailed(pCompiler->Compile(pShaderText, fileName, L"", L"lib_6_3", args.data(), args.size(), nullptr, 0,
-		dxcIncludeHandler, &pResult));
+	DX::ThrowIfFailed(dxc.library->CreateBlobFromFile(request.fileName.c_str(), &code, &pShaderText));
+
+	std::vector<LPCWSTR> args;
+	for (const auto& argument : request.arguments) {
+		args.push_back(argument.c_str());
+	}
+
+	std::vector<DxcDefine> defines;
+	for (const auto& define : request.defines) {
+		defines.push_back({ define.first.c_str(), define.second.c_str() });
+	}
+
+	// Compile
+	ComPtr<IDxcOperationResult> pResult;
+	DX::ThrowIfFailed(dxc.compiler->Compile(pShaderText.Get(), request.fileName.c_str(), request.entryPoint.c_str(), request.profile.c_str(),
+		args.data(), static_cast<UINT32>(args.size()), defines.data(), static_cast<UINT32>(defines.size()),
+		dxc.includeHandler.Get(), &pResult));
 
 	// Verify the result
 	HRESULT resultCode;
 	DX::ThrowIfFailed(pResult->GetStatus(&resultCode));
 	if (FAILED(resultCode))
 	{
-		IDxcBlobEncoding* pError;
+		ComPtr<IDxcBlobEncoding> pError;
 		hr = pResult->GetErrorBuffer(&pError);
 		if (FAILED(hr))
 		{
@@ -54,14 +110,104 @@ IDxcBlob* SonarPropagation::Graphics::Common::CompileShader(LPCWSTR fileName) {
 		std::string errorMsg = "Shader Compiler Error:\n";
 		errorMsg.append(infoLog.data());
 
-		throw std::logic_error("Failed compile shader");
+		throw std::logic_error(errorMsg);
 	}
 
-	IDxcBlob* pBlob;
+	ComPtr<IDxcBlob> pBlob;
 	DX::ThrowIfFailed(pResult->GetResult(&pBlob));
+
+	const uint8_t* data = static_cast<const uint8_t*>(pBlob->GetBufferPointer());
+	return ShaderBytecode(data, data + pBlob->GetBufferSize());
+}
+
+SonarPropagation::Graphics::Common::ShaderCache& SonarPropagation::Graphics::Common::GetShaderCache() {
+	static ShaderCache cache(GetShaderCacheDirectory(), CompileShaderWithDxc);
+	return cache;
+}
+
+ComPtr<IDxcBlob> SonarPropagation::Graphics::Common::CreateShaderBlob(const ShaderBytecode& bytecode) {
+	ComPtr<IDxcBlobEncoding> pBlob;
+	DX::ThrowIfFailed(GetDxcContext().library->CreateBlobWithEncodingOnHeapCopy(
+		bytecode.data(), static_cast<UINT32>(bytecode.size()), 0, &pBlob));
 	return pBlob;
 }
 
+IDxcBlob* SonarPropagation::Graphics::Common::CompileShader(const ShaderCompileRequest& request) {
+	ShaderBytecodePtr bytecode = GetShaderCache().GetOrCompile(request);
+	return CreateShaderBlob(*bytecode).Detach();
+}
+
+IDxcBlob* SonarPropagation::Graphics::Common::CompileShader(LPCWSTR fileName) {
+	ShaderCompileRequest request;
+	request.fileName = fileName;
+	return CompileShader(request);
+}
+
+std::vector<ComPtr<IDxcBlob>> SonarPropagation::Graphics::Common::CompileShaders(const std::vector<ShaderCompileRequest>& requests) {
+	std::vector<ShaderBytecodePtr> bytecodes = GetShaderCache().GetOrCompileAll(requests);
+
+	std::vector<ComPtr<IDxcBlob>> blobs;
+	for (const auto& bytecode : bytecodes) {
+		blobs.push_back(CreateShaderBlob(*bytecode));
+	}
+
+	return blobs;
+}
+
+std::vector<ComPtr<IDxcBlob>> SonarPropagation::Graphics::Common::LoadShaderLibraries(const std::vector<ShaderLibraryRequest>& libraries,
+	UINT maxPayloadSize, UINT maxAttributeSize) {
+	SONAR_PROFILE_SCOPE("LoadShaderLibraries");
+	const ShaderLibraryManifest* manifest = GetShaderLibraryManifest();
+
+	std::vector<ComPtr<IDxcBlob>> blobs(libraries.size());
+	std::vector<ShaderCompileRequest> fallbackRequests;
+	std::vector<size_t> fallbackIndices;
+
+	for (size_t i = 0; i < libraries.size(); ++i) {
+		const ShaderLibraryRequest& library = libraries[i];
+		const ShaderLibraryInfo* info = manifest ? manifest->Find(library.source.fileName) : nullptr;
+
+		std::string rejection;
+		ShaderBytecode bytecode;
+
+		if (!info) {
+			rejection = "not in the shader library manifest";
+		}
+		else if (!info->ExportsAll(library.exports)) {
+			rejection = "missing a requested export";
+		}
+		else if (info->payloadSize > maxPayloadSize || info->attributeSize > maxAttributeSize) {
+			rejection = "built for a larger payload or attribute size";
+		}
+		else if (!ReadBlobFile(std::wstring(c_shaderLibraryDirectory) + info->blobFile, bytecode)) {
+			rejection = "blob file is missing";
+		}
+
+		if (rejection.empty()) {
+			blobs[i] = CreateShaderBlob(bytecode);
+			continue;
+		}
+
+		std::string name(library.source.fileName.begin(), library.source.fileName.end());
+#if defined(SONAR_SHADER_DEVELOPER_MODE)
+		OutputDebugStringA(("Compiling " + name + " at runtime: precompiled library " + rejection + "\n").c_str());
+		fallbackRequests.push_back(library.source);
+		fallbackIndices.push_back(i);
+#else
+		throw std::runtime_error("Precompiled shader library " + name + " is unusable: " + rejection);
+#endif
+	}
+
+	if (!fallbackRequests.empty()) {
+		auto compiled = CompileShaders(fallbackRequests);
+		for (size_t i = 0; i < compiled.size(); ++i) {
+			blobs[fallbackIndices[i]] = compiled[i];
+		}
+	}
+
+	return blobs;
+}
+
 ID3D12DescriptorHeap* SonarPropagation::Graphics::Common::CreateDescriptorHeap(ID3D12Device* device, uint32_t count,
 	D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible) {	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
 	desc.NumDescriptors = count;
@@ -4,12 +4,54 @@
 #include <DXR/Nvidia/DXSampleHelper.h>
 #include "../DXR/Nvidia/nvidia_include.h"
 #include <dxcapi.h>
+#include "ShaderCache.h"
+#include "ShaderLibraryManifest.h"
 
 namespace SonarPropagation{
 	namespace Graphics {
 		namespace Common {
+			/// <summary>
+			/// Compiles a shader library with DXC, bypassing the cache.
+			/// </summary>
+			ShaderBytecode CompileShaderWithDxc(const ShaderCompileRequest& request);
+
+			/// <summary>
+			/// Process wide DXIL cache, stored in the local cache folder of the app.
+			/// </summary>
+			ShaderCache& GetShaderCache();
+
+			/// <summary>
+			/// Wraps bytecode served by the shader cache in a blob the pipeline generator can link.
+			/// </summary>
+			Microsoft::WRL::ComPtr<IDxcBlob> CreateShaderBlob(const ShaderBytecode& bytecode);
+
 			IDxcBlob* CompileShader(LPCWSTR fileName);
 
+			IDxcBlob* CompileShader(const ShaderCompileRequest& request);
+
+			/// <summary>
+			/// Compiles independent libraries in parallel through the shader cache.
+			/// </summary>
+			std::vector<Microsoft::WRL::ComPtr<IDxcBlob>> CompileShaders(const std::vector<ShaderCompileRequest>& requests);
+
+			/// <summary>
+			/// A shader library the pipeline needs, with the exports it links against.
+			/// </summary>
+			struct ShaderLibraryRequest {
+				ShaderCompileRequest source;
+				std::vector<std::wstring> exports;
+			};
+
+			/// <summary>
+			/// Loads the libraries precompiled by the offline shader build (ShaderLibraries.targets).
+			/// A library is rejected if it is missing, lacks one of the requested exports, or was built
+			/// for a larger payload or attribute struct than the pipeline allows. Rejected libraries are
+			/// compiled at runtime in developer mode (SONAR_SHADER_DEVELOPER_MODE); otherwise they throw.
+			/// The result order matches the requests.
+			/// </summary>
+			std::vector<Microsoft::WRL::ComPtr<IDxcBlob>> LoadShaderLibraries(const std::vector<ShaderLibraryRequest>& libraries,
+				UINT maxPayloadSize, UINT maxAttributeSize);
+
 			ID3D12DescriptorHeap* CreateDescriptorHeap(ID3D12Device* device, uint32_t count,
 				D3D12_DESCRIPTOR_HEAP_TYPE type, bool shaderVisible);
 		}
@@ -118,6 +118,28 @@ namespace nv_helpers_dx12 {
 		m_vertexBuffers.push_back(descriptor);
 	}
 
+	//--------------------------------------------------------------------------------------------------
+	// Add a buffer of axis-aligned boxes in GPU memory into the acceleration structure. The boxes are
+	// procedural primitives: a ray entering one runs the intersection shader of the hit group, which
+	// finds and reports the actual surface inside
+	void BottomLevelASGenerator::AddAabbBuffer(
+		ID3D12Resource* aabbBuffer, // Buffer containing D3D12_RAYTRACING_AABB records
+		UINT64 aabbOffsetInBytes,   // Offset of the first box in the buffer, 8-byte aligned
+		uint32_t aabbCount,         // Number of boxes to consider in the buffer
+		bool isOpaque /* = true */  // If true, the geometry is considered opaque,
+		// optimizing the search for a closest hit
+	) {
+		D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
+		descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
+		descriptor.AABBs.AABBCount = aabbCount;
+		descriptor.AABBs.AABBs.StartAddress = aabbBuffer->GetGPUVirtualAddress() + aabbOffsetInBytes;
+		descriptor.AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
+		descriptor.Flags = isOpaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE
+			: D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+
+		m_vertexBuffers.push_back(descriptor);
+	}
+
 	//--------------------------------------------------------------------------------------------------
 	// Compute the size of the scratch space required to build the acceleration
 	// structure, as well as the size of the resulting structure. The allocation of
@@ -127,6 +127,15 @@ namespace nv_helpers_dx12
 			/// optimizing the search for a closest hit
 		);
 
+		/// Add a buffer of D3D12_RAYTRACING_AABB boxes in GPU memory into the acceleration structure. The
+		/// boxes are procedural primitives, intersected by the intersection shader of their hit group
+		void AddAabbBuffer(ID3D12Resource* aabbBuffer, /// Buffer containing the boxes
+			UINT64 aabbOffsetInBytes,   /// Offset of the first box in the buffer
+			uint32_t aabbCount,         /// Number of boxes to consider in the buffer
+			bool isOpaque = true /// If true, the geometry is considered opaque,
+			/// optimizing the search for a closest hit
+		);
+
 		/// Compute the size of the scratch space required to build the acceleration structure, as well as
 		/// the size of the resulting structure. The allocation of the buffers is then left to the
 		/// application
@@ -155,7 +164,7 @@ namespace nv_helpers_dx12
 		);
 
 	private:
-		/// Vertex buffer descriptors used to generate the AS
+		/// Vertex buffer and AABB buffer descriptors used to generate the AS
 		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> m_vertexBuffers = {};
 
 		/// Amount of temporary memory required by the builder
@@ -481,6 +481,9 @@ namespace nv_helpers_dx12
 		m_desc.AnyHitShaderImport = m_anyHitSymbol.empty() ? nullptr : m_anyHitSymbol.c_str();
 		m_desc.IntersectionShaderImport =
 			m_intersectionSymbol.empty() ? nullptr : m_intersectionSymbol.c_str();
+		// Groups with an intersection shader are hit through AABB geometry rather than triangles
+		m_desc.Type = m_intersectionSymbol.empty() ? D3D12_HIT_GROUP_TYPE_TRIANGLES
+			: D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE;
 	}
 
 	//--------------------------------------------------------------------------------------------------
@@ -0,0 +1,85 @@
+#include "pch.h"
+#include "PipelineStateCache.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+	void AppendWide(std::ostringstream& stream, const std::wstring& value) {
+		// Export names are HLSL identifiers; code units are written as numbers to stay unambiguous.
+		stream << value.size() << ':';
+		for (wchar_t c : value) {
+			if (c < 0x80) {
+				stream << static_cast<char>(c);
+			}
+			else {
+				stream << "\\u" << static_cast<uint32_t>(c) << ';';
+			}
+		}
+	}
+}
+
+std::string SonarPropagation::Graphics::DXR::PipelineKey::ToString() const
+{
+	std::vector<std::string> libraryParts;
+	for (const auto& library : libraries) {
+		std::vector<std::wstring> exports = library.exports;
+		std::sort(exports.begin(), exports.end());
+
+		std::ostringstream part;
+		part << "lib " << library.bytecodeHash;
+		for (const auto& name : exports) {
+			part << ' ';
+			AppendWide(part, name);
+		}
+		libraryParts.push_back(part.str());
+	}
+	std::sort(libraryParts.begin(), libraryParts.end());
+
+	std::vector<std::string> hitGroupParts;
+	for (const auto& hitGroup : hitGroups) {
+		std::ostringstream part;
+		part << "hit ";
+		AppendWide(part, hitGroup.name);
+		part << ' ';
+		AppendWide(part, hitGroup.closestHit);
+		part << ' ';
+		AppendWide(part, hitGroup.anyHit);
+		part << ' ';
+		AppendWide(part, hitGroup.intersection);
+		hitGroupParts.push_back(part.str());
+	}
+	std::sort(hitGroupParts.begin(), hitGroupParts.end());
+
+	std::ostringstream key;
+	for (const auto& part : libraryParts) {
+		key << part << '\n';
+	}
+	for (const auto& part : hitGroupParts) {
+		key << part << '\n';
+	}
+	key << "payload " << maxPayloadSize << '\n';
+	key << "attributes " << maxAttributeSize << '\n';
+	key << "recursion " << maxRecursionDepth << '\n';
+	return key.str();
+}
+
+SonarPropagation::Graphics::DXR::PipelineKey SonarPropagation::Graphics::DXR::PipelineKey::WithRecursionDepth(uint32_t depth) const
+{
+	PipelineKey key = *this;
+	key.maxRecursionDepth = depth;
+	return key;
+}
+
+std::vector<SonarPropagation::Graphics::DXR::PipelineKey> SonarPropagation::Graphics::DXR::GetNeighbouringPipelineKeys(const PipelineKey& key, uint32_t maxRecursionDepth)
+{
+	std::vector<PipelineKey> keys;
+	if (key.maxRecursionDepth < maxRecursionDepth) {
+		keys.push_back(key.WithRecursionDepth(key.maxRecursionDepth + 1));
+	}
+	if (key.maxRecursionDepth > 1) {
+		keys.push_back(key.WithRecursionDepth(key.maxRecursionDepth - 1));
+	}
+	return keys;
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Common/Profiler.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace DXR {
+
+			/// <summary>
+			/// A DXIL library linked into a pipeline, identified by the hash of its bytecode.
+			/// </summary>
+			struct PipelineLibraryKey {
+				std::string bytecodeHash;
+				std::vector<std::wstring> exports;
+			};
+
+			/// <summary>
+			/// A hit group of a pipeline. Empty names mean the shader is not used.
+			/// </summary>
+			struct PipelineHitGroupKey {
+				std::wstring name;
+				std::wstring closestHit;
+				std::wstring anyHit;
+				std::wstring intersection;
+			};
+
+			/// <summary>
+			/// Everything that determines a raytracing state object. Root signatures are not part of the
+			/// key: the renderer creates them once and they never change for a given set of exports.
+			/// </summary>
+			struct PipelineKey {
+				std::vector<PipelineLibraryKey> libraries;
+				std::vector<PipelineHitGroupKey> hitGroups;
+				uint32_t maxPayloadSize = 0;
+				uint32_t maxAttributeSize = 0;
+				uint32_t maxRecursionDepth = 1;
+
+				/// <summary>
+				/// Canonical text form. The order of libraries, exports and hit groups does not matter,
+				/// as it does not change the linked pipeline.
+				/// </summary>
+				std::string ToString() const;
+
+				/// <summary>
+				/// Copy of the key with a different recursion depth.
+				/// </summary>
+				PipelineKey WithRecursionDepth(uint32_t depth) const;
+			};
+
+			/// <summary>
+			/// Keys worth building ahead of a switch from key: the same pipeline one recursion level deeper
+			/// and one shallower, as far as they stay within 1 and maxRecursionDepth.
+			/// </summary>
+			std::vector<PipelineKey> GetNeighbouringPipelineKeys(const PipelineKey& key, uint32_t maxRecursionDepth);
+
+			enum class PipelineBuildState {
+				Missing,
+				Queued,
+				Building,
+				Ready,
+				Failed
+			};
+
+			struct PipelineCacheStats {
+				uint64_t hits = 0;
+				uint64_t misses = 0;
+				uint64_t builds = 0;
+				uint64_t failures = 0;
+				uint64_t evictions = 0;
+			};
+
+			/// <summary>
+			/// Cache of pipeline state objects keyed by PipelineKey, with a background builder.
+			/// TryAcquire() never blocks: a missing pipeline is queued ahead of speculative Prebuild()
+			/// requests and the caller keeps using its current pipeline until the new one is ready.
+			/// The pipeline type and the build function are parameters, so the keying and the
+			/// scheduling do not depend on a device.
+			/// </summary>
+			template <typename TPipeline>
+			class PipelineStateCache {
+			public:
+				typedef std::function<TPipeline(const PipelineKey&)> BuildFunction;
+
+				/// <summary>
+				/// Constructor for the PipelineStateCache.
+				/// </summary>
+				/// <param name="build">Creates a pipeline. Runs on the worker thread; exceptions mark the key as failed.</param>
+				/// <param name="capacity">Number of ready pipelines kept before the least recently used one is dropped.</param>
+				/// <param name="startWorker">Without a worker, queued builds only run through RunOne().</param>
+				PipelineStateCache(BuildFunction build, size_t capacity = 8, bool startWorker = true)
+					: m_build(std::move(build)), m_capacity(capacity == 0 ? 1 : capacity)
+				{
+					if (startWorker) {
+						m_worker = std::thread([this]() { WorkerLoop(); });
+					}
+				}
+
+				~PipelineStateCache() {
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_stop = true;
+					}
+					m_wake.notify_all();
+
+					if (m_worker.joinable()) {
+						m_worker.join();
+					}
+				}
+
+				PipelineStateCache(const PipelineStateCache&) = delete;
+				PipelineStateCache& operator=(const PipelineStateCache&) = delete;
+
+				/// <summary>
+				/// Returns true and the pipeline if it is ready. Otherwise queues it with priority and returns false.
+				/// Failed keys are not retried; check GetState().
+				/// </summary>
+				bool TryAcquire(const PipelineKey& key, TPipeline& pipeline) {
+					std::string id = key.ToString();
+					bool queued = false;
+					bool ready = false;
+
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						Entry& entry = FindOrAdd(id, key);
+
+						if (entry.state == PipelineBuildState::Ready) {
+							entry.lastUse = ++m_useCounter;
+							pipeline = entry.pipeline;
+							++m_stats.hits;
+							ready = true;
+						}
+						else {
+							++m_stats.misses;
+							if (entry.state == PipelineBuildState::Missing || (entry.state == PipelineBuildState::Queued && !entry.urgent)) {
+								entry.state = PipelineBuildState::Queued;
+								entry.urgent = true;
+								m_urgentQueue.push_back(id);
+								queued = true;
+							}
+						}
+					}
+
+					if (queued) {
+						m_wake.notify_one();
+					}
+					return ready;
+				}
+
+				/// <summary>
+				/// Queues a speculative build behind every TryAcquire() request. No-op if the key is known.
+				/// </summary>
+				void Prebuild(const PipelineKey& key) {
+					std::string id = key.ToString();
+					bool queued = false;
+
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						Entry& entry = FindOrAdd(id, key);
+						if (entry.state == PipelineBuildState::Missing) {
+							entry.state = PipelineBuildState::Queued;
+							m_speculativeQueue.push_back(id);
+							queued = true;
+						}
+					}
+
+					if (queued) {
+						m_wake.notify_one();
+					}
+				}
+
+				/// <summary>
+				/// Returns the pipeline, building it on the calling thread if it is not ready yet.
+				/// Rethrows the build error. Meant for startup, when there is no pipeline to fall back to.
+				/// </summary>
+				TPipeline GetOrBuild(const PipelineKey& key) {
+					TPipeline pipeline;
+					if (TryAcquire(key, pipeline)) {
+						return pipeline;
+					}
+
+					std::string id = key.ToString();
+
+					std::unique_lock<std::mutex> lock(m_mutex);
+					Entry& entry = m_entries[id];
+
+					++entry.waiters;
+
+					// Claim the build unless the worker already started it.
+					if (entry.state == PipelineBuildState::Queued) {
+						entry.state = PipelineBuildState::Building;
+						lock.unlock();
+						Build(id);
+						lock.lock();
+					}
+
+					m_finished.wait(lock, [&entry]() {
+						return entry.state == PipelineBuildState::Ready || entry.state == PipelineBuildState::Failed;
+					});
+					--entry.waiters;
+
+					if (entry.state == PipelineBuildState::Failed) {
+						std::rethrow_exception(entry.error);
+					}
+
+					entry.lastUse = ++m_useCounter;
+					return entry.pipeline;
+				}
+
+				PipelineBuildState GetState(const PipelineKey& key) const {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					auto it = m_entries.find(key.ToString());
+					return it == m_entries.end() ? PipelineBuildState::Missing : it->second.state;
+				}
+
+				/// <summary>
+				/// The exception thrown by a failed build, or null.
+				/// </summary>
+				std::exception_ptr GetError(const PipelineKey& key) const {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					auto it = m_entries.find(key.ToString());
+					return it == m_entries.end() ? nullptr : it->second.error;
+				}
+
+				/// <summary>
+				/// Runs the next queued build on the calling thread. Returns false if nothing was queued.
+				/// </summary>
+				bool RunOne() {
+					std::string id;
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						if (!PopQueued(id)) {
+							return false;
+						}
+					}
+
+					Build(id);
+					return true;
+				}
+
+				/// <summary>
+				/// Number of builds waiting in either queue.
+				/// </summary>
+				size_t GetQueuedCount() const {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					size_t count = 0;
+					for (const auto& entry : m_entries) {
+						if (entry.second.state == PipelineBuildState::Queued) {
+							++count;
+						}
+					}
+					return count;
+				}
+
+				PipelineCacheStats GetStats() const {
+					std::lock_guard<std::mutex> lock(m_mutex);
+					return m_stats;
+				}
+
+			private:
+				struct Entry {
+					PipelineKey key;
+					PipelineBuildState state = PipelineBuildState::Missing;
+					TPipeline pipeline = TPipeline();
+					std::exception_ptr error;
+					uint64_t lastUse = 0;
+					uint32_t waiters = 0;
+					bool urgent = false;
+				};
+
+				Entry& FindOrAdd(const std::string& id, const PipelineKey& key) {
+					auto it = m_entries.find(id);
+					if (it == m_entries.end()) {
+						it = m_entries.insert(std::make_pair(id, Entry())).first;
+						it->second.key = key;
+					}
+					return it->second;
+				}
+
+				// Urgent requests first; entries that were claimed elsewhere in the meantime are skipped.
+				bool PopQueued(std::string& id) {
+					std::deque<std::string>* queues[] = { &m_urgentQueue, &m_speculativeQueue };
+					for (auto* queue : queues) {
+						while (!queue->empty()) {
+							std::string candidate = queue->front();
+							queue->pop_front();
+
+							Entry& entry = m_entries[candidate];
+							if (entry.state == PipelineBuildState::Queued) {
+								entry.state = PipelineBuildState::Building;
+								id = candidate;
+								return true;
+							}
+						}
+					}
+					return false;
+				}
+
+				// Expects the entry in the Building state, owned by the caller.
+				void Build(const std::string& id) {
+					SONAR_PROFILE_SCOPE("PipelineStateCache::Build");
+
+					PipelineKey key;
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						key = m_entries[id].key;
+					}
+
+					TPipeline pipeline = TPipeline();
+					std::exception_ptr error;
+					try {
+						pipeline = m_build(key);
+					}
+					catch (...) {
+						error = std::current_exception();
+					}
+
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						Entry& entry = m_entries[id];
+						if (error) {
+							entry.state = PipelineBuildState::Failed;
+							entry.error = error;
+							++m_stats.failures;
+						}
+						else {
+							entry.state = PipelineBuildState::Ready;
+							entry.pipeline = pipeline;
+							entry.lastUse = ++m_useCounter;
+							++m_stats.builds;
+							EvictLeastRecentlyUsed();
+						}
+					}
+					m_finished.notify_all();
+				}
+
+				void EvictLeastRecentlyUsed() {
+					for (;;) {
+						size_t readyCount = 0;
+						auto oldest = m_entries.end();
+						for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+							if (it->second.state == PipelineBuildState::Ready) {
+								++readyCount;
+								if (it->second.waiters == 0 && (oldest == m_entries.end() || it->second.lastUse < oldest->second.lastUse)) {
+									oldest = it;
+								}
+							}
+						}
+
+						if (readyCount <= m_capacity || oldest == m_entries.end()) {
+							return;
+						}
+
+						// Users hold their own reference, so a pipeline still in use stays alive.
+						m_entries.erase(oldest);
+						++m_stats.evictions;
+					}
+				}
+
+				void WorkerLoop() {
+					Utils::Profiler::SetThreadName("Pipeline builder");
+
+					for (;;) {
+						std::string id;
+						{
+							std::unique_lock<std::mutex> lock(m_mutex);
+							m_wake.wait(lock, [this]() { return m_stop || !m_urgentQueue.empty() || !m_speculativeQueue.empty(); });
+							if (m_stop) {
+								return;
+							}
+							if (!PopQueued(id)) {
+								continue;
+							}
+						}
+
+						Build(id);
+					}
+				}
+
+				BuildFunction m_build;
+				size_t m_capacity;
+
+				mutable std::mutex m_mutex;
+				std::condition_variable m_wake;
+				std::condition_variable m_finished;
+				std::map<std::string, Entry> m_entries;
+				std::deque<std::string> m_urgentQueue;
+				std::deque<std::string> m_speculativeQueue;
+				uint64_t m_useCounter = 0;
+				PipelineCacheStats m_stats;
+				bool m_stop = false;
+
+				// Declared last so it starts after, and is joined before, everything it uses.
+				std::thread m_worker;
+			};
+		}
+	}
+}
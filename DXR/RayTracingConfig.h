@@ -1,5 +1,6 @@
 #pragma once
 #include "pch.h"
+#include "DXR/DXRHelpers/ShaderPermutation.h"
 
 /// <summary>
 /// Holds the configuration for the raytracing.
@@ -9,6 +10,10 @@ struct RayTracingConfig {
 	UINT m_maxPayloadSize;
 	UINT m_maxAttributeSize;
 
+	// Dispatches the sonar kernels instead of the camera ray generation, compiled as this permutation.
+	bool m_sonarRayGeneration = false;
+	SonarPropagation::Graphics::Common::SonarKernelPermutation m_sonarKernels;
+
 	RayTracingConfig(UINT recursionDepth, UINT maxPayloadSize, UINT maxAttributeSize ) :
 		m_recursionDepth(recursionDepth),
 		m_maxPayloadSize(maxPayloadSize),
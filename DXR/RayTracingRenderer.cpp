@@ -1,7 +1,10 @@
 
 #include "pch.h"
 #include "RayTracingRenderer.h"
+#include "Common/Profiler.h"
 #include <ResourceUploadBatch.h>
+#include <algorithm>
+#include <sstream>
 
 
 
@@ -16,6 +19,84 @@
 //-----------------------------------------------------------------------------
 // Namespace for helper functions
 
+namespace {
+
+	// The scene before scenario files: the sea surface as one large boundary quad.
+	const char* c_defaultScenario =
+		"sonar-scenario 1\n"
+		"mesh quad builtin=quad\n"
+		"transform surface scale=1000000,1,1000000\n"
+		"instance surface mesh=quad transform=surface type=boundary\n";
+
+	Platform::String^ c_scenarioPathKey = "ScenarioPath";
+
+	DirectX::XMMATRIX ToXMMatrix(const SonarPropagation::Sonar::Matrix4x3& matrix) {
+		return DirectX::XMMatrixSet(
+			static_cast<float>(matrix.m[0][0]), static_cast<float>(matrix.m[0][1]), static_cast<float>(matrix.m[0][2]), 0.f,
+			static_cast<float>(matrix.m[1][0]), static_cast<float>(matrix.m[1][1]), static_cast<float>(matrix.m[1][2]), 0.f,
+			static_cast<float>(matrix.m[2][0]), static_cast<float>(matrix.m[2][1]), static_cast<float>(matrix.m[2][2]), 0.f,
+			static_cast<float>(matrix.m[3][0]), static_cast<float>(matrix.m[3][1]), static_cast<float>(matrix.m[3][2]), 1.f);
+	}
+
+	// Area weighted vertex normals, with the winding of GetQuadVertices() facing +y.
+	std::vector<SonarPropagation::VertexPositionNormalUV> MakeVertices(const SonarPropagation::Sonar::MeshData& mesh) {
+		std::vector<SonarPropagation::VertexPositionNormalUV> vertices(mesh.positions.size());
+		std::vector<DirectX::XMVECTOR> normals(mesh.positions.size(), DirectX::XMVectorZero());
+
+		auto load = [&](uint32_t index) {
+			const SonarPropagation::Sonar::Float3& p = mesh.positions[index];
+			return DirectX::XMVectorSet(p.x, p.y, p.z, 0.f);
+		};
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			const DirectX::XMVECTOR p0 = load(mesh.indices[i]);
+			const DirectX::XMVECTOR normal = DirectX::XMVector3Cross(
+				DirectX::XMVectorSubtract(load(mesh.indices[i + 2]), p0), DirectX::XMVectorSubtract(load(mesh.indices[i + 1]), p0));
+			for (size_t corner = 0; corner < 3; ++corner) {
+				normals[mesh.indices[i + corner]] = DirectX::XMVectorAdd(normals[mesh.indices[i + corner]], normal);
+			}
+		}
+
+		for (size_t v = 0; v < vertices.size(); ++v) {
+			const SonarPropagation::Sonar::Float3& p = mesh.positions[v];
+			vertices[v].posU = { p.x, p.y, p.z, 0.f };
+			DirectX::XMStoreFloat4(&vertices[v].normalV, DirectX::XMVector3Normalize(normals[v]));
+			vertices[v].normalV.w = 0.f;
+		}
+		return vertices;
+	}
+
+	std::string NarrowPath(const std::wstring& path) {
+		const int size = WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, nullptr, 0, nullptr, nullptr);
+		if (size <= 1) {
+			return std::string();
+		}
+
+		std::string narrow(static_cast<size_t>(size), '\0');
+		WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, &narrow[0], size, nullptr, nullptr);
+		narrow.resize(static_cast<size_t>(size) - 1);
+		return narrow;
+	}
+
+	// The sonar kernel permutation in use followed by the ones the ImGui panel switches to with one click:
+	// every other integrator tableau and the other precision.
+	std::vector<SonarPropagation::Graphics::Common::SonarKernelPermutation> GetSonarKernelAlternatives(
+		const SonarPropagation::Graphics::Common::SonarKernelPermutation& current) {
+		using namespace SonarPropagation::Graphics::Common;
+
+		std::vector<SonarKernelPermutation> permutations = { current };
+		for (IntegratorTableau tableau : { IntegratorTableau::Euler, IntegratorTableau::Midpoint, IntegratorTableau::RungeKutta4 }) {
+			if (tableau != current.tableau) {
+				permutations.push_back(current);
+				permutations.back().tableau = tableau;
+			}
+		}
+
+		permutations.push_back(current);
+		permutations.back().precision = current.precision == KernelPrecision::Full ? KernelPrecision::Half : KernelPrecision::Full;
+		return permutations;
+	}
+}
 
 
 // ---------------------------------------------------------------------------
@@ -29,14 +110,20 @@ SonarPropagation::Graphics::DXR::RayTracingRenderer::RayTracingRenderer(
 	m_loadingComplete(false),
 	m_deviceResources(deviceResources),
 	m_dxrConfig({ 1, 4 * sizeof(float), 2 * sizeof(float) }),
+	m_activeDxrConfig(m_dxrConfig),
 	m_objectLibrary({ deviceResources->GetD3DDevice() }),
 	m_scene({ m_deviceResources->GetD3DDevice() }),
-	m_cameraController({m_deviceResources->GetD3DDevice()})
+	m_descriptorHeap(deviceResources->GetD3DDevice(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, c_descriptorHeapCapacity, true),
+	m_cameraController({m_deviceResources->GetD3DDevice()}),
+	m_cameraConstants(deviceResources->GetD3DDevice(), 4 * sizeof(XMMATRIX))
 {
 	LoadState();
 
 	m_cameraController.AddCamera(new Camera());
 
+	m_gpuTimer = std::make_unique<GpuTimer>(deviceResources->GetD3DDevice(), deviceResources->GetCommandQueue(),
+		static_cast<uint32_t>(TimingStage::Count));
+
 	CreateDeviceDependentResources();
 	CreateWindowSizeDependentResources();
 }
@@ -177,6 +264,10 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateDeviceDependentR
 
 		CreateShaderBindingTable();
 
+		// Command allocators and staging memory of the initial upload are reused by the first frames.
+		m_deviceResources->WaitForFenceValue(m_uploadFenceValue);
+		m_objectLibrary.OnUploadCompleted();
+
 		m_imguiManager.InitImGui(DX::c_frameCount, m_deviceResources->GetBackBufferFormat(), m_dxrDevice.Get(), m_imguiHeap.Get());
 
 		});
@@ -188,44 +279,85 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateDeviceDependentR
 }
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateScene() {
-	
+	SONAR_PROFILE_SCOPE("CreateScene");
+
+	std::vector<Scene::SoundReflector> previousObjects;
+	std::vector<std::string> previousNames;
+	previousObjects.swap(m_scene.m_objects);
+	previousNames.swap(m_objectNames);
+
+	const std::vector<Sonar::Matrix4x3> world = m_scenarioModel.scene.ComputeWorldTransforms();
+
+	for (size_t i = 0; i < m_scenarioModel.scene.m_objects.size(); ++i) {
+		const Sonar::ReflectorModel& reflector = m_scenarioModel.scene.m_objects[i];
+
+		// The hierarchy stays in the scenario model, which is where the TLAS takes the world matrices from;
+		// the object only mirrors its world position.
+		const Sonar::Matrix4x3& matrix = world[reflector.transform];
+		XMFLOAT3 position = { static_cast<float>(matrix.m[3][0]), static_cast<float>(matrix.m[3][1]), static_cast<float>(matrix.m[3][2]) };
+		Scene::Transform transform = { position, { 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 1.f, 1.f } };
+		transform.SetParent(nullptr, nullptr);
+
+		Scene::SoundReflector object(transform, m_modelByMesh.at(reflector.mesh), reflector.type);
 
+		auto previous = std::find(previousNames.begin(), previousNames.end(), m_scenarioModel.objectNames[i]);
+		if (previous != previousNames.end()) {
+			object.m_texture = previousObjects[previous - previousNames.begin()].m_texture;
+			m_scene.m_objects.push_back(object);
+		}
+		else {
+			m_scene.AddObject(object);
+		}
+		m_objectNames.push_back(m_scenarioModel.objectNames[i]);
+	}
 }
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::InitializeObjects() {
+	SONAR_PROFILE_SCOPE("InitializeObjects");
 
-	//size_t cubeData = m_objectLibrary.LoadPredefined<VertexPositionNormalUV>(GetCubeVertices<VertexPositionNormalUV>(1, 1, 1), GetCubeIndices());
-	size_t quadData = m_objectLibrary.LoadPredefined<VertexPositionNormalUV>(GetQuadVertices<VertexPositionNormalUV>(1, 1), GetQuadIndices());
+	std::istringstream defaultScenario(c_defaultScenario);
+	m_scenario = Sonar::ScenarioDescription::Parse(defaultScenario, "default scenario");
+	m_scenarioModel = Sonar::BuildScenarioModel(m_scenario, m_meshLibrary);
 
-	{
-		XMFLOAT3 position = { 0.f, 0.f, 0.f };
-		XMFLOAT4 scale = { 1000000.f, 1.f, 1000000.f , 1.f };
-		XMFLOAT4 rotation = { 0.f, 0.f, 0.f, 1.f };
+	// The first poll reads the file if there is one; later edits are picked up by PollScenario().
+	m_scenarioWatcher = std::make_unique<Sonar::ScenarioWatcher>(NarrowPath(m_scenarioPath));
 
-		Scene::Transform transform = { position,rotation,scale };
-		transform.SetParent(nullptr, nullptr);
-		m_scene.AddObject(Scene::SoundReflector(transform, quadData, ObjectType::Boundary));
+	Sonar::ScenarioDescription loaded;
+	Sonar::ScenarioChanges changes;
+	if (m_scenarioWatcher->Poll(m_scenario, loaded, changes)) {
+		try {
+			m_scenarioModel = Sonar::BuildScenarioModel(loaded, m_meshLibrary);
+			m_scenario = std::move(loaded);
+		}
+		catch (const std::exception& exception) {
+			m_scenarioError = exception.what();
+		}
 	}
 
-	//{
-	//	XMFLOAT3 position = { 0.f, 50000.f, 0.f };
-	//	XMFLOAT4 scale = { 1000000.f, 1.f, 1000000.f , 1.f };
-	//	XMFLOAT4 rotation = { 0.f, 0.f, 0.f, 1.f };
+	// Geometry is copied into the default heap by m_commandList; the BLAS builds recorded after this read it.
+	m_objectLibrary.BeginUpload(m_commandList.Get());
+	UploadScenarioMeshes();
+	m_objectLibrary.EndUpload();
+}
 
-	//	Scene::Transform transform = { position,rotation,scale };
-	//	transform.SetParent(nullptr, nullptr);
-	//	m_scene.AddObject(Scene::SoundReflector(transform, quadData, ObjectType::Boundary));
-	//}
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::UploadScenarioMeshes() {
+	for (const auto& mesh : m_scenarioModel.meshes) {
+		if (m_modelByMesh.count(mesh.second)) {
+			continue;
+		}
 
+		const Sonar::MeshData& data = m_meshLibrary.GetMesh(mesh.second);
+		m_modelByMesh[mesh.second] = m_objectLibrary.LoadPredefined<VertexPositionNormalUV>(
+			MakeVertices(data), std::vector<UINT>(data.indices.begin(), data.indices.end()));
+	}
+
+	for (const auto& heightfield : m_scenarioModel.heightfields) {
+		if (m_heightfieldByIndex.count(heightfield.second)) {
+			continue;
+		}
 
-	//{
-	//	XMFLOAT3 position = { 0.f,-7500.f,0.f };
-	//	XMFLOAT4 scale = { 1.f, 1000000.f, 1000000.f , 1.f };
-	//	XMFLOAT4 rotation = { g_XMHalfPi[0],g_XMHalfPi[0],0.f, 1.f };
-	//	Scene::Transform transform = { position,rotation,scale };
-	//	transform.SetParent(nullptr, nullptr);
-	//	m_scene.AddObject(Scene::SoundReflector(transform, quadData, ObjectType::Object));
-	//}
+		m_heightfieldByIndex[heightfield.second] = m_objectLibrary.LoadHeightfield(m_meshLibrary.GetHeightfield(heightfield.second));
+	}
 }
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateWindowSizeDependentResources() {
@@ -254,7 +386,6 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateWindowSizeDepend
 
 	CreateRaytracingOutputBuffer();
 	CreateShaderResourceHeap();
-	CreateShaderBindingTable();
 
 }
 
@@ -269,26 +400,40 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateWindowSizeDepend
 
 template <typename V>
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateAccelerationStructures() {
-	for (auto& object : m_scene.m_objects) {
+	SONAR_PROFILE_SCOPE("CreateAccelerationStructures");
+	const std::vector<Sonar::Matrix4x3> world = m_scenarioModel.scene.ComputeWorldTransforms();
+
+	for (size_t i = 0; i < m_scene.m_objects.size(); ++i) {
 		
-		auto& model = m_objectLibrary.m_objects[object.GetModelIndex()];
+		auto& model = m_objectLibrary.m_objects[m_scene.m_objects[i].GetModelIndex()];
 		
 		if (!model.IsASInstanciated() )
 		{
 			model.m_asBuffers = CreateBottomLevelAS<V>(
 				{ {
-					model.m_bufferData.vertexBuffer.Get(),
+					model.m_bufferData.vertexAllocation,
 					model.m_bufferData.vertexBufferView.SizeInBytes / sizeof(V),
 				} },
 				{ {
-					model.m_bufferData.indexBuffer.Get(),
+					model.m_bufferData.indexAllocation,
 					model.m_bufferData.indexBufferView.SizeInBytes / sizeof(UINT)
 				} }
 			);
 		}
 
 		
-		m_instances.push_back({ model.m_asBuffers.pResult, object.m_transform.LocalToWorld() });
+		m_instances.push_back({ model.m_asBuffers.pResult, ToXMMatrix(world[m_scenarioModel.scene.m_objects[i].transform]) });
+	}
+
+	// Heightfields come after the objects, so their instance index is also their hit group record.
+	for (const Sonar::HeightfieldModel& placement : m_scenarioModel.scene.m_heightfields) {
+		auto& heightfield = m_objectLibrary.m_heightfields[m_heightfieldByIndex.at(placement.heightfield)];
+
+		if (!heightfield.IsASInstanciated()) {
+			heightfield.m_asBuffers = CreateProceduralBottomLevelAS(heightfield);
+		}
+
+		m_instances.push_back({ heightfield.m_asBuffers.pResult, ToXMMatrix(world[placement.transform]) });
 	}
 
 	CreateTopLevelAS(m_instances, false);
@@ -296,7 +441,9 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateAccelerationStru
 	m_commandList->Close();
 	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
 	m_deviceResources->GetCommandQueue()->ExecuteCommandLists(1, ppCommandLists);
-	m_deviceResources->WaitForGpu();
+
+	// The CPU goes on to build the pipeline while the GPU copies the geometry and builds the BLASes.
+	m_uploadFenceValue = m_deviceResources->Signal();
 
 	DX::ThrowIfFailed(
 		m_commandList->Reset(m_deviceResources->GetCommandAllocator(), m_pipelineState.Get())
@@ -314,21 +461,22 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateRaytracingInterf
 template <typename V>
 SonarPropagation::Graphics::DXR::AccelerationStructureBuffers
 SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateBottomLevelAS(
-	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
-	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers
+	std::vector<std::pair<BufferAllocation, uint32_t>> vVertexBuffers,
+	std::vector<std::pair<BufferAllocation, uint32_t>> vIndexBuffers
 ) {
+	SONAR_PROFILE_SCOPE("CreateBottomLevelAS");
 	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
 
 	for (size_t i = 0; i < vVertexBuffers.size(); i++) {
 		if (i < vIndexBuffers.size() && vIndexBuffers[i].second > 0)
 			bottomLevelAS.AddVertexBuffer(
-				vVertexBuffers[i].first.Get(), 0,
+				vVertexBuffers[i].first.resource, vVertexBuffers[i].first.offset,
 				vVertexBuffers[i].second, sizeof(V),
-				vIndexBuffers[i].first.Get(), 0,
+				vIndexBuffers[i].first.resource, vIndexBuffers[i].first.offset,
 				vIndexBuffers[i].second, nullptr, 0, true);
 
 		else
-			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
+			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.resource, vVertexBuffers[i].first.offset,
 				vVertexBuffers[i].second, sizeof(V), 0,
 				0);
 	}
@@ -357,8 +505,41 @@ SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateBottomLevelAS(
 	return buffers;
 }
 
+SonarPropagation::Graphics::DXR::AccelerationStructureBuffers
+SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateProceduralBottomLevelAS(const HeightfieldResources& heightfield) {
+	SONAR_PROFILE_SCOPE("CreateProceduralBottomLevelAS");
+	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
+
+	bottomLevelAS.AddAabbBuffer(heightfield.aabbAllocation.resource, heightfield.aabbAllocation.offset,
+		heightfield.aabbCount, true);
+
+	UINT64 scratchSizeInBytes = 0;
+
+	UINT64 resultSizeInBytes = 0;
+
+	bottomLevelAS.ComputeASBufferSizes(m_dxrDevice.Get(), false, &scratchSizeInBytes,
+		&resultSizeInBytes);
+
+	AccelerationStructureBuffers buffers;
+	buffers.pScratch = nv_helpers_dx12::CreateBuffer(
+		m_dxrDevice.Get(), scratchSizeInBytes,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON,
+		nv_helpers_dx12::kDefaultHeapProps);
+	buffers.pResult = nv_helpers_dx12::CreateBuffer(
+		m_dxrDevice.Get(), resultSizeInBytes,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
+		nv_helpers_dx12::kDefaultHeapProps);
+
+	bottomLevelAS.Generate(m_commandList.Get(), buffers.pScratch.Get(),
+		buffers.pResult.Get(), false, nullptr);
+
+	return buffers;
+}
+
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, bool updateOnly = false
 ) {
+	SONAR_PROFILE_SCOPE("CreateTopLevelAS");
 	if (!updateOnly) {
 		for (size_t i = 0; i < instances.size(); i++) {
 			m_topLevelASGenerator.AddInstance(
@@ -432,46 +613,214 @@ ComPtr<ID3D12RootSignature> SonarPropagation::Graphics::DXR::RayTracingRenderer:
 	return rsc.Generate(m_dxrDevice.Get(), true);
 }
 
+/// <summary>
+/// Create the signature of the heightfield hit group.
+/// </summary>
+/// <returns></returns>
+ComPtr<ID3D12RootSignature> SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateHeightfieldSignature() {
+	nv_helpers_dx12::RootSignatureGenerator rsc;
+
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 0);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 1);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
+	return rsc.Generate(m_dxrDevice.Get(), true);
+}
+
 /// <summary>
 /// Create the raytracing pipeline from HLSL shaders.
-/// Initializes the libraries, shaders, hit groups, root signatures, etc.
+/// Initializes the libraries and root signatures once, then takes the state object for the current
+/// configuration from the pipeline cache, building it on this thread if it is not cached yet.
 /// </summary>
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateRaytracingPipeline()
-{	
-	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_dxrDevice.Get());
+{
+	SONAR_PROFILE_SCOPE("CreateRaytracingPipeline");
+	if (!m_pipelineCache) {
+		LoadRaytracingLibraries();
+		PrepareSonarKernels(m_dxrConfig);
+
+		m_pipelineCache.reset(new PipelineStateCache<ComPtr<ID3D12StateObject>>(
+			[this](const PipelineKey& key) { return BuildStateObject(key); }));
+	}
 
-	m_rayGenLibrary = CompileShader(L"RayGen.hlsl");
-	m_missLibrary = CompileShader(L"Miss.hlsl");
-	m_hitLibrary = CompileShader(L"Hit.hlsl");
+	SetStateObject(m_pipelineCache->GetOrBuild(MakePipelineKey(m_dxrConfig)));
+	m_activeDxrConfig = m_dxrConfig;
 
-	pipeline.AddLibrary(m_rayGenLibrary.Get(), { L"CameraRayGen" });
-	pipeline.AddLibrary(m_missLibrary.Get(), { L"MeshMiss" });
-	pipeline.AddLibrary(m_hitLibrary.Get(), { L"MeshClosestHit"});
+	PrebuildLikelyPipelines();
+}
+
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::LoadRaytracingLibraries()
+{
+	SONAR_PROFILE_SCOPE("LoadRaytracingLibraries");
+	// Precompiled by the offline shader build; developer builds compile stale or missing
+	// libraries at runtime through the shader cache.
+	ShaderLibraryRequest rayGenLibrary, missLibrary, hitLibrary, heightfieldLibrary;
+	rayGenLibrary.source.fileName = L"RayGen.hlsl";
+	rayGenLibrary.exports = { L"CameraRayGen" };
+	missLibrary.source.fileName = L"Miss.hlsl";
+	missLibrary.exports = { L"MeshMiss" };
+	hitLibrary.source.fileName = L"Hit.hlsl";
+	hitLibrary.exports = { L"MeshClosestHit" };
+	heightfieldLibrary.source.fileName = L"Heightfield.hlsl";
+	heightfieldLibrary.exports = { L"HeightfieldIntersection", L"HeightfieldClosestHit" };
+
+	auto libraries = LoadShaderLibraries({ rayGenLibrary, missLibrary, hitLibrary, heightfieldLibrary },
+		m_dxrConfig.m_maxPayloadSize, m_dxrConfig.m_maxAttributeSize);
+	m_rayGenLibrary = libraries[0];
+	m_missLibrary = libraries[1];
+	m_hitLibrary = libraries[2];
+	m_heightfieldLibrary = libraries[3];
 
 	m_rayGenSignature = CreateRayGenSignature();
 	m_missSignature = CreateMissSignature();
 	m_hitSignature = CreateHitSignature();
+	m_heightfieldSignature = CreateHeightfieldSignature();
+
+	// Libraries are keyed by their bytecode, so a recompiled shader never matches a stale pipeline.
+	const std::vector<std::wstring>* exports[] = { &rayGenLibrary.exports, &missLibrary.exports, &hitLibrary.exports, &heightfieldLibrary.exports };
+
+	m_pipelineKeyBase = PipelineKey();
+	for (size_t i = 0; i < libraries.size(); ++i) {
+		PipelineLibraryKey library;
+		library.bytecodeHash = ShaderCache::HashBytecode(libraries[i]->GetBufferPointer(), libraries[i]->GetBufferSize());
+		library.exports = *exports[i];
+		m_pipelineKeyBase.libraries.push_back(library);
+	}
+
+	PipelineHitGroupKey hitGroup;
+	hitGroup.name = L"MeshHitGroup";
+	hitGroup.closestHit = L"MeshClosestHit";
+	m_pipelineKeyBase.hitGroups.push_back(hitGroup);
+
+	PipelineHitGroupKey heightfieldHitGroup;
+	heightfieldHitGroup.name = L"HeightfieldHitGroup";
+	heightfieldHitGroup.closestHit = L"HeightfieldClosestHit";
+	heightfieldHitGroup.intersection = L"HeightfieldIntersection";
+	m_pipelineKeyBase.hitGroups.push_back(heightfieldHitGroup);
+
+	// Every permutation of the sonar ray generation links against the camera's root signature (b0, u0, t0).
+	ShaderCompileRequest sonarRayGen;
+	sonarRayGen.fileName = L"SonarShaders\\SonarRayGen.hlsl";
+	sonarRayGen.arguments = { L"-O3" };
+	m_sonarRayGenPermutations.reset(new ShaderPermutationLibrary(GetShaderCache(), { sonarRayGen }));
+}
+
+/// <summary>
+/// Compiles the sonar ray generation for the permutation of the configuration and its one click
+/// alternatives in one parallel batch, so that switching the integrator or the precision only waits
+/// for the pipeline. Runs on the main thread; BuildStateObject finds the libraries by bytecode hash.
+/// </summary>
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::PrepareSonarKernels(const RayTracingConfig& config)
+{
+	if (!config.m_sonarRayGeneration) {
+		return;
+	}
+
+	SONAR_PROFILE_SCOPE("PrepareSonarKernels");
+	std::vector<SonarKernelPermutation> permutations = GetSonarKernelAlternatives(config.m_sonarKernels);
+	m_sonarRayGenPermutations->Precompile(permutations);
+
+	for (const auto& permutation : permutations) {
+		std::wstring key = permutation.GetKey();
+		if (m_sonarRayGenHashes.count(key)) {
+			continue;
+		}
+
+		const ShaderBytecode& bytecode = *m_sonarRayGenPermutations->Get(permutation)[0];
+		std::string hash = ShaderCache::HashBytecode(bytecode.data(), bytecode.size());
+		ComPtr<IDxcBlob> blob = CreateShaderBlob(bytecode);
+
+		{
+			std::lock_guard<std::mutex> lock(m_sonarRayGenMutex);
+			m_sonarRayGenLibraries[hash] = blob;
+		}
+		m_sonarRayGenHashes[key] = hash;
+	}
+}
+
+SonarPropagation::Graphics::DXR::PipelineKey SonarPropagation::Graphics::DXR::RayTracingRenderer::MakePipelineKey(const RayTracingConfig& config) const
+{
+	PipelineKey key = m_pipelineKeyBase;
+	key.maxPayloadSize = config.m_maxPayloadSize;
+	key.maxAttributeSize = config.m_maxAttributeSize;
+	key.maxRecursionDepth = config.m_recursionDepth;
+
+	if (config.m_sonarRayGeneration) {
+		PipelineLibraryKey sonarRayGen;
+		sonarRayGen.bytecodeHash = m_sonarRayGenHashes.at(config.m_sonarKernels.GetKey());
+		sonarRayGen.exports = { L"SonarRayGen" };
+		key.libraries.push_back(sonarRayGen);
+	}
+	return key;
+}
+
+ComPtr<ID3D12StateObject> SonarPropagation::Graphics::DXR::RayTracingRenderer::BuildStateObject(const PipelineKey& key)
+{
+	SONAR_PROFILE_SCOPE("BuildStateObject");
+	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_dxrDevice.Get());
+
+	pipeline.AddLibrary(m_rayGenLibrary.Get(), key.libraries[0].exports);
+	pipeline.AddLibrary(m_missLibrary.Get(), key.libraries[1].exports);
+	pipeline.AddLibrary(m_hitLibrary.Get(), key.libraries[2].exports);
+	pipeline.AddLibrary(m_heightfieldLibrary.Get(), key.libraries[3].exports);
+
+	std::vector<std::wstring> rayGenExports = { L"CameraRayGen" };
+	if (key.libraries.size() > 4) {
+		ComPtr<IDxcBlob> sonarRayGen;
+		{
+			std::lock_guard<std::mutex> lock(m_sonarRayGenMutex);
+			sonarRayGen = m_sonarRayGenLibraries.at(key.libraries[4].bytecodeHash);
+		}
+		pipeline.AddLibrary(sonarRayGen.Get(), key.libraries[4].exports);
+		rayGenExports.push_back(L"SonarRayGen");
+	}
 
-	pipeline.AddHitGroup(L"MeshHitGroup", L"MeshClosestHit");
+	for (const auto& hitGroup : key.hitGroups) {
+		pipeline.AddHitGroup(hitGroup.name, hitGroup.closestHit, hitGroup.anyHit, hitGroup.intersection);
+	}
 
-	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get(), { L"CameraRayGen"});
+	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get(), rayGenExports);
 	pipeline.AddRootSignatureAssociation(m_missSignature.Get(), { L"MeshMiss"});
 	pipeline.AddRootSignatureAssociation(m_hitSignature.Get(), { L"MeshHitGroup" });
+	pipeline.AddRootSignatureAssociation(m_heightfieldSignature.Get(), { L"HeightfieldHitGroup" });
 
-	pipeline.SetMaxPayloadSize(m_dxrConfig.m_maxPayloadSize); // RGB + distance
+	pipeline.SetMaxPayloadSize(key.maxPayloadSize); // RGB + distance
 
-	pipeline.SetMaxAttributeSize(m_dxrConfig.m_maxAttributeSize); // barycentric coordinates
+	pipeline.SetMaxAttributeSize(key.maxAttributeSize); // barycentric coordinates
 
-	pipeline.SetMaxRecursionDepth(m_dxrConfig.m_recursionDepth);
+	pipeline.SetMaxRecursionDepth(key.maxRecursionDepth);
 
 	// Compile the pipeline for execution on the GPU
-	m_rtStateObject = pipeline.Generate();
+	return pipeline.Generate();
+}
+
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::SetStateObject(const ComPtr<ID3D12StateObject>& stateObject)
+{
+	if (m_rtStateObject) {
+		m_retiredStateObjects.Retire(m_rtStateObject, m_deviceResources->GetCurrentFrameFenceValue());
+	}
+
+	m_rtStateObject = stateObject;
 
 	DX::ThrowIfFailed(
 		m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps))
 	);
 }
 
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::PrebuildLikelyPipelines()
+{
+	for (const PipelineKey& key : GetNeighbouringPipelineKeys(MakePipelineKey(m_activeDxrConfig), D3D12_RAYTRACING_MAX_DECLARABLE_TRACE_RECURSION_DEPTH)) {
+		m_pipelineCache->Prebuild(key);
+	}
+
+	if (m_activeDxrConfig.m_sonarRayGeneration) {
+		RayTracingConfig config = m_activeDxrConfig;
+		for (const auto& permutation : GetSonarKernelAlternatives(m_activeDxrConfig.m_sonarKernels)) {
+			config.m_sonarKernels = permutation;
+			m_pipelineCache->Prebuild(MakePipelineKey(config));
+		}
+	}
+}
+
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateRaytracingOutputBuffer() {
 	D3D12_RESOURCE_DESC resDesc = {};
 	resDesc.DepthOrArraySize = 1;
@@ -492,23 +841,20 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateRaytracingOutput
 
 
 
+/// <summary>
+/// Writes the output UAV, TLAS SRV and camera CBV into their slots of the persistent descriptor heap.
+/// The slots are allocated once, so the heap pointer stored in the SBT never changes.
+/// </summary>
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateShaderResourceHeap() {
 
-	m_srvUavHeap = CreateDescriptorHeap(
-		m_dxrDevice.Get(), 3, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
-
-	NAME_D3D12_OBJECT(m_srvUavHeap);
-
-	D3D12_CPU_DESCRIPTOR_HANDLE srvHandle =
-		m_srvUavHeap->GetCPUDescriptorHandleForHeapStart();
+	if (!m_raytracingDescriptors.IsValid()) {
+		m_raytracingDescriptors = m_descriptorHeap.Allocate(c_raytracingDescriptorCount);
+	}
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
 	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
 	m_dxrDevice.Get()->CreateUnorderedAccessView(m_outputResource.Get(), nullptr, &uavDesc,
-		srvHandle);
-
-	srvHandle.ptr += m_dxrDevice.Get()->GetDescriptorHandleIncrementSize(
-		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		m_descriptorHeap.GetCpuHandle(m_raytracingDescriptors, c_outputUavSlot));
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
@@ -516,69 +862,119 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateShaderResourceHe
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	srvDesc.RaytracingAccelerationStructure.Location =
 		m_topLevelASBuffers.pResult->GetGPUVirtualAddress();
-	m_dxrDevice.Get()->CreateShaderResourceView(nullptr, &srvDesc, srvHandle);
+	m_dxrDevice.Get()->CreateShaderResourceView(nullptr, &srvDesc,
+		m_descriptorHeap.GetCpuHandle(m_raytracingDescriptors, c_tlasSrvSlot));
 
-	srvHandle.ptr += m_dxrDevice.Get()->GetDescriptorHandleIncrementSize(
-		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	UpdateCameraDescriptor();
+}
 
+/// <summary>
+/// Points the camera CBV slot at the camera constants. The address never changes, switching cameras only
+/// changes what is uploaded into it.
+/// </summary>
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::UpdateCameraDescriptor() {
 	D3D12_CONSTANT_BUFFER_VIEW_DESC cameraCbvDesc = {};
-	cameraCbvDesc.BufferLocation = m_cameraController.GetCurrentCamera()->GetCameraBuffer()->GetGPUVirtualAddress();
-	cameraCbvDesc.SizeInBytes = m_cameraController.GetCurrentCamera()->GetCameraBufferSize();
-	m_dxrDevice->CreateConstantBufferView(&cameraCbvDesc, srvHandle);
+	cameraCbvDesc.BufferLocation = m_cameraConstants.GetGpuAddress();
+	cameraCbvDesc.SizeInBytes = m_cameraConstants.GetSize();
+	m_dxrDevice->CreateConstantBufferView(&cameraCbvDesc,
+		m_descriptorHeap.GetCpuHandle(m_raytracingDescriptors, c_cameraCbvSlot));
 }
 
 
 /// <summary>
 /// Create the shader binding table for the raytracing pipeline by initializing the RayGen, Miss shaders
-/// and the Hit shaders per instances.
+/// and the Hit shaders per instances, objects first and heightfields after them. The record layout is only
+/// recomputed when the hit group or the root arguments of an instance changed, e.g. a reload that turns a mesh
+/// into a heightfield while keeping the instance count; otherwise the table is rewritten in place with the
+/// identifiers of the current pipeline.
 /// </summary>
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::CreateShaderBindingTable() {
+	SONAR_PROFILE_SCOPE("CreateShaderBindingTable");
+
+	ShaderTableLayout& layout = m_shaderTable.GetLayout();
+
+	std::vector<std::pair<const wchar_t*, uint32_t>> hitGroups;
+	for (auto& object : m_scene.m_objects) {
+		auto& model = m_objectLibrary.m_objects[object.GetModelIndex()];
+		hitGroups.push_back({ L"MeshHitGroup", model.m_bufferData.indexBuffer ? 2u : 1u });
+	}
+	for (size_t i = 0; i < m_scenarioModel.scene.m_heightfields.size(); ++i) {
+		hitGroups.push_back({ L"HeightfieldHitGroup", 3u });
+	}
 
-	m_sbtHelper.Reset();
+	const wchar_t* rayGenExport = m_activeDxrConfig.m_sonarRayGeneration ? L"SonarRayGen" : L"CameraRayGen";
+
+	bool keepLayout = layout.IsFinalized() && m_hitGroupRecords.size() == hitGroups.size() &&
+		layout.GetExportName(m_rayGenRecord) == rayGenExport;
+	for (size_t i = 0; keepLayout && i < hitGroups.size(); ++i) {
+		keepLayout = layout.GetExportName(m_hitGroupRecords[i]) == hitGroups[i].first &&
+			layout.GetArgumentCount(m_hitGroupRecords[i]) == hitGroups[i].second;
+	}
+
+	if (!keepLayout) {
+		layout.Reset();
+		m_hitGroupRecords.clear();
+
+		m_rayGenRecord = layout.AddRecord(ShaderTableSection::RayGeneration, rayGenExport, 1);
+		m_missRecord = layout.AddRecord(ShaderTableSection::Miss, L"MeshMiss", 0);
+
+		for (const auto& hitGroup : hitGroups) {
+			m_hitGroupRecords.push_back(layout.AddRecord(ShaderTableSection::HitGroup, hitGroup.first, hitGroup.second));
+		}
+
+		layout.Finalize();
+	}
+
+	UpdateShaderBindingTable();
+
+	m_shaderTable.Build(m_dxrDevice.Get(), m_rtStateObjectProps.Get());
+}
+
+/// <summary>
+/// Sets the root arguments of every record. Only records whose arguments changed get rewritten.
+/// </summary>
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::UpdateShaderBindingTable() {
+	SONAR_PROFILE_SCOPE("UpdateShaderBindingTable");
 
 	D3D12_GPU_DESCRIPTOR_HANDLE srvUavHeapHandle =
-		m_srvUavHeap->GetGPUDescriptorHandleForHeapStart();
+		m_descriptorHeap.GetGpuHandle(m_raytracingDescriptors);
 
 	auto srvHeapPointer = reinterpret_cast<UINT64*>(srvUavHeapHandle.ptr);
 
-	m_sbtHelper.AddRayGenerationProgram(L"CameraRayGen", { srvHeapPointer });
-	m_sbtHelper.AddMissProgram(L"MeshMiss", {});
+	m_shaderTable.SetArguments(m_rayGenRecord, { srvHeapPointer });
 
-	for (auto& object : m_scene.m_objects) {
-		auto model = m_objectLibrary.m_objects[object.GetModelIndex()];
+	for (size_t i = 0; i < m_scene.m_objects.size(); ++i) {
+		auto& model = m_objectLibrary.m_objects[m_scene.m_objects[i].GetModelIndex()];
 
 		if (model.m_bufferData.indexBuffer)
 		{
-			m_sbtHelper.AddHitGroup(
-				L"MeshHitGroup",
+			m_shaderTable.SetArguments(
+				m_hitGroupRecords[i],
 				{
-					(void*)(model.m_bufferData.vertexBuffer->GetGPUVirtualAddress()),
-					(void*)(model.m_bufferData.indexBuffer->GetGPUVirtualAddress()),
+					(void*)(model.m_bufferData.vertexBufferView.BufferLocation),
+					(void*)(model.m_bufferData.indexBufferView.BufferLocation),
 				});
 		}
 		else {
-			m_sbtHelper.AddHitGroup(
-				L"MeshHitGroup",
+			m_shaderTable.SetArguments(
+				m_hitGroupRecords[i],
 				{
-					(void*)(model.m_bufferData.vertexBuffer->GetGPUVirtualAddress()),
+					(void*)(model.m_bufferData.vertexBufferView.BufferLocation),
 				});
 		}
-
 	}
 
-	
-	// Shadow hit group is added after each addition of the original hitgroup, 
-	// so that all geometry can be hit!
-	uint32_t sbtSize = m_sbtHelper.ComputeSBTSize();
+	for (size_t i = 0; i < m_scenarioModel.scene.m_heightfields.size(); ++i) {
+		auto& heightfield = m_objectLibrary.m_heightfields[m_heightfieldByIndex.at(m_scenarioModel.scene.m_heightfields[i].heightfield)];
 
-	m_sbtStorage = nv_helpers_dx12::CreateBuffer(
-		m_dxrDevice.Get(), sbtSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-	if (!m_sbtStorage) {
-		throw std::logic_error("Could not allocate the shader binding table");
+		m_shaderTable.SetArguments(
+			m_hitGroupRecords[m_scene.m_objects.size() + i],
+			{
+				(void*)(heightfield.heightAllocation.gpuAddress),
+				(void*)(heightfield.pyramidAllocation.gpuAddress),
+				(void*)(heightfield.constantsAllocation.gpuAddress),
+			});
 	}
-
-	m_sbtHelper.Generate(m_sbtStorage.Get(), m_rtStateObjectProps.Get());
 }
 
 #pragma endregion
@@ -600,73 +996,170 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::CheckRayTracingSupport
 
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::Update(DX::StepTimer const& timer) {
+	SONAR_PROFILE_SCOPE("RayTracingRenderer::Update");
 
 	if (!m_loadingComplete)
 	{
 		return;
 	}
 
+	StageTimer stageTimer(m_timingStats, TimingStage::Update);
+	ScopedAllocationCounter allocationCounter;
+
 	if (m_animate) {
+		StageTimer refitTimer(m_timingStats, TimingStage::AccelerationStructures);
 		UpdateInstanceTransforms();
 	}
 
+	PollScenario(timer);
+
 	m_cameraController.ProcessCameraUpdate(timer);
 
-	if (m_cameraController.IsBufferDirty())
-	{
-		CreateShaderResourceHeap();
-		CreateShaderBindingTable();
-		m_cameraController.SetBufferToClean();
-		
-	}
+	// 256 bytes per frame; cheaper than tracking which camera changed in which frame slice.
+	auto camera = m_cameraController.GetCurrentCamera();
+	m_cameraConstants.Write(m_deviceResources->GetCurrentFrameIndex(), camera->GetCameraData(), camera->GetCameraBufferSize());
+	m_cameraController.SetBufferToClean();
+
+	m_frameHeapAllocations = allocationCounter.GetAllocations();
 }
 
 bool SonarPropagation::Graphics::DXR::RayTracingRenderer::Render() {
+	SONAR_PROFILE_SCOPE("RayTracingRenderer::Render");
 
 	if (!m_loadingComplete)
 	{
 		return false;
 	}
 
+	// StepTimer runs at a fixed step, so the frame time is the interval between Render() calls.
+	auto renderTime = std::chrono::steady_clock::now();
+	if (m_hasLastRenderTime) {
+		std::chrono::duration<double, std::milli> frameTime = renderTime - m_lastRenderTime;
+		m_timingStats.AddCpuSample(TimingStage::Frame, frameTime.count());
+	}
+	m_lastRenderTime = renderTime;
+	m_hasLastRenderTime = true;
+
+	ScopedAllocationCounter allocationCounter;
+
 	if (m_pipelineDirty) {
-		CreateRaytracingPipeline();
-		m_sbtDirty = true;
-		m_pipelineDirty = false;
+		// Keep dispatching with the current state object until the requested one has been built in the
+		// background. The new shader identifiers reach each copy of the SBT through m_shaderTable.Update().
+		PipelineKey requested = MakePipelineKey(m_dxrConfig);
+		ComPtr<ID3D12StateObject> stateObject;
+
+		if (m_pipelineCache->TryAcquire(requested, stateObject)) {
+			SetStateObject(stateObject);
+			if (m_dxrConfig.m_sonarRayGeneration != m_activeDxrConfig.m_sonarRayGeneration) {
+				// The ray generation record names another export, so the table is rebuilt below.
+				m_sbtDirty = true;
+			}
+			else {
+				m_shaderTable.SetPipeline(m_rtStateObjectProps.Get());
+			}
+			m_activeDxrConfig = m_dxrConfig;
+			m_pipelineDirty = false;
+
+			PrebuildLikelyPipelines();
+		}
+		else if (m_pipelineCache->GetState(requested) == PipelineBuildState::Failed) {
+			OutputDebugStringA("Raytracing pipeline build failed; keeping the previous configuration\n");
+			m_dxrConfig = m_activeDxrConfig;
+			m_pipelineDirty = false;
+		}
 	}
 
-	if (m_sbtDirty) {
-		CreateShaderBindingTable();
-		m_sbtDirty = false;
+	if (m_scenarioPending) {
+		ApplyScenarioChanges();
 	}
 
-	//PhotonMappingPreprocess();
-	PopulateCommandListForRendering();
+	{
+		StageTimer stageTimer(m_timingStats, TimingStage::ShaderTable);
 
-	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-	m_deviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+		if (m_sbtDirty) {
+			// A new record layout rewrites every copy of the table, including the ones of the frames in flight.
+			m_deviceResources->WaitForGpu();
+			CreateShaderBindingTable();
+			m_sbtDirty = false;
+		}
+
+		// Patches the records changed since this frame's copy of the table was last used; free when nothing changed.
+		m_shaderTable.Update(m_deviceResources->GetCurrentFrameIndex());
+	}
 
-	m_deviceResources->Present();
+	{
+		StageTimer stageTimer(m_timingStats, TimingStage::Dispatch);
 
-	m_deviceResources->WaitForGpu();
+		//PhotonMappingPreprocess();
+		PopulateCommandListForRendering();
+
+		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+		m_deviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+	}
+
+	// Present() only blocks until the resources of the next frame slot are free, so the CPU records the
+	// next frame while the GPU is still executing this one.
+	{
+		SONAR_PROFILE_SCOPE("Present");
+		StageTimer stageTimer(m_timingStats, TimingStage::Present);
+		m_deviceResources->Present();
+	}
+
+	const UINT64 completedFenceValue = m_deviceResources->GetCompletedFenceValue();
+	m_retiredStateObjects.Collect(completedFenceValue);
+
+	// Every frame completed since the last update, oldest first, so no GPU sample is dropped.
+	while (m_gpuTimer->Collect(completedFenceValue)) {
+		for (uint32_t stage = 0; stage < static_cast<uint32_t>(TimingStage::Count); ++stage) {
+			double milliseconds;
+			if (m_gpuTimer->GetMilliseconds(stage, milliseconds)) {
+				m_timingStats.AddGpuSample(static_cast<TimingStage>(stage), milliseconds);
+			}
+		}
+	}
+
+	m_frameHeapAllocations += allocationCounter.GetAllocations();
 
 	return true;
 }
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::SaveState() {
-	return;
+	auto state = Windows::Storage::ApplicationData::Current->LocalSettings->Values;
+
+	if (state->HasKey(c_scenarioPathKey)) {
+		state->Remove(c_scenarioPathKey);
+	}
+
+	state->Insert(c_scenarioPathKey, Windows::Foundation::PropertyValue::CreateString(ref new Platform::String(m_scenarioPath.c_str())));
 }
 
+/// <summary>
+/// Restores the scenario file of the last session; the first session uses scene.scenario in the local
+/// folder, which the app can read and a user can edit while it runs.
+/// </summary>
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::LoadState() {
-	return;
+	auto state = Windows::Storage::ApplicationData::Current->LocalSettings->Values;
+
+	m_scenarioPath = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\scene.scenario";
+	if (state->HasKey(c_scenarioPathKey)) {
+		m_scenarioPath = safe_cast<Windows::Foundation::IPropertyValue^>(state->Lookup(c_scenarioPathKey))->GetString()->Data();
+	}
 }
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListForRendering() {
+	SONAR_PROFILE_SCOPE("PopulateCommandList");
+
+	m_frameArena.Reset();
 
 	DX::ThrowIfFailed(m_deviceResources->GetCommandAllocator()->Reset());
 
 	// The command list can be reset anytime after ExecuteCommandList() is called.
 	DX::ThrowIfFailed(m_commandList->Reset(m_deviceResources->GetCommandAllocator(), m_pipelineState.Get()));
 
+	m_gpuTimer->Begin(m_commandList.Get(), static_cast<uint32_t>(TimingStage::Frame));
+
+	m_cameraConstants.RecordUpload(m_commandList.Get(), m_deviceResources->GetCurrentFrameIndex());
+
 	PIXBeginEvent(m_commandList.Get(), 0, L"Draw Scene");
 	{
 		// Set the graphics root signature and descriptor heaps to be used by this frame.
@@ -690,11 +1183,11 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListFor
 
 		m_commandList->OMSetRenderTargets(1, &renderTargetView, false, &depthStencilView);
 
-		std::vector<ID3D12DescriptorHeap*> heaps = { m_srvUavHeap.Get() };
+		auto heaps = m_frameArena.MakeArray<ID3D12DescriptorHeap*>({ m_descriptorHeap.GetHeap() });
 
 
-		m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size()),
-			heaps.data());
+		m_commandList->SetDescriptorHeaps(static_cast<UINT>(heaps.size),
+			heaps.data);
 
 		CD3DX12_RESOURCE_BARRIER transition = CD3DX12_RESOURCE_BARRIER::Transition(
 			m_outputResource.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE,
@@ -704,19 +1197,7 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListFor
 		// Setup the raytracing task
 		D3D12_DISPATCH_RAYS_DESC desc = {};
 
-		uint32_t rayGenerationSectionSizeInBytes = m_sbtHelper.GetRayGenSectionSize();
-		desc.RayGenerationShaderRecord.StartAddress = m_sbtStorage->GetGPUVirtualAddress();
-		desc.RayGenerationShaderRecord.SizeInBytes = rayGenerationSectionSizeInBytes;
-
-		uint32_t missSectionSizeInBytes = m_sbtHelper.GetMissSectionSize();
-		desc.MissShaderTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes;
-		desc.MissShaderTable.SizeInBytes = missSectionSizeInBytes;
-		desc.MissShaderTable.StrideInBytes = m_sbtHelper.GetMissEntrySize();
-
-		uint32_t hitGroupsSectionSize = m_sbtHelper.GetHitGroupSectionSize();
-		desc.HitGroupTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
-		desc.HitGroupTable.SizeInBytes = hitGroupsSectionSize;
-		desc.HitGroupTable.StrideInBytes = m_sbtHelper.GetHitGroupEntrySize();
+		m_shaderTable.FillDispatchDesc(m_deviceResources->GetCurrentFrameIndex(), desc);
 
 		// Dimensions of the image to render, identical to a kernel launch dimension
 		desc.Width = m_deviceResources->GetScreenViewport().Width;
@@ -726,7 +1207,9 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListFor
 		// Bind the raytracing pipeline
 		m_commandList->SetPipelineState1(m_rtStateObject.Get());
 		// Dispatch the rays and write to the raytracing output
+		m_gpuTimer->Begin(m_commandList.Get(), static_cast<uint32_t>(TimingStage::Dispatch));
 		m_commandList->DispatchRays(&desc);
+		m_gpuTimer->End(m_commandList.Get(), static_cast<uint32_t>(TimingStage::Dispatch));
 
 		{
 			auto transitionOutputResource = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -737,9 +1220,9 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListFor
 				m_deviceResources->GetRenderTarget(), D3D12_RESOURCE_STATE_RENDER_TARGET,
 				D3D12_RESOURCE_STATE_COPY_DEST);
 			
-			std::vector<CD3DX12_RESOURCE_BARRIER> transitions = { transitionOutputResource, transitionDeviceResources };
+			auto transitions = m_frameArena.MakeArray<CD3DX12_RESOURCE_BARRIER>({ transitionOutputResource, transitionDeviceResources });
 
-			m_commandList->ResourceBarrier(2, transitions.data());
+			m_commandList->ResourceBarrier(static_cast<UINT>(transitions.size), transitions.data);
 		}
 
 		m_commandList->CopyResource(m_deviceResources->GetRenderTarget(),
@@ -762,12 +1245,16 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::PopulateCommandListFor
 	}
 	PIXEndEvent(m_commandList.Get());
 
+	m_gpuTimer->End(m_commandList.Get(), static_cast<uint32_t>(TimingStage::Frame));
+	m_gpuTimer->Resolve(m_commandList.Get(), m_deviceResources->GetCurrentFrameIndex(), m_deviceResources->GetCurrentFrameFenceValue());
+
 	DX::ThrowIfFailed(m_commandList->Close());
 
 }
 
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::RenderImGui() {
+	SONAR_PROFILE_SCOPE("RenderImGui");
 	m_imguiManager.BeginImGui(m_commandList.Get());
 
 	{
@@ -789,6 +1276,19 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::RenderImGui() {
 					ImGui::Checkbox("Animate", &m_animate);
 					ImGui::EndTabItem();
 				}
+
+				if (ImGui::BeginTabItem("Scenario"))
+				{
+					ImGui::TextWrapped("%s", m_scenarioWatcher ? m_scenarioWatcher->GetFilename().c_str() : "");
+					ImGui::Text("%zu instances, %zu meshes, %zu sources, %zu receivers", m_scene.m_objects.size(),
+						m_scenarioModel.meshes.size(), m_scenarioModel.scene.m_soundSources.size(), m_scenarioModel.scene.m_soundReceivers.size());
+
+					const std::string& error = m_scenarioError.empty() && m_scenarioWatcher ? m_scenarioWatcher->GetLastError() : m_scenarioError;
+					if (!error.empty()) {
+						ImGui::TextWrapped("%s", error.c_str());
+					}
+					ImGui::EndTabItem();
+				}
 				ImGui::EndTabBar();
 			}
 			ImGui::End();
@@ -816,20 +1316,96 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::RenderImGui() {
 			{
 				static bool showDXRInfo = false;
 				static bool showDXRControls = false;
+				static bool showTimings = false;
 				ImGui::Checkbox("Show raytracing information", &showDXRInfo);
 				ImGui::Checkbox("Show raytracing controls", &showDXRControls);
+				ImGui::Checkbox("Show frame timings", &showTimings);
 
 				if (showDXRInfo) {
 					if (ImGui::BeginChild("Information", ImVec2(400, 200)))
 					{
 						int maxPayloadSize = m_dxrConfig.m_maxPayloadSize;
 						int maxAttributeSize = m_dxrConfig.m_maxAttributeSize;
-						int recursionDepth = m_dxrConfig.m_recursionDepth;
+						int recursionDepth = m_activeDxrConfig.m_recursionDepth;
 
 						ImGui::InputInt("Max Payload Size", &maxPayloadSize, 0, 0, ImGuiInputTextFlags_ReadOnly);
 						ImGui::InputInt("Max Attribute Size", &maxAttributeSize, 0, 0, ImGuiInputTextFlags_ReadOnly);
 						ImGui::InputInt("Max Recursion Depth", &recursionDepth, 0, 0, ImGuiInputTextFlags_ReadOnly);
 
+						ImGui::Separator();
+
+						if (AllocationCounter::IsEnabled()) {
+							ImGui::Text("Heap allocations / frame: %llu", m_frameHeapAllocations);
+						}
+						ImGui::Text("Frame arena: %zu / %zu bytes (overflows: %zu)",
+							m_frameArena.GetStats().peakBytesInUse, m_frameArena.Capacity(), m_frameArena.GetOverflowCount());
+
+						PipelineCacheStats pipelineStats = m_pipelineCache->GetStats();
+						ImGui::Text("Pipeline cache: %llu built, %llu hits, %llu queued",
+							pipelineStats.builds, pipelineStats.hits, static_cast<unsigned long long>(m_pipelineCache->GetQueuedCount()));
+
+						ImGui::Separator();
+
+						if (!Profiler::IsCapturing()) {
+							if (ImGui::Button("Start CPU trace")) {
+								Profiler::BeginCapture();
+							}
+						}
+						else if (ImGui::Button("Stop CPU trace")) {
+							Profiler::EndCapture();
+							m_tracePath = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\trace.json";
+							Profiler::WriteChromeTrace(m_tracePath);
+						}
+
+						if (!m_tracePath.empty()) {
+							ProfilerStats profilerStats = Profiler::GetStats();
+							ImGui::TextWrapped("%ls", m_tracePath.c_str());
+							ImGui::Text("%llu events on %u threads (dropped: %llu)",
+								profilerStats.collectedEvents, profilerStats.threadCount, profilerStats.droppedEvents);
+						}
+
+						ImGui::EndChild();
+					}
+				}
+
+				if (showTimings) {
+					if (ImGui::BeginChild("Timings", ImVec2(400, 260)))
+					{
+						ImGui::Text("%-16s %7s %7s %7s %7s", "Stage (ms)", "p50", "p95", "p99", "max");
+
+						for (uint32_t i = 0; i < static_cast<uint32_t>(TimingStage::Count); ++i) {
+							TimingStage stage = static_cast<TimingStage>(i);
+
+							TimingSummary cpu = m_timingStats.GetCpuSummary(stage);
+							if (cpu.count > 0) {
+								ImGui::Text("%-12s cpu %7.3f %7.3f %7.3f %7.3f", GetTimingStageName(stage), cpu.p50, cpu.p95, cpu.p99, cpu.max);
+							}
+
+							TimingSummary gpu = m_timingStats.GetGpuSummary(stage);
+							if (gpu.count > 0) {
+								ImGui::Text("%-12s gpu %7.3f %7.3f %7.3f %7.3f", GetTimingStageName(stage), gpu.p50, gpu.p95, gpu.p99, gpu.max);
+							}
+						}
+
+						if (!m_gpuTimer->IsAvailable()) {
+							ImGui::Text("GPU timestamps are not supported on this queue");
+						}
+
+						if (ImGui::Button("Reset")) {
+							m_timingStats.Clear();
+						}
+						ImGui::SameLine();
+						if (ImGui::Button("Write CSV")) {
+							m_timingCsvPath = std::wstring(Windows::Storage::ApplicationData::Current->LocalFolder->Path->Data()) + L"\\timings.csv";
+							if (!m_timingStats.WriteCsv(m_timingCsvPath)) {
+								m_timingCsvPath = L"(could not write timings.csv)";
+							}
+						}
+
+						if (!m_timingCsvPath.empty()) {
+							ImGui::TextWrapped("%ls", m_timingCsvPath.c_str());
+						}
+
 						ImGui::EndChild();
 					}
 				}
@@ -838,18 +1414,54 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::RenderImGui() {
 				{
 					if (ImGui::BeginChild("Controls"))
 					{
-						if (ImGui::Checkbox("Use reflective materials?", &m_useReflections))
-						{
-							m_sbtDirty = true;
-						}
+						// No shader record depends on the reflection toggle, so the SBT stays untouched.
+						ImGui::Checkbox("Use reflective materials?", &m_useReflections);
 
 						int recursionDepth = m_dxrConfig.m_recursionDepth;
 
 						if (ImGui::InputInt("Ray Recursion Depth", &recursionDepth, 1, 1))
 						{
+							recursionDepth = std::max(1, std::min(recursionDepth, static_cast<int>(D3D12_RAYTRACING_MAX_DECLARABLE_TRACE_RECURSION_DEPTH)));
 							m_dxrConfig.m_recursionDepth = recursionDepth;
 							m_pipelineDirty = true;
 						}
+
+						bool sonarRayGeneration = m_dxrConfig.m_sonarRayGeneration;
+						if (ImGui::Checkbox("Sonar ray generation", &sonarRayGeneration))
+						{
+							m_dxrConfig.m_sonarRayGeneration = sonarRayGeneration;
+							PrepareSonarKernels(m_dxrConfig);
+							m_pipelineDirty = true;
+						}
+
+						if (m_dxrConfig.m_sonarRayGeneration)
+						{
+							const char* tableaus[] = { "Euler", "Midpoint", "Runge-Kutta 4" };
+							const char* precisions[] = { "fp32", "fp16" };
+							int tableau = static_cast<int>(m_dxrConfig.m_sonarKernels.tableau);
+							int precision = static_cast<int>(m_dxrConfig.m_sonarKernels.precision);
+
+							bool changed = ImGui::Combo("Integrator", &tableau, tableaus, IM_ARRAYSIZE(tableaus));
+							changed |= ImGui::Combo("Precision", &precision, precisions, IM_ARRAYSIZE(precisions));
+							if (changed)
+							{
+								m_dxrConfig.m_sonarKernels.tableau = static_cast<IntegratorTableau>(tableau);
+								m_dxrConfig.m_sonarKernels.precision = static_cast<KernelPrecision>(precision);
+								// Usually precompiled along with the previous permutation; otherwise compiled here.
+								PrepareSonarKernels(m_dxrConfig);
+								m_pipelineDirty = true;
+							}
+						}
+
+						if (m_pipelineDirty) {
+							ImGui::Text("Building pipeline for depth %u...", m_dxrConfig.m_recursionDepth);
+						}
+
+						int frameLatency = m_deviceResources->GetMaxFrameLatency();
+						if (ImGui::SliderInt("Frame Latency", &frameLatency, 1, DX::c_frameCount))
+						{
+							m_deviceResources->SetMaxFrameLatency(frameLatency);
+						}
 						ImGui::EndChild();
 					}
 				}
@@ -870,6 +1482,111 @@ void SonarPropagation::Graphics::DXR::RayTracingRenderer::UpdateInstanceTransfor
 
 }
 
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::PollScenario(DX::StepTimer const& timer) {
+	// A few stat() calls; twice a second keeps edits feeling immediate without touching the disk every frame.
+	if (m_scenarioPending || !m_scenarioWatcher || timer.GetTotalSeconds() - m_lastScenarioPoll < 0.5) {
+		return;
+	}
+
+	SONAR_PROFILE_SCOPE("PollScenario");
+	m_lastScenarioPoll = timer.GetTotalSeconds();
+	m_scenarioPending = m_scenarioWatcher->Poll(m_scenario, m_pendingScenario, m_pendingChanges);
+}
+
+void SonarPropagation::Graphics::DXR::RayTracingRenderer::ApplyScenarioChanges() {
+	SONAR_PROFILE_SCOPE("ApplyScenarioChanges");
+	StageTimer stageTimer(m_timingStats, TimingStage::AccelerationStructures);
+
+	m_scenarioPending = false;
+
+	// A scenario that does not build leaves the scene as it is until the next edit.
+	Sonar::ScenarioModel model;
+	try {
+		model = Sonar::BuildScenarioModel(m_pendingScenario, m_meshLibrary, m_pendingChanges.meshes);
+	}
+	catch (const std::exception& exception) {
+		m_scenarioError = exception.what();
+		return;
+	}
+
+	m_scenarioError.clear();
+	m_scenario = std::move(m_pendingScenario);
+	m_scenarioModel = std::move(model);
+
+	const bool rebuild = m_pendingChanges.instancesChanged || !m_pendingChanges.meshes.empty();
+	if (!rebuild && !m_pendingChanges.transformsChanged) {
+		// Materials, sound speed and sensors have no GPU resources yet.
+		return;
+	}
+
+	// Geometry and acceleration structures of the frames in flight are replaced or refitted in place.
+	m_deviceResources->WaitForGpu();
+
+	DX::ThrowIfFailed(m_deviceResources->GetCommandAllocator()->Reset());
+	DX::ThrowIfFailed(m_commandList->Reset(m_deviceResources->GetCommandAllocator(), m_pipelineState.Get()));
+
+	if (rebuild) {
+		// Reloaded meshes and heightfields kept their MeshLibrary slot, so their old GPU copy is dropped and
+		// uploaded again.
+		for (const std::string& name : m_pendingChanges.meshes) {
+			auto mesh = m_scenarioModel.meshes.find(name);
+			if (mesh != m_scenarioModel.meshes.end()) {
+				auto found = m_modelByMesh.find(mesh->second);
+				if (found != m_modelByMesh.end()) {
+					m_objectLibrary.ReleaseModel(found->second);
+					m_modelByMesh.erase(found);
+				}
+			}
+
+			auto heightfield = m_scenarioModel.heightfields.find(name);
+			if (heightfield != m_scenarioModel.heightfields.end()) {
+				auto found = m_heightfieldByIndex.find(heightfield->second);
+				if (found != m_heightfieldByIndex.end()) {
+					m_objectLibrary.ReleaseHeightfield(found->second);
+					m_heightfieldByIndex.erase(found);
+				}
+			}
+		}
+
+		m_objectLibrary.BeginUpload(m_commandList.Get());
+		UploadScenarioMeshes();
+		m_objectLibrary.EndUpload();
+
+		CreateScene();
+
+		// Only models without a BLAS get one; the TLAS is rebuilt over the new set of instances.
+		m_instances.clear();
+		m_topLevelASGenerator = nv_helpers_dx12::TopLevelASGenerator();
+		CreateAccelerationStructures<VertexPositionNormalUV>();
+		DX::ThrowIfFailed(m_commandList->Close());
+
+		m_deviceResources->WaitForFenceValue(m_uploadFenceValue);
+		m_objectLibrary.OnUploadCompleted();
+
+		// The TLAS lives in new buffers, and the hit group records follow the instances.
+		CreateShaderResourceHeap();
+		m_sbtDirty = true;
+	}
+	else {
+		const std::vector<Sonar::Matrix4x3> world = m_scenarioModel.scene.ComputeWorldTransforms();
+		const size_t objectCount = m_scenarioModel.scene.m_objects.size();
+		for (size_t i = 0; i < m_instances.size(); ++i) {
+			const size_t transform = i < objectCount
+				? m_scenarioModel.scene.m_objects[i].transform
+				: m_scenarioModel.scene.m_heightfields[i - objectCount].transform;
+			m_instances[i].second = ToXMMatrix(world[transform]);
+		}
+
+		// The TLAS generator refers to the matrices of m_instances, so the refit picks the new ones up.
+		CreateTopLevelAS(m_instances, true);
+		DX::ThrowIfFailed(m_commandList->Close());
+
+		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+		m_deviceResources->GetCommandQueue()->ExecuteCommandLists(1, ppCommandLists);
+		m_deviceResources->WaitForGpu();
+	}
+}
+
 
 void SonarPropagation::Graphics::DXR::RayTracingRenderer::KeyPressed(Windows::UI::Core::KeyEventArgs^ args) {
 	m_cameraController.KeyPressed(args);
@@ -10,6 +10,15 @@
 #include "Common/ImGuiManager.h"
 #include "DXR/RayTracingConfig.h"
 #include "Common/ObjectLibrary.h"
+#include "Common/FrameArena.h"
+#include "Common/AllocationCounter.h"
+#include "Common/DescriptorAllocator.h"
+#include "Common/FrameResources.h"
+#include "Common/TimingStats.h"
+#include "Common/GpuTimer.h"
+#include "DXR/ShaderTable.h"
+#include "DXR/PipelineStateCache.h"
+#include "Sonar/ScenarioFile.h"
 #include "DescriptorHeap.h"
 
 
@@ -126,6 +135,12 @@ namespace SonarPropagation{
 				/// <returns></returns>
 				ComPtr<ID3D12RootSignature> CreateMissSignature();
 
+				/// <summary>
+				/// Creates the signature of the heightfield hit group: heights, pyramid and grid constants.
+				/// </summary>
+				/// <returns></returns>
+				ComPtr<ID3D12RootSignature> CreateHeightfieldSignature();
+
 				/// <summary>
 				/// Creates the necessary resources and interfaces for raytracing.
 				/// At the moment it only creates the DXR compatible device.
@@ -146,6 +161,38 @@ namespace SonarPropagation{
 				/// </summary>
 				void CreateRaytracingPipeline();
 
+				/// <summary>
+				/// Loads the shader libraries and creates the root signatures shared by every pipeline configuration.
+				/// </summary>
+				void LoadRaytracingLibraries();
+
+				/// <summary>
+				/// Key of the state object for the given configuration.
+				/// </summary>
+				PipelineKey MakePipelineKey(const RayTracingConfig& config) const;
+
+				/// <summary>
+				/// Compiles the sonar ray generation permutations reachable from the configuration.
+				/// Must run before MakePipelineKey is called for a configuration using the sonar kernels.
+				/// </summary>
+				void PrepareSonarKernels(const RayTracingConfig& config);
+
+				/// <summary>
+				/// Creates a state object. Runs on the pipeline cache worker, so it only reads state that
+				/// LoadRaytracingLibraries() set up.
+				/// </summary>
+				ComPtr<ID3D12StateObject> BuildStateObject(const PipelineKey& key);
+
+				/// <summary>
+				/// Makes the state object current; the previous one is kept alive until the frames using it retire.
+				/// </summary>
+				void SetStateObject(const ComPtr<ID3D12StateObject>& stateObject);
+
+				/// <summary>
+				/// Queues background builds of the configurations reachable with one click in the ImGui panel.
+				/// </summary>
+				void PrebuildLikelyPipelines();
+
 				/// <summary>
 				/// Creates the raytracing output buffer.
 				/// </summary>
@@ -159,15 +206,39 @@ namespace SonarPropagation{
 				/// </summary>
 				void CreateShaderResourceHeap();
 
+				/// <summary>
+				/// Points the camera CBV at the per-frame camera constants.
+				/// </summary>
+				void UpdateCameraDescriptor();
+
 				/// <summary>
 				/// Creates the shader binding table.
 				/// </summary>
 				void CreateShaderBindingTable();
 
+				/// <summary>
+				/// Updates the root arguments of the shader binding table records.
+				/// </summary>
+				void UpdateShaderBindingTable();
+
+				/// <summary>
+				/// Loads the scenario file and uploads its meshes. Without a file that builds, the scene is the
+				/// sea surface alone.
+				/// </summary>
 				void InitializeObjects();
 				
+				/// <summary>
+				/// Fills m_scene with the instances of the scenario model. Objects of instances that existed
+				/// before keep their resources.
+				/// </summary>
 				void CreateScene();
 
+				/// <summary>
+				/// Uploads the meshes and heightfields of the scenario model that have no ObjectLibrary resources yet. Has to be
+				/// called between BeginUpload and EndUpload.
+				/// </summary>
+				void UploadScenarioMeshes();
+
 			// Raytracing Render Loop:
 				
 				/// <summary>
@@ -180,6 +251,17 @@ namespace SonarPropagation{
 				/// Updates the transforms found in the instance constant buffers.
 				/// </summary>
 				void UpdateInstanceTransforms();
+
+				/// <summary>
+				/// Checks the scenario file and its meshes for modifications, twice a second.
+				/// </summary>
+				void PollScenario(DX::StepTimer const& timer);
+
+				/// <summary>
+				/// Applies a modified scenario between frames. Reloaded meshes get new BLASes and a changed set
+				/// of instances rebuilds the TLAS and the SBT layout; moved transforms only refit the TLAS.
+				/// </summary>
+				void ApplyScenarioChanges();
 				
 				/// <summary>
 				/// Renders the ImGui windows.
@@ -209,10 +291,17 @@ namespace SonarPropagation{
 				/// <param name="vIndexBuffers"></param>
 				/// <returns></returns>
 				template <typename V>
-				AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
-					std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers
+				AccelerationStructureBuffers CreateBottomLevelAS(std::vector<std::pair<BufferAllocation, uint32_t>> vVertexBuffers,
+					std::vector<std::pair<BufferAllocation, uint32_t>> vIndexBuffers
 				);
 
+				/// <summary>
+				/// Creates the bottom level acceleration structure of a heightfield, one procedural box per tile.
+				/// </summary>
+				/// <param name="heightfield"></param>
+				/// <returns></returns>
+				AccelerationStructureBuffers CreateProceduralBottomLevelAS(const HeightfieldResources& heightfield);
+
 			private:
 				// Raytracing pipeline objects:
 				ComPtr<ID3D12StateObject> m_rtStateObject;
@@ -237,16 +326,48 @@ namespace SonarPropagation{
 				Scene			m_scene;
 				ObjectLibrary    m_objectLibrary;
 
+				// Scenario the scene is built from. Meshes are parsed once into m_meshLibrary and uploaded once
+				// into m_objectLibrary, whatever the number of instances.
+				std::wstring										m_scenarioPath;
+				std::unique_ptr<SonarPropagation::Sonar::ScenarioWatcher> m_scenarioWatcher;
+				SonarPropagation::Sonar::ScenarioDescription		m_scenario;
+				SonarPropagation::Sonar::ScenarioModel				m_scenarioModel;
+				SonarPropagation::Sonar::MeshLibrary				m_meshLibrary;
+				std::map<size_t, size_t>							m_modelByMesh;
+				std::map<size_t, size_t>							m_heightfieldByIndex;
+				// Scenario instance of every m_scene.m_objects entry.
+				std::vector<std::string>							m_objectNames;
+				std::string											m_scenarioError;
+
+				SonarPropagation::Sonar::ScenarioDescription		m_pendingScenario;
+				SonarPropagation::Sonar::ScenarioChanges			m_pendingChanges;
+				bool												m_scenarioPending = false;
+				double												m_lastScenarioPoll = 0.0;
+
 				std::vector<std::pair<ComPtr<ID3D12Resource>, XMMATRIX>> m_instances;
 
+				// Transient per-frame allocations, reset at the start of every command list:
+				FrameArena											m_frameArena;
+
 				// DXR Specific Attributes:
 				ComPtr<ID3D12Device5>								m_dxrDevice;
 
 				ComPtr<ID3D12Resource>								m_outputResource;
 
-				ComPtr<ID3D12DescriptorHeap>						m_srvUavHeap;
-				nv_helpers_dx12::ShaderBindingTableGenerator		m_sbtHelper;
-				ComPtr<ID3D12Resource>								m_sbtStorage;
+				// Persistent shader visible heap; the raytracing descriptors keep their slots for the
+				// lifetime of the renderer and are rewritten in place.
+				static const uint32_t c_descriptorHeapCapacity = 64;
+				static const uint32_t c_raytracingDescriptorCount = 3;
+				static const uint32_t c_outputUavSlot = 0;
+				static const uint32_t c_tlasSrvSlot = 1;
+				static const uint32_t c_cameraCbvSlot = 2;
+
+				DescriptorAllocator									m_descriptorHeap;
+				DescriptorRange										m_raytracingDescriptors;
+				ShaderTable											m_shaderTable;
+				uint32_t											m_rayGenRecord = 0;
+				uint32_t											m_missRecord = 0;
+				std::vector<uint32_t>								m_hitGroupRecords;
 				ComPtr<ID3D12Resource>								m_bottomLevelAS;
 				AccelerationStructureBuffers						m_topLevelASBuffers;
 				nv_helpers_dx12::TopLevelASGenerator				m_topLevelASGenerator;
@@ -261,22 +382,42 @@ namespace SonarPropagation{
 				ComPtr<IDxcBlob>									m_rayGenLibrary;
 				ComPtr<IDxcBlob>									m_hitLibrary;
 				ComPtr<IDxcBlob>									m_missLibrary;
+				ComPtr<IDxcBlob>									m_heightfieldLibrary;
+
+				// Sonar ray generation per kernel permutation. The hashes are only used on the main thread;
+				// the libraries are also read by BuildStateObject on the pipeline cache worker.
+				std::unique_ptr<ShaderPermutationLibrary>			m_sonarRayGenPermutations;
+				std::map<std::wstring, std::string>					m_sonarRayGenHashes;
+				std::map<std::string, ComPtr<IDxcBlob>>				m_sonarRayGenLibraries;
+				std::mutex											m_sonarRayGenMutex;
 
 				// Root Signatures for Shader:
 				ComPtr<ID3D12RootSignature>							m_rayGenSignature;
 				ComPtr<ID3D12RootSignature>							m_hitSignature;
 				ComPtr<ID3D12RootSignature>							m_missSignature;
+				ComPtr<ID3D12RootSignature>							m_heightfieldSignature;
+
+				// State objects per configuration, built in the background. Declared after the libraries and
+				// root signatures so the worker is joined before they are released.
+				PipelineKey											m_pipelineKeyBase;
+				RayTracingConfig									m_activeDxrConfig;
+				std::unique_ptr<PipelineStateCache<ComPtr<ID3D12StateObject>>> m_pipelineCache;
+				FenceRetireQueue<ComPtr<ID3D12StateObject>>			m_retiredStateObjects;
 
 				// Camera: 
 
 				SonarPropagation::Graphics::Utils::CameraController m_cameraController;
 
+				// Written every frame while earlier frames may still read the previous matrices.
+				FrameConstantBuffer									m_cameraConstants;
+
 				uint32_t											m_aspectRatio;
 
 				// ImGUI:
 
 				ComPtr<ID3D12DescriptorHeap>						m_imguiHeap;
 				SonarPropagation::Graphics::Utils::ImGuiManager		m_imguiManager;
+				std::wstring										m_tracePath;
 
 
 				// Variables used with the rendering loop:
@@ -287,15 +428,28 @@ namespace SonarPropagation{
 
 				bool												m_useReflections = true;
 
-				bool												m_pipelineDirty;
-				bool												m_sbtDirty;
-				bool												m_ASDirty;
+				bool												m_pipelineDirty = false;
+				bool												m_sbtDirty = false;
+				bool												m_ASDirty = false;
+
+				// Geometry upload and BLAS builds run while the pipeline is created; waited for before the first frame.
+				UINT64												m_uploadFenceValue = 0;
 
 				bool												m_animate = true;
 
 
 				uint32_t											m_time = 0;
 
+				// Heap allocations made by the last Update/Render pair (Debug builds only):
+				uint64_t											m_frameHeapAllocations = 0;
+
+				// Per-stage frame timings; GPU timestamps arrive a few frames after the CPU samples.
+				FrameTimingStats									m_timingStats;
+				std::unique_ptr<GpuTimer>							m_gpuTimer;
+				std::chrono::steady_clock::time_point				m_lastRenderTime;
+				bool												m_hasLastRenderTime = false;
+				std::wstring										m_timingCsvPath;
+
 			};
 		}
 	}
@@ -0,0 +1,217 @@
+#include "pch.h"
+#include "ShaderTable.h"
+#include "Common/Profiler.h"
+
+#include <stdexcept>
+#include <string>
+
+SonarPropagation::Graphics::DXR::ShaderTable::ShaderTable(uint32_t copyCount)
+	: m_copyCount(copyCount)
+{
+	if (copyCount == 0 || copyCount > 32) {
+		throw std::invalid_argument("ShaderTable copy count must be between 1 and 32");
+	}
+}
+
+SonarPropagation::Graphics::DXR::ShaderTable::~ShaderTable()
+{
+	if (m_buffer) {
+		m_buffer->Unmap(0, nullptr);
+	}
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::Build(ID3D12Device* device, ID3D12StateObjectProperties* pipelineProperties)
+{
+	SONAR_PROFILE_SCOPE("ShaderTable::Build");
+	if (!m_layout.IsFinalized()) {
+		m_layout.Finalize();
+	}
+
+	const uint32_t recordCount = m_layout.GetRecordCount();
+
+	PrepareArguments();
+
+	LoadIdentifiers(pipelineProperties);
+
+	uint32_t copySize = m_layout.GetTotalSize();
+	if (!m_buffer || copySize != m_copySize) {
+		if (m_buffer) {
+			m_buffer->Unmap(0, nullptr);
+		}
+
+		m_copySize = copySize;
+		m_buffer = nv_helpers_dx12::CreateBuffer(
+			device, static_cast<UINT64>(m_copySize) * m_copyCount, D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		if (!m_buffer) {
+			throw std::logic_error("Could not allocate the shader binding table");
+		}
+
+		NAME_D3D12_OBJECT(m_buffer);
+
+		CD3DX12_RANGE readRange(0, 0);
+		DX::ThrowIfFailed(m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_mapped)));
+		memset(m_mapped, 0, static_cast<size_t>(m_copySize) * m_copyCount);
+	}
+
+	for (uint32_t copy = 0; copy < m_copyCount; ++copy) {
+		for (uint32_t record = 0; record < recordCount; ++record) {
+			WriteRecord(copy, record);
+		}
+	}
+
+	m_dirtyMasks.assign(recordCount, 0);
+	m_dirtyRecords.clear();
+	m_needsBuild = false;
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::SetPipeline(ID3D12StateObjectProperties* pipelineProperties)
+{
+	SONAR_PROFILE_SCOPE("ShaderTable::SetPipeline");
+	if (!m_buffer || m_needsBuild) {
+		throw std::logic_error("ShaderTable::SetPipeline called before the table was built");
+	}
+
+	for (uint32_t record : LoadIdentifiers(pipelineProperties)) {
+		MarkDirty(record);
+	}
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::SetArguments(uint32_t record, std::initializer_list<void*> arguments)
+{
+	if (!m_layout.IsFinalized()) {
+		throw std::logic_error("ShaderTable::SetArguments called before the layout was finalized");
+	}
+
+	PrepareArguments();
+
+	if (arguments.size() > m_layout.GetArgumentCount(record)) {
+		throw std::invalid_argument("ShaderTable: more root arguments than the record was laid out for");
+	}
+
+	uint64_t* stored = &m_arguments[m_argumentOffsets[record]];
+	bool changed = false;
+
+	uint32_t i = 0;
+	for (void* argument : arguments) {
+		uint64_t value = reinterpret_cast<uint64_t>(argument);
+		if (stored[i] != value) {
+			stored[i] = value;
+			changed = true;
+		}
+		++i;
+	}
+
+	// Before the next Build() every record gets written anyway.
+	if (changed && !m_needsBuild) {
+		MarkDirty(record);
+	}
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::Update(uint32_t frameIndex)
+{
+	SONAR_PROFILE_SCOPE("ShaderTable::Update");
+	const uint32_t copy = frameIndex % m_copyCount;
+	const uint32_t bit = 1u << copy;
+
+	size_t remaining = 0;
+	for (size_t i = 0; i < m_dirtyRecords.size(); ++i) {
+		uint32_t record = m_dirtyRecords[i];
+
+		if (m_dirtyMasks[record] & bit) {
+			WriteRecord(copy, record);
+			m_dirtyMasks[record] &= ~bit;
+		}
+
+		if (m_dirtyMasks[record]) {
+			m_dirtyRecords[remaining++] = record;
+		}
+	}
+
+	m_dirtyRecords.resize(remaining);
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::FillDispatchDesc(uint32_t frameIndex, D3D12_DISPATCH_RAYS_DESC& desc) const
+{
+	D3D12_GPU_VIRTUAL_ADDRESS start = m_buffer->GetGPUVirtualAddress() +
+		static_cast<UINT64>(frameIndex % m_copyCount) * m_copySize;
+
+	desc.RayGenerationShaderRecord.StartAddress = start + m_layout.GetSectionOffset(ShaderTableSection::RayGeneration);
+	desc.RayGenerationShaderRecord.SizeInBytes = m_layout.GetEntrySize(ShaderTableSection::RayGeneration);
+
+	desc.MissShaderTable.StartAddress = start + m_layout.GetSectionOffset(ShaderTableSection::Miss);
+	desc.MissShaderTable.SizeInBytes = m_layout.GetSectionSize(ShaderTableSection::Miss);
+	desc.MissShaderTable.StrideInBytes = m_layout.GetEntrySize(ShaderTableSection::Miss);
+
+	desc.HitGroupTable.StartAddress = start + m_layout.GetSectionOffset(ShaderTableSection::HitGroup);
+	desc.HitGroupTable.SizeInBytes = m_layout.GetSectionSize(ShaderTableSection::HitGroup);
+	desc.HitGroupTable.StrideInBytes = m_layout.GetEntrySize(ShaderTableSection::HitGroup);
+}
+
+std::vector<uint32_t> SonarPropagation::Graphics::DXR::ShaderTable::LoadIdentifiers(ID3D12StateObjectProperties* pipelineProperties)
+{
+	const uint32_t recordCount = m_layout.GetRecordCount();
+	const size_t identifierSize = ShaderTableLayout::c_shaderIdentifierSize;
+
+	m_identifiers.resize(static_cast<size_t>(recordCount) * identifierSize);
+
+	std::vector<uint32_t> changed;
+	for (uint32_t record = 0; record < recordCount; ++record) {
+		void* id = pipelineProperties->GetShaderIdentifier(m_layout.GetExportName(record).c_str());
+		if (!id) {
+			std::wstring exportName = m_layout.GetExportName(record);
+			throw std::logic_error("Unknown shader identifier used in the SBT: " + std::string(exportName.begin(), exportName.end()));
+		}
+
+		uint8_t* stored = &m_identifiers[static_cast<size_t>(record) * identifierSize];
+		if (memcmp(stored, id, identifierSize) != 0) {
+			memcpy(stored, id, identifierSize);
+			changed.push_back(record);
+		}
+	}
+
+	return changed;
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::WriteRecord(uint32_t copy, uint32_t record)
+{
+	uint8_t* destination = m_mapped + static_cast<size_t>(copy) * m_copySize + m_layout.GetRecordOffset(record);
+
+	memcpy(destination, &m_identifiers[static_cast<size_t>(record) * ShaderTableLayout::c_shaderIdentifierSize], ShaderTableLayout::c_shaderIdentifierSize);
+	memcpy(destination + ShaderTableLayout::c_shaderIdentifierSize, &m_arguments[m_argumentOffsets[record]],
+		m_layout.GetArgumentCount(record) * ShaderTableLayout::c_argumentSize);
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::MarkDirty(uint32_t record)
+{
+	if (m_dirtyMasks[record] == 0) {
+		m_dirtyRecords.push_back(record);
+	}
+
+	m_dirtyMasks[record] = m_copyCount == 32 ? ~0u : (1u << m_copyCount) - 1;
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTable::PrepareArguments()
+{
+	const uint32_t recordCount = m_layout.GetRecordCount();
+
+	// Any new layout needs a Build(); root arguments are only kept if their offsets did not move.
+	if (m_preparedGeneration == m_layout.GetGeneration()) {
+		return;
+	}
+
+	m_preparedGeneration = m_layout.GetGeneration();
+	m_needsBuild = true;
+
+	std::vector<uint32_t> argumentOffsets(recordCount);
+	uint32_t argumentCount = 0;
+	for (uint32_t record = 0; record < recordCount; ++record) {
+		argumentOffsets[record] = argumentCount;
+		argumentCount += m_layout.GetArgumentCount(record);
+	}
+
+	if (argumentOffsets != m_argumentOffsets || argumentCount != m_arguments.size()) {
+		m_argumentOffsets.swap(argumentOffsets);
+		m_arguments.assign(argumentCount, 0);
+	}
+}
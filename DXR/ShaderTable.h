@@ -0,0 +1,98 @@
+#pragma once
+
+#include <initializer_list>
+#include <vector>
+
+#include "ShaderTableLayout.h"
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace DXR {
+
+			/// <summary>
+			/// Shader binding table kept in a persistently mapped upload buffer.
+			/// The buffer holds one copy of the table per frame in flight; SetArguments() only marks a
+			/// record dirty, and Update() patches the dirty records of the copy used by the next frame,
+			/// so frames that did not change any root argument cost nothing.
+			/// </summary>
+			class ShaderTable {
+			public:
+				/// <summary>
+				/// Constructor for the ShaderTable.
+				/// </summary>
+				/// <param name="copyCount">Number of table copies, one per frame in flight.</param>
+				explicit ShaderTable(uint32_t copyCount = DX::c_frameCount);
+				~ShaderTable();
+
+				ShaderTable(const ShaderTable&) = delete;
+				ShaderTable& operator=(const ShaderTable&) = delete;
+
+				/// <summary>
+				/// Layout of the table. Records have to be added and finalized before Build().
+				/// </summary>
+				ShaderTableLayout& GetLayout() { return m_layout; }
+				const ShaderTableLayout& GetLayout() const { return m_layout; }
+
+				/// <summary>
+				/// (Re)creates the buffer if needed and writes every record of every copy. Required after the
+				/// layout or the pipeline state object changed. The GPU must not be using the table.
+				/// </summary>
+				void Build(ID3D12Device* device, ID3D12StateObjectProperties* pipelineProperties);
+
+				/// <summary>
+				/// Switches the records to the shader identifiers of another state object with the same exports.
+				/// Records whose identifier changed are marked dirty and reach each copy through Update(), so
+				/// frames still in flight keep reading their own copy. Requires a previous Build().
+				/// </summary>
+				void SetPipeline(ID3D12StateObjectProperties* pipelineProperties);
+
+				/// <summary>
+				/// Sets the root arguments of a record. Unchanged arguments do not mark the record dirty.
+				/// Can be called before the first Build() once the layout is finalized.
+				/// </summary>
+				void SetArguments(uint32_t record, std::initializer_list<void*> arguments);
+
+				/// <summary>
+				/// Writes the dirty records into the copy of the given frame.
+				/// </summary>
+				void Update(uint32_t frameIndex);
+
+				/// <summary>
+				/// Fills the shader table addresses of the dispatch description for the given frame.
+				/// </summary>
+				void FillDispatchDesc(uint32_t frameIndex, D3D12_DISPATCH_RAYS_DESC& desc) const;
+
+				/// <summary>
+				/// Number of records that still have to be written into at least one copy.
+				/// </summary>
+				size_t GetDirtyRecordCount() const { return m_dirtyRecords.size(); }
+
+				bool IsBuilt() const { return m_buffer != nullptr; }
+
+			private:
+				void PrepareArguments();
+				std::vector<uint32_t> LoadIdentifiers(ID3D12StateObjectProperties* pipelineProperties);
+				void WriteRecord(uint32_t copy, uint32_t record);
+				void MarkDirty(uint32_t record);
+
+				ShaderTableLayout m_layout;
+				uint32_t m_copyCount;
+
+				Microsoft::WRL::ComPtr<ID3D12Resource> m_buffer;
+				uint8_t* m_mapped = nullptr;
+				uint32_t m_copySize = 0;
+				bool m_needsBuild = true;
+				uint32_t m_preparedGeneration = 0;
+
+				// Shader identifiers and root arguments of every record, as last written.
+				std::vector<uint8_t> m_identifiers;
+				std::vector<uint64_t> m_arguments;
+				std::vector<uint32_t> m_argumentOffsets;
+
+				// One bit per copy that has not seen the latest arguments of the record yet.
+				std::vector<uint32_t> m_dirtyMasks;
+				std::vector<uint32_t> m_dirtyRecords;
+			};
+		}
+	}
+}
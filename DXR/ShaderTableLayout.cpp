@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "ShaderTableLayout.h"
+
+#include <stdexcept>
+
+namespace {
+	inline uint32_t RoundUp(uint32_t value, uint32_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+uint32_t SonarPropagation::Graphics::DXR::ShaderTableLayout::AddRecord(ShaderTableSection section, const std::wstring& exportName, uint32_t argumentCount)
+{
+	if (m_finalized) {
+		throw std::logic_error("ShaderTableLayout: records cannot be added after Finalize");
+	}
+
+	Section& s = m_sections[Index(section)];
+
+	Record record;
+	record.section = section;
+	record.exportName = exportName;
+	record.argumentCount = argumentCount;
+	record.indexInSection = s.count++;
+	record.offset = 0;
+
+	if (argumentCount > s.maxArguments) {
+		s.maxArguments = argumentCount;
+	}
+
+	m_records.push_back(record);
+	return static_cast<uint32_t>(m_records.size() - 1);
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTableLayout::Finalize()
+{
+	uint32_t offset = 0;
+
+	for (auto& section : m_sections) {
+		// Every section has to start on a table boundary to be usable as a dispatch start address.
+		offset = RoundUp(offset, c_tableAlignment);
+
+		section.entrySize = RoundUp(c_shaderIdentifierSize + c_argumentSize * section.maxArguments, c_recordAlignment);
+		section.offset = offset;
+
+		offset += section.entrySize * section.count;
+	}
+
+	for (auto& record : m_records) {
+		const Section& section = m_sections[Index(record.section)];
+		record.offset = section.offset + record.indexInSection * section.entrySize;
+	}
+
+	m_totalSize = RoundUp(offset, 256);
+	m_finalized = true;
+	++m_generation;
+}
+
+void SonarPropagation::Graphics::DXR::ShaderTableLayout::Reset()
+{
+	m_records.clear();
+	for (auto& section : m_sections) {
+		section = Section();
+	}
+
+	m_totalSize = 0;
+	m_finalized = false;
+}
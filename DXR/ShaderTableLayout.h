@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Graphics {
+		namespace DXR {
+
+			/// <summary>
+			/// Sections of a shader binding table, in the order they are laid out in memory.
+			/// </summary>
+			enum class ShaderTableSection : uint32_t {
+				RayGeneration = 0,
+				Miss = 1,
+				HitGroup = 2,
+				Count = 3
+			};
+
+			/// <summary>
+			/// Device independent layout of a shader binding table. Records are added once, then
+			/// Finalize() computes entry sizes and offsets that stay fixed until the next Reset().
+			/// Root arguments are 8 bytes each (descriptor table handles or GPU addresses).
+			/// </summary>
+			class ShaderTableLayout {
+			public:
+				// Mirrors D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+				// and D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, so the layout needs no D3D headers.
+				static const uint32_t c_shaderIdentifierSize = 32;
+				static const uint32_t c_recordAlignment = 32;
+				static const uint32_t c_tableAlignment = 64;
+				static const uint32_t c_argumentSize = 8;
+
+				/// <summary>
+				/// Adds a record and returns its index.
+				/// </summary>
+				uint32_t AddRecord(ShaderTableSection section, const std::wstring& exportName, uint32_t argumentCount);
+
+				/// <summary>
+				/// Computes the entry size of each section and the offset of every record.
+				/// </summary>
+				void Finalize();
+
+				/// <summary>
+				/// Removes every record.
+				/// </summary>
+				void Reset();
+
+				bool IsFinalized() const { return m_finalized; }
+
+				/// <summary>
+				/// Incremented by every Finalize(), so users can tell when offsets have moved.
+				/// </summary>
+				uint32_t GetGeneration() const { return m_generation; }
+
+				uint32_t GetRecordCount() const { return static_cast<uint32_t>(m_records.size()); }
+				uint32_t GetRecordOffset(uint32_t record) const { return m_records[record].offset; }
+				uint32_t GetArgumentCount(uint32_t record) const { return m_records[record].argumentCount; }
+				ShaderTableSection GetRecordSection(uint32_t record) const { return m_records[record].section; }
+				const std::wstring& GetExportName(uint32_t record) const { return m_records[record].exportName; }
+
+				uint32_t GetSectionOffset(ShaderTableSection section) const { return m_sections[Index(section)].offset; }
+				uint32_t GetSectionSize(ShaderTableSection section) const { return m_sections[Index(section)].entrySize * m_sections[Index(section)].count; }
+				uint32_t GetEntrySize(ShaderTableSection section) const { return m_sections[Index(section)].entrySize; }
+
+				/// <summary>
+				/// Total size in bytes, rounded up to 256 bytes.
+				/// </summary>
+				uint32_t GetTotalSize() const { return m_totalSize; }
+
+			private:
+				struct Record {
+					ShaderTableSection section;
+					std::wstring exportName;
+					uint32_t argumentCount;
+					uint32_t indexInSection;
+					uint32_t offset;
+				};
+
+				struct Section {
+					uint32_t count = 0;
+					uint32_t maxArguments = 0;
+					uint32_t entrySize = 0;
+					uint32_t offset = 0;
+				};
+
+				static uint32_t Index(ShaderTableSection section) { return static_cast<uint32_t>(section); }
+
+				std::vector<Record> m_records;
+				Section m_sections[static_cast<uint32_t>(ShaderTableSection::Count)];
+				uint32_t m_totalSize = 0;
+				bool m_finalized = false;
+				uint32_t m_generation = 0;
+			};
+		}
+	}
+}
@@ -0,0 +1,858 @@
+#include "pch.h"
+#include "Common/Profiler.h"
+#include "Common/TimingStats.h"
+#include "Sonar/HitMap.h"
+#include "Sonar/PropagationEngine.h"
+#include "Sonar/ScenarioFile.h"
+#include "Sonar/SceneModel.h"
+#include "Sonar/TileCache.h"
+#include "Sonar/TrajectoryCache.h"
+#include "Validation/GoldenScenarios.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace SonarPropagation::Sonar;
+using namespace SonarPropagation::Validation;
+using SonarPropagation::Graphics::Utils::FrameTimingStats;
+using SonarPropagation::Graphics::Utils::Profiler;
+using SonarPropagation::Graphics::Utils::ProfilerStats;
+using SonarPropagation::Graphics::Utils::StageTimer;
+using SonarPropagation::Graphics::Utils::TimingStage;
+using SonarPropagation::Graphics::Utils::TimingSummary;
+
+namespace {
+
+	const double c_pi = 3.14159265358979323846;
+
+	struct RunnerOptions {
+		std::string scenario = "munk";
+		std::string scenarioFile;
+		bool watch = false;
+		std::string bathymetry;
+		double bearing = 0.0;
+		double bottomSpacing = 10.0;
+		double tileBudgetMb = 256.0;
+		// Picks the levels of detail of boundary meshes; 0 takes the frequency of the source, if any.
+		double frequency = 0.0;
+		bool lodReport = false;
+		std::string lodCache;
+		uint32_t receiverArray = 0;
+		EngineMode mode = EngineMode::ScalarDouble;
+		uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+		uint32_t rayCount = 0;
+		uint32_t refinementLevels = 0;
+		double trajectoryCacheMb = 0.0;
+		// Texels along the longer side of the hit maps of the bottom surfaces without a frequency; 0 for none.
+		uint32_t hitMapResolution = 0;
+		double hitStart = 0.0;
+		double hitEnd = std::numeric_limits<double>::infinity();
+		uint32_t repetitions = 1;
+		std::string outputDirectory;
+		std::string traceFile;
+	};
+
+	void PrintUsage() {
+		std::cout <<
+			"Usage: SonarRunner [options]\n"
+			"  --scenario <name>        built-in scenario (default munk)\n"
+			"  --list                   print the built-in scenarios and exit\n"
+			"  --scenario-file <file>   scenario file; replaces --scenario, --bathymetry and --bearing\n"
+			"  --watch                  propagate the scenario file again whenever it or its meshes change\n"
+			"  --bathymetry <file>      boundary mesh (.obj), ESRI ASCII grid (.asc) or tile set of grids (.tiles);\n"
+			"                           its shallowest surface below y = 0 becomes the bottom\n"
+			"  --tile-budget <MB>       memory of the tiles of a tile set kept loaded (default 256)\n"
+			"  --bearing <degrees>      direction of the fan from +x towards +z (default 0)\n"
+			"  --bottom-spacing <m>     range spacing of the bottom taken from the mesh (default 10)\n"
+			"  --frequency <Hz>         take boundary meshes at the level of detail the wavelength resolves\n"
+			"                           (default: the frequency of the source, if any)\n"
+			"  --lod-report             time the bottom extraction and the TL error of every level of detail\n"
+			"  --lod-cache <dir>        keep the levels of detail of meshes in an existing directory and reuse\n"
+			"                           them while the mesh is unchanged (default: built on every run)\n"
+			"  --receiver-array <n>     add n receivers on a regular grid over the field\n"
+			"  --mode <name>            scalar_double, scalar_float, simd, adaptive or analytic\n"
+			"  --threads <n>            worker threads (default: one per hardware thread)\n"
+			"  --rays <n>               number of rays of the fan (default: the scenario's)\n"
+			"  --refine <levels>        trace the fan coarse and halve the gaps between diverging rays up to\n"
+			"                           levels times (default 0)\n"
+			"  --trajectory-cache <MB>  keep ray paths and replay them while only receivers move, with sources\n"
+			"                           rounded to 1 m of depth (default 0, off)\n"
+			"  --hit-maps <texels>      accumulate the bottom reflections on every boundary mesh and heightfield\n"
+			"                           into sparse maps with half-wavelength texels at the frequency or, without\n"
+			"                           one, this many texels along the longer side (default 0, off)\n"
+			"  --hit-start <s>          leave out bottom reflections before this time (default 0)\n"
+			"  --hit-end <s>            leave out bottom reflections from this time on (default: none)\n"
+			"  --repetitions <n>        propagations to time (default 1)\n"
+			"  --output <dir>           write arrivals.csv, tl.csv, timings.csv and, with receivers,\n"
+			"                           receivers.csv, with a trajectory cache, paths.csv and, with hit maps,\n"
+			"                           hitmap_<surface>.pgm and .bin to an existing directory\n"
+			"  --trace <file>           write a Chrome trace of the stages and the ray tracing of every run\n"
+			"                           (chrome://tracing, Perfetto)\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, RunnerOptions& options) {
+		for (int i = 1; i < argc; ++i) {
+			const bool hasValue = i + 1 < argc;
+
+			if (!std::strcmp(argv[i], "--scenario") && hasValue) {
+				options.scenario = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "--scenario-file") && hasValue) {
+				options.scenarioFile = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "--watch")) {
+				options.watch = true;
+			}
+			else if (!std::strcmp(argv[i], "--bathymetry") && hasValue) {
+				options.bathymetry = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "--tile-budget") && hasValue) {
+				options.tileBudgetMb = std::max(0.0, std::atof(argv[++i]));
+			}
+			else if (!std::strcmp(argv[i], "--bearing") && hasValue) {
+				options.bearing = std::atof(argv[++i]) * c_pi / 180.0;
+			}
+			else if (!std::strcmp(argv[i], "--bottom-spacing") && hasValue) {
+				options.bottomSpacing = std::max(0.01, std::atof(argv[++i]));
+			}
+			else if (!std::strcmp(argv[i], "--frequency") && hasValue) {
+				options.frequency = std::max(0.0, std::atof(argv[++i]));
+			}
+			else if (!std::strcmp(argv[i], "--lod-report")) {
+				options.lodReport = true;
+			}
+			else if (!std::strcmp(argv[i], "--lod-cache") && hasValue) {
+				options.lodCache = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "--receiver-array") && hasValue) {
+				options.receiverArray = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+			}
+			else if (!std::strcmp(argv[i], "--mode") && hasValue) {
+				if (!ParseEngineMode(argv[++i], options.mode)) {
+					std::cerr << "Unknown mode " << argv[i] << '\n';
+					return false;
+				}
+			}
+			else if (!std::strcmp(argv[i], "--threads") && hasValue) {
+				options.threadCount = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if (!std::strcmp(argv[i], "--rays") && hasValue) {
+				options.rayCount = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if (!std::strcmp(argv[i], "--refine") && hasValue) {
+				options.refinementLevels = static_cast<uint32_t>(std::max(0, std::min(16, std::atoi(argv[++i]))));
+			}
+			else if (!std::strcmp(argv[i], "--trajectory-cache") && hasValue) {
+				options.trajectoryCacheMb = std::max(0.0, std::atof(argv[++i]));
+			}
+			else if (!std::strcmp(argv[i], "--hit-maps") && hasValue) {
+				options.hitMapResolution = static_cast<uint32_t>(std::max(0, std::min(65536, std::atoi(argv[++i]))));
+			}
+			else if (!std::strcmp(argv[i], "--hit-start") && hasValue) {
+				options.hitStart = std::atof(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "--hit-end") && hasValue) {
+				options.hitEnd = std::atof(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "--repetitions") && hasValue) {
+				options.repetitions = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			}
+			else if (!std::strcmp(argv[i], "--output") && hasValue) {
+				options.outputDirectory = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "--trace") && hasValue) {
+				options.traceFile = argv[++i];
+			}
+			else {
+				return false;
+			}
+		}
+		return !options.watch || !options.scenarioFile.empty();
+	}
+
+	const GoldenScenario* FindScenario(const std::string& name) {
+		for (const GoldenScenario& scenario : GetGoldenScenarios()) {
+			if (scenario.name == name) {
+				return &scenario;
+			}
+		}
+		return nullptr;
+	}
+
+	void WriteArrivals(std::ostream& stream, const LaunchFan& fan, const FieldGrid& grid, const PropagationResult& result) {
+		stream << "column,range_m,ray,launch_angle_deg,depth_m,time_s,surface_bounces,bottom_bounces,intensity\n";
+		stream << std::setprecision(10);
+		for (const RayCrossing& crossing : result.crossings) {
+			stream << crossing.column << ',' << grid.GetRange(crossing.column) << ',' << crossing.ray << ','
+				<< fan.GetLaunchAngle(crossing.ray) * 180.0 / c_pi << ',' << crossing.depth << ',' << crossing.time << ','
+				<< crossing.surfaceBounces << ',' << crossing.bottomBounces << ',' << crossing.intensity << '\n';
+		}
+	}
+
+	// One row per depth, one column per range.
+	void WriteTransmissionLoss(std::ostream& stream, const FieldGrid& grid, const PropagationResult& result) {
+		stream << "depth_m";
+		for (uint32_t column = 0; column < grid.rangeCount; ++column) {
+			stream << ',' << grid.GetRange(column);
+		}
+		stream << '\n' << std::setprecision(6);
+
+		for (uint32_t row = 0; row < grid.depthCount; ++row) {
+			stream << grid.GetDepth(row);
+			for (uint32_t column = 0; column < grid.rangeCount; ++column) {
+				stream << ',' << result.transmissionLoss[static_cast<size_t>(column) * grid.depthCount + row];
+			}
+			stream << '\n';
+		}
+	}
+
+	void WriteReceiverArrivals(std::ostream& stream, const LaunchFan& fan, const ReceiverGrid& receivers, const PropagationResult& result) {
+		stream << "receiver,range_m,depth_m,ray,launch_angle_deg,time_s,distance_m,surface_bounces,bottom_bounces,intensity\n";
+		stream << std::setprecision(10);
+		for (const ReceiverArrival& arrival : result.arrivals) {
+			const ReceiverPoint& receiver = receivers.GetReceivers()[arrival.receiver];
+			stream << arrival.receiver << ',' << receiver.range << ',' << receiver.depth << ',' << arrival.ray << ','
+				<< fan.GetLaunchAngle(arrival.ray) * 180.0 / c_pi << ',' << arrival.time << ',' << arrival.distance << ','
+				<< arrival.surfaceBounces << ',' << arrival.bottomBounces << ',' << arrival.intensity << '\n';
+		}
+	}
+
+	// The kept points of every ray of the result, from the trajectory cache.
+	void WritePaths(std::ostream& stream, const TrajectoryCache& cache, uint64_t environmentVersion, const LaunchFan& fan,
+		const FieldGrid& grid, const PropagationSettings& settings, const PropagationResult& result) {
+		stream << "ray,launch_angle_deg,point,range_m,depth_m,time_s,surface_bounces,bottom_bounces\n";
+		stream << std::setprecision(10);
+
+		RayPath path;
+		for (uint32_t index = 0; index < (result.tracedRays.empty() ? fan.rayCount : result.tracedRays.size()); ++index) {
+			const uint32_t ray = result.tracedRays.empty() ? index : result.tracedRays[index];
+			if (!cache.FindPath(environmentVersion, fan, grid, settings, ray, path)) {
+				continue;
+			}
+			for (size_t point = 0; point < path.points.size(); ++point) {
+				const PathPoint& at = path.points[point];
+				stream << ray << ',' << fan.GetLaunchAngle(ray) * 180.0 / c_pi << ',' << point << ',' << at.range << ',' << at.depth << ','
+					<< at.time << ',' << at.surfaceBounces << ',' << at.bottomBounces << '\n';
+			}
+		}
+	}
+
+	template <typename Writer>
+	bool WriteFile(const std::string& path, Writer write, std::ios::openmode mode = std::ios::out) {
+		std::ofstream file(path.c_str(), mode);
+		if (!file) {
+			std::cerr << "Could not write " << path << '\n';
+			return false;
+		}
+		write(file);
+		return true;
+	}
+
+	// Starts the capture of --trace, if any, dropping the events of earlier runs.
+	void BeginTrace(const RunnerOptions& options) {
+		if (!options.traceFile.empty()) {
+			Profiler::BeginCapture();
+		}
+	}
+
+	// Ends the capture of --trace and writes it; a watched scenario overwrites it with every run.
+	bool WriteTrace(const RunnerOptions& options) {
+		if (options.traceFile.empty()) {
+			return true;
+		}
+
+		Profiler::EndCapture();
+		if (!WriteFile(options.traceFile, [](std::ostream& stream) { Profiler::WriteChromeTrace(stream); })) {
+			return false;
+		}
+
+		const ProfilerStats stats = Profiler::GetStats();
+		std::cout << "trace: " << stats.collectedEvents << " events";
+		if (stats.droppedEvents) {
+			std::cout << ", " << stats.droppedEvents << " dropped";
+		}
+		std::cout << ", written to " << options.traceFile << '\n';
+		return true;
+	}
+
+	void PrintSummary(const char* name, const TimingSummary& summary) {
+		std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(6) << summary.count << std::setw(12) << summary.mean << std::setw(12) << summary.p50
+			<< std::setw(12) << summary.p95 << std::setw(12) << summary.max << '\n';
+	}
+
+	struct RunSetup {
+		explicit RunSetup(const Environment& environment) : environment(environment) {}
+
+		std::string name;
+		Environment environment;
+		LaunchFan fan;
+		FieldGrid grid;
+		// Where the bottom profile came from; empty for the flat or sloped bottom of the environment.
+		std::string bottomSource;
+		// Receivers of the scene and of --receiver-array, in the range-depth plane of the fan.
+		std::vector<ReceiverPoint> receivers;
+		// With --hit-maps, the surfaces of the scene, which of them the bottom came from and the
+		// frequency their texels are sized for.
+		std::vector<HitSurface> hitSurfaces;
+		BottomTrack bottomTrack;
+		double hitFrequency = 0.0;
+	};
+
+	double GetLodFrequency(const SoundSourceModel& source, const RunnerOptions& options) {
+		return options.frequency > 0.0 ? options.frequency : source.frequency;
+	}
+
+	// Root mean square of the TL differences in dB, over the cells both results reach.
+	double GetTransmissionLossRms(const PropagationResult& result, const PropagationResult& reference) {
+		double sum = 0.0;
+		size_t count = 0;
+		for (size_t cell = 0; cell < result.transmissionLoss.size() && cell < reference.transmissionLoss.size(); ++cell) {
+			if (result.transmissionLoss[cell] < 200.0f && reference.transmissionLoss[cell] < 200.0f) {
+				const double difference = result.transmissionLoss[cell] - reference.transmissionLoss[cell];
+				sum += difference * difference;
+				++count;
+			}
+		}
+		return count ? std::sqrt(sum / count) : 0.0;
+	}
+
+	// Extracts the bottom at every level of detail of the boundary meshes and propagates over it,
+	// against the full meshes. The last row is the level the frequency picks at every range.
+	void PrintLodReport(const SceneModel& scene, const MeshLibrary& library, const SoundSourceModel& source,
+		const RunnerOptions& options, const RunSetup& setup) {
+		SONAR_PROFILE_SCOPE("LodReport");
+
+		const Vector3 origin = scene.ComputeWorldTransforms()[source.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 });
+		size_t levelCount = 0;
+		for (const ReflectorModel& reflector : scene.m_objects) {
+			if (reflector.type == ObjectType::Boundary) {
+				levelCount = std::max(levelCount, library.GetMesh(reflector.mesh).lods.size());
+			}
+		}
+
+		LaunchFan fan = setup.fan;
+		if (options.rayCount) {
+			fan.rayCount = options.rayCount;
+		}
+		PropagationSettings settings = GetModeSettings(options.mode);
+		settings.threadCount = options.threadCount;
+
+		std::vector<LodPolicy> policies;
+		for (size_t level = 0; level <= levelCount; ++level) {
+			LodPolicy policy;
+			policy.fixedLevel = static_cast<int32_t>(level);
+			policies.push_back(policy);
+		}
+		const double frequency = GetLodFrequency(source, options);
+		if (frequency > 0.0) {
+			LodPolicy policy;
+			policy.frequency = frequency;
+			policies.push_back(policy);
+		}
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+		std::cout << std::left << std::setw(10) << "lod" << std::right << std::setw(12) << "triangles" << std::setw(12) << "error m"
+			<< std::setw(14) << "extract ms" << std::setw(10) << "speedup" << std::setw(12) << "TL rms dB" << '\n';
+
+		PropagationResult reference;
+		double referenceMs = 0.0;
+		for (const LodPolicy& policy : policies) {
+			size_t triangles = 0;
+			double error = 0.0;
+			for (const ReflectorModel& reflector : scene.m_objects) {
+				const MeshData& mesh = library.GetMesh(reflector.mesh);
+				if (reflector.type != ObjectType::Boundary || policy.fixedLevel < 0) {
+					continue;
+				}
+				const size_t level = std::min(static_cast<size_t>(policy.fixedLevel), mesh.lods.size());
+				triangles += level == 0 ? mesh.indices.size() / 3 : mesh.lods[level - 1].GetTriangleCount();
+				error = std::max(error, level == 0 ? 0.0 : mesh.lods[level - 1].error);
+			}
+
+			// Fastest of the repetitions, as for the propagation.
+			Environment environment = setup.environment;
+			double extractMs = 0.0;
+			for (uint32_t repetition = 0; repetition < options.repetitions; ++repetition) {
+				const auto start = std::chrono::steady_clock::now();
+				environment.bottomProfile = ExtractBottomProfile(scene, library, origin, source.bearing, setup.grid.maxRange,
+					options.bottomSpacing, setup.environment.bottomDepth, policy);
+				const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+				extractMs = repetition == 0 ? elapsed.count() : std::min(extractMs, elapsed.count());
+			}
+
+			const PropagationResult result = RunPropagation(environment, fan, setup.grid, settings);
+			if (policy.fixedLevel == 0) {
+				reference = result;
+				referenceMs = extractMs;
+			}
+
+			std::cout << std::left << std::setw(10) << (policy.fixedLevel < 0 ? "by freq" : std::to_string(policy.fixedLevel)) << std::right;
+			if (policy.fixedLevel < 0) {
+				std::cout << std::setw(12) << "-" << std::setw(12) << "-";
+			}
+			else {
+				std::cout << std::setw(12) << triangles << std::fixed << std::setprecision(2) << std::setw(12) << error;
+			}
+			std::cout << std::fixed << std::setprecision(3) << std::setw(14) << extractMs << std::setprecision(2)
+				<< std::setw(10) << (extractMs > 0.0 ? referenceMs / extractMs : 0.0)
+				<< std::setprecision(3) << std::setw(12) << GetTransmissionLossRms(result, reference) << '\n';
+		}
+		std::cout << '\n';
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+
+	// The scene holds what the renderer would put into its acceleration structures; the CPU engine
+	// only needs the bottom along the bearing of the source out of it.
+	void ExtractBottom(const SceneModel& scene, const MeshLibrary& library, const SoundSourceModel& source,
+		const RunnerOptions& options, RunSetup& setup) {
+		SONAR_PROFILE_SCOPE("ExtractBottom");
+
+		if (options.lodReport) {
+			PrintLodReport(scene, library, source, options, setup);
+		}
+
+		LodPolicy lod;
+		lod.frequency = GetLodFrequency(source, options);
+
+		const Vector3 origin = scene.ComputeWorldTransforms()[source.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 });
+		const bool hitMaps = options.hitMapResolution > 0;
+		setup.environment.bottomProfile = ExtractBottomProfile(scene, library, origin, source.bearing, setup.grid.maxRange,
+			options.bottomSpacing, setup.environment.bottomDepth, lod, hitMaps ? &setup.bottomTrack.surfaces : nullptr);
+
+		if (hitMaps) {
+			setup.hitSurfaces = GetHitSurfaces(scene, library);
+			setup.bottomTrack.origin = origin;
+			setup.bottomTrack.bearing = source.bearing;
+			setup.bottomTrack.spacing = options.bottomSpacing;
+			setup.hitFrequency = lod.frequency;
+		}
+	}
+
+	// Levels of detail are only built once something picks them.
+	void ConfigureLods(MeshLibrary& library, const RunnerOptions& options, bool sourceFrequency) {
+		if (!library.HasLods() && (options.lodReport || options.frequency > 0.0 || sourceFrequency)) {
+			library.EnableLods(SimplifySettings(), options.lodCache);
+		}
+	}
+
+	bool EndsWith(const std::string& text, const std::string& suffix) {
+		return text.size() > suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	// A tile set is streamed along the bearing through a cache of --tile-budget, two tiles ahead,
+	// rather than loaded into the scene.
+	void ExtractTiledBottom(const std::string& path, const Vector3& origin, const SoundSourceModel& source,
+		const RunnerOptions& options, RunSetup& setup) {
+		SONAR_PROFILE_SCOPE("ExtractTiledBottom");
+
+		const TileSet tiles = TileSet::Load(path);
+		const size_t budget = static_cast<size_t>(options.tileBudgetMb * 1024.0 * 1024.0);
+		TileCache cache([&tiles](const TileKey& key) { return tiles.LoadTile(key); }, budget);
+
+		setup.environment.bottomProfile = ExtractBottomProfile(tiles, cache, origin, source.bearing, setup.grid.maxRange,
+			options.bottomSpacing, setup.environment.bottomDepth, 2.0 * tiles.GetTileExtent());
+
+		const TileCacheStats stats = cache.GetStats();
+		std::ostringstream text;
+		text << std::fixed << std::setprecision(1) << path << " (" << tiles.GetTileCount() << " tiles, "
+			<< stats.blockingLoads << " blocking loads, " << stats.prefetchHits << " prefetched, peak "
+			<< stats.peakBytes / (1024.0 * 1024.0) << " of " << options.tileBudgetMb << " MB)";
+		setup.bottomSource = text.str();
+	}
+
+	// The engine is range independent along its bearing, so a receiver sits at its horizontal distance
+	// from the source, whatever its bearing.
+	void AddSceneReceivers(const SceneModel& scene, const SoundSourceModel& source, RunSetup& setup) {
+		const std::vector<Matrix4x3> world = scene.ComputeWorldTransforms();
+		const Vector3 origin = world[source.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 });
+		for (const SoundReceiverModel& receiver : scene.m_soundReceivers) {
+			const Vector3 position = world[receiver.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 });
+			setup.receivers.push_back({ std::hypot(position.x - origin.x, position.z - origin.z), -position.y, receiver.radius });
+		}
+	}
+
+	// About count receivers in square cells over the field, each catching the rays through its cell.
+	void AddReceiverArray(uint32_t count, RunSetup& setup) {
+		if (!count) {
+			return;
+		}
+
+		const double spacing = std::sqrt(setup.grid.maxRange * setup.grid.maxDepth / count);
+		const uint32_t columns = std::max(1u, static_cast<uint32_t>(std::round(setup.grid.maxRange / spacing)));
+		const uint32_t rows = std::max(1u, static_cast<uint32_t>(std::round(setup.grid.maxDepth / spacing)));
+		const double rangeStep = setup.grid.maxRange / columns;
+		const double depthStep = setup.grid.maxDepth / rows;
+		const double radius = 0.5 * std::max(rangeStep, depthStep);
+		for (uint32_t column = 0; column < columns; ++column) {
+			for (uint32_t row = 0; row < rows; ++row) {
+				setup.receivers.push_back({ (column + 0.5) * rangeStep, (row + 0.5) * depthStep, radius });
+			}
+		}
+	}
+
+	RunSetup SetUpBuiltinScenario(const GoldenScenario& scenario, const RunnerOptions& options, FrameTimingStats& stats) {
+		StageTimer timer(stats, TimingStage::SceneBuild);
+		SONAR_PROFILE_SCOPE("SceneBuild");
+
+		RunSetup setup(scenario.environment);
+		setup.name = "scenario " + scenario.name;
+		setup.fan = scenario.fan;
+		setup.grid = scenario.grid;
+
+		MeshLibrary library;
+		ConfigureLods(library, options, false);
+		SceneModel scene;
+		const size_t root = scene.AddTransform(SceneTransform());
+
+		SceneTransform sourceTransform;
+		sourceTransform.position = { 0.0, -setup.fan.sourceDepth, 0.0 };
+		sourceTransform.parent = static_cast<int32_t>(root);
+
+		SoundSourceModel source;
+		source.transform = scene.AddTransform(sourceTransform);
+		source.bearing = options.bearing;
+		source.fan = setup.fan;
+		scene.AddSoundSource(source);
+		AddReceiverArray(options.receiverArray, setup);
+
+		if (!options.bathymetry.empty()) {
+			SceneTransform bathymetryTransform;
+			bathymetryTransform.parent = static_cast<int32_t>(root);
+			const size_t transform = scene.AddTransform(bathymetryTransform);
+
+			// Gridded bathymetry is traced as a heightfield rather than turned into triangles.
+			const std::string& path = options.bathymetry;
+			if (EndsWith(path, ".tiles")) {
+				const Vector3 origin = scene.ComputeWorldTransforms()[source.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 });
+				ExtractTiledBottom(path, origin, source, options, setup);
+				return setup;
+			}
+			if (EndsWith(path, ".asc")) {
+				scene.AddHeightfield({ transform, library.LoadHeightfield(path) });
+			}
+			else {
+				scene.AddObject({ transform, library.LoadWavefront(path), ObjectType::Boundary });
+			}
+
+			ExtractBottom(scene, library, source, options, setup);
+			setup.bottomSource = options.bathymetry;
+		}
+		return setup;
+	}
+
+	// The fan is the one of the first source; the bottom comes from the boundary instances, if any.
+	RunSetup SetUpScenarioFile(const ScenarioDescription& description, MeshLibrary& library, const std::vector<std::string>& reloadMeshes,
+		const RunnerOptions& options, FrameTimingStats& stats) {
+		StageTimer timer(stats, TimingStage::SceneBuild);
+		SONAR_PROFILE_SCOPE("SceneBuild");
+
+		const std::vector<ScenarioEntity>& entities = description.GetEntities();
+		ConfigureLods(library, options, std::any_of(entities.begin(), entities.end(),
+			[](const ScenarioEntity& entity) { return entity.kind == "source" && entity.GetDouble("frequency", 0.0) > 0.0; }));
+		const ScenarioModel model = BuildScenarioModel(description, library, reloadMeshes);
+		if (model.scene.m_soundSources.empty()) {
+			throw std::runtime_error(description.GetSource() + " has no source");
+		}
+
+		const SoundSourceModel& source = model.scene.m_soundSources.front();
+		RunSetup setup(model.environment);
+		setup.name = description.GetSource() + ", source " + source.name;
+		setup.fan = source.fan;
+		setup.grid = model.grid;
+		AddSceneReceivers(model.scene, source, setup);
+		AddReceiverArray(options.receiverArray, setup);
+
+		const bool hasBoundary = std::any_of(model.scene.m_objects.begin(), model.scene.m_objects.end(),
+			[](const ReflectorModel& reflector) { return reflector.type == ObjectType::Boundary; });
+		if (hasBoundary || !model.scene.m_heightfields.empty()) {
+			ExtractBottom(model.scene, library, source, options, setup);
+			setup.bottomSource = model.scene.m_heightfields.empty() ? "the boundary instances" : "the boundary instances and heightfields";
+		}
+		return setup;
+	}
+
+	bool HaveSameEnvironment(const Environment& a, const Environment& b) {
+		return a.profile == b.profile && a.bottomDepth == b.bottomDepth && a.bottomSlope == b.bottomSlope &&
+			a.bottomProfile.GetSpacing() == b.bottomProfile.GetSpacing() && a.bottomProfile.GetDepths() == b.bottomProfile.GetDepths() &&
+			a.bottomLossDb == b.bottomLossDb && a.surfaceLossDb == b.surfaceLossDb;
+	}
+
+	// The trajectory cache of a run, and the environment its current version stands for.
+	struct CachedTrajectories {
+		explicit CachedTrajectories(size_t budgetBytes) : cache(budgetBytes) {}
+
+		TrajectoryCache cache;
+		uint64_t environmentVersion = 0;
+		std::unique_ptr<Environment> environment;
+	};
+
+	std::unique_ptr<CachedTrajectories> MakeTrajectoryCache(const RunnerOptions& options) {
+		if (!(options.trajectoryCacheMb > 0.0)) {
+			return nullptr;
+		}
+		return std::unique_ptr<CachedTrajectories>(new CachedTrajectories(static_cast<size_t>(options.trajectoryCacheMb * 1024.0 * 1024.0)));
+	}
+
+	int Propagate(RunSetup& setup, const RunnerOptions& options, FrameTimingStats& stats, CachedTrajectories* trajectories) {
+		if (options.rayCount) {
+			setup.fan.rayCount = options.rayCount;
+		}
+
+		PropagationSettings settings = GetModeSettings(options.mode);
+		settings.threadCount = options.threadCount;
+		settings.refinementLevels = options.refinementLevels;
+		settings.recordBottomHits = !setup.hitSurfaces.empty();
+		const ReceiverGrid receiverGrid(setup.receivers);
+		const ReceiverGrid* receivers = receiverGrid.IsEmpty() ? nullptr : &receiverGrid;
+
+		std::cout << setup.name << ", mode " << GetEngineModeName(options.mode) << ", " << setup.fan.rayCount
+			<< " rays, threads " << settings.threadCount;
+		if (!setup.bottomSource.empty()) {
+			const std::vector<double>& depths = setup.environment.bottomProfile.GetDepths();
+			std::cout << ", bottom " << *std::min_element(depths.begin(), depths.end()) << " to "
+				<< *std::max_element(depths.begin(), depths.end()) << " m from " << setup.bottomSource;
+		}
+		if (settings.refinementLevels) {
+			std::cout << ", refined " << settings.refinementLevels << " levels";
+		}
+		std::cout << '\n';
+
+		// Paths stay valid for as long as the environment does; sources and receivers may move.
+		if (trajectories && (!trajectories->environment || !HaveSameEnvironment(*trajectories->environment, setup.environment))) {
+			++trajectories->environmentVersion;
+			trajectories->environment.reset(new Environment(setup.environment));
+		}
+
+		PropagationResult result;
+		double fastestSeconds = 0.0;
+		for (uint32_t repetition = 0; repetition < options.repetitions; ++repetition) {
+			const auto start = std::chrono::steady_clock::now();
+			{
+				SONAR_PROFILE_SCOPE("Propagation");
+				result = trajectories
+					? trajectories->cache.Propagate(setup.environment, trajectories->environmentVersion, setup.fan, setup.grid, settings, receivers)
+					: RunPropagation(setup.environment, setup.fan, setup.grid, settings, receivers);
+			}
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			// Every repetition has its own worker threads; their rings go once collected.
+			if (Profiler::IsCapturing()) {
+				Profiler::Collect();
+			}
+
+			stats.AddCpuSample(TimingStage::CpuPropagation, elapsed.count() * 1000.0);
+			fastestSeconds = repetition == 0 ? elapsed.count() : std::min(fastestSeconds, elapsed.count());
+		}
+
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+
+		std::cout << result.crossings.size() << " crossings, " << result.totalSteps << " steps";
+		if (receivers) {
+			std::cout << ", " << result.arrivals.size() << " arrivals at " << receivers->GetReceiverCount() << " receivers";
+		}
+		// Ray numbers of a refined run are those of the dense fan it picks from.
+		const LaunchFan fan = settings.refinementLevels ? GetRefinedFan(setup.fan, settings.refinementLevels) : setup.fan;
+		if (!result.tracedRays.empty()) {
+			std::cout << ", " << result.tracedRays.size() << " of " << fan.rayCount << " rays traced";
+		}
+		if (trajectories) {
+			const TrajectoryCacheStats& cacheStats = trajectories->cache.GetStats();
+			std::cout << "\ntrajectory cache: " << cacheStats.cachedRays << " rays replayed, " << cacheStats.tracedRays << " traced, "
+				<< cacheStats.residentBytes / (1024 * 1024) << " MB in " << cacheStats.sourceCount << " sources";
+		}
+
+		std::vector<HitMap> hitMaps;
+		if (settings.recordBottomHits) {
+			HitMapSettings hitSettings;
+			hitSettings.frequency = setup.hitFrequency;
+			hitSettings.resolution = options.hitMapResolution;
+			hitSettings.startTime = options.hitStart;
+			hitSettings.endTime = options.hitEnd;
+			hitSettings.threadCount = settings.threadCount;
+
+			SONAR_PROFILE_SCOPE("HitMaps");
+			const auto start = std::chrono::steady_clock::now();
+			const std::vector<SurfaceHit> hits = ProjectBottomHits(result.bottomHits, fan,
+				result.tracedRays.empty() ? nullptr : &result.tracedRays, setup.bottomTrack, setup.hitSurfaces);
+			hitMaps = AccumulateHitMaps(hits, setup.hitSurfaces, hitSettings);
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+			uint64_t mapped = 0;
+			size_t hitSurfaces = 0;
+			size_t tiles = 0;
+			size_t bytes = 0;
+			for (const HitMap& map : hitMaps) {
+				const uint64_t mapHits = map.GetTotalHits();
+				mapped += mapHits;
+				hitSurfaces += mapHits > 0;
+				tiles += map.GetTiles().size();
+				bytes += map.GetBytes();
+			}
+			std::cout << "\nhit maps: " << mapped << " of " << result.bottomHits.size() << " bottom reflections on " << hitSurfaces
+				<< " of " << hitMaps.size() << " surfaces, " << tiles << " tiles, " << std::fixed << std::setprecision(2)
+				<< bytes / (1024.0 * 1024.0) << " MB, " << std::setprecision(3) << elapsed.count() << " ms";
+		}
+		std::cout << "\n\n";
+		std::cout << std::left << std::setw(18) << "stage" << std::right << std::setw(6) << "runs" << std::setw(12) << "mean ms"
+			<< std::setw(12) << "p50 ms" << std::setw(12) << "p95 ms" << std::setw(12) << "max ms" << '\n';
+		for (TimingStage stage : { TimingStage::SceneBuild, TimingStage::CpuPropagation }) {
+			PrintSummary(GetTimingStageName(stage), stats.GetCpuSummary(stage));
+		}
+		const size_t tracedRays = result.tracedRays.empty() ? fan.rayCount : result.tracedRays.size();
+		std::cout << std::setprecision(0) << "\nfastest run: " << tracedRays / fastestSeconds << " rays/s, "
+			<< result.totalSteps / fastestSeconds << " steps/s\n";
+
+		// A watched scenario prints its next run with the same stream.
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+
+		if (!options.outputDirectory.empty()) {
+			SONAR_PROFILE_SCOPE("WriteOutput");
+			const std::string prefix = options.outputDirectory + "/";
+			const bool written =
+				WriteFile(prefix + "arrivals.csv", [&](std::ostream& stream) { WriteArrivals(stream, fan, setup.grid, result); }) &&
+				WriteFile(prefix + "tl.csv", [&](std::ostream& stream) { WriteTransmissionLoss(stream, setup.grid, result); }) &&
+				WriteFile(prefix + "timings.csv", [&](std::ostream& stream) { stats.WriteCsv(stream); }) &&
+				(!receivers || WriteFile(prefix + "receivers.csv", [&](std::ostream& stream) { WriteReceiverArrivals(stream, fan, *receivers, result); })) &&
+				(!trajectories || WriteFile(prefix + "paths.csv", [&](std::ostream& stream) {
+					WritePaths(stream, trajectories->cache, trajectories->environmentVersion, fan, setup.grid, settings, result);
+				}));
+			if (!written) {
+				return 1;
+			}
+
+			// Surfaces no reflection reached get no files.
+			for (size_t surface = 0; surface < hitMaps.size(); ++surface) {
+				const HitMap& map = hitMaps[surface];
+				const std::string name = prefix + "hitmap_" + std::to_string(surface);
+				if (map.GetTotalHits() > 0 &&
+					(!WriteFile(name + ".pgm", [&](std::ostream& stream) { map.WriteImage(stream, 60.0, 4096, settings.threadCount); },
+						std::ios::out | std::ios::binary) ||
+					!WriteFile(name + ".bin", [&](std::ostream& stream) { map.WriteBinary(stream); }, std::ios::out | std::ios::binary))) {
+					return 1;
+				}
+			}
+		}
+		return 0;
+	}
+
+	void PrintChanges(const ScenarioChanges& changes) {
+		std::cout << "\nscenario changed:";
+		for (const std::string& mesh : changes.meshes) {
+			std::cout << " geometry " << mesh;
+		}
+		if (changes.instancesChanged) {
+			std::cout << " instances";
+		}
+		if (changes.transformsChanged) {
+			std::cout << " transforms";
+		}
+		if (changes.acousticsChanged) {
+			std::cout << " acoustics";
+		}
+		std::cout << "\n\n";
+	}
+
+	// Propagates the scenario file; with --watch, again after every change until interrupted.
+	int RunScenarioFile(const RunnerOptions& options) {
+		ScenarioDescription scenario = ScenarioDescription::Load(options.scenarioFile);
+		MeshLibrary library;
+		std::vector<std::string> reloadMeshes;
+
+		// The first poll only records the stamps of the files just loaded.
+		std::unique_ptr<CachedTrajectories> trajectories = MakeTrajectoryCache(options);
+
+		ScenarioWatcher watcher(options.scenarioFile);
+		ScenarioDescription next;
+		ScenarioChanges changes;
+		watcher.Poll(scenario, next, changes);
+
+		while (true) {
+			try {
+				FrameTimingStats stats(options.repetitions);
+				BeginTrace(options);
+				RunSetup setup = SetUpScenarioFile(scenario, library, reloadMeshes, options, stats);
+				int status = Propagate(setup, options, stats, trajectories.get());
+				if (!WriteTrace(options)) {
+					status = 1;
+				}
+				if (!options.watch) {
+					return status;
+				}
+				std::cout.flush();
+			}
+			catch (const std::exception& exception) {
+				if (!options.watch) {
+					throw;
+				}
+				std::cerr << "Run failed: " << exception.what() << '\n';
+			}
+
+			std::string reportedError;
+			while (!watcher.Poll(scenario, next, changes)) {
+				if (watcher.GetLastError() != reportedError) {
+					reportedError = watcher.GetLastError();
+					std::cerr << reportedError << '\n';
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			}
+
+			PrintChanges(changes);
+			scenario = next;
+			reloadMeshes = changes.meshes;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 2 && !std::strcmp(argv[1], "--list")) {
+		for (const GoldenScenario& scenario : GetGoldenScenarios()) {
+			std::cout << scenario.name << '\n';
+		}
+		return 0;
+	}
+
+	RunnerOptions options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 2;
+	}
+
+	try {
+		if (!options.scenarioFile.empty()) {
+			return RunScenarioFile(options);
+		}
+
+		const GoldenScenario* scenario = FindScenario(options.scenario);
+		if (!scenario) {
+			std::cerr << "Unknown scenario " << options.scenario << "; --list prints the built-in ones\n";
+			return 2;
+		}
+
+		FrameTimingStats stats(options.repetitions);
+		BeginTrace(options);
+		RunSetup setup = SetUpBuiltinScenario(*scenario, options, stats);
+		std::unique_ptr<CachedTrajectories> trajectories = MakeTrajectoryCache(options);
+		const int status = Propagate(setup, options, stats, trajectories.get());
+		return WriteTrace(options) ? status : 1;
+	}
+	catch (const std::exception& exception) {
+		std::cerr << "Run failed: " << exception.what() << '\n';
+		return 1;
+	}
+}
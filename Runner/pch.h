@@ -0,0 +1,13 @@
+#pragma once
+
+// Stand-in for the application's pch.h, as in Benchmarks/ and Validation/: with this directory first
+// on the include path the portable sources get the standard library instead of the D3D12 and WinRT
+// headers.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
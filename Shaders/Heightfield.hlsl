@@ -0,0 +1,172 @@
+#include "Common.hlsl"
+
+// Heightfield bathymetry as a procedural primitive. The BLAS holds one box per tile of cells; a ray
+// entering a box walks down the min/max pyramid of that tile, stepping over every node whose height
+// range its segment misses, and only intersects the two triangles of the cells it cannot rule out.
+// Mirrors Heightfield::Intersect() of Sonar/Heightfield.cpp.
+
+StructuredBuffer<float> heights : register(t0);  // columns x rows, row after row
+StructuredBuffer<float2> pyramid : register(t1); // min and max of the nodes of levels 1 and up
+
+// HeightfieldConstants of Content/ShaderStructures.h
+cbuffer HeightfieldConstants : register(b0)
+{
+    uint columns;
+    uint rows;
+    float cellSize;
+    uint tileLevel;
+    uint tileColumns;
+    uint3 padding;
+    uint4 levelOffsets[2];
+    uint4 levelColumns[2];
+    uint4 levelRows[2];
+};
+
+uint GetLevelValue(uint4 values[2], uint level)
+{
+    return values[level >> 2][level & 3];
+}
+
+float GetHeight(uint column, uint row)
+{
+    return heights[row * columns + column];
+}
+
+float2 GetNodeRange(uint level, uint column, uint row)
+{
+    if (level > 0)
+    {
+        return pyramid[GetLevelValue(levelOffsets, level) + row * GetLevelValue(levelColumns, level) + column];
+    }
+
+    float a = GetHeight(column, row), b = GetHeight(column + 1, row);
+    float c = GetHeight(column, row + 1), d = GetHeight(column + 1, row + 1);
+    return float2(min(min(a, b), min(c, d)), max(max(a, b), max(c, d)));
+}
+
+// Moller-Trumbore; t is only written for hits nearer than it.
+bool IntersectTriangle(float3 origin, float3 direction, float3 a, float3 b, float3 c, float tMin, inout float t)
+{
+    float3 e1 = b - a;
+    float3 e2 = c - a;
+    float3 p = cross(direction, e2);
+    float determinant = dot(e1, p);
+    if (abs(determinant) < 1e-20f)
+    {
+        return false;
+    }
+
+    float inverse = 1.0f / determinant;
+    float3 s = origin - a;
+    float u = dot(s, p) * inverse;
+    float3 q = cross(s, e1);
+    float v = dot(direction, q) * inverse;
+    float candidate = dot(e2, q) * inverse;
+    if (u < 0.0f || v < 0.0f || u + v > 1.0f || candidate < tMin || candidate >= t)
+    {
+        return false;
+    }
+
+    t = candidate;
+    return true;
+}
+
+bool IntersectCell(uint column, uint row, float3 origin, float3 direction, float tMin, inout float t)
+{
+    float x0 = column * cellSize, x1 = x0 + cellSize;
+    float z0 = row * cellSize, z1 = z0 + cellSize;
+    float3 a = float3(x0, GetHeight(column, row), z0);
+    float3 b = float3(x1, GetHeight(column + 1, row), z0);
+    float3 c = float3(x0, GetHeight(column, row + 1), z1);
+    float3 d = float3(x1, GetHeight(column + 1, row + 1), z1);
+
+    bool hit = IntersectTriangle(origin, direction, a, b, c, tMin, t);
+    return IntersectTriangle(origin, direction, b, c, d, tMin, t) || hit;
+}
+
+[shader("intersection")]
+void HeightfieldIntersection()
+{
+    float3 origin = ObjectRayOrigin();
+    float3 direction = ObjectRayDirection();
+
+    uint tileColumn = PrimitiveIndex() % tileColumns;
+    uint tileRow = PrimitiveIndex() / tileColumns;
+    uint tileCells = 1u << tileLevel;
+
+    // Clip the ray to the columns of the tile.
+    float2 tileMin = float2(tileColumn, tileRow) * tileCells * cellSize;
+    float2 tileMax = min(tileMin + tileCells * cellSize, float2(columns - 1, rows - 1) * cellSize);
+    float2 inverse = 1.0f / direction.xz;
+    float2 t0 = (tileMin - origin.xz) * inverse;
+    float2 t1 = (tileMax - origin.xz) * inverse;
+    float2 tNear = min(t0, t1);
+    float2 tFar = max(t0, t1);
+    float t = max(RayTMin(), max(direction.x != 0.0f ? tNear.x : RayTMin(), direction.z != 0.0f ? tNear.y : RayTMin()));
+    float tEnd = min(RayTCurrent(), min(direction.x != 0.0f ? tFar.x : RayTCurrent(), direction.z != 0.0f ? tFar.y : RayTCurrent()));
+
+    float tHit = RayTCurrent();
+    uint level = tileLevel;
+    float horizontal = max(abs(direction.x), abs(direction.z));
+
+    // Every step either descends or moves past a node, so a tile takes a bounded number of them.
+    for (uint step = 0; step < 4096 && t <= tEnd; ++step)
+    {
+        float nodeSize = cellSize * (1u << level);
+        float nudge = 1e-4f * nodeSize;
+        float2 position = origin.xz + t * direction.xz + sign(direction.xz) * nudge;
+        uint column = (uint)clamp(floor(position.x / nodeSize), 0.0f, GetLevelValue(levelColumns, level) - 1.0f);
+        uint row = (uint)clamp(floor(position.y / nodeSize), 0.0f, GetLevelValue(levelRows, level) - 1.0f);
+
+        float tExit = tEnd;
+        if (direction.x != 0.0f)
+        {
+            tExit = min(tExit, ((direction.x > 0.0f ? column + 1 : column) * nodeSize - origin.x) * inverse.x);
+        }
+        if (direction.z != 0.0f)
+        {
+            tExit = min(tExit, ((direction.z > 0.0f ? row + 1 : row) * nodeSize - origin.z) * inverse.y);
+        }
+        if (horizontal > 0.0f)
+        {
+            tExit = max(tExit, t + nudge / horizontal);
+        }
+
+        if (level == 0)
+        {
+            if (IntersectCell(column, row, origin, direction, RayTMin(), tHit))
+            {
+                Attributes attributes;
+                float3 position = origin + tHit * direction;
+                attributes.bary = position.xz / (float2(columns - 1, rows - 1) * cellSize);
+                ReportHit(tHit, 0, attributes);
+                return;
+            }
+        }
+        else
+        {
+            float2 range = GetNodeRange(level, column, row);
+            float y0 = origin.y + t * direction.y;
+            float y1 = origin.y + min(tExit, tEnd) * direction.y;
+            if (max(y0, y1) >= range.x && min(y0, y1) <= range.y)
+            {
+                --level;
+                continue;
+            }
+        }
+
+        if (tExit >= tEnd)
+        {
+            break;
+        }
+        t = tExit;
+        level = min(level + 1, tileLevel);
+    }
+}
+
+[shader("closesthit")]
+void HeightfieldClosestHit(inout HitInfo payload, Attributes attrib)
+{
+    // The intersection shader reports the position on the grid in place of barycentrics.
+    payload.colorAndDistance = float4(attrib.bary, 0.0, RayTCurrent());
+}
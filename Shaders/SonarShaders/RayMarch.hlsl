@@ -1,85 +1,84 @@
 #include "SonarEq.hlsl"
 
 
-ray_data ComputeNextRay(ray_data data, float h)
+//-------------------------------------------------------
+// Butcher tableau of the explicit Runge-Kutta integrator, selected by SONAR_RK_TABLEAU.
+// The coefficients are static constants and the stage loops are unrolled, so the
+// compiler folds every zero coefficient away instead of indexing local arrays.
+#if SONAR_RK_TABLEAU == SONAR_TABLEAU_EULER
+#define SONAR_RK_STAGES 1
+static const float c_rkA[1][1] = { { 0.0 } };
+static const float c_rkB[1] = { 1.0 };
+#elif SONAR_RK_TABLEAU == SONAR_TABLEAU_MIDPOINT
+#define SONAR_RK_STAGES 2
+static const float c_rkA[2][2] =
 {
-    int m = 4;
-    int n = 3;
-    
-    float mtx[3 * 4] = 
-    {
-		0.0,0.0,0.0,
-        0.5,0.0,0.0,
-        0.0,0.5,0.0,
-        0.0,0.0,1.0,
-    };
-    
-    float w[4] =
-    {
-        1/6, 1/3, 1/3, 1/6  
-    };
-    
-    ray_data du = sonar_diff_eq(data);
-    
-    ray_data ks[4];
+    { 0.0, 0.0 },
+    { 0.5, 0.0 },
+};
+static const float c_rkB[2] = { 0.0, 1.0 };
+#else
+#define SONAR_RK_STAGES 4
+static const float c_rkA[4][4] =
+{
+    { 0.0, 0.0, 0.0, 0.0 },
+    { 0.5, 0.0, 0.0, 0.0 },
+    { 0.0, 0.5, 0.0, 0.0 },
+    { 0.0, 0.0, 1.0, 0.0 },
+};
+static const float c_rkB[4] = { 1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0 };
+#endif
+//-------------------------------------------------------
 
-	ks[0] = du;
+ray_data ComputeNextRay(ray_data data, sonar_real h)
+{
+    ray_data ks[SONAR_RK_STAGES];
 
-    for (int i = 1; i < m; ++i) 
+    [unroll]
+    for (int i = 0; i < SONAR_RK_STAGES; ++i)
     {
-        ks[i] = data; 
-        
-        for (int j = 0; j < i-1; ++j)
-        {
-            ray_data res;
-            res.r = ks[j].r * mtx[i * n + j] * h;
-            res.z = ks[j].z * mtx[i * n + j] * h;
-            res.xi = ks[j].xi * mtx[i * n + j] * h;
-            res.zeta = ks[j].zeta * mtx[i * n + j] * h;
+        ray_data stage = data;
 
-            ks[i] = sum_ray_data(ks[i],res);
-            //ks[i] += ks[j] * mtx[i * n + j];
+        [unroll]
+        for (int j = 0; j < i; ++j)
+        {
+            stage = sum_ray_data(stage, scale_ray_data(ks[j], (sonar_real)(c_rkA[i][j]) * h));
         }
+
+        ks[i] = sonar_diff_eq(stage);
     }
-    
+
     ray_data newU = data;
-    
-    for (int k = 0; k < m; ++k)
-    {
-        ray_data res;
-		res.r = data.r + ks[k].r * w[k];
-        res.z = data.z + ks[k].z * w[k];
-        res.xi = data.xi + ks[k].xi * w[k];
-        res.zeta = data.zeta + ks[k].zeta * w[k];
 
-        newU = sum_ray_data(newU, res);
+    [unroll]
+    for (int k = 0; k < SONAR_RK_STAGES; ++k)
+    {
+        newU = sum_ray_data(newU, scale_ray_data(ks[k], (sonar_real)(c_rkB[k]) * h));
     }
+
     return newU;
 }
 
 ray_march_output RayMarch(ray_march_input data)
 {
-    float ARBITRARY_DEPTH = 6800.0;
-    float ARBITRARY_OFFSET = 10.0;
-	float ARBITRARY_H = 1.0;
-
     ray_data u = input_to_data(data);
     
-    for (int i = 0; i < 100000; ++i)
+    [loop]
+    for (int i = 0; i < SONAR_MAX_STEPS; ++i)
     {
-        ray_data u2 = ComputeNextRay(u,ARBITRARY_H);
+        ray_data u2 = ComputeNextRay(u, (sonar_real)SONAR_STEP_SIZE);
         
         float3 p = data_to_output(u,data.rayDirection.z,data.distance).rayOrigin;
         // TODO: Check for proximity to other objects
         // Check for boundaries, if distance is smaller than a certain threshold, break
-        if (p.z < 0.0 || p.z < ARBITRARY_DEPTH)
+        if (p.z < 0.0 || p.z < SONAR_MAX_DEPTH)
         {
             break;
         }
         
         u = u2;
         
-        if (p.z <= ARBITRARY_OFFSET || p.z < ARBITRARY_DEPTH - ARBITRARY_OFFSET)
+        if (p.z <= SONAR_BOUNDARY_OFFSET || p.z < SONAR_MAX_DEPTH - SONAR_BOUNDARY_OFFSET)
         {
             break;
         }
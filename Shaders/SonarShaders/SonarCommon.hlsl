@@ -2,4 +2,5 @@ struct SoundHitInfo
 {
     float2 uv;
     bool isObjectHit;
+    uint bounces;
 };
\ No newline at end of file
@@ -0,0 +1,61 @@
+//-------------------------------------------------------
+// Compile-time configuration of the sonar kernels.
+// Every value can be overridden with a define when compiling a permutation
+// (see ShaderPermutation.h); the defaults reproduce the original constants.
+//-------------------------------------------------------
+
+#ifndef SONAR_CONFIG_HLSL
+#define SONAR_CONFIG_HLSL
+
+// Integrator tableaus:
+#define SONAR_TABLEAU_EULER 0
+#define SONAR_TABLEAU_MIDPOINT 1
+#define SONAR_TABLEAU_RK4 2
+
+// Sound speed profile models:
+#define SONAR_SSP_MACKENZIE 0
+#define SONAR_SSP_COMPACT_MACKENZIE 1
+
+// Precision of the integrator state:
+#define SONAR_PRECISION_FULL 0
+#define SONAR_PRECISION_HALF 1
+
+#ifndef SONAR_STEP_SIZE
+#define SONAR_STEP_SIZE 1.0
+#endif
+
+#ifndef SONAR_MAX_STEPS
+#define SONAR_MAX_STEPS 100000
+#endif
+
+#ifndef SONAR_MAX_DEPTH
+#define SONAR_MAX_DEPTH 6800.0
+#endif
+
+#ifndef SONAR_BOUNDARY_OFFSET
+#define SONAR_BOUNDARY_OFFSET 10.0
+#endif
+
+#ifndef SONAR_RK_TABLEAU
+#define SONAR_RK_TABLEAU SONAR_TABLEAU_RK4
+#endif
+
+#ifndef SONAR_SSP_MODEL
+#define SONAR_SSP_MODEL SONAR_SSP_MACKENZIE
+#endif
+
+#ifndef SONAR_MAX_BOUNCES
+#define SONAR_MAX_BOUNCES 8
+#endif
+
+#ifndef SONAR_PRECISION
+#define SONAR_PRECISION SONAR_PRECISION_FULL
+#endif
+
+#if SONAR_PRECISION == SONAR_PRECISION_HALF
+#define sonar_real min16float
+#else
+#define sonar_real float
+#endif
+
+#endif
@@ -58,11 +58,41 @@ float cmf_partial_of_z(env_data data)
 // Coppens Formulas:
 //-------------------------------------------------------
 
+//-------------------------------------------------------
+// Sound speed profile selected by SONAR_SSP_MODEL:
+float sound_speed(env_data data)
+{
+#if SONAR_SSP_MODEL == SONAR_SSP_COMPACT_MACKENZIE
+    return compact_mackenzie_formula(data);
+#else
+    return mackenzie_formula(data);
+#endif
+}
+
+float sound_speed_partial_of_r(env_data data)
+{
+#if SONAR_SSP_MODEL == SONAR_SSP_COMPACT_MACKENZIE
+    return cmf_partial_of_r(data);
+#else
+    return mf_partial_of_r(data);
+#endif
+}
+
+float sound_speed_partial_of_z(env_data data)
+{
+#if SONAR_SSP_MODEL == SONAR_SSP_COMPACT_MACKENZIE
+    return cmf_partial_of_z(data);
+#else
+    return mf_partial_of_z(data);
+#endif
+}
+//-------------------------------------------------------
+
 ray_data init_ray(float r, float z, float theta)
 {
     env_data envData = { 2.0, 34.7, z };
     
-    float c = mackenzie_formula(envData);
+    float c = sound_speed(envData);
     
     float xi = cos(theta) / c;
     float zeta = sin(theta) / c;
@@ -84,9 +114,9 @@ ray_data sonar_diff_eq(ray_data ray)
 	envData.salinity = 2.0;
 
     
-    float c = mackenzie_formula(envData);
-    float c_r = mf_partial_of_r(envData);
-    float c_z = mf_partial_of_z(envData);
+    float c = sound_speed(envData);
+    float c_r = sound_speed_partial_of_r(envData);
+    float c_z = sound_speed_partial_of_z(envData);
     
     float x = -1.0 / pow(c, 2);
     
@@ -29,6 +29,13 @@ void ObjectClosestHit(inout SoundHitInfo hit,Attributes attrib)
 [shader("closesthit")]
 void BoundaryClosestHit(inout SoundHitInfo hit, Attributes attrib)
 {
+    // Recursion depth is bounded at compile time by the permutation.
+    if (hit.bounces >= SONAR_MAX_BOUNCES)
+    {
+        return;
+    }
+    hit.bounces++;
+
     float3 barycentrics = float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
     
     uint vertId = 3 * PrimitiveIndex();
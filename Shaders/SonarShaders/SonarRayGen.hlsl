@@ -21,6 +21,7 @@ void SonarRayGen()
 	// Initialize the ray payload
     SoundHitInfo payload;
 	payload.isObjectHit = false;
+    payload.bounces = 0;
 
     // Get the location within the dispatched 2D grid of work items
     // (often maps to pixels, so this could represent a pixel coordinate).
@@ -1,3 +1,5 @@
+#include "SonarConfig.hlsl"
+
 struct env_data
 {
     float depth;
@@ -21,10 +23,10 @@ struct ray_march_output
 
 struct ray_data
 {
-    float r;
-    float z;
-    float xi;
-    float zeta;
+    sonar_real r;
+    sonar_real z;
+    sonar_real xi;
+    sonar_real zeta;
 };
 
 ray_data sum_ray_data(ray_data r1, ray_data r2)
@@ -35,5 +37,16 @@ ray_data sum_ray_data(ray_data r1, ray_data r2)
     res.xi = r1.xi + r2.xi;
     res.zeta = r1.zeta + r2.zeta;
 
+    return res;
+}
+
+ray_data scale_ray_data(ray_data r, sonar_real s)
+{
+    ray_data res;
+    res.r = r.r * s;
+    res.z = r.z * s;
+    res.xi = r.xi * s;
+    res.zeta = r.zeta * s;
+
     return res;
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#include "pch.h"
+#include "BottomProfile.h"
+
+#include <stdexcept>
+
+SonarPropagation::Sonar::BottomProfile::BottomProfile(std::vector<double> depths, double spacing)
+	: m_depths(std::move(depths)), m_spacing(spacing)
+{
+	if (m_depths.size() < 2 || !(spacing > 0.0)) {
+		throw std::invalid_argument("BottomProfile needs at least two depths and a positive spacing");
+	}
+
+	m_inverseSpacing = 1.0 / spacing;
+	m_slopes.resize(m_depths.size() - 1);
+	for (size_t cell = 0; cell < m_slopes.size(); ++cell) {
+		m_slopes[cell] = (m_depths[cell + 1] - m_depths[cell]) * m_inverseSpacing;
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Bottom depth along the propagation track, sampled at a regular range spacing and linear in
+		/// between, like the sound speed tables. Depths beyond the sampled range hold the end values.
+		/// </summary>
+		class BottomProfile {
+		public:
+			BottomProfile() = default;
+
+			/// <summary>
+			/// depths[i] is the depth at range i * spacing. Throws std::invalid_argument if there are
+			/// fewer than two depths or the spacing is not positive.
+			/// </summary>
+			BottomProfile(std::vector<double> depths, double spacing);
+
+			bool IsEmpty() const { return m_depths.empty(); }
+
+			double DepthAt(double r) const;
+
+			/// <summary>
+			/// dz/dr of the cell containing r; positive where the bottom gets deeper with range.
+			/// </summary>
+			double SlopeAt(double r) const;
+
+			double GetSpacing() const { return m_spacing; }
+			double GetMaxRange() const { return m_spacing * (m_depths.size() - 1); }
+			const std::vector<double>& GetDepths() const { return m_depths; }
+
+		private:
+			size_t GetCell(double r) const;
+
+			std::vector<double> m_depths;
+			std::vector<double> m_slopes;
+			double m_spacing = 0.0;
+			double m_inverseSpacing = 0.0;
+		};
+
+		inline size_t BottomProfile::GetCell(double r) const
+		{
+			const double position = r * m_inverseSpacing;
+			if (!(position > 0.0)) {
+				return 0;
+			}
+			return position >= static_cast<double>(m_slopes.size()) ? m_slopes.size() : static_cast<size_t>(position);
+		}
+
+		inline double BottomProfile::DepthAt(double r) const
+		{
+			const size_t cell = GetCell(r);
+			if (cell == m_slopes.size()) {
+				return m_depths.back();
+			}
+			if (cell == 0 && !(r > 0.0)) {
+				return m_depths.front();
+			}
+			return m_depths[cell] + (r - cell * m_spacing) * m_slopes[cell];
+		}
+
+		inline double BottomProfile::SlopeAt(double r) const
+		{
+			const size_t cell = GetCell(r);
+			if (cell == m_slopes.size() || (cell == 0 && !(r > 0.0))) {
+				return 0.0;
+			}
+			return m_slopes[cell];
+		}
+	}
+}
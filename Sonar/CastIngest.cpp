@@ -0,0 +1,391 @@
+#include "pch.h"
+#include "CastIngest.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	bool IsSeparator(char c) {
+		return c == ' ' || c == '\t' || c == ',' || c == '\r';
+	}
+
+	char* SkipSeparators(char* text) {
+		while (IsSeparator(*text)) {
+			++text;
+		}
+		return text;
+	}
+
+	char* FindSeparator(char* text) {
+		while (*text && !IsSeparator(*text)) {
+			++text;
+		}
+		return text;
+	}
+
+	const double c_powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// Plain decimals such as "-12.345", which is what cast files hold. With at most 15 digits the
+	// digits are an exact double and so is the power of ten, so the one division rounds like
+	// strtod() would. Returns false for anything else, which strtod() then handles.
+	bool ParseDecimal(const char* text, const char*& end, double& value) {
+		const char* p = text;
+		const bool negative = *p == '-';
+		if (*p == '-' || *p == '+') {
+			++p;
+		}
+
+		uint64_t digits = 0;
+		int digitCount = 0;
+		int fractionCount = 0;
+		bool point = false;
+		for (;; ++p) {
+			if (*p >= '0' && *p <= '9') {
+				digits = digits * 10 + static_cast<uint64_t>(*p - '0');
+				++digitCount;
+				fractionCount += point;
+			}
+			else if (*p == '.' && !point) {
+				point = true;
+			}
+			else {
+				break;
+			}
+		}
+
+		if (digitCount == 0 || digitCount > 15 || *p == 'e' || *p == 'E') {
+			return false;
+		}
+
+		value = static_cast<double>(digits) / c_powersOfTen[fractionCount];
+		value = negative ? -value : value;
+		end = p;
+		return true;
+	}
+
+	// Parses the number starting at text and moves text past it and the separators after it.
+	bool ParseNumber(char*& text, double& value) {
+		const char* decimalEnd;
+		char* end = nullptr;
+		if (ParseDecimal(text, decimalEnd, value)) {
+			end = text + (decimalEnd - text);
+		}
+		else {
+			errno = 0;
+			value = std::strtod(text, &end);
+			if (end == text || errno != 0) {
+				return false;
+			}
+		}
+
+		if (*end && !IsSeparator(*end)) {
+			return false;
+		}
+		text = SkipSeparators(end);
+		return true;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// CastBlock implementation
+
+void SonarPropagation::Sonar::CastBlock::Clear()
+{
+	startsCast = false;
+	depths.clear();
+	temperatures.clear();
+	salinities.clear();
+}
+
+//--------------------------------------------------------------------------------------
+// CastReader implementation
+
+SonarPropagation::Sonar::CastReader::CastReader(std::istream& stream, std::string source, size_t chunkSize, double defaultSalinity)
+	: m_stream(stream), m_source(std::move(source)), m_defaultSalinity(defaultSalinity), m_buffer(chunkSize + 1)
+{
+	if (chunkSize == 0) {
+		throw std::invalid_argument("CastReader: the chunk size must be positive");
+	}
+}
+
+bool SonarPropagation::Sonar::CastReader::Read(CastBlock& block)
+{
+	block.Clear();
+
+	while (block.GetSize() < c_blockSize) {
+		if (m_hasNext) {
+			if (block.GetSize()) {
+				return true;
+			}
+			m_current = m_next;
+			m_hasNext = false;
+			m_inCast = true;
+			block.header = m_current;
+			block.startsCast = true;
+		}
+
+		char* line;
+		if (!NextLine(line)) {
+			return block.GetSize() != 0;
+		}
+
+		char* text = SkipSeparators(line);
+		if (*text == '\0' || *text == '#') {
+			continue;
+		}
+
+		if (!std::strncmp(text, "cast", 4) && IsSeparator(text[4])) {
+			ParseHeader(text + 4, m_next);
+			m_hasNext = true;
+			continue;
+		}
+
+		if (!m_inCast) {
+			Fail("rows before the first cast header");
+		}
+
+		double depth, temperature, salinity = m_current.salinity;
+		if (!ParseNumber(text, depth) || !ParseNumber(text, temperature) || (*text && !ParseNumber(text, salinity)) || *text) {
+			Fail("expected depth, temperature and optionally salinity");
+		}
+
+		if (!block.GetSize()) {
+			block.header = m_current;
+		}
+		block.depths.push_back(depth);
+		block.temperatures.push_back(temperature);
+		block.salinities.push_back(salinity);
+	}
+	return true;
+}
+
+bool SonarPropagation::Sonar::CastReader::NextLine(char*& line)
+{
+	while (true) {
+		char* begin = m_buffer.data() + m_begin;
+		char* newline = static_cast<char*>(std::memchr(begin, '\n', m_end - m_begin));
+		if (newline || (m_endOfStream && m_begin < m_end)) {
+			const size_t length = newline ? static_cast<size_t>(newline - begin) : m_end - m_begin;
+			begin[length] = '\0';
+			m_begin += newline ? length + 1 : length;
+			++m_lineCount;
+			line = begin;
+			return true;
+		}
+		if (m_endOfStream) {
+			return false;
+		}
+
+		// Move the partial line to the front and fill the rest of the chunk after it.
+		const size_t chunkSize = m_buffer.size() - 1;
+		const size_t partial = m_end - m_begin;
+		if (partial == chunkSize) {
+			++m_lineCount;
+			Fail("line longer than the read chunk");
+		}
+		std::memmove(m_buffer.data(), begin, partial);
+		m_begin = 0;
+		m_end = partial;
+
+		m_stream.read(m_buffer.data() + m_end, static_cast<std::streamsize>(chunkSize - m_end));
+		const size_t count = static_cast<size_t>(m_stream.gcount());
+		m_end += count;
+		m_bytesRead += count;
+		m_buffer[m_end] = '\0';
+		if (!m_stream) {
+			m_endOfStream = true;
+		}
+	}
+}
+
+void SonarPropagation::Sonar::CastReader::ParseHeader(char* text, CastHeader& header)
+{
+	header = CastHeader();
+	header.salinity = m_defaultSalinity;
+	header.index = m_castCount;
+	header.line = m_lineCount;
+
+	text = SkipSeparators(text);
+	char* end = FindSeparator(text);
+	header.name.assign(text, end);
+	if (header.name.empty() || header.name.find('=') != std::string::npos) {
+		Fail("a cast header needs a name");
+	}
+
+	text = SkipSeparators(end);
+	while (*text) {
+		end = FindSeparator(text);
+		const char saved = *end;
+		*end = '\0';
+
+		char* equals = std::strchr(text, '=');
+		if (!equals) {
+			Fail(std::string("expected key=value, not ") + text);
+		}
+		*equals = '\0';
+		char* value = equals + 1;
+
+		double number;
+		if (!ParseNumber(value, number) || *value) {
+			Fail(std::string(text) + " is not a number");
+		}
+		if (!std::strcmp(text, "range")) {
+			header.range = number;
+		}
+		else if (!std::strcmp(text, "salinity")) {
+			header.salinity = number;
+		}
+		else {
+			Fail(std::string("unknown cast key ") + text);
+		}
+
+		*end = saved;
+		text = SkipSeparators(end);
+	}
+	++m_castCount;
+}
+
+void SonarPropagation::Sonar::CastReader::Fail(const std::string& message) const
+{
+	std::ostringstream stream;
+	stream << m_source << " line " << m_lineCount << ": " << message;
+	throw std::runtime_error(stream.str());
+}
+
+//--------------------------------------------------------------------------------------
+// CastProfileBuilder implementation
+
+SonarPropagation::Sonar::CastProfileBuilder::CastProfileBuilder(const CastIngestSettings& settings)
+	: m_settings(settings)
+{
+	if (settings.depthSpacing <= 0.0 || settings.maxDepth <= 0.0 || settings.rangeBinWidth <= 0.0) {
+		throw std::invalid_argument("CastProfileBuilder: spacing, depth and bin width must be positive");
+	}
+	m_nodeCount = static_cast<size_t>(std::ceil(settings.maxDepth / settings.depthSpacing)) + 1;
+}
+
+void SonarPropagation::Sonar::CastProfileBuilder::Add(const CastBlock& block)
+{
+	if (block.startsCast || !m_inCast || block.header.index != m_cast.index) {
+		FinishCast();
+		m_cast = block.header;
+		m_inCast = true;
+		m_castSpeeds.assign(m_nodeCount, 0.0);
+		m_nextNode = 0;
+		m_hasPrevious = false;
+	}
+
+	m_blockSpeeds.resize(block.GetSize());
+	ConvertToSoundSpeed(m_settings.formula, block.temperatures.data(), block.salinities.data(), block.depths.data(),
+		m_blockSpeeds.data(), block.GetSize());
+
+	// Linear interpolation between consecutive rows, as SoundSpeedProfile::FromSamples() does, but
+	// one row at a time: every grid node above the row is final once the row is seen.
+	for (size_t row = 0; row < block.GetSize(); ++row) {
+		const double depth = block.depths[row];
+		const double speed = m_blockSpeeds[row];
+		if (m_hasPrevious && !(depth > m_previousDepth)) {
+			++m_skippedRows;
+			continue;
+		}
+
+		for (; m_nextNode < m_nodeCount; ++m_nextNode) {
+			const double z = m_nextNode * m_settings.depthSpacing;
+			if (z > depth) {
+				break;
+			}
+			m_castSpeeds[m_nextNode] = m_hasPrevious
+				? m_previousSpeed + (z - m_previousDepth) / (depth - m_previousDepth) * (speed - m_previousSpeed)
+				: speed;
+		}
+
+		m_hasPrevious = true;
+		m_previousDepth = depth;
+		m_previousSpeed = speed;
+	}
+}
+
+void SonarPropagation::Sonar::CastProfileBuilder::FinishCast()
+{
+	if (!m_inCast) {
+		return;
+	}
+	m_inCast = false;
+	if (!m_hasPrevious) {
+		return;
+	}
+
+	// Below the deepest row the profile holds its last speed.
+	for (; m_nextNode < m_nodeCount; ++m_nextNode) {
+		m_castSpeeds[m_nextNode] = m_previousSpeed;
+	}
+
+	RangeBin& bin = m_bins[static_cast<int64_t>(std::floor(m_cast.range / m_settings.rangeBinWidth))];
+	if (bin.speedSums.empty()) {
+		bin.speedSums.assign(m_nodeCount, 0.0);
+	}
+	bin.rangeSum += m_cast.range;
+	++bin.castCount;
+	for (size_t node = 0; node < m_nodeCount; ++node) {
+		bin.speedSums[node] += m_castSpeeds[node];
+	}
+	++m_castCount;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfileSet SonarPropagation::Sonar::CastProfileBuilder::Finish()
+{
+	FinishCast();
+	if (m_bins.empty()) {
+		throw std::runtime_error("No cast with rows to build sound speed profiles from");
+	}
+
+	std::vector<double> ranges;
+	std::vector<double> speeds;
+	ranges.reserve(m_bins.size());
+	speeds.reserve(m_bins.size() * m_nodeCount);
+	for (const auto& entry : m_bins) {
+		const RangeBin& bin = entry.second;
+		ranges.push_back(bin.rangeSum / bin.castCount);
+		for (double sum : bin.speedSums) {
+			speeds.push_back(sum / bin.castCount);
+		}
+	}
+
+	m_bins.clear();
+	return SoundSpeedProfileSet(std::move(ranges), std::move(speeds), m_settings.depthSpacing);
+}
+
+//--------------------------------------------------------------------------------------
+
+SonarPropagation::Sonar::SoundSpeedProfileSet SonarPropagation::Sonar::IngestCasts(std::istream& stream, const std::string& source,
+	const CastIngestSettings& settings)
+{
+	CastReader reader(stream, source, settings.chunkSize, settings.defaultSalinity);
+	CastProfileBuilder builder(settings);
+
+	CastBlock block;
+	while (reader.Read(block)) {
+		builder.Add(block);
+	}
+	return builder.Finish();
+}
+
+SonarPropagation::Sonar::SoundSpeedProfileSet SonarPropagation::Sonar::LoadCasts(const std::string& filename, const CastIngestSettings& settings)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	return IngestCasts(file, filename, settings);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SoundSpeed.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		struct CastHeader {
+			std::string name;
+			// Along-track position of the cast in metres.
+			double range = 0.0;
+			// Salinity of rows without a salinity column (XBT casts), in ppt.
+			double salinity = 35.0;
+			// Running number of the cast in its file and the line of its header.
+			uint64_t index = 0;
+			uint64_t line = 0;
+		};
+
+		/// <summary>
+		/// Consecutive rows of one cast, as columns.
+		/// </summary>
+		struct CastBlock {
+			CastHeader header;
+			// Set on the first block of every cast.
+			bool startsCast = false;
+			std::vector<double> depths;
+			std::vector<double> temperatures;
+			std::vector<double> salinities;
+
+			size_t GetSize() const { return depths.size(); }
+			void Clear();
+		};
+
+		/// <summary>
+		/// Streaming reader of CTD and XBT cast files:
+		///
+		///   # comment
+		///   cast  station-12  range=4000 salinity=35.1
+		///   0.5   18.2  35.4            (depth m, temperature C, salinity ppt)
+		///   1.0   18.2                  (no salinity column: the one of the header, default 35)
+		///
+		/// Columns are separated by blanks or commas. The stream is read in chunks of a fixed size and
+		/// parsed in place, and rows are handed out in blocks of bounded size, so memory does not grow
+		/// with the size of the file nor with the length of a cast.
+		/// </summary>
+		class CastReader {
+		public:
+			static const size_t c_defaultChunkSize = 1 << 20;
+			static const size_t c_blockSize = 4096;
+
+			/// <summary>
+			/// source names the stream in error messages. Lines longer than chunkSize are an error.
+			/// </summary>
+			CastReader(std::istream& stream, std::string source, size_t chunkSize = c_defaultChunkSize, double defaultSalinity = 35.0);
+
+			/// <summary>
+			/// Fills block with the next rows of the current cast. Returns false at the end of the stream.
+			/// Throws std::runtime_error naming the line of malformed input.
+			/// </summary>
+			bool Read(CastBlock& block);
+
+			uint64_t GetBytesRead() const { return m_bytesRead; }
+			uint64_t GetCastCount() const { return m_castCount; }
+			uint64_t GetLineCount() const { return m_lineCount; }
+
+		private:
+			// Points line at the next line, terminated in place. Returns false at the end of the stream.
+			bool NextLine(char*& line);
+			void ParseHeader(char* line, CastHeader& header);
+			[[noreturn]] void Fail(const std::string& message) const;
+
+			std::istream& m_stream;
+			std::string m_source;
+			double m_defaultSalinity;
+
+			// One chunk plus a terminator; unread text is [m_begin, m_end).
+			std::vector<char> m_buffer;
+			size_t m_begin = 0;
+			size_t m_end = 0;
+			bool m_endOfStream = false;
+
+			CastHeader m_current;
+			bool m_inCast = false;
+			// A header met while a block was being filled; it starts the next block.
+			CastHeader m_next;
+			bool m_hasNext = false;
+
+			uint64_t m_bytesRead = 0;
+			uint64_t m_castCount = 0;
+			uint64_t m_lineCount = 0;
+		};
+
+		struct CastIngestSettings {
+			SoundSpeedFormula formula = SoundSpeedFormula::Mackenzie;
+			// Common depth grid of every profile.
+			double depthSpacing = 5.0;
+			double maxDepth = 5000.0;
+			// Casts less than this far apart are averaged into one profile.
+			double rangeBinWidth = 1000.0;
+			double defaultSalinity = 35.0;
+			size_t chunkSize = CastReader::c_defaultChunkSize;
+		};
+
+		/// <summary>
+		/// Turns cast blocks into a SoundSpeedProfileSet: rows are converted to sound speed in
+		/// batches, resampled onto the common depth grid as they arrive, and every cast is folded into
+		/// the running mean of its range bin. Only the bins are kept, so memory depends on the survey
+		/// extent and the depth grid, not on the number of casts.
+		/// </summary>
+		class CastProfileBuilder {
+		public:
+			explicit CastProfileBuilder(const CastIngestSettings& settings);
+
+			void Add(const CastBlock& block);
+
+			/// <summary>
+			/// Profiles of the bins, by increasing range. Throws std::runtime_error if no cast had rows.
+			/// </summary>
+			SoundSpeedProfileSet Finish();
+
+			uint64_t GetCastCount() const { return m_castCount; }
+			// Rows above the previous depth of their cast, such as the up leg of a CTD, are dropped.
+			uint64_t GetSkippedRows() const { return m_skippedRows; }
+
+		private:
+			struct RangeBin {
+				double rangeSum = 0.0;
+				uint32_t castCount = 0;
+				std::vector<double> speedSums;
+			};
+
+			void FinishCast();
+
+			CastIngestSettings m_settings;
+			size_t m_nodeCount;
+
+			// Cast being resampled: its grid so far, the next node to fill and the last row taken.
+			CastHeader m_cast;
+			bool m_inCast = false;
+			std::vector<double> m_castSpeeds;
+			size_t m_nextNode = 0;
+			bool m_hasPrevious = false;
+			double m_previousDepth = 0.0;
+			double m_previousSpeed = 0.0;
+
+			std::vector<double> m_blockSpeeds;
+			std::map<int64_t, RangeBin> m_bins;
+			uint64_t m_castCount = 0;
+			uint64_t m_skippedRows = 0;
+		};
+
+		/// <summary>
+		/// Reads every cast of a stream into a profile set.
+		/// </summary>
+		SoundSpeedProfileSet IngestCasts(std::istream& stream, const std::string& source, const CastIngestSettings& settings);
+
+		SoundSpeedProfileSet LoadCasts(const std::string& filename, const CastIngestSettings& settings);
+	}
+}
@@ -0,0 +1,393 @@
+#include "pch.h"
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	uint32_t CeilShift(uint32_t count, uint32_t level) {
+		return static_cast<uint32_t>((static_cast<uint64_t>(count) + (uint64_t(1) << level) - 1) >> level);
+	}
+
+	[[noreturn]] void FailAt(const std::string& source, uint64_t line, const std::string& message) {
+		std::ostringstream stream;
+		stream << source << " line " << line << ": " << message;
+		throw std::runtime_error(stream.str());
+	}
+
+	// Möller-Trumbore; only hits with t in [tMin, tMax] count.
+	bool IntersectTriangle(const Vector3& origin, const Vector3& direction, const Vector3& a, const Vector3& b, const Vector3& c,
+		double tMin, double tMax, double& t) {
+		const Vector3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+		const Vector3 e2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+		const Vector3 p = {
+			direction.y * e2.z - direction.z * e2.y,
+			direction.z * e2.x - direction.x * e2.z,
+			direction.x * e2.y - direction.y * e2.x
+		};
+		const double determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+		if (std::abs(determinant) < 1e-300) {
+			return false;
+		}
+
+		const double inverse = 1.0 / determinant;
+		const Vector3 s = { origin.x - a.x, origin.y - a.y, origin.z - a.z };
+		const double u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+		const double epsilon = 1e-12;
+		if (u < -epsilon || u > 1.0 + epsilon) {
+			return false;
+		}
+
+		const Vector3 q = { s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x };
+		const double v = (direction.x * q.x + direction.y * q.y + direction.z * q.z) * inverse;
+		if (v < -epsilon || u + v > 1.0 + epsilon) {
+			return false;
+		}
+
+		t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+		return t >= tMin && t <= tMax;
+	}
+
+	// Clips the ray to the slab [low, high] of one axis.
+	bool ClipSlab(double origin, double direction, double low, double high, double& tEnter, double& tExit) {
+		if (direction == 0.0) {
+			return origin >= low && origin <= high;
+		}
+		double t0 = (low - origin) / direction;
+		double t1 = (high - origin) / direction;
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		tEnter = std::max(tEnter, t0);
+		tExit = std::min(tExit, t1);
+		return tEnter <= tExit;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Heightfield implementation
+
+SonarPropagation::Sonar::Heightfield::Heightfield(uint32_t columns, uint32_t rows, double cellSize, std::vector<float> heights)
+	: m_columns(columns), m_rows(rows), m_cellSize(cellSize), m_heights(std::move(heights))
+{
+	if (columns < 2 || rows < 2) {
+		throw std::invalid_argument("Heightfield: the grid needs at least 2 x 2 heights");
+	}
+	if (!(cellSize > 0.0)) {
+		throw std::invalid_argument("Heightfield: the cell size must be positive");
+	}
+	if (m_heights.size() != static_cast<size_t>(columns) * rows) {
+		throw std::invalid_argument("Heightfield: the number of heights does not match the grid");
+	}
+
+	const auto range = std::minmax_element(m_heights.begin(), m_heights.end());
+	m_range = { *range.first, *range.second };
+	BuildPyramid();
+}
+
+SonarPropagation::Sonar::Heightfield SonarPropagation::Sonar::Heightfield::ReadEsriAscii(std::istream& stream, const std::string& source)
+{
+	long long columns = -1, rows = -1;
+	double cellSize = 0.0;
+	double noData = 0.0;
+	bool hasNoData = false;
+
+	std::string line;
+	uint64_t lineNumber = 0;
+	bool pending = false;
+	while (std::getline(stream, line)) {
+		++lineNumber;
+		std::istringstream fields(line);
+		std::string key;
+		if (!(fields >> key)) {
+			continue;
+		}
+		if (!std::isalpha(static_cast<unsigned char>(key[0]))) {
+			pending = true;
+			break;
+		}
+
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+		double value;
+		if (!(fields >> value)) {
+			FailAt(source, lineNumber, key + " is not followed by a number");
+		}
+		if (key == "ncols") {
+			columns = static_cast<long long>(value);
+		}
+		else if (key == "nrows") {
+			rows = static_cast<long long>(value);
+		}
+		else if (key == "cellsize") {
+			cellSize = value;
+		}
+		else if (key == "nodata_value") {
+			noData = value;
+			hasNoData = true;
+		}
+		else if (key != "xllcorner" && key != "yllcorner" && key != "xllcenter" && key != "yllcenter") {
+			FailAt(source, lineNumber, "unknown header key " + key);
+		}
+	}
+
+	if (columns < 2 || rows < 2 || columns > std::numeric_limits<uint32_t>::max() || rows > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error(source + ": ncols and nrows must be given and at least 2");
+	}
+	if (!(cellSize > 0.0)) {
+		throw std::runtime_error(source + ": cellsize must be given and positive");
+	}
+
+	// Values run west to east and north to south, wrapped over lines however the writer liked.
+	const size_t count = static_cast<size_t>(columns) * static_cast<size_t>(rows);
+	std::vector<float> heights(count);
+	size_t read = 0;
+	while (pending || std::getline(stream, line)) {
+		if (!pending) {
+			++lineNumber;
+		}
+		pending = false;
+
+		const char* text = line.c_str();
+		while (true) {
+			char* end;
+			errno = 0;
+			double value = std::strtod(text, &end);
+			if (end == text) {
+				while (std::isspace(static_cast<unsigned char>(*end))) {
+					++end;
+				}
+				if (*end) {
+					FailAt(source, lineNumber, "expected a number");
+				}
+				break;
+			}
+			if (errno == ERANGE || read == count) {
+				FailAt(source, lineNumber, read == count ? "more values than ncols x nrows" : "value out of range");
+			}
+
+			if (hasNoData && value == noData) {
+				value = 0.0;
+			}
+			const size_t fileRow = read / static_cast<size_t>(columns);
+			const size_t column = read % static_cast<size_t>(columns);
+			heights[(static_cast<size_t>(rows) - 1 - fileRow) * static_cast<size_t>(columns) + column] = static_cast<float>(value);
+			++read;
+			text = end;
+		}
+	}
+
+	if (read != count) {
+		std::ostringstream stream;
+		stream << source << ": " << read << " values for a grid of " << columns << " x " << rows;
+		throw std::runtime_error(stream.str());
+	}
+
+	return Heightfield(static_cast<uint32_t>(columns), static_cast<uint32_t>(rows), cellSize, std::move(heights));
+}
+
+SonarPropagation::Sonar::Heightfield SonarPropagation::Sonar::Heightfield::LoadEsriAscii(const std::string& filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	return ReadEsriAscii(file, filename);
+}
+
+double SonarPropagation::Sonar::Heightfield::HeightAt(double x, double z) const
+{
+	const double u = std::min(std::max(x / m_cellSize, 0.0), static_cast<double>(GetCellColumns()));
+	const double v = std::min(std::max(z / m_cellSize, 0.0), static_cast<double>(GetCellRows()));
+	const uint32_t column = std::min(static_cast<uint32_t>(u), GetCellColumns() - 1);
+	const uint32_t row = std::min(static_cast<uint32_t>(v), GetCellRows() - 1);
+	const double fu = u - column;
+	const double fv = v - row;
+
+	const double b = GetHeight(column + 1, row);
+	const double c = GetHeight(column, row + 1);
+	if (fu + fv <= 1.0) {
+		const double a = GetHeight(column, row);
+		return a + fu * (b - a) + fv * (c - a);
+	}
+	const double d = GetHeight(column + 1, row + 1);
+	return d + (1.0 - fu) * (c - d) + (1.0 - fv) * (b - d);
+}
+
+uint32_t SonarPropagation::Sonar::Heightfield::GetLevelColumns(uint32_t level) const
+{
+	return CeilShift(GetCellColumns(), level);
+}
+
+uint32_t SonarPropagation::Sonar::Heightfield::GetLevelRows(uint32_t level) const
+{
+	return CeilShift(GetCellRows(), level);
+}
+
+HeightRange SonarPropagation::Sonar::Heightfield::GetNodeRange(uint32_t level, uint32_t column, uint32_t row) const
+{
+	if (level > 0) {
+		const Level& pyramidLevel = m_levels[level - 1];
+		return m_pyramid[pyramidLevel.offset + static_cast<size_t>(row) * pyramidLevel.columns + column];
+	}
+
+	const float a = GetHeight(column, row), b = GetHeight(column + 1, row);
+	const float c = GetHeight(column, row + 1), d = GetHeight(column + 1, row + 1);
+	return { std::min(std::min(a, b), std::min(c, d)), std::max(std::max(a, b), std::max(c, d)) };
+}
+
+void SonarPropagation::Sonar::Heightfield::BuildPyramid()
+{
+	m_levels.clear();
+	m_pyramid.clear();
+
+	const uint32_t cells = std::max(GetCellColumns(), GetCellRows());
+	uint32_t levelCount = 0;
+	while ((uint64_t(1) << levelCount) < cells) {
+		++levelCount;
+	}
+
+	size_t offset = 0;
+	for (uint32_t level = 1; level <= levelCount; ++level) {
+		m_levels.push_back({ GetLevelColumns(level), GetLevelRows(level), offset });
+		offset += static_cast<size_t>(m_levels.back().columns) * m_levels.back().rows;
+	}
+	m_pyramid.resize(offset);
+
+	for (uint32_t level = 1; level <= levelCount; ++level) {
+		const Level& current = m_levels[level - 1];
+		const uint32_t childColumns = GetLevelColumns(level - 1);
+		const uint32_t childRows = GetLevelRows(level - 1);
+		for (uint32_t row = 0; row < current.rows; ++row) {
+			for (uint32_t column = 0; column < current.columns; ++column) {
+				HeightRange range = GetNodeRange(level - 1, 2 * column, 2 * row);
+				for (uint32_t child = 1; child < 4; ++child) {
+					const uint32_t childColumn = 2 * column + (child & 1);
+					const uint32_t childRow = 2 * row + (child >> 1);
+					if (childColumn < childColumns && childRow < childRows) {
+						const HeightRange childRange = GetNodeRange(level - 1, childColumn, childRow);
+						range.min = std::min(range.min, childRange.min);
+						range.max = std::max(range.max, childRange.max);
+					}
+				}
+				m_pyramid[current.offset + static_cast<size_t>(row) * current.columns + column] = range;
+			}
+		}
+	}
+}
+
+bool SonarPropagation::Sonar::Heightfield::IntersectCell(uint32_t column, uint32_t row, const Vector3& origin, const Vector3& direction,
+	double tMin, double tMax, HeightfieldHit& hit) const
+{
+	const double x0 = column * m_cellSize, x1 = (column + 1) * m_cellSize;
+	const double z0 = row * m_cellSize, z1 = (row + 1) * m_cellSize;
+	const Vector3 a = { x0, GetHeight(column, row), z0 };
+	const Vector3 b = { x1, GetHeight(column + 1, row), z0 };
+	const Vector3 c = { x0, GetHeight(column, row + 1), z1 };
+	const Vector3 d = { x1, GetHeight(column + 1, row + 1), z1 };
+
+	double t;
+	double nearest = tMax;
+	const Vector3* triangle = nullptr;
+	if (IntersectTriangle(origin, direction, a, b, c, tMin, nearest, t)) {
+		nearest = t;
+		triangle = &a;
+	}
+	if (IntersectTriangle(origin, direction, b, c, d, tMin, nearest, t)) {
+		nearest = t;
+		triangle = &d;
+	}
+	if (!triangle) {
+		return false;
+	}
+
+	// Both triangles have the corners b and c; the third decides the normal.
+	const Vector3 e1 = { c.x - b.x, c.y - b.y, c.z - b.z };
+	const Vector3 e2 = { triangle->x - b.x, triangle->y - b.y, triangle->z - b.z };
+	Vector3 normal = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+	const double length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	const double sign = normal.y < 0.0 ? -1.0 : 1.0;
+
+	hit.t = nearest;
+	hit.position = { origin.x + nearest * direction.x, origin.y + nearest * direction.y, origin.z + nearest * direction.z };
+	hit.normal = { sign * normal.x / length, sign * normal.y / length, sign * normal.z / length };
+	hit.column = column;
+	hit.row = row;
+	return true;
+}
+
+bool SonarPropagation::Sonar::Heightfield::Intersect(const Vector3& origin, const Vector3& direction, double tMin, double tMax,
+	HeightfieldHit& hit) const
+{
+	if (IsEmpty()) {
+		return false;
+	}
+
+	double t = tMin;
+	double tEnd = tMax;
+	if (!ClipSlab(origin.x, direction.x, 0.0, GetCellColumns() * m_cellSize, t, tEnd) ||
+		!ClipSlab(origin.z, direction.z, 0.0, GetCellRows() * m_cellSize, t, tEnd) ||
+		!ClipSlab(origin.y, direction.y, m_range.min, m_range.max, t, tEnd)) {
+		return false;
+	}
+
+	const uint32_t topLevel = GetLevelCount();
+	uint32_t level = topLevel;
+	while (t <= tEnd) {
+		const double nodeSize = std::ldexp(m_cellSize, static_cast<int>(level));
+
+		// The node the ray is in just after t, so that a ray on a node boundary moves on to the next one.
+		const double nudge = 1e-7 * nodeSize;
+		const double x = origin.x + t * direction.x + (direction.x > 0.0 ? nudge : direction.x < 0.0 ? -nudge : 0.0);
+		const double z = origin.z + t * direction.z + (direction.z > 0.0 ? nudge : direction.z < 0.0 ? -nudge : 0.0);
+		const uint32_t column = static_cast<uint32_t>(std::min(std::max(std::floor(x / nodeSize), 0.0), GetLevelColumns(level) - 1.0));
+		const uint32_t row = static_cast<uint32_t>(std::min(std::max(std::floor(z / nodeSize), 0.0), GetLevelRows(level) - 1.0));
+
+		double tExit = tEnd;
+		if (direction.x != 0.0) {
+			const double boundary = (direction.x > 0.0 ? column + 1 : column) * nodeSize;
+			tExit = std::min(tExit, (boundary - origin.x) / direction.x);
+		}
+		if (direction.z != 0.0) {
+			const double boundary = (direction.z > 0.0 ? row + 1 : row) * nodeSize;
+			tExit = std::min(tExit, (boundary - origin.z) / direction.z);
+		}
+		// Rounding can put the exit of a node at or before the entry; stepping by the nudge moves on.
+		if (direction.x != 0.0 || direction.z != 0.0) {
+			tExit = std::max(tExit, t + nudge / std::max(std::abs(direction.x), std::abs(direction.z)));
+		}
+
+		if (level == 0) {
+			if (IntersectCell(column, row, origin, direction, tMin, tMax, hit)) {
+				return true;
+			}
+		}
+		else {
+			const HeightRange range = GetNodeRange(level, column, row);
+			const double y0 = origin.y + t * direction.y;
+			const double y1 = origin.y + std::min(tExit, tEnd) * direction.y;
+			if (std::max(y0, y1) >= range.min && std::min(y0, y1) <= range.max) {
+				--level;
+				continue;
+			}
+		}
+
+		if (tExit >= tEnd) {
+			break;
+		}
+		t = tExit;
+		if (level < topLevel) {
+			++level;
+		}
+	}
+	return false;
+}
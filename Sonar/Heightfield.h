@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		struct HeightRange {
+			float min;
+			float max;
+		};
+
+		struct HeightfieldHit {
+			double t;
+			// Local space, like the ray passed to Heightfield::Intersect().
+			Vector3 position;
+			// Unit geometric normal of the triangle that was hit, pointing up.
+			Vector3 normal;
+			uint32_t column;
+			uint32_t row;
+		};
+
+		/// <summary>
+		/// Regular grid of heights, intersected directly instead of being turned into triangles.
+		/// Vertex (i, j) is at x = i * cellSize, z = j * cellSize, y = height; y is up, so seabed heights
+		/// are negative. Each cell is split along its (i + 1, j)-(i, j + 1) diagonal into the triangles
+		/// (i, j), (i + 1, j), (i, j + 1) and (i + 1, j), (i, j + 1), (i + 1, j + 1).
+		///
+		/// A min/max pyramid over the cells bounds every 2^k x 2^k block of cells for k = 1 up to the level
+		/// whose single node covers the grid. It costs about two thirds of the heights; level 0 is read
+		/// from the four corners of a cell.
+		/// </summary>
+		class Heightfield {
+		public:
+			Heightfield() = default;
+
+			/// <summary>
+			/// heights holds columns x rows values, row after row. Throws std::invalid_argument if the grid
+			/// is smaller than 2 x 2, the cell size is not positive or the heights do not match.
+			/// </summary>
+			Heightfield(uint32_t columns, uint32_t rows, double cellSize, std::vector<float> heights);
+
+			/// <summary>
+			/// Reads an ESRI ASCII grid (ncols, nrows, xllcorner, yllcorner, cellsize, optional
+			/// NODATA_value, then nrows lines of elevations from north to south). The first line becomes
+			/// the last row, so z grows northwards; the corner is not used, the grid is placed by its
+			/// transform. NODATA cells get height 0. Throws std::runtime_error naming the source.
+			/// </summary>
+			static Heightfield ReadEsriAscii(std::istream& stream, const std::string& source);
+
+			static Heightfield LoadEsriAscii(const std::string& filename);
+
+			bool IsEmpty() const { return m_heights.empty(); }
+			uint32_t GetColumns() const { return m_columns; }
+			uint32_t GetRows() const { return m_rows; }
+			uint32_t GetCellColumns() const { return m_columns - 1; }
+			uint32_t GetCellRows() const { return m_rows - 1; }
+			double GetCellSize() const { return m_cellSize; }
+			float GetHeight(uint32_t column, uint32_t row) const { return m_heights[static_cast<size_t>(row) * m_columns + column]; }
+			const std::vector<float>& GetHeights() const { return m_heights; }
+			HeightRange GetHeightRange() const { return m_range; }
+
+			/// <summary>
+			/// Bytes held by the heights and the pyramid.
+			/// </summary>
+			size_t GetMemorySize() const { return m_heights.size() * sizeof(float) + m_pyramid.size() * sizeof(HeightRange); }
+
+			/// <summary>
+			/// Height of the surface above (x, z), clamped to the edges of the grid.
+			/// </summary>
+			double HeightAt(double x, double z) const;
+
+			/// <summary>
+			/// Number of pyramid levels; level k has one node per 2^k x 2^k cells, and the node of the
+			/// last level covers the whole grid. Zero for a grid of a single cell.
+			/// </summary>
+			uint32_t GetLevelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+			uint32_t GetLevelColumns(uint32_t level) const;
+			uint32_t GetLevelRows(uint32_t level) const;
+
+			/// <summary>
+			/// Height range of a node; level 0 is a single cell.
+			/// </summary>
+			HeightRange GetNodeRange(uint32_t level, uint32_t column, uint32_t row) const;
+
+			/// <summary>
+			/// Every level from 1 up, node after node and row after row within a level, as the GPU reads it.
+			/// GetLevelOffset() is the index of the first node of a level.
+			/// </summary>
+			const std::vector<HeightRange>& GetPyramid() const { return m_pyramid; }
+			size_t GetLevelOffset(uint32_t level) const { return m_levels[level - 1].offset; }
+
+			/// <summary>
+			/// Nearest intersection with t in [tMin, tMax] of the ray origin + t * direction, in local
+			/// space. Descends the pyramid front to back: a node whose height range the ray segment over
+			/// it misses is stepped over whole, so rays over deep water or high above the seabed visit a
+			/// handful of nodes however large the grid is.
+			/// </summary>
+			bool Intersect(const Vector3& origin, const Vector3& direction, double tMin, double tMax, HeightfieldHit& hit) const;
+
+		private:
+			struct Level {
+				uint32_t columns;
+				uint32_t rows;
+				size_t offset;
+			};
+
+			void BuildPyramid();
+			bool IntersectCell(uint32_t column, uint32_t row, const Vector3& origin, const Vector3& direction,
+				double tMin, double tMax, HeightfieldHit& hit) const;
+
+			uint32_t m_columns = 0;
+			uint32_t m_rows = 0;
+			double m_cellSize = 1.0;
+			std::vector<float> m_heights;
+			HeightRange m_range = { 0.0f, 0.0f };
+
+			std::vector<Level> m_levels;
+			std::vector<HeightRange> m_pyramid;
+		};
+	}
+}
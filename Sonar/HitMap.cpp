@@ -0,0 +1,580 @@
+#include "pch.h"
+#include "HitMap.h"
+
+#include "../Common/Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	const char c_hitMapMagic[4] = { 'S', 'P', 'H', 'M' };
+	const uint32_t c_hitMapVersion = 2;
+
+	const uint32_t c_tileSize = HitMap::c_tileSize;
+	const uint32_t c_tileTexels = c_tileSize * c_tileSize;
+	const uint32_t c_noTile = 0xFFFFFFFF;
+
+	// Tile keys hold the surface in the high half and the row and column in 16 bits each.
+	const uint32_t c_maxResolution = c_tileSize << 16;
+
+	// Tiles ReadBinary() reads at a time, so a header that claims more than the stream holds fails
+	// before it allocates them all.
+	const size_t c_readTiles = 256;
+
+	uint64_t MakeTileKey(uint32_t surface, uint32_t x, uint32_t y) {
+		return (static_cast<uint64_t>(surface) << 32) | (static_cast<uint64_t>(y) << 16) | x;
+	}
+
+	size_t HashTileKey(uint64_t key) {
+		const uint64_t mixed = key * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(mixed ^ (mixed >> 29));
+	}
+
+	struct AccumulationTile {
+		int64_t energy[c_tileTexels];
+		uint32_t hits[c_tileTexels];
+	};
+
+	/// <summary>
+	/// Tiles of one thread in an open hash table keyed by MakeTileKey(), allocated when first touched.
+	/// </summary>
+	class TileTable {
+	public:
+		TileTable() : m_slotKeys(64), m_slotTiles(64, c_noTile), m_mask(63) {}
+
+		AccumulationTile& Get(uint64_t key) {
+			size_t slot = FindSlot(key);
+			if (m_slotTiles[slot] == c_noTile) {
+				// Kept at most half full.
+				if (2 * (m_keys.size() + 1) > m_slotKeys.size()) {
+					Grow();
+					slot = FindSlot(key);
+				}
+				m_slotKeys[slot] = key;
+				m_slotTiles[slot] = static_cast<uint32_t>(m_tiles.size());
+				m_keys.push_back(key);
+				m_tiles.emplace_back(new AccumulationTile());
+			}
+			return *m_tiles[m_slotTiles[slot]];
+		}
+
+		const AccumulationTile* Find(uint64_t key) const {
+			const uint32_t tile = m_slotTiles[FindSlot(key)];
+			return tile == c_noTile ? nullptr : m_tiles[tile].get();
+		}
+
+		// In the order they were allocated.
+		const std::vector<uint64_t>& GetKeys() const { return m_keys; }
+
+	private:
+		size_t FindSlot(uint64_t key) const {
+			size_t slot = HashTileKey(key) & m_mask;
+			while (m_slotTiles[slot] != c_noTile && m_slotKeys[slot] != key) {
+				slot = (slot + 1) & m_mask;
+			}
+			return slot;
+		}
+
+		void Grow() {
+			m_slotKeys.assign(2 * m_slotKeys.size(), 0);
+			m_slotTiles.assign(m_slotKeys.size(), c_noTile);
+			m_mask = m_slotKeys.size() - 1;
+			for (size_t tile = 0; tile < m_keys.size(); ++tile) {
+				const size_t slot = FindSlot(m_keys[tile]);
+				m_slotKeys[slot] = m_keys[tile];
+				m_slotTiles[slot] = static_cast<uint32_t>(tile);
+			}
+		}
+
+		std::vector<uint64_t> m_slotKeys;
+		std::vector<uint32_t> m_slotTiles;
+		size_t m_mask;
+		std::vector<uint64_t> m_keys;
+		std::vector<std::unique_ptr<AccumulationTile>> m_tiles;
+	};
+
+	// Runs work(thread) for every thread, the calling one being thread 0.
+	template <typename Work>
+	void RunThreads(uint32_t threadCount, Work work) {
+		std::vector<std::thread> workers;
+		for (uint32_t thread = 1; thread < threadCount; ++thread) {
+			workers.emplace_back(work, thread);
+		}
+		work(0);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	// Runs task(0) to task(count - 1) on up to threadCount threads, each taking the next task as it finishes one.
+	template <typename Task>
+	void RunTasks(size_t count, uint32_t threadCount, Task task) {
+		std::atomic<size_t> nextTask(0);
+		RunThreads(static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(threadCount, count))), [&](uint32_t) {
+			for (size_t index = nextTask++; index < count; index = nextTask++) {
+				task(index);
+			}
+		});
+	}
+
+	template <typename T>
+	void ReadValue(std::istream& stream, const std::string& source, T& value) {
+		if (!stream.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+			throw std::runtime_error(source + ": truncated hit map");
+		}
+	}
+
+	double GetAxisScale(const Matrix4x3& transform, int axis) {
+		return std::sqrt(transform.m[axis][0] * transform.m[axis][0] + transform.m[axis][1] * transform.m[axis][1] +
+			transform.m[axis][2] * transform.m[axis][2]);
+	}
+}
+
+std::vector<HitSurface> SonarPropagation::Sonar::GetHitSurfaces(const SceneModel& scene, const MeshLibrary& library)
+{
+	const std::vector<Matrix4x3> world = scene.ComputeWorldTransforms();
+	std::vector<HitSurface> surfaces;
+
+	for (const ReflectorModel& reflector : scene.m_objects) {
+		const MeshData& mesh = library.GetMesh(reflector.mesh);
+		const Matrix4x3& transform = world[reflector.transform];
+		surfaces.push_back({ transform.Inverse(), mesh.boundsMin.x, mesh.boundsMin.z, mesh.boundsMax.x, mesh.boundsMax.z,
+			GetAxisScale(transform, 0), GetAxisScale(transform, 2) });
+	}
+
+	for (const HeightfieldModel& model : scene.m_heightfields) {
+		const Heightfield& heightfield = library.GetHeightfield(model.heightfield);
+		const Matrix4x3& transform = world[model.transform];
+		surfaces.push_back({ transform.Inverse(), 0.0, 0.0,
+			heightfield.GetCellColumns() * heightfield.GetCellSize(), heightfield.GetCellRows() * heightfield.GetCellSize(),
+			GetAxisScale(transform, 0), GetAxisScale(transform, 2) });
+	}
+	return surfaces;
+}
+
+std::vector<SurfaceHit> SonarPropagation::Sonar::ProjectBottomHits(const std::vector<BottomHit>& hits, const LaunchFan& fan,
+	const std::vector<uint32_t>* tracedRays, const BottomTrack& track, const std::vector<HitSurface>& surfaces)
+{
+	SONAR_PROFILE_SCOPE("ProjectBottomHits");
+
+	const double directionX = std::cos(track.bearing);
+	const double directionZ = std::sin(track.bearing);
+	std::vector<SurfaceHit> projected;
+	projected.reserve(hits.size());
+
+	// Hits come ray by ray, so the weight only changes between rays.
+	uint32_t weightRay = 0;
+	double weight = GetRayWeight(fan, tracedRays, 0);
+	for (const BottomHit& hit : hits) {
+		if (track.surfaces.empty()) {
+			break;
+		}
+
+		const size_t sample = std::min(track.surfaces.size() - 1, static_cast<size_t>(std::max(0.0, std::round(hit.range / track.spacing))));
+		const uint32_t surface = track.surfaces[sample];
+		if (surface == c_noBottomSurface || surface >= surfaces.size()) {
+			continue;
+		}
+
+		const HitSurface& target = surfaces[surface];
+		const Vector3 local = target.worldToLocal.TransformPoint(
+			Vector3{ track.origin.x + hit.range * directionX, -hit.depth, track.origin.z + hit.range * directionZ });
+		const double width = target.maxX - target.minX;
+		const double height = target.maxZ - target.minZ;
+		const double u = width > 0.0 ? (local.x - target.minX) / width : 0.5;
+		const double v = height > 0.0 ? (local.z - target.minZ) / height : 0.5;
+
+		if (hit.ray != weightRay) {
+			weightRay = hit.ray;
+			weight = GetRayWeight(fan, tracedRays, hit.ray);
+		}
+
+		projected.push_back({ surface, static_cast<float>(std::max(0.0, std::min(1.0, u))), static_cast<float>(std::max(0.0, std::min(1.0, v))),
+			hit.time, hit.intensity * weight });
+	}
+	return projected;
+}
+
+HitMapLayout SonarPropagation::Sonar::GetHitMapLayout(const HitSurface& surface, const HitMapSettings& settings)
+{
+	if (settings.maxResolution == 0 || settings.maxResolution > c_maxResolution) {
+		throw std::invalid_argument("GetHitMapLayout: the largest resolution has to be from 1 to 2097152");
+	}
+
+	const double width = std::max(0.0, surface.GetWidth());
+	const double height = std::max(0.0, surface.GetHeight());
+	const double longer = std::max(width, height);
+
+	double texelSize;
+	if (settings.frequency > 0.0) {
+		if (!(settings.soundSpeed > 0.0) || !(settings.texelsPerWavelength > 0.0)) {
+			throw std::invalid_argument("GetHitMapLayout: the sound speed and texels per wavelength have to be positive");
+		}
+		texelSize = settings.soundSpeed / settings.frequency / settings.texelsPerWavelength;
+	}
+	else {
+		if (settings.resolution == 0) {
+			throw std::invalid_argument("GetHitMapLayout: the resolution has to be at least 1");
+		}
+		texelSize = longer / settings.resolution;
+	}
+	texelSize = std::max(texelSize, longer / settings.maxResolution);
+
+	// A surface without extent is one texel.
+	if (!(texelSize > 0.0) || !std::isfinite(texelSize)) {
+		return { 1, 1, std::isfinite(longer) && longer > 0.0 ? longer : 1.0 };
+	}
+
+	auto texels = [&](double extent) {
+		return static_cast<uint32_t>(std::max(1.0, std::min<double>(settings.maxResolution, std::ceil(extent / texelSize))));
+	};
+	return { texels(width), texels(height), texelSize };
+}
+
+//--------------------------------------------------------------------------------------
+// HitMap implementation
+
+SonarPropagation::Sonar::HitMap::HitMap(const HitMapLayout& layout, std::vector<Tile> tiles)
+	: m_layout(layout), m_tiles(std::move(tiles))
+{
+	const uint32_t columns = (layout.width + c_tileSize - 1) / c_tileSize;
+	const uint32_t rows = (layout.height + c_tileSize - 1) / c_tileSize;
+	for (size_t tile = 0; tile < m_tiles.size(); ++tile) {
+		const Tile& current = m_tiles[tile];
+		if (current.x >= columns || current.y >= rows) {
+			throw std::invalid_argument("HitMap: tile outside the map");
+		}
+		if (tile > 0 && (m_tiles[tile - 1].y > current.y || (m_tiles[tile - 1].y == current.y && m_tiles[tile - 1].x >= current.x))) {
+			throw std::invalid_argument("HitMap: tiles out of order");
+		}
+	}
+
+	if (m_tiles.empty()) {
+		return;
+	}
+
+	size_t bucketCount = 1;
+	while (bucketCount < 2 * m_tiles.size()) {
+		bucketCount *= 2;
+	}
+	m_indexMask = bucketCount - 1;
+	m_index.assign(bucketCount, c_noTile);
+	for (size_t tile = 0; tile < m_tiles.size(); ++tile) {
+		size_t slot = HashTileKey(MakeTileKey(0, m_tiles[tile].x, m_tiles[tile].y)) & m_indexMask;
+		while (m_index[slot] != c_noTile) {
+			slot = (slot + 1) & m_indexMask;
+		}
+		m_index[slot] = static_cast<uint32_t>(tile);
+	}
+}
+
+const HitMap::Tile* SonarPropagation::Sonar::HitMap::FindTile(uint32_t x, uint32_t y) const
+{
+	if (m_index.empty()) {
+		return nullptr;
+	}
+
+	for (size_t slot = HashTileKey(MakeTileKey(0, x, y)) & m_indexMask; m_index[slot] != c_noTile; slot = (slot + 1) & m_indexMask) {
+		const Tile& tile = m_tiles[m_index[slot]];
+		if (tile.x == x && tile.y == y) {
+			return &tile;
+		}
+	}
+	return nullptr;
+}
+
+float SonarPropagation::Sonar::HitMap::GetEnergy(uint32_t x, uint32_t y) const
+{
+	const Tile* tile = FindTile(x / c_tileSize, y / c_tileSize);
+	return tile ? tile->energy[(y % c_tileSize) * c_tileSize + x % c_tileSize] : 0.0f;
+}
+
+uint32_t SonarPropagation::Sonar::HitMap::GetHitCount(uint32_t x, uint32_t y) const
+{
+	const Tile* tile = FindTile(x / c_tileSize, y / c_tileSize);
+	return tile ? tile->hits[(y % c_tileSize) * c_tileSize + x % c_tileSize] : 0;
+}
+
+double SonarPropagation::Sonar::HitMap::GetTotalEnergy() const
+{
+	double total = 0.0;
+	for (const Tile& tile : m_tiles) {
+		for (float energy : tile.energy) {
+			total += energy;
+		}
+	}
+	return total;
+}
+
+uint64_t SonarPropagation::Sonar::HitMap::GetTotalHits() const
+{
+	uint64_t total = 0;
+	for (const Tile& tile : m_tiles) {
+		for (uint32_t hits : tile.hits) {
+			total += hits;
+		}
+	}
+	return total;
+}
+
+void SonarPropagation::Sonar::HitMap::WriteBinary(std::ostream& stream) const
+{
+	const uint64_t tileCount = m_tiles.size();
+	stream.write(c_hitMapMagic, sizeof(c_hitMapMagic));
+	stream.write(reinterpret_cast<const char*>(&c_hitMapVersion), sizeof(c_hitMapVersion));
+	stream.write(reinterpret_cast<const char*>(&m_layout.width), sizeof(m_layout.width));
+	stream.write(reinterpret_cast<const char*>(&m_layout.height), sizeof(m_layout.height));
+	stream.write(reinterpret_cast<const char*>(&m_layout.texelSize), sizeof(m_layout.texelSize));
+	stream.write(reinterpret_cast<const char*>(&tileCount), sizeof(tileCount));
+	stream.write(reinterpret_cast<const char*>(m_tiles.data()), m_tiles.size() * sizeof(Tile));
+}
+
+SonarPropagation::Sonar::HitMap SonarPropagation::Sonar::HitMap::ReadBinary(std::istream& stream, const std::string& source)
+{
+	char magic[sizeof(c_hitMapMagic)];
+	uint32_t version;
+	if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, c_hitMapMagic, sizeof(magic)) != 0) {
+		throw std::runtime_error(source + ": not a hit map");
+	}
+	ReadValue(stream, source, version);
+	if (version != c_hitMapVersion) {
+		throw std::runtime_error(source + ": unsupported hit map version " + std::to_string(version));
+	}
+
+	HitMapLayout layout;
+	uint64_t tileCount;
+	ReadValue(stream, source, layout.width);
+	ReadValue(stream, source, layout.height);
+	ReadValue(stream, source, layout.texelSize);
+	ReadValue(stream, source, tileCount);
+	if (layout.width > c_maxResolution || layout.height > c_maxResolution) {
+		throw std::runtime_error(source + ": hit map of " + std::to_string(layout.width) + " x " + std::to_string(layout.height) +
+			" texels, more than GetHitMapLayout() makes");
+	}
+	const uint64_t maxTiles = static_cast<uint64_t>((layout.width + c_tileSize - 1) / c_tileSize) * ((layout.height + c_tileSize - 1) / c_tileSize);
+	if (tileCount > maxTiles) {
+		throw std::runtime_error(source + ": more tiles than the hit map holds");
+	}
+
+	std::vector<Tile> tiles;
+	while (tiles.size() < tileCount) {
+		const size_t first = tiles.size();
+		tiles.resize(first + static_cast<size_t>(std::min<uint64_t>(c_readTiles, tileCount - first)));
+		if (!stream.read(reinterpret_cast<char*>(&tiles[first]), (tiles.size() - first) * sizeof(Tile))) {
+			throw std::runtime_error(source + ": truncated hit map");
+		}
+	}
+
+	try {
+		return HitMap(layout, std::move(tiles));
+	}
+	catch (const std::invalid_argument& error) {
+		throw std::runtime_error(source + ": " + error.what());
+	}
+}
+
+void SonarPropagation::Sonar::HitMap::WriteImage(std::ostream& stream, double dynamicRangeDb, uint32_t maxSide, uint32_t threadCount) const
+{
+	SONAR_PROFILE_SCOPE("HitMap::WriteImage");
+
+	if (m_tiles.empty()) {
+		stream << "P5\n1 1\n255\n";
+		stream.put(0);
+		return;
+	}
+
+	// Texels of the tiles that were hit; rows are sorted, columns are not.
+	uint32_t firstColumn = m_tiles.front().x;
+	uint32_t lastColumn = firstColumn;
+	for (const Tile& tile : m_tiles) {
+		firstColumn = std::min(firstColumn, tile.x);
+		lastColumn = std::max(lastColumn, tile.x);
+	}
+	const uint32_t x0 = firstColumn * c_tileSize;
+	const uint32_t x1 = std::min(m_layout.width, (lastColumn + 1) * c_tileSize);
+	const uint32_t y0 = m_tiles.front().y * c_tileSize;
+	const uint32_t y1 = std::min(m_layout.height, (m_tiles.back().y + 1) * c_tileSize);
+
+	const uint32_t factor = std::max(1u, (std::max(x1 - x0, y1 - y0) + std::max(1u, maxSide) - 1) / std::max(1u, maxSide));
+	const uint32_t width = (x1 - x0 + factor - 1) / factor;
+	const uint32_t height = (y1 - y0 + factor - 1) / factor;
+
+	// Pixel rows, counted from the lowest z, sum their texels; each task fills one from the tiles of
+	// its rows, which are contiguous.
+	std::vector<double> pixels(static_cast<size_t>(width) * height, 0.0);
+	RunTasks(height, threadCount, [&](size_t row) {
+		double* pixel = &pixels[row * width];
+		const uint32_t firstY = y0 + static_cast<uint32_t>(row) * factor;
+		const uint32_t endY = std::min(y1, firstY + factor);
+
+		auto tile = std::lower_bound(m_tiles.begin(), m_tiles.end(), firstY / c_tileSize, [](const Tile& t, uint32_t y) { return t.y < y; });
+		for (; tile != m_tiles.end() && tile->y * c_tileSize < endY; ++tile) {
+			for (uint32_t y = std::max(firstY, tile->y * c_tileSize); y < std::min(endY, (tile->y + 1) * c_tileSize); ++y) {
+				const float* energy = &tile->energy[(y % c_tileSize) * c_tileSize];
+				for (uint32_t x = 0; x < c_tileSize && tile->x * c_tileSize + x < x1; ++x) {
+					pixel[(tile->x * c_tileSize + x - x0) / factor] += energy[x];
+				}
+			}
+		}
+	});
+
+	const double peak = *std::max_element(pixels.begin(), pixels.end());
+	const double range = std::max(dynamicRangeDb, 1e-3);
+	std::vector<uint8_t> image(pixels.size());
+	RunTasks(height, threadCount, [&](size_t row) {
+		// The top row is the highest z.
+		uint8_t* out = &image[(height - 1 - row) * width];
+		for (uint32_t x = 0; x < width; ++x) {
+			const double energy = pixels[row * width + x];
+			const double level = energy > 0.0 && peak > 0.0 ? 1.0 + 10.0 * std::log10(energy / peak) / range : 0.0;
+			out[x] = static_cast<uint8_t>(std::lround(255.0 * std::max(0.0, std::min(1.0, level))));
+		}
+	});
+
+	stream << "P5\n# texels " << x0 << ' ' << y0 << " to " << x1 << ' ' << y1 << ", " << factor << " per pixel, "
+		<< m_layout.texelSize << " m each\n" << width << ' ' << height << "\n255\n";
+	stream.write(reinterpret_cast<const char*>(image.data()), image.size());
+}
+
+//--------------------------------------------------------------------------------------
+
+std::vector<HitMap> SonarPropagation::Sonar::AccumulateHitMaps(const std::vector<SurfaceHit>& hits, const std::vector<HitSurface>& surfaces,
+	const HitMapSettings& settings)
+{
+	SONAR_PROFILE_SCOPE("AccumulateHitMaps");
+
+	std::vector<HitMapLayout> layouts;
+	// Texels per unit of u and v.
+	std::vector<double> scaleU;
+	std::vector<double> scaleV;
+	for (const HitSurface& surface : surfaces) {
+		layouts.push_back(GetHitMapLayout(surface, settings));
+		scaleU.push_back(std::max(0.0, surface.GetWidth()) / layouts.back().texelSize);
+		scaleV.push_back(std::max(0.0, surface.GetHeight()) / layouts.back().texelSize);
+	}
+
+	const size_t surfaceCount = surfaces.size();
+	const uint32_t threadCount = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(settings.threadCount, hits.size())));
+	const size_t blockSize = (hits.size() + threadCount - 1) / threadCount;
+
+	auto isTaken = [&settings, surfaceCount](const SurfaceHit& hit) {
+		return hit.surface < surfaceCount && hit.time >= settings.startTime && hit.time < settings.endTime && hit.energy >= 0.0;
+	};
+
+	// The largest energy and the count of the hits taken pick the fixed point scale; both are the
+	// same however the hits are split.
+	std::vector<double> threadPeaks(threadCount, 0.0);
+	std::vector<size_t> threadCounts(threadCount, 0);
+	RunThreads(threadCount, [&](uint32_t thread) {
+		const size_t first = std::min(hits.size(), thread * blockSize);
+		const size_t end = std::min(hits.size(), first + blockSize);
+		for (size_t i = first; i < end; ++i) {
+			if (isTaken(hits[i])) {
+				threadPeaks[thread] = std::max(threadPeaks[thread], hits[i].energy);
+				++threadCounts[thread];
+			}
+		}
+	});
+
+	double peak = 0.0;
+	size_t count = 0;
+	for (uint32_t thread = 0; thread < threadCount; ++thread) {
+		peak = std::max(peak, threadPeaks[thread]);
+		count += threadCounts[thread];
+	}
+
+	std::vector<HitMap> maps;
+	if (!(peak > 0.0) || !std::isfinite(peak)) {
+		for (const HitMapLayout& layout : layouts) {
+			maps.emplace_back(layout, std::vector<HitMap::Tile>());
+		}
+		return maps;
+	}
+
+	// Every hit together stays below 2^62.
+	const double quantum = peak * count / 4.6116860184273879e18;
+	const double inverseQuantum = 1.0 / quantum;
+
+	std::vector<TileTable> tables(threadCount);
+	RunThreads(threadCount, [&](uint32_t thread) {
+		TileTable& table = tables[thread];
+		// Consecutive hits of a ray tend to fall on the same tile.
+		uint64_t lastKey = ~0ull;
+		AccumulationTile* lastTile = nullptr;
+
+		const size_t first = std::min(hits.size(), thread * blockSize);
+		const size_t end = std::min(hits.size(), first + blockSize);
+		for (size_t i = first; i < end; ++i) {
+			const SurfaceHit& hit = hits[i];
+			if (!isTaken(hit)) {
+				continue;
+			}
+
+			const HitMapLayout& layout = layouts[hit.surface];
+			const uint32_t x = std::min(layout.width - 1, static_cast<uint32_t>(std::max(0.0, hit.u * scaleU[hit.surface])));
+			const uint32_t y = std::min(layout.height - 1, static_cast<uint32_t>(std::max(0.0, hit.v * scaleV[hit.surface])));
+			const uint64_t key = MakeTileKey(hit.surface, x / c_tileSize, y / c_tileSize);
+			if (key != lastKey) {
+				lastKey = key;
+				lastTile = &table.Get(key);
+			}
+
+			const size_t texel = (y % c_tileSize) * c_tileSize + x % c_tileSize;
+			lastTile->energy[texel] += std::llround(hit.energy * inverseQuantum);
+			++lastTile->hits[texel];
+		}
+	});
+
+	// Sorted keys run surface by surface, each row by row, which is the order maps keep their tiles in.
+	std::vector<uint64_t> keys;
+	for (const TileTable& table : tables) {
+		keys.insert(keys.end(), table.GetKeys().begin(), table.GetKeys().end());
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	std::vector<size_t> firstKey(surfaceCount + 1, 0);
+	for (uint64_t key : keys) {
+		++firstKey[(key >> 32) + 1];
+	}
+	std::vector<std::vector<HitMap::Tile>> surfaceTiles(surfaceCount);
+	for (size_t surface = 0; surface < surfaceCount; ++surface) {
+		surfaceTiles[surface].resize(firstKey[surface + 1]);
+		firstKey[surface + 1] += firstKey[surface];
+	}
+
+	// Tiles cover disjoint texels, so they merge without locks.
+	RunTasks(keys.size(), settings.threadCount, [&](size_t index) {
+		const uint64_t key = keys[index];
+		const size_t surface = static_cast<size_t>(key >> 32);
+		HitMap::Tile& tile = surfaceTiles[surface][index - firstKey[surface]];
+		tile.x = static_cast<uint32_t>(key & 0xFFFF);
+		tile.y = static_cast<uint32_t>((key >> 16) & 0xFFFF);
+
+		int64_t energy[c_tileTexels] = {};
+		for (const TileTable& table : tables) {
+			if (const AccumulationTile* part = table.Find(key)) {
+				for (uint32_t texel = 0; texel < c_tileTexels; ++texel) {
+					energy[texel] += part->energy[texel];
+					tile.hits[texel] += part->hits[texel];
+				}
+			}
+		}
+		for (uint32_t texel = 0; texel < c_tileTexels; ++texel) {
+			tile.energy[texel] = static_cast<float>(energy[texel] * quantum);
+		}
+	});
+
+	for (size_t surface = 0; surface < surfaceCount; ++surface) {
+		maps.emplace_back(layouts[surface], std::move(surfaceTiles[surface]));
+	}
+	return maps;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "PropagationEngine.h"
+#include "SceneModel.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// A surface hit maps are laid over: a reflector or a heightfield of the scene, numbered as by
+		/// ExtractBottomProfile(). Maps span the horizontal extent of the surface in its own frame, x
+		/// across and z up the map, like a texture projected from above.
+		/// </summary>
+		struct HitSurface {
+			Matrix4x3 worldToLocal;
+			double minX;
+			double minZ;
+			double maxX;
+			double maxZ;
+			// World metres per local unit along x and z.
+			double scaleX;
+			double scaleZ;
+
+			double GetWidth() const { return (maxX - minX) * scaleX; }
+			double GetHeight() const { return (maxZ - minZ) * scaleZ; }
+		};
+
+		/// <summary>
+		/// Every reflector of the scene, then every heightfield. Throws std::invalid_argument if a
+		/// transform is singular.
+		/// </summary>
+		std::vector<HitSurface> GetHitSurfaces(const SceneModel& scene, const MeshLibrary& library);
+
+		/// <summary>
+		/// The track a bottom profile was extracted along, with the surface of every point of it.
+		/// </summary>
+		struct BottomTrack {
+			Vector3 origin = { 0.0, 0.0, 0.0 };
+			double bearing = 0.0;
+			double spacing = 1.0;
+			std::vector<uint32_t> surfaces;
+		};
+
+		/// <summary>
+		/// A bottom hit on a surface, at map coordinates u and v from 0 to 1. Energy is the intensity
+		/// factor of the ray times the share of the launch angles it stands for.
+		/// </summary>
+		struct SurfaceHit {
+			uint32_t surface;
+			float u;
+			float v;
+			double time;
+			double energy;
+		};
+
+		/// <summary>
+		/// Places the bottom hits of a propagation over the track on the surfaces the bottom was taken
+		/// from. Hits where the track has no surface are left out. Rays are numbered on fan, and
+		/// tracedRays are those of an adaptive fan, as in PropagationResult.
+		/// </summary>
+		std::vector<SurfaceHit> ProjectBottomHits(const std::vector<BottomHit>& hits, const LaunchFan& fan,
+			const std::vector<uint32_t>* tracedRays, const BottomTrack& track, const std::vector<HitSurface>& surfaces);
+
+		struct HitMapSettings {
+			// With a frequency in Hz, texels are a wavelength at soundSpeed divided by texelsPerWavelength.
+			double frequency = 0.0;
+			double soundSpeed = 1500.0;
+			double texelsPerWavelength = 2.0;
+			// Without a frequency, texels along the longer side of every map.
+			uint32_t resolution = 1024;
+			// Texels along a side are capped; larger surfaces get larger texels.
+			uint32_t maxResolution = 1 << 20;
+			// Hits arriving before startTime or from endTime on, in seconds, are left out.
+			double startTime = 0.0;
+			double endTime = std::numeric_limits<double>::infinity();
+			uint32_t threadCount = 1;
+		};
+
+		struct HitMapLayout {
+			uint32_t width;
+			uint32_t height;
+			// In metres.
+			double texelSize;
+		};
+
+		/// <summary>
+		/// Texels of the map of a surface, from its extent and the settings. Throws
+		/// std::invalid_argument if the settings give no texel size.
+		/// </summary>
+		HitMapLayout GetHitMapLayout(const HitSurface& surface, const HitMapSettings& settings);
+
+		/// <summary>
+		/// Energy and hit count per texel of one surface, kept as the 32 x 32 tiles of texels that
+		/// were hit, so memory follows the insonified area rather than the size of the surface.
+		/// Tiles are stored row after row, with an open hash table from their position to them.
+		/// Row 0 is the lowest z.
+		/// </summary>
+		class HitMap {
+		public:
+			static const uint32_t c_tileSize = 32;
+
+			struct Tile {
+				// Position in tiles.
+				uint32_t x;
+				uint32_t y;
+				float energy[c_tileSize * c_tileSize];
+				uint32_t hits[c_tileSize * c_tileSize];
+			};
+
+			HitMap() = default;
+
+			/// <summary>
+			/// Tiles must be ordered by row, then column, without repeats, and lie within the map.
+			/// Throws std::invalid_argument if they do not.
+			/// </summary>
+			HitMap(const HitMapLayout& layout, std::vector<Tile> tiles);
+
+			uint32_t GetWidth() const { return m_layout.width; }
+			uint32_t GetHeight() const { return m_layout.height; }
+			double GetTexelSize() const { return m_layout.texelSize; }
+			const HitMapLayout& GetLayout() const { return m_layout; }
+
+			float GetEnergy(uint32_t x, uint32_t y) const;
+			uint32_t GetHitCount(uint32_t x, uint32_t y) const;
+
+			/// <summary>
+			/// The tile at column x and row y of tiles, or null if nothing hit it.
+			/// </summary>
+			const Tile* FindTile(uint32_t x, uint32_t y) const;
+			const std::vector<Tile>& GetTiles() const { return m_tiles; }
+
+			double GetTotalEnergy() const;
+			uint64_t GetTotalHits() const;
+			size_t GetBytes() const { return m_tiles.capacity() * sizeof(Tile) + m_index.capacity() * sizeof(uint32_t); }
+
+			/// <summary>
+			/// The layout and the tile count, then the tiles as they are in memory, in host byte order,
+			/// behind a magic number and version.
+			/// </summary>
+			void WriteBinary(std::ostream& stream) const;
+
+			/// <summary>
+			/// Reads what WriteBinary() wrote. Throws std::runtime_error naming the source if it cannot,
+			/// or if the header gives a map larger than GetHitMapLayout() makes.
+			/// </summary>
+			static HitMap ReadBinary(std::istream& stream, const std::string& source);
+
+			/// <summary>
+			/// Binary 8-bit PGM of the energy in dB over the tiles that were hit, from black dynamicRangeDb
+			/// below the brightest pixel to white; pixels without hits are black. The top row is the
+			/// highest z. Maps wider or higher than maxSide texels are shrunk by a whole factor, each
+			/// pixel summing the energy of its texels; a comment gives the texels the image covers. Rows
+			/// are filled on threadCount threads.
+			/// </summary>
+			void WriteImage(std::ostream& stream, double dynamicRangeDb = 60.0, uint32_t maxSide = 4096, uint32_t threadCount = 1) const;
+
+		private:
+			HitMapLayout m_layout = { 0, 0, 0.0 };
+			std::vector<Tile> m_tiles;
+			// Tile indices by hashed position; empty slots hold ~0.
+			std::vector<uint32_t> m_index;
+			size_t m_indexMask = 0;
+		};
+
+		/// <summary>
+		/// Sums the hits into one map per surface, laid out by GetHitMapLayout(). The hits are split
+		/// into one contiguous block per thread, and every thread adds its block into tiles of its own,
+		/// in a hash table that allocates them as they are first touched, so threads never share a
+		/// texel. The tiles touched are then merged and compacted into the maps in parallel, one task
+		/// per tile. Energies are summed in 64-bit fixed point, scaled so that every hit could land on
+		/// one texel, which makes the sums exact whatever the thread count and order.
+		/// </summary>
+		std::vector<HitMap> AccumulateHitMaps(const std::vector<SurfaceHit>& hits, const std::vector<HitSurface>& surfaces,
+			const HitMapSettings& settings);
+	}
+}
@@ -0,0 +1,660 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	// Wavelengths are taken at a nominal sound speed; the LOD choice does not need the profile.
+	const double c_nominalSoundSpeed = 1500.0;
+
+	// A collapse may turn a triangle by up to about 78 degrees.
+	const double c_minNormalCosine = 0.2;
+
+	Vector3 Subtract(const Vector3& a, const Vector3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	double Dot(const Vector3& a, const Vector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	Vector3 Cross(const Vector3& a, const Vector3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+	/// <summary>
+	/// Sum of squared distances to planes, as the symmetric 4x4 matrix of Garland and Heckbert.
+	/// </summary>
+	struct Quadric {
+		// xx xy xz xw yy yz yw zz zw ww
+		double m[10] = {};
+
+		void AddPlane(const Vector3& normal, double d) {
+			const double p[4] = { normal.x, normal.y, normal.z, d };
+			int k = 0;
+			for (int row = 0; row < 4; ++row) {
+				for (int column = row; column < 4; ++column) {
+					m[k++] += p[row] * p[column];
+				}
+			}
+		}
+
+		Quadric& operator+=(const Quadric& other) {
+			for (int k = 0; k < 10; ++k) {
+				m[k] += other.m[k];
+			}
+			return *this;
+		}
+
+		double Evaluate(const Vector3& p) const {
+			return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+				+ m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+				+ m[7] * p.z * p.z + 2.0 * m[8] * p.z + m[9];
+		}
+
+		// Point of least error; false if the planes leave it undetermined, as for a flat patch.
+		bool Minimize(Vector3& p) const {
+			const double a = m[0], b = m[1], c = m[2], d = m[4], e = m[5], f = m[7];
+			const double c00 = d * f - e * e;
+			const double c01 = c * e - b * f;
+			const double c02 = b * e - c * d;
+			const double determinant = a * c00 + b * c01 + c * c02;
+
+			const double scale = std::max(std::abs(a), std::max(std::abs(d), std::abs(f)));
+			if (!(std::abs(determinant) > 1e-10 * scale * scale * scale)) {
+				return false;
+			}
+
+			const double c11 = a * f - c * c;
+			const double c12 = b * c - a * e;
+			const double c22 = a * d - b * b;
+			const double inverse = 1.0 / determinant;
+			const double rx = -m[3], ry = -m[6], rz = -m[8];
+			p = {
+				(c00 * rx + c01 * ry + c02 * rz) * inverse,
+				(c01 * rx + c11 * ry + c12 * rz) * inverse,
+				(c02 * rx + c12 * ry + c22 * rz) * inverse
+			};
+			return true;
+		}
+	};
+
+	struct WeldKeyHash {
+		size_t operator()(const Float3& p) const {
+			uint32_t bits[3];
+			std::memcpy(bits, &p, sizeof(bits));
+			uint64_t hash = 0xCBF29CE484222325ull;
+			for (uint32_t word : bits) {
+				hash = (hash ^ word) * 0x100000001B3ull;
+			}
+			return static_cast<size_t>(hash ^ (hash >> 32));
+		}
+	};
+
+	struct WeldKeyEqual {
+		bool operator()(const Float3& a, const Float3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+	};
+
+	struct WeldedMesh {
+		std::vector<Vector3> positions;
+		std::vector<uint32_t> indices;
+		std::vector<bool> locked;
+	};
+
+	// Merges coincident vertices and drops the triangles that become degenerate.
+	WeldedMesh Weld(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices, const std::vector<bool>* locked) {
+		WeldedMesh welded;
+		std::unordered_map<Float3, uint32_t, WeldKeyHash, WeldKeyEqual> unique;
+		std::vector<uint32_t> remap(positions.size());
+
+		for (size_t v = 0; v < positions.size(); ++v) {
+			// -0 and 0 are one position.
+			const Float3 key = { positions[v].x + 0.0f, positions[v].y + 0.0f, positions[v].z + 0.0f };
+			auto inserted = unique.insert({ key, static_cast<uint32_t>(welded.positions.size()) });
+			if (inserted.second) {
+				welded.positions.push_back({ key.x, key.y, key.z });
+				welded.locked.push_back(false);
+			}
+			remap[v] = inserted.first->second;
+			if (locked && (*locked)[v]) {
+				welded.locked[remap[v]] = true;
+			}
+		}
+
+		welded.indices.reserve(indices.size());
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			const uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a != b && b != c && a != c) {
+				welded.indices.insert(welded.indices.end(), { a, b, c });
+			}
+		}
+		return welded;
+	}
+
+	class EdgeCollapser {
+	public:
+		explicit EdgeCollapser(WeldedMesh mesh);
+
+		void Run(size_t targetTriangles);
+
+		// Compacted result; origins[i] is the input vertex output vertex i stands for.
+		MeshLevel Extract(std::vector<uint32_t>& origins) const;
+
+	private:
+		struct Candidate {
+			double cost;
+			uint32_t keep;
+			uint32_t remove;
+			uint32_t keepStamp;
+			uint32_t removeStamp;
+			Vector3 target;
+		};
+
+		struct CandidateOrder {
+			bool operator()(const Candidate& a, const Candidate& b) const {
+				if (a.cost != b.cost) {
+					return a.cost > b.cost;
+				}
+				return a.keep != b.keep ? a.keep > b.keep : a.remove > b.remove;
+			}
+		};
+
+		void PushEdge(uint32_t a, uint32_t b);
+		bool Collapse(const Candidate& candidate);
+		bool HasVertex(uint32_t triangle, uint32_t vertex) const;
+		Vector3 GetNormal(uint32_t triangle, uint32_t moved, const Vector3& to) const;
+
+		std::vector<Vector3> m_positions;
+		std::vector<uint32_t> m_indices;
+		std::vector<bool> m_locked;
+		std::vector<Quadric> m_quadrics;
+		std::vector<std::vector<uint32_t>> m_vertexTriangles;
+		std::vector<uint32_t> m_stamps;
+		std::vector<bool> m_removedVertices;
+		std::vector<bool> m_removedTriangles;
+		size_t m_triangleCount = 0;
+		double m_maxCost = 0.0;
+
+		std::priority_queue<Candidate, std::vector<Candidate>, CandidateOrder> m_queue;
+	};
+
+	EdgeCollapser::EdgeCollapser(WeldedMesh mesh)
+		: m_positions(std::move(mesh.positions)), m_indices(std::move(mesh.indices)), m_locked(std::move(mesh.locked))
+	{
+		const size_t vertexCount = m_positions.size();
+		m_triangleCount = m_indices.size() / 3;
+		m_quadrics.resize(vertexCount);
+		m_vertexTriangles.resize(vertexCount);
+		m_stamps.assign(vertexCount, 0);
+		m_removedVertices.assign(vertexCount, false);
+		m_removedTriangles.assign(m_triangleCount, false);
+
+		// Number of triangles on every edge; edges with one are open borders.
+		std::unordered_map<uint64_t, uint32_t> edges;
+		auto edgeKey = [](uint32_t a, uint32_t b) { return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a; };
+
+		for (uint32_t triangle = 0; triangle < m_triangleCount; ++triangle) {
+			const uint32_t* corners = &m_indices[3 * triangle];
+			for (int k = 0; k < 3; ++k) {
+				m_vertexTriangles[corners[k]].push_back(triangle);
+				++edges[edgeKey(corners[k], corners[(k + 1) % 3])];
+			}
+
+			Vector3 normal = GetNormal(triangle, corners[0], m_positions[corners[0]]);
+			const double length = std::sqrt(Dot(normal, normal));
+			if (length == 0.0) {
+				continue;
+			}
+			normal = { normal.x / length, normal.y / length, normal.z / length };
+			const double d = -Dot(normal, m_positions[corners[0]]);
+			for (int k = 0; k < 3; ++k) {
+				m_quadrics[corners[k]].AddPlane(normal, d);
+			}
+		}
+
+		// A plane through every border edge, upright on its triangle, keeps borders from shrinking.
+		for (uint32_t triangle = 0; triangle < m_triangleCount; ++triangle) {
+			const uint32_t* corners = &m_indices[3 * triangle];
+			const Vector3 normal = GetNormal(triangle, corners[0], m_positions[corners[0]]);
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t a = corners[k], b = corners[(k + 1) % 3];
+				if (edges[edgeKey(a, b)] != 1) {
+					continue;
+				}
+
+				Vector3 side = Cross(Subtract(m_positions[b], m_positions[a]), normal);
+				const double length = std::sqrt(Dot(side, side));
+				if (length == 0.0) {
+					continue;
+				}
+				side = { side.x / length, side.y / length, side.z / length };
+				const double d = -Dot(side, m_positions[a]);
+				m_quadrics[a].AddPlane(side, d);
+				m_quadrics[b].AddPlane(side, d);
+			}
+		}
+
+		for (const auto& edge : edges) {
+			PushEdge(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first & 0xFFFFFFFFu));
+		}
+	}
+
+	bool EdgeCollapser::HasVertex(uint32_t triangle, uint32_t vertex) const {
+		const uint32_t* corners = &m_indices[3 * triangle];
+		return corners[0] == vertex || corners[1] == vertex || corners[2] == vertex;
+	}
+
+	Vector3 EdgeCollapser::GetNormal(uint32_t triangle, uint32_t moved, const Vector3& to) const {
+		const uint32_t* corners = &m_indices[3 * triangle];
+		const Vector3& a = corners[0] == moved ? to : m_positions[corners[0]];
+		const Vector3& b = corners[1] == moved ? to : m_positions[corners[1]];
+		const Vector3& c = corners[2] == moved ? to : m_positions[corners[2]];
+		return Cross(Subtract(b, a), Subtract(c, a));
+	}
+
+	void EdgeCollapser::PushEdge(uint32_t a, uint32_t b) {
+		if (m_locked[a] && m_locked[b]) {
+			return;
+		}
+
+		Quadric quadric = m_quadrics[a];
+		quadric += m_quadrics[b];
+
+		Candidate candidate;
+		if (m_locked[a] || m_locked[b]) {
+			candidate.keep = m_locked[a] ? a : b;
+			candidate.remove = m_locked[a] ? b : a;
+			candidate.target = m_positions[candidate.keep];
+			candidate.cost = quadric.Evaluate(candidate.target);
+		}
+		else {
+			candidate.keep = a;
+			candidate.remove = b;
+
+			const Vector3& pa = m_positions[a];
+			const Vector3& pb = m_positions[b];
+			const Vector3 middle = { 0.5 * (pa.x + pb.x), 0.5 * (pa.y + pb.y), 0.5 * (pa.z + pb.z) };
+			Vector3 options[4] = { pa, pb, middle, middle };
+			int optionCount = 3;
+
+			// The optimum of a nearly flat patch can lie far off; only a point near the edge is used.
+			Vector3 optimum;
+			const Vector3 edge = Subtract(pb, pa);
+			if (quadric.Minimize(optimum)) {
+				const Vector3 offset = Subtract(optimum, middle);
+				if (Dot(offset, offset) <= Dot(edge, edge)) {
+					options[optionCount++] = optimum;
+				}
+			}
+
+			candidate.cost = std::numeric_limits<double>::infinity();
+			for (int option = 0; option < optionCount; ++option) {
+				const double cost = quadric.Evaluate(options[option]);
+				if (cost < candidate.cost) {
+					candidate.cost = cost;
+					candidate.target = options[option];
+				}
+			}
+		}
+
+		candidate.cost = std::max(0.0, candidate.cost);
+		candidate.keepStamp = m_stamps[candidate.keep];
+		candidate.removeStamp = m_stamps[candidate.remove];
+		m_queue.push(candidate);
+	}
+
+	bool EdgeCollapser::Collapse(const Candidate& candidate) {
+		const uint32_t keep = candidate.keep;
+		const uint32_t remove = candidate.remove;
+		if (m_removedVertices[keep] || m_removedVertices[remove] ||
+			m_stamps[keep] != candidate.keepStamp || m_stamps[remove] != candidate.removeStamp) {
+			return false;
+		}
+
+		// Link condition: the two vertices may only share the neighbours of the triangles on their edge,
+		// otherwise the collapse pinches the surface.
+		std::vector<uint32_t> keepNeighbours, removeNeighbours;
+		size_t sharedTriangles = 0;
+		for (uint32_t triangle : m_vertexTriangles[keep]) {
+			const uint32_t* corners = &m_indices[3 * triangle];
+			keepNeighbours.insert(keepNeighbours.end(), corners, corners + 3);
+			sharedTriangles += HasVertex(triangle, remove);
+		}
+		for (uint32_t triangle : m_vertexTriangles[remove]) {
+			const uint32_t* corners = &m_indices[3 * triangle];
+			removeNeighbours.insert(removeNeighbours.end(), corners, corners + 3);
+		}
+		if (sharedTriangles == 0) {
+			return false;
+		}
+
+		std::sort(keepNeighbours.begin(), keepNeighbours.end());
+		keepNeighbours.erase(std::unique(keepNeighbours.begin(), keepNeighbours.end()), keepNeighbours.end());
+		std::sort(removeNeighbours.begin(), removeNeighbours.end());
+		removeNeighbours.erase(std::unique(removeNeighbours.begin(), removeNeighbours.end()), removeNeighbours.end());
+
+		size_t common = 0;
+		for (uint32_t vertex : removeNeighbours) {
+			if (vertex != keep && vertex != remove && std::binary_search(keepNeighbours.begin(), keepNeighbours.end(), vertex)) {
+				++common;
+			}
+		}
+		if (common != sharedTriangles) {
+			return false;
+		}
+
+		// No surviving triangle may flip or collapse to a sliver.
+		for (uint32_t moved : { keep, remove }) {
+			for (uint32_t triangle : m_vertexTriangles[moved]) {
+				if (HasVertex(triangle, keep) && HasVertex(triangle, remove)) {
+					continue;
+				}
+
+				const Vector3 before = GetNormal(triangle, moved, m_positions[moved]);
+				const Vector3 after = GetNormal(triangle, moved, candidate.target);
+				const double beforeLength = std::sqrt(Dot(before, before));
+				const double afterLength = std::sqrt(Dot(after, after));
+				if (afterLength <= 1e-12 * beforeLength) {
+					return false;
+				}
+				if (beforeLength > 0.0 && Dot(before, after) < c_minNormalCosine * beforeLength * afterLength) {
+					return false;
+				}
+			}
+		}
+
+		m_positions[keep] = candidate.target;
+		m_quadrics[keep] += m_quadrics[remove];
+		m_maxCost = std::max(m_maxCost, candidate.cost);
+
+		std::vector<uint32_t> triangles;
+		for (uint32_t triangle : m_vertexTriangles[keep]) {
+			if (HasVertex(triangle, remove)) {
+				m_removedTriangles[triangle] = true;
+				--m_triangleCount;
+			}
+			else {
+				triangles.push_back(triangle);
+			}
+		}
+		for (uint32_t triangle : m_vertexTriangles[remove]) {
+			if (m_removedTriangles[triangle]) {
+				continue;
+			}
+			uint32_t* corners = &m_indices[3 * triangle];
+			for (int k = 0; k < 3; ++k) {
+				if (corners[k] == remove) {
+					corners[k] = keep;
+				}
+			}
+			triangles.push_back(triangle);
+		}
+
+		m_vertexTriangles[keep].swap(triangles);
+		m_vertexTriangles[remove].clear();
+		m_removedVertices[remove] = true;
+		++m_stamps[keep];
+		++m_stamps[remove];
+
+		// The neighbours of other vertices lost triangles too.
+		for (uint32_t vertex : removeNeighbours) {
+			if (vertex == keep || vertex == remove) {
+				continue;
+			}
+			std::vector<uint32_t>& around = m_vertexTriangles[vertex];
+			around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t triangle) { return m_removedTriangles[triangle]; }), around.end());
+		}
+
+		std::vector<uint32_t> neighbours;
+		for (uint32_t triangle : m_vertexTriangles[keep]) {
+			const uint32_t* corners = &m_indices[3 * triangle];
+			neighbours.insert(neighbours.end(), corners, corners + 3);
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for (uint32_t vertex : neighbours) {
+			if (vertex != keep) {
+				PushEdge(keep, vertex);
+			}
+		}
+		return true;
+	}
+
+	void EdgeCollapser::Run(size_t targetTriangles) {
+		while (m_triangleCount > targetTriangles && !m_queue.empty()) {
+			const Candidate candidate = m_queue.top();
+			m_queue.pop();
+			Collapse(candidate);
+		}
+	}
+
+	MeshLevel EdgeCollapser::Extract(std::vector<uint32_t>& origins) const {
+		MeshLevel level;
+		level.error = std::sqrt(m_maxCost);
+
+		std::vector<uint32_t> remap(m_positions.size(), UINT32_MAX);
+		origins.clear();
+		for (size_t triangle = 0; triangle < m_removedTriangles.size(); ++triangle) {
+			if (m_removedTriangles[triangle]) {
+				continue;
+			}
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t vertex = m_indices[3 * triangle + k];
+				if (remap[vertex] == UINT32_MAX) {
+					remap[vertex] = static_cast<uint32_t>(level.positions.size());
+					const Vector3& p = m_positions[vertex];
+					level.positions.push_back({ static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) });
+					origins.push_back(vertex);
+				}
+				level.indices.push_back(remap[vertex]);
+			}
+		}
+		return level;
+	}
+
+	// One level of the chain: chunks of the mesh simplified in parallel, their shared vertices locked.
+	MeshLevel SimplifyChunked(const MeshLevel& mesh, size_t targetTriangles, const SimplifySettings& settings, double shift) {
+		const size_t triangleCount = mesh.GetTriangleCount();
+		const uint32_t chunksPerSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(triangleCount) / std::max(1u, settings.chunkTriangles))));
+		if (chunksPerSide <= 1) {
+			return SimplifyMesh(mesh.positions, mesh.indices, targetTriangles);
+		}
+
+		// Chunks are squares across the two largest extents of the mesh.
+		Float3 low = mesh.positions[0], high = mesh.positions[0];
+		for (const Float3& p : mesh.positions) {
+			low = { std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z) };
+			high = { std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z) };
+		}
+		const double extents[3] = { high.x - low.x, high.y - low.y, high.z - low.z };
+		const int thinnest = extents[0] <= extents[1] && extents[0] <= extents[2] ? 0 : (extents[1] <= extents[2] ? 1 : 2);
+		const int axisU = thinnest == 0 ? 1 : 0;
+		const int axisV = thinnest == 2 ? 1 : 2;
+		const double lowBounds[3] = { low.x, low.y, low.z };
+		const uint32_t cellsPerSide = chunksPerSide + (shift > 0.0 ? 1 : 0);
+
+		auto coordinate = [](const Float3& p, int axis) { return axis == 0 ? p.x : (axis == 1 ? p.y : p.z); };
+		auto cell = [&](double value, int axis) {
+			const double size = extents[axis] / chunksPerSide;
+			const double position = size > 0.0 ? (value - lowBounds[axis]) / size + shift : 0.0;
+			return std::min(cellsPerSide - 1, static_cast<uint32_t>(std::max(0.0, position)));
+		};
+
+		std::vector<std::vector<uint32_t>> chunkTriangles(static_cast<size_t>(cellsPerSide) * cellsPerSide);
+		std::vector<uint32_t> owner(mesh.positions.size(), UINT32_MAX);
+		std::vector<bool> shared(mesh.positions.size(), false);
+		for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+			double u = 0.0, v = 0.0;
+			for (int k = 0; k < 3; ++k) {
+				const Float3& p = mesh.positions[mesh.indices[3 * triangle + k]];
+				u += coordinate(p, axisU) / 3.0;
+				v += coordinate(p, axisV) / 3.0;
+			}
+			const uint32_t chunk = cell(v, axisV) * cellsPerSide + cell(u, axisU);
+			chunkTriangles[chunk].push_back(triangle);
+
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t vertex = mesh.indices[3 * triangle + k];
+				if (owner[vertex] == UINT32_MAX) {
+					owner[vertex] = chunk;
+				}
+				else if (owner[vertex] != chunk) {
+					shared[vertex] = true;
+				}
+			}
+		}
+
+		struct ChunkResult {
+			MeshLevel level;
+			// Input vertex of the whole mesh behind every vertex of the result.
+			std::vector<uint32_t> globals;
+		};
+		std::vector<ChunkResult> results(chunkTriangles.size());
+
+		auto simplifyChunk = [&](size_t chunk) {
+			const std::vector<uint32_t>& triangles = chunkTriangles[chunk];
+			if (triangles.empty()) {
+				return;
+			}
+
+			WeldedMesh local;
+			std::vector<uint32_t> localToGlobal;
+			std::unordered_map<uint32_t, uint32_t> globalToLocal;
+			for (uint32_t triangle : triangles) {
+				for (int k = 0; k < 3; ++k) {
+					const uint32_t vertex = mesh.indices[3 * triangle + k];
+					auto inserted = globalToLocal.insert({ vertex, static_cast<uint32_t>(localToGlobal.size()) });
+					if (inserted.second) {
+						const Float3& p = mesh.positions[vertex];
+						local.positions.push_back({ p.x, p.y, p.z });
+						local.locked.push_back(shared[vertex]);
+						localToGlobal.push_back(vertex);
+					}
+					local.indices.push_back(inserted.first->second);
+				}
+			}
+
+			const size_t target = (triangles.size() * targetTriangles + triangleCount - 1) / triangleCount;
+			EdgeCollapser collapser(std::move(local));
+			collapser.Run(target);
+
+			std::vector<uint32_t> origins;
+			results[chunk].level = collapser.Extract(origins);
+			for (uint32_t origin : origins) {
+				results[chunk].globals.push_back(localToGlobal[origin]);
+			}
+		};
+
+		const uint32_t threadCount = std::max(1u, std::min(settings.threadCount ? settings.threadCount : std::thread::hardware_concurrency(),
+			static_cast<uint32_t>(chunkTriangles.size())));
+		std::atomic<size_t> nextChunk(0);
+		auto work = [&]() {
+			for (size_t chunk = nextChunk++; chunk < chunkTriangles.size(); chunk = nextChunk++) {
+				simplifyChunk(chunk);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (uint32_t thread = 1; thread < threadCount; ++thread) {
+			workers.emplace_back(work);
+		}
+		work();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+
+		// Stitched in chunk order, so the result does not depend on the thread count. Locked vertices
+		// did not move and are shared between the chunks that use them.
+		MeshLevel level;
+		std::unordered_map<uint32_t, uint32_t> sharedVertices;
+		for (const ChunkResult& result : results) {
+			std::vector<uint32_t> remap(result.level.positions.size());
+			for (size_t v = 0; v < remap.size(); ++v) {
+				const uint32_t global = result.globals[v];
+				if (shared[global]) {
+					auto inserted = sharedVertices.insert({ global, static_cast<uint32_t>(level.positions.size()) });
+					if (inserted.second) {
+						level.positions.push_back(result.level.positions[v]);
+					}
+					remap[v] = inserted.first->second;
+				}
+				else {
+					remap[v] = static_cast<uint32_t>(level.positions.size());
+					level.positions.push_back(result.level.positions[v]);
+				}
+			}
+			for (uint32_t index : result.level.indices) {
+				level.indices.push_back(remap[index]);
+			}
+			level.error = std::max(level.error, result.level.error);
+		}
+		return level;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+
+MeshLevel SonarPropagation::Sonar::SimplifyMesh(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices, size_t targetTriangles,
+	const std::vector<bool>* locked)
+{
+	EdgeCollapser collapser(Weld(positions, indices, locked));
+	collapser.Run(targetTriangles);
+
+	std::vector<uint32_t> origins;
+	return collapser.Extract(origins);
+}
+
+std::vector<MeshLevel> SonarPropagation::Sonar::BuildLodChain(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices,
+	const SimplifySettings& settings)
+{
+	std::vector<MeshLevel> lods;
+
+	// Level 0 welded, so that chunks see which vertices they share.
+	const WeldedMesh welded = Weld(positions, indices, nullptr);
+	MeshLevel current;
+	current.indices = welded.indices;
+	current.positions.reserve(welded.positions.size());
+	for (const Vector3& p : welded.positions) {
+		current.positions.push_back({ static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) });
+	}
+
+	for (uint32_t level = 1; level <= settings.maxLevels; ++level) {
+		const size_t triangleCount = current.GetTriangleCount();
+		if (triangleCount <= settings.minTriangles) {
+			break;
+		}
+
+		const size_t target = std::max<size_t>(settings.minTriangles, static_cast<size_t>(triangleCount * settings.reduction));
+		MeshLevel next = SimplifyChunked(current, target, settings, (level % 2) ? 0.0 : 0.5);
+		if (next.GetTriangleCount() > triangleCount * 9 / 10) {
+			break;
+		}
+
+		// Errors add up from level to level, as every level is reduced from the previous one.
+		next.error += current.error;
+		lods.push_back(next);
+		current = std::move(next);
+	}
+	return lods;
+}
+
+double SonarPropagation::Sonar::GetLodTolerance(double frequency, double range)
+{
+	if (!(frequency > 0.0)) {
+		return 0.0;
+	}
+
+	const double wavelength = c_nominalSoundSpeed / frequency;
+	return std::max(0.25 * wavelength, 0.1 * std::sqrt(wavelength * std::max(range, 0.0)));
+}
+
+size_t SonarPropagation::Sonar::SelectLod(const std::vector<MeshLevel>& lods, double tolerance)
+{
+	size_t level = 0;
+	while (level < lods.size() && lods[level].error <= tolerance) {
+		++level;
+	}
+	return level;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// One level of detail of a mesh.
+		/// </summary>
+		struct MeshLevel {
+			std::vector<Float3> positions;
+			std::vector<uint32_t> indices;
+			// Bound on the distance between this level and the full mesh, in model space units.
+			double error = 0.0;
+
+			size_t GetTriangleCount() const { return indices.size() / 3; }
+		};
+
+		struct SimplifySettings {
+			// Every level keeps this fraction of the triangles of the previous one.
+			double reduction = 0.25;
+			// No level goes below this many triangles.
+			uint32_t minTriangles = 256;
+			uint32_t maxLevels = 6;
+			// Triangles per chunk; chunks are simplified on their own, in parallel.
+			uint32_t chunkTriangles = 1 << 16;
+			// Zero for one thread per hardware thread. The levels do not depend on it.
+			uint32_t threadCount = 0;
+		};
+
+		/// <summary>
+		/// Quadric edge collapse (Garland and Heckbert): every vertex carries the sum of the squared
+		/// distances to the planes of its triangles, and the edge whose collapse adds the least of it
+		/// goes first, until targetTriangles are left. Coincident vertices are welded first; collapses
+		/// that would flip a triangle are skipped. Open borders are kept in place by planes through
+		/// their edges, and locked vertices, if given, never move.
+		///
+		/// The error of the result is the square root of the largest quadric error of a collapse.
+		/// </summary>
+		MeshLevel SimplifyMesh(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices, size_t targetTriangles,
+			const std::vector<bool>* locked = nullptr);
+
+		/// <summary>
+		/// Levels 1 and up of a mesh, each reduced from the previous one by settings.reduction. A level
+		/// is split into square chunks of about settings.chunkTriangles across its two largest extents,
+		/// and the chunks are simplified in parallel with the vertices they share locked; the chunk grid
+		/// moves by half a chunk from one level to the next, so the seams of a level are simplified by
+		/// the next. Stops at settings.minTriangles, at settings.maxLevels, or once a level barely shrinks.
+		/// </summary>
+		std::vector<MeshLevel> BuildLodChain(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices,
+			const SimplifySettings& settings);
+
+		/// <summary>
+		/// Geometric error a reflection at range metres from the source does not resolve at frequency Hz:
+		/// a quarter wavelength, or a tenth of the radius of the first Fresnel zone, sqrt(lambda r),
+		/// whichever is larger. Zero without a frequency.
+		/// </summary>
+		double GetLodTolerance(double frequency, double range);
+
+		/// <summary>
+		/// The coarsest level whose error is within tolerance: 0 for the full mesh, k for lods[k - 1].
+		/// </summary>
+		size_t SelectLod(const std::vector<MeshLevel>& lods, double tolerance);
+	}
+}
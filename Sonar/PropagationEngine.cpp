@@ -0,0 +1,662 @@
+#include "pch.h"
+#include "PropagationEngine.h"
+
+#include "RayMarch.h"
+#include "RayPacket.h"
+
+#include "../Common/Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+	using namespace SonarPropagation::Sonar;
+
+	const double c_pi = 3.14159265358979323846;
+
+	struct ModeInfo {
+		EngineMode mode;
+		const char* name;
+	};
+
+	const ModeInfo c_modes[] = {
+		{ EngineMode::ScalarDouble, "scalar_double" },
+		{ EngineMode::ScalarFloat, "scalar_float" },
+		{ EngineMode::Simd, "simd" },
+		{ EngineMode::Adaptive, "adaptive" },
+		{ EngineMode::Analytic, "analytic" },
+	};
+
+	RayMarchConfig MakeMarchConfig(const Environment& environment, const FieldGrid& grid, const PropagationSettings& settings) {
+		RayMarchConfig config;
+		config.stepSize = settings.stepSize;
+		config.maxSteps = settings.maxSteps;
+		config.bottomDepth = environment.bottomDepth;
+		config.bottomSlope = environment.bottomSlope;
+		config.bottomProfile = environment.bottomProfile.IsEmpty() ? nullptr : &environment.bottomProfile;
+		config.maxRange = grid.maxRange;
+		config.maxBounces = settings.maxBounces;
+		config.integrator = settings.mode == EngineMode::Analytic ? Integrator::Analytic : Integrator::Rk4;
+		config.tolerance = settings.mode == EngineMode::Adaptive ? settings.tolerance : 0.0;
+		return config;
+	}
+
+	/// <summary>
+	/// Records where a ray passes the receiver columns, its arrivals at the receivers and, if asked
+	/// for, where it reflects off the bottom, segment by segment. Columns are visited in order, so a ray
+	/// that a sloped bottom turns back is only recorded on its way out.
+	/// </summary>
+	class SegmentRecorder {
+	public:
+		SegmentRecorder(const FieldGrid& grid, const ReceiverGrid& receivers, uint32_t ray, bool bottomHits, RayTrace& trace)
+			: m_grid(grid), m_ray(ray), m_crossings(trace.crossings), m_capture(receivers, ray, trace.arrivals),
+			m_hasReceivers(!receivers.IsEmpty()), m_bottomHits(bottomHits ? &trace.bottomHits : nullptr) {}
+
+		// Returns false once the ray has passed the last column.
+		bool AddSegment(double r0, double z0, double tau0, double r1, double z1, double tau1,
+			uint32_t surfaceBounces, uint32_t bottomBounces, double intensity) {
+			if (m_hasReceivers) {
+				m_capture.AddSegment(r0, z0, tau0, r1, z1, tau1, surfaceBounces, bottomBounces, intensity);
+			}
+
+			// The segment after a reflection starts where the ray met the bottom.
+			if (m_bottomHits) {
+				if (bottomBounces > m_bottomBounces) {
+					m_bottomHits->push_back({ m_ray, r0, z0, tau0, m_intensity });
+				}
+				m_bottomBounces = bottomBounces;
+				m_intensity = intensity;
+			}
+
+			while (m_nextColumn < m_grid.rangeCount) {
+				const double range = m_grid.GetRange(m_nextColumn);
+				if (!(r1 >= range) || !(r1 > r0)) {
+					break;
+				}
+
+				const double t = (range - r0) / (r1 - r0);
+
+				RayCrossing crossing;
+				crossing.column = m_nextColumn;
+				crossing.ray = m_ray;
+				crossing.depth = z0 + t * (z1 - z0);
+				crossing.time = tau0 + t * (tau1 - tau0);
+				crossing.surfaceBounces = surfaceBounces;
+				crossing.bottomBounces = bottomBounces;
+				crossing.intensity = intensity;
+				m_crossings.push_back(crossing);
+
+				++m_nextColumn;
+			}
+
+			return m_nextColumn < m_grid.rangeCount;
+		}
+
+		// Records the arrivals of the receivers the ray was still passing when it stopped.
+		void Finish() {
+			m_capture.Finish();
+		}
+
+	private:
+		const FieldGrid& m_grid;
+		uint32_t m_ray;
+		uint32_t m_nextColumn = 0;
+		std::vector<RayCrossing>& m_crossings;
+		ReceiverCapture m_capture;
+		bool m_hasReceivers;
+		std::vector<BottomHit>* m_bottomHits;
+		// Of the segment before.
+		uint32_t m_bottomBounces = 0;
+		double m_intensity = 1.0;
+	};
+
+	/// <summary>
+	/// RayMarch() visitor feeding a SegmentRecorder, and the path encoder of the ray if one is given.
+	/// </summary>
+	class CrossingRecorder {
+	public:
+		CrossingRecorder(const Environment& environment, const FieldGrid& grid, const ReceiverGrid& receivers, uint32_t ray, double initialXi,
+			bool bottomHits, RayTrace& trace, PathEncoder* path)
+			: m_environment(environment), m_initialXi(initialXi), m_segments(grid, receivers, ray, bottomHits, trace), m_path(path) {}
+
+		template <typename Real>
+		bool operator()(const RayStateT<Real>& from, const RayStateT<Real>& to, const RayMarchResultT<Real>& progress) {
+			const double lossDb = progress.surfaceBounces * m_environment.surfaceLossDb + progress.bottomBounces * m_environment.bottomLossDb;
+			const double intensity = std::pow(10.0, -0.1 * lossDb) * std::abs(m_initialXi / static_cast<double>(to.xi));
+
+			if (m_path) {
+				if (m_path->IsEmpty()) {
+					m_path->Add({ from.r, from.z, from.tau, 0.0, 0, 0 });
+				}
+				m_path->Add({ to.r, to.z, to.tau, intensity, progress.surfaceBounces, progress.bottomBounces });
+			}
+
+			return m_segments.AddSegment(from.r, from.z, from.tau, to.r, to.z, to.tau, progress.surfaceBounces, progress.bottomBounces, intensity);
+		}
+
+		void Finish() {
+			m_segments.Finish();
+			if (m_path) {
+				m_path->Finish();
+			}
+		}
+
+	private:
+		const Environment& m_environment;
+		double m_initialXi;
+		SegmentRecorder m_segments;
+		PathEncoder* m_path;
+	};
+
+	// Paths, if given, has a path for every ray from firstRay to endRay.
+	template <typename Real>
+	uint64_t TraceScalar(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings,
+		const ReceiverGrid& receivers, uint32_t firstRay, uint32_t endRay, RayTrace& trace, PathEncoder* paths) {
+		const RayMarchConfig config = MakeMarchConfig(environment, grid, settings);
+		uint64_t steps = 0;
+
+		for (uint32_t ray = firstRay; ray < endRay; ++ray) {
+			const RayState start = InitializeRay(environment.profile, 0.0, fan.sourceDepth, fan.GetLaunchAngle(ray));
+			const RayStateT<Real> startReal = { static_cast<Real>(start.r), static_cast<Real>(start.z),
+				static_cast<Real>(start.xi), static_cast<Real>(start.zeta), Real(0) };
+
+			CrossingRecorder recorder(environment, grid, receivers, ray, start.xi, settings.recordBottomHits, trace,
+				paths ? &paths[ray - firstRay] : nullptr);
+			steps += RayMarch(environment.profile, startReal, config, recorder).steps;
+			recorder.Finish();
+		}
+
+		return steps;
+	}
+
+	/// <summary>
+	/// The recorders of the lanes of a packet, constructed in place so that tracing a packet does not allocate.
+	/// </summary>
+	class LaneRecorders {
+	public:
+		LaneRecorders() = default;
+		LaneRecorders(const LaneRecorders&) = delete;
+		LaneRecorders& operator=(const LaneRecorders&) = delete;
+
+		~LaneRecorders() {
+			for (size_t lane = 0; lane < m_count; ++lane) {
+				(*this)[lane].~CrossingRecorder();
+			}
+		}
+
+		template <typename... Args>
+		void Add(Args&&... args) {
+			new (&m_storage[m_count]) CrossingRecorder(std::forward<Args>(args)...);
+			++m_count;
+		}
+
+		CrossingRecorder& operator[](size_t lane) {
+			return *reinterpret_cast<CrossingRecorder*>(&m_storage[lane]);
+		}
+
+		size_t GetCount() const { return m_count; }
+
+	private:
+		typename std::aligned_storage<sizeof(CrossingRecorder), alignof(CrossingRecorder)>::type m_storage[RayPacket4::c_width];
+		size_t m_count = 0;
+	};
+
+	// Same boundary handling as RayMarch(), applied lane by lane around the packet step.
+	uint64_t TraceSimd(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings,
+		const ReceiverGrid& receivers, uint32_t firstRay, uint32_t endRay, RayTrace& trace, PathEncoder* paths) {
+		const RayMarchConfig config = MakeMarchConfig(environment, grid, settings);
+		const float h = static_cast<float>(settings.stepSize);
+		const size_t width = RayPacket4::c_width;
+		uint64_t steps = 0;
+
+		for (uint32_t packetStart = firstRay; packetStart < endRay; packetStart += width) {
+			const size_t count = std::min<size_t>(width, endRay - packetStart);
+
+			RayStateF lanes[RayPacket4::c_width];
+			RayMarchResultT<float> progress[RayPacket4::c_width];
+			LaneRecorders recorders;
+			bool active[RayPacket4::c_width] = {};
+
+			for (size_t lane = 0; lane < count; ++lane) {
+				const uint32_t ray = static_cast<uint32_t>(packetStart + lane);
+				const RayState start = InitializeRay(environment.profile, 0.0, fan.sourceDepth, fan.GetLaunchAngle(ray));
+				lanes[lane] = { static_cast<float>(start.r), static_cast<float>(start.z), static_cast<float>(start.xi), static_cast<float>(start.zeta), 0.0f };
+				recorders.Add(environment, grid, receivers, ray, start.xi, settings.recordBottomHits, trace,
+					paths ? &paths[ray - firstRay] : nullptr);
+				active[lane] = true;
+			}
+
+			RayPacket4 packet;
+			LoadPacket(packet, lanes, count);
+
+			size_t activeCount = count;
+			for (uint32_t step = 0; step < config.maxSteps && activeCount > 0; ++step) {
+				RayStateF previous[RayPacket4::c_width];
+				StorePacket(packet, previous, count);
+
+				IntegrateStep4(environment.profile, packet, h);
+				StorePacket(packet, lanes, count);
+
+				for (size_t lane = 0; lane < count; ++lane) {
+					if (!active[lane]) {
+						continue;
+					}
+
+					// A lane that left the water redoes its shortened step on its own.
+					RayStateF& next = lanes[lane];
+					const BoundaryHit hit = ResolveBoundaries(environment.profile, config, previous[lane], next, h);
+					const bool keepGoing = recorders[lane](previous[lane], next, progress[lane]);
+
+					if (hit == BoundaryHit::Surface) {
+						++progress[lane].surfaceBounces;
+					}
+					else if (hit == BoundaryHit::Bottom) {
+						++progress[lane].bottomBounces;
+					}
+					++progress[lane].steps;
+					++steps;
+
+					if (!keepGoing || progress[lane].surfaceBounces + progress[lane].bottomBounces > config.maxBounces ||
+						next.r > config.maxRange || next.r < 0.0f) {
+						active[lane] = false;
+						--activeCount;
+					}
+				}
+
+				// Finished lanes keep integrating their last state; nobody reads them any more.
+				LoadPacket(packet, lanes, count);
+			}
+
+			for (size_t lane = 0; lane < recorders.GetCount(); ++lane) {
+				recorders[lane].Finish();
+			}
+		}
+
+		return steps;
+	}
+
+	// Appends to trace; its steps are returned rather than added.
+	uint64_t TraceRange(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings,
+		const ReceiverGrid& receivers, uint32_t firstRay, uint32_t endRay, RayTrace& trace, PathEncoder* paths = nullptr) {
+		SONAR_PROFILE_SCOPE("TraceRays");
+
+		switch (settings.mode) {
+		case EngineMode::ScalarFloat:
+			return TraceScalar<float>(environment, fan, grid, settings, receivers, firstRay, endRay, trace, paths);
+		case EngineMode::Simd:
+			return TraceSimd(environment, fan, grid, settings, receivers, firstRay, endRay, trace, paths);
+		default:
+			return TraceScalar<double>(environment, fan, grid, settings, receivers, firstRay, endRay, trace, paths);
+		}
+	}
+
+	// Adjacent traced rays of a ray, the ray itself on a side without one, and the share of the fan the ray stands for.
+	double GetTracedNeighbours(const LaunchFan& fan, const std::vector<uint32_t>& tracedRays, uint32_t ray, uint32_t& previousRay, uint32_t& nextRay) {
+		const auto position = std::lower_bound(tracedRays.begin(), tracedRays.end(), ray);
+		const bool hasPrevious = position != tracedRays.begin();
+		const bool hasNext = position != tracedRays.end() && position + 1 < tracedRays.end();
+		previousRay = hasPrevious ? *(position - 1) : ray;
+		nextRay = hasNext ? *(position + 1) : ray;
+		const double span = hasPrevious && hasNext ? 0.5 * (nextRay - previousRay) : (hasPrevious || hasNext ? nextRay - previousRay : 1.0);
+		return fan.GetAngleStep() * span;
+	}
+
+	void SortResult(PropagationResult& result) {
+		SONAR_PROFILE_SCOPE("SortResult");
+
+		std::sort(result.crossings.begin(), result.crossings.end(), [](const RayCrossing& a, const RayCrossing& b) {
+			return a.column != b.column ? a.column < b.column : a.ray < b.ray;
+		});
+		std::sort(result.arrivals.begin(), result.arrivals.end(), [](const ReceiverArrival& a, const ReceiverArrival& b) {
+			if (a.receiver != b.receiver) {
+				return a.receiver < b.receiver;
+			}
+			return a.ray != b.ray ? a.ray < b.ray : a.time < b.time;
+		});
+		// Hits of a ray are recorded in time order, so ordering by time within a ray keeps that order
+		// without the buffer stable_sort allocates.
+		std::sort(result.bottomHits.begin(), result.bottomHits.end(), [](const BottomHit& a, const BottomHit& b) {
+			return a.ray != b.ray ? a.ray < b.ray : a.time < b.time;
+		});
+	}
+
+	// Neighbouring rays that land in different places, bounce differently or arrive at different
+	// times leave a gap in the field that needs a ray between them.
+	bool Diverge(const RayTrace& a, const RayTrace& b, double depthGap, double timeGap) {
+		if (a.crossings.size() != b.crossings.size()) {
+			return true;
+		}
+
+		for (size_t i = 0; i < a.crossings.size(); ++i) {
+			const RayCrossing& first = a.crossings[i];
+			const RayCrossing& second = b.crossings[i];
+			if (first.column != second.column || first.surfaceBounces != second.surfaceBounces || first.bottomBounces != second.bottomBounces ||
+				std::abs(first.depth - second.depth) > depthGap || std::abs(first.time - second.time) > timeGap) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// ComputeTransmissionLoss() into buffers kept by the caller.
+	void ComputeTransmissionLossInto(const LaunchFan& fan, const FieldGrid& grid, const std::vector<RayCrossing>& crossings,
+		double minBeamWidth, const std::vector<uint32_t>* tracedRays, std::vector<double>& intensity, std::vector<float>& transmissionLoss) {
+		SONAR_PROFILE_SCOPE("TransmissionLoss");
+
+		const double cellHeight = grid.maxDepth / grid.depthCount;
+		const double inverseSqrtTwoPi = 1.0 / std::sqrt(2.0 * c_pi);
+
+		intensity.assign(static_cast<size_t>(grid.rangeCount) * grid.depthCount, 0.0);
+
+		for (size_t i = 0; i < crossings.size(); ++i) {
+			const RayCrossing& crossing = crossings[i];
+
+			// Adjacent traced rays, and the share of the fan the ray stands for; the weight is the one of GetRayWeight().
+			uint32_t previousRay = crossing.ray - 1;
+			uint32_t nextRay = crossing.ray + 1;
+			const double weight = tracedRays && !tracedRays->empty()
+				? GetTracedNeighbours(fan, *tracedRays, crossing.ray, previousRay, nextRay)
+				: GetRayWeight(fan, nullptr, crossing.ray);
+
+			// Neighbours only count if they are the adjacent rays of the fan in the same column.
+			const RayCrossing* previous = i > 0 && crossings[i - 1].column == crossing.column && crossings[i - 1].ray == previousRay &&
+				previousRay != crossing.ray ? &crossings[i - 1] : nullptr;
+			const RayCrossing* next = i + 1 < crossings.size() && crossings[i + 1].column == crossing.column && crossings[i + 1].ray == nextRay &&
+				nextRay != crossing.ray ? &crossings[i + 1] : nullptr;
+
+			const double range = grid.GetRange(crossing.column);
+			double width;
+			if (previous && next) {
+				width = 0.5 * std::abs(next->depth - previous->depth);
+			}
+			else if (previous || next) {
+				width = std::abs((previous ? previous : next)->depth - crossing.depth);
+			}
+			else {
+				width = range * weight;
+			}
+
+			const double sigma = std::max(width, minBeamWidth);
+			const double amplitude = weight * crossing.intensity / range * inverseSqrtTwoPi / sigma;
+
+			// Cells further than four widths away get nothing measurable.
+			const double reach = 4.0 * sigma;
+			const int firstRow = std::max(0, static_cast<int>(std::floor((crossing.depth - reach) / cellHeight)));
+			const int lastRow = std::min(static_cast<int>(grid.depthCount) - 1, static_cast<int>(std::ceil((crossing.depth + reach) / cellHeight)));
+
+			double* column = &intensity[static_cast<size_t>(crossing.column) * grid.depthCount];
+			for (int row = firstRow; row <= lastRow; ++row) {
+				const double offset = (grid.GetDepth(static_cast<uint32_t>(row)) - crossing.depth) / sigma;
+				column[row] += amplitude * std::exp(-0.5 * offset * offset);
+			}
+		}
+
+		transmissionLoss.resize(intensity.size());
+		for (size_t cell = 0; cell < intensity.size(); ++cell) {
+			// 200 dB stands for "no energy"; the comparisons ignore cells that quiet.
+			transmissionLoss[cell] = intensity[cell] > 1e-20 ? static_cast<float>(-10.0 * std::log10(intensity[cell])) : 200.0f;
+		}
+	}
+
+	// Runs task(0) to task(count - 1) on up to threadCount threads, the calling one included, each
+	// taking the next task as it finishes one.
+	template <typename Task>
+	void RunTasks(size_t count, uint32_t threadCount, Task task) {
+		threadCount = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(threadCount, count)));
+		std::atomic<size_t> nextTask(0);
+		auto work = [&]() {
+			for (size_t index = nextTask++; index < count; index = nextTask++) {
+				task(index);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (uint32_t thread = 1; thread < threadCount; ++thread) {
+			workers.emplace_back(work);
+		}
+		work();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+}
+
+const char* SonarPropagation::Sonar::GetEngineModeName(EngineMode mode)
+{
+	for (const ModeInfo& info : c_modes) {
+		if (info.mode == mode) {
+			return info.name;
+		}
+	}
+	return "unknown";
+}
+
+bool SonarPropagation::Sonar::ParseEngineMode(const std::string& name, EngineMode& mode)
+{
+	for (const ModeInfo& info : c_modes) {
+		if (name == info.name) {
+			mode = info.mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+double SonarPropagation::Sonar::LaunchFan::GetAngleStep() const
+{
+	return rayCount > 1 ? (maxAngle - minAngle) * c_pi / 180.0 / (rayCount - 1) : 0.0;
+}
+
+double SonarPropagation::Sonar::LaunchFan::GetLaunchAngle(uint32_t ray) const
+{
+	const double t = rayCount > 1 ? static_cast<double>(ray) / (rayCount - 1) : 0.5;
+	return (minAngle + t * (maxAngle - minAngle)) * c_pi / 180.0;
+}
+
+SonarPropagation::Sonar::LaunchFan SonarPropagation::Sonar::GetRefinedFan(const LaunchFan& fan, uint32_t levels)
+{
+	LaunchFan refined = fan;
+	if (fan.rayCount > 1) {
+		refined.rayCount = ((fan.rayCount - 1) << std::min(levels, 16u)) + 1;
+	}
+	return refined;
+}
+
+SonarPropagation::Sonar::PropagationResult SonarPropagation::Sonar::RefineFan(const LaunchFan& fan, const FieldGrid& grid,
+	const PropagationSettings& settings, const std::vector<uint32_t>& seedRays, const WaveTracer& traceWave)
+{
+	SONAR_PROFILE_SCOPE("RefineFan");
+
+	const LaunchFan refined = GetRefinedFan(fan, settings.refinementLevels);
+	const uint32_t stride = std::max(1u, (refined.rayCount - 1) / std::max(1u, fan.rayCount - 1));
+	const double depthGap = settings.refineDepthGap > 0.0 ? settings.refineDepthGap : 2.0 * grid.maxDepth / grid.depthCount;
+
+	// Seeds come from a refinement of the same fan, so every interval they leave is still halved at its midpoint.
+	std::vector<uint32_t> wave;
+	for (uint32_t ray = 0; ray < refined.rayCount; ray += stride) {
+		wave.push_back(ray);
+	}
+	for (uint32_t ray : seedRays) {
+		if (ray < refined.rayCount) {
+			wave.push_back(ray);
+		}
+	}
+	std::sort(wave.begin(), wave.end());
+	wave.erase(std::unique(wave.begin(), wave.end()), wave.end());
+
+	// Only the rays traced so far, by ray: a deep refinement traces a small part of its fan.
+	std::map<uint32_t, RayTrace> traces;
+	std::vector<RayTrace> waveTraces;
+	while (!wave.empty()) {
+		waveTraces.clear();
+		waveTraces.resize(wave.size());
+		traceWave(wave, waveTraces);
+		for (size_t i = 0; i < wave.size(); ++i) {
+			traces[wave[i]] = std::move(waveTraces[i]);
+		}
+		wave.clear();
+
+		for (auto left = traces.begin(), right = std::next(left); right != traces.end(); left = right++) {
+			if (right->first - left->first > 1 && Diverge(left->second, right->second, depthGap, settings.refineTimeGap)) {
+				wave.push_back((left->first + right->first) / 2);
+			}
+		}
+	}
+
+	PropagationResult result;
+	for (const auto& trace : traces) {
+		result.crossings.insert(result.crossings.end(), trace.second.crossings.begin(), trace.second.crossings.end());
+		result.arrivals.insert(result.arrivals.end(), trace.second.arrivals.begin(), trace.second.arrivals.end());
+		result.bottomHits.insert(result.bottomHits.end(), trace.second.bottomHits.begin(), trace.second.bottomHits.end());
+		result.totalSteps += trace.second.steps;
+		result.tracedRays.push_back(trace.first);
+	}
+
+	SortResult(result);
+	result.transmissionLoss = ComputeTransmissionLoss(refined, grid, result.crossings, settings.minBeamWidth, &result.tracedRays);
+	if (result.tracedRays.size() == refined.rayCount) {
+		result.tracedRays.clear();
+	}
+	return result;
+}
+
+uint64_t SonarPropagation::Sonar::TracePaths(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+	const PropagationSettings& settings, const std::vector<uint32_t>& rays, const PathTolerance& tolerance, std::vector<PathEncoder>& paths)
+{
+	SONAR_PROFILE_SCOPE("TracePaths");
+
+	const ReceiverGrid noReceivers;
+	paths.assign(rays.size(), PathEncoder(tolerance));
+	std::vector<uint64_t> steps(rays.size(), 0);
+
+	PropagationSettings pathSettings = settings;
+	pathSettings.recordBottomHits = false;
+	RunTasks(rays.size(), settings.threadCount, [&](size_t task) {
+		RayTrace trace;
+		steps[task] = TraceRange(environment, fan, grid, pathSettings, noReceivers, rays[task], rays[task] + 1, trace, &paths[task]);
+	});
+
+	uint64_t totalSteps = 0;
+	for (uint64_t taskSteps : steps) {
+		totalSteps += taskSteps;
+	}
+	return totalSteps;
+}
+
+void SonarPropagation::Sonar::ReplayPath(const RayPath& path, const FieldGrid& grid, const ReceiverGrid& receivers, uint32_t ray, bool bottomHits,
+	RayTrace& trace)
+{
+	SegmentRecorder recorder(grid, receivers, ray, bottomHits, trace);
+	for (size_t point = 1; point < path.points.size(); ++point) {
+		const PathPoint& from = path.points[point - 1];
+		const PathPoint& to = path.points[point];
+		if (!recorder.AddSegment(from.range, from.depth, from.time, to.range, to.depth, to.time, to.surfaceBounces, to.bottomBounces, to.intensity)) {
+			break;
+		}
+	}
+	recorder.Finish();
+}
+
+SonarPropagation::Sonar::PropagationResult SonarPropagation::Sonar::RunPropagation(const Environment& environment, const LaunchFan& fan,
+	const FieldGrid& grid, const PropagationSettings& settings, const ReceiverGrid* receivers)
+{
+	PropagationWorkspace workspace;
+	PropagationResult result;
+	RunPropagation(environment, fan, grid, settings, receivers, workspace, result);
+	return result;
+}
+
+void SonarPropagation::Sonar::RunPropagation(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+	const PropagationSettings& settings, const ReceiverGrid* receivers, PropagationWorkspace& workspace, PropagationResult& result)
+{
+	SONAR_PROFILE_SCOPE("RunPropagation");
+
+	const ReceiverGrid noReceivers;
+	if (settings.refinementLevels > 0 && fan.rayCount > 1) {
+		const LaunchFan refined = GetRefinedFan(fan, settings.refinementLevels);
+		result = RefineFan(fan, grid, settings, std::vector<uint32_t>(), [&](const std::vector<uint32_t>& wave, std::vector<RayTrace>& traces) {
+			RunTasks(wave.size(), settings.threadCount, [&](size_t task) {
+				RayTrace& trace = traces[task];
+				trace.steps = TraceRange(environment, refined, grid, settings, receivers ? *receivers : noReceivers, wave[task], wave[task] + 1, trace);
+			});
+		});
+		return;
+	}
+
+	const uint32_t threadCount = std::max(1u, std::min(settings.threadCount, fan.rayCount));
+
+	// Blocks are multiples of the packet width, so SIMD mode packs the same rays at any thread count.
+	const uint32_t width = static_cast<uint32_t>(RayPacket4::c_width);
+	const uint32_t blockSize = ((fan.rayCount + threadCount - 1) / threadCount + width - 1) / width * width;
+
+	// Cleared rather than replaced, so the traces keep their capacity from the previous call.
+	std::vector<RayTrace>& threadTraces = workspace.threadTraces;
+	if (threadTraces.size() < threadCount) {
+		threadTraces.resize(threadCount);
+	}
+	for (RayTrace& trace : threadTraces) {
+		trace.crossings.clear();
+		trace.arrivals.clear();
+		trace.bottomHits.clear();
+		trace.steps = 0;
+	}
+
+	auto work = [&](uint32_t thread) {
+		const uint32_t firstRay = std::min(fan.rayCount, thread * blockSize);
+		const uint32_t endRay = std::min(fan.rayCount, firstRay + blockSize);
+		RayTrace& trace = threadTraces[thread];
+		trace.steps = TraceRange(environment, fan, grid, settings, receivers ? *receivers : noReceivers, firstRay, endRay, trace);
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t thread = 1; thread < threadCount; ++thread) {
+		workers.emplace_back(work, thread);
+	}
+	work(0);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+
+	result.crossings.clear();
+	result.arrivals.clear();
+	result.bottomHits.clear();
+	result.tracedRays.clear();
+	result.totalSteps = 0;
+	for (uint32_t thread = 0; thread < threadCount; ++thread) {
+		const RayTrace& trace = threadTraces[thread];
+		result.crossings.insert(result.crossings.end(), trace.crossings.begin(), trace.crossings.end());
+		result.arrivals.insert(result.arrivals.end(), trace.arrivals.begin(), trace.arrivals.end());
+		result.bottomHits.insert(result.bottomHits.end(), trace.bottomHits.begin(), trace.bottomHits.end());
+		result.totalSteps += trace.steps;
+	}
+
+	SortResult(result);
+
+	ComputeTransmissionLossInto(fan, grid, result.crossings, settings.minBeamWidth, nullptr, workspace.intensity, result.transmissionLoss);
+}
+
+double SonarPropagation::Sonar::GetRayWeight(const LaunchFan& fan, const std::vector<uint32_t>* tracedRays, uint32_t ray)
+{
+	if (!tracedRays || tracedRays->empty()) {
+		return fan.GetAngleStep();
+	}
+
+	uint32_t previousRay, nextRay;
+	return GetTracedNeighbours(fan, *tracedRays, ray, previousRay, nextRay);
+}
+
+std::vector<float> SonarPropagation::Sonar::ComputeTransmissionLoss(const LaunchFan& fan, const FieldGrid& grid,
+	const std::vector<RayCrossing>& crossings, double minBeamWidth, const std::vector<uint32_t>* tracedRays)
+{
+	std::vector<double> intensity;
+	std::vector<float> transmissionLoss;
+	ComputeTransmissionLossInto(fan, grid, crossings, minBeamWidth, tracedRays, intensity, transmissionLoss);
+	return transmissionLoss;
+}
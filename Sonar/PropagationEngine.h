@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "BottomProfile.h"
+#include "ReceiverGrid.h"
+#include "SoundSpeed.h"
+#include "TrajectoryStore.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Ways the CPU engine can integrate the same fan. All of them must agree with the golden
+		/// references within their tolerances (see Validation/).
+		/// </summary>
+		enum class EngineMode : uint32_t {
+			ScalarDouble,
+			ScalarFloat,
+			Simd,
+			Adaptive,
+			Analytic,
+			Count
+		};
+
+		const char* GetEngineModeName(EngineMode mode);
+
+		/// <summary>
+		/// Parses a name returned by GetEngineModeName(). Returns false if it is unknown.
+		/// </summary>
+		bool ParseEngineMode(const std::string& name, EngineMode& mode);
+
+		/// <summary>
+		/// Water column and its boundaries. Losses are in dB per reflection. A bottom profile, if not
+		/// empty, replaces the flat or sloped bottom given by bottomDepth and bottomSlope.
+		/// </summary>
+		struct Environment {
+			explicit Environment(const SoundSpeedProfile& soundSpeed) : profile(soundSpeed) {}
+
+			SoundSpeedProfile profile;
+			double bottomDepth = 5000.0;
+			double bottomSlope = 0.0;
+			BottomProfile bottomProfile;
+			double bottomLossDb = 0.0;
+			double surfaceLossDb = 0.0;
+		};
+
+		/// <summary>
+		/// Rays launched from one point with evenly spaced angles in degrees, positive downwards.
+		/// </summary>
+		struct LaunchFan {
+			double sourceDepth = 100.0;
+			double minAngle = -20.0;
+			double maxAngle = 20.0;
+			uint32_t rayCount = 101;
+
+			double GetAngleStep() const;
+			double GetLaunchAngle(uint32_t ray) const;
+		};
+
+		/// <summary>
+		/// Receiver columns at ranges (i + 1) * maxRange / rangeCount, each sampled at depthCount cell
+		/// centres. Ray crossings are recorded at every column; transmission loss at every cell.
+		/// </summary>
+		struct FieldGrid {
+			double maxRange = 10000.0;
+			uint32_t rangeCount = 10;
+			double maxDepth = 5000.0;
+			uint32_t depthCount = 50;
+
+			double GetRange(uint32_t column) const { return (column + 1) * maxRange / rangeCount; }
+			double GetDepth(uint32_t row) const { return (row + 0.5) * maxDepth / depthCount; }
+		};
+
+		struct PropagationSettings {
+			EngineMode mode = EngineMode::ScalarDouble;
+			double stepSize = 5.0;
+			// Position error per step allowed by EngineMode::Adaptive, in metres.
+			double tolerance = 0.001;
+			uint32_t maxSteps = 1000000;
+			uint32_t maxBounces = 200;
+			uint32_t threadCount = 1;
+			// Lower limit of the beam width used for transmission loss, in metres.
+			double minBeamWidth = 1.0;
+
+			// Adaptive fan: with refinementLevels > 0 the fan is traced coarse and every interval between
+			// neighbouring rays whose crossings diverge is halved, up to refinementLevels times. Rays are
+			// then numbered on the fan of GetRefinedFan().
+			uint32_t refinementLevels = 0;
+			// Neighbours diverge when a column sees one and not the other, their bounce counts differ,
+			// or their crossings are further apart than these. A depth gap of 0 stands for two cells of
+			// the grid.
+			double refineDepthGap = 0.0;
+			double refineTimeGap = 0.005;
+
+			// Records where rays reflect off the bottom, for hit maps.
+			bool recordBottomHits = false;
+		};
+
+		/// <summary>
+		/// A ray passing a receiver column.
+		/// </summary>
+		struct RayCrossing {
+			uint32_t column;
+			uint32_t ray;
+			double depth;
+			double time;
+			uint32_t surfaceBounces;
+			uint32_t bottomBounces;
+			// Intensity factor of the ray tube: boundary losses and the change of xi at sloped bottoms.
+			double intensity;
+		};
+
+		/// <summary>
+		/// A ray reflecting off the bottom. The intensity factor is the one the ray arrives with, before
+		/// the loss of the reflection.
+		/// </summary>
+		struct BottomHit {
+			uint32_t ray;
+			double range;
+			double depth;
+			double time;
+			double intensity;
+		};
+
+		/// <summary>
+		/// Crossings, arrivals and bottom hits of one ray, and the steps it took to trace.
+		/// </summary>
+		struct RayTrace {
+			uint64_t steps = 0;
+			std::vector<RayCrossing> crossings;
+			std::vector<ReceiverArrival> arrivals;
+			std::vector<BottomHit> bottomHits;
+		};
+
+		struct PropagationResult {
+			// Sorted by column, then ray, whatever the thread count.
+			std::vector<RayCrossing> crossings;
+			// depthCount values per column, column after column, in dB re 1 m.
+			std::vector<float> transmissionLoss;
+			// Sorted by receiver, then ray, then time, whatever the thread count.
+			std::vector<ReceiverArrival> arrivals;
+			// Sorted by ray, then time, if the settings record them.
+			std::vector<BottomHit> bottomHits;
+			// Rays traced by an adaptive fan, in increasing order; empty if every ray of the fan was.
+			std::vector<uint32_t> tracedRays;
+			uint64_t totalSteps = 0;
+		};
+
+		/// <summary>
+		/// Buffers RunPropagation() reuses from one call to the next.
+		/// </summary>
+		struct PropagationWorkspace {
+			std::vector<RayTrace> threadTraces;
+			std::vector<double> intensity;
+		};
+
+		/// <summary>
+		/// Traces the fan through the environment and evaluates crossings and transmission loss on the grid,
+		/// and arrivals at the receivers, if any. Rays are split into contiguous blocks, one per thread,
+		/// each with its own crossings and arrivals, so the result does not depend on the thread count.
+		/// </summary>
+		PropagationResult RunPropagation(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+			const PropagationSettings& settings, const ReceiverGrid* receivers = nullptr);
+
+		/// <summary>
+		/// RunPropagation() into a result and a workspace kept by the caller. Once they have grown to the
+		/// size of the step, repeating it makes no heap allocation on one thread, without receivers and
+		/// without refinement; more threads still start their workers.
+		/// </summary>
+		void RunPropagation(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+			const PropagationSettings& settings, const ReceiverGrid* receivers, PropagationWorkspace& workspace, PropagationResult& result);
+
+		/// <summary>
+		/// The fan whose every 2^levels-th ray is a ray of fan, which an adaptive fan picks its rays from.
+		/// </summary>
+		LaunchFan GetRefinedFan(const LaunchFan& fan, uint32_t levels);
+
+		/// <summary>
+		/// Fills traces[i] for rays[i], a ray of the refined fan; traces has one empty trace per ray.
+		/// </summary>
+		typedef std::function<void(const std::vector<uint32_t>& rays, std::vector<RayTrace>& traces)> WaveTracer;
+
+		/// <summary>
+		/// The adaptive fan of RunPropagation() over any tracer, which gets one wave of rays at a time.
+		/// Seed rays, on the refined fan, are traced in the first wave along with the coarse fan; a
+		/// refinement of a nearby source makes good seeds, since it tends to diverge in the same places.
+		/// </summary>
+		PropagationResult RefineFan(const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings,
+			const std::vector<uint32_t>& seedRays, const WaveTracer& traceWave);
+
+		/// <summary>
+		/// Traces the given rays of the fan, one task per ray on settings.threadCount threads, and keeps
+		/// their paths, up to where they pass the last column, instead of crossings. Returns the number
+		/// of steps.
+		/// </summary>
+		uint64_t TracePaths(const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+			const PropagationSettings& settings, const std::vector<uint32_t>& rays, const PathTolerance& tolerance,
+			std::vector<PathEncoder>& paths);
+
+		/// <summary>
+		/// Crossings, arrivals and, if asked for, bottom hits of a ray from its path, as tracing would
+		/// record them on a grid that ends where the path does, to within the tolerance of the path.
+		/// </summary>
+		void ReplayPath(const RayPath& path, const FieldGrid& grid, const ReceiverGrid& receivers, uint32_t ray, bool bottomHits,
+			RayTrace& trace);
+
+		/// <summary>
+		/// Share of the launch angles a ray stands for, in radians, as ComputeTransmissionLoss() weighs it.
+		/// </summary>
+		double GetRayWeight(const LaunchFan& fan, const std::vector<uint32_t>* tracedRays, uint32_t ray);
+
+		/// <summary>
+		/// Incoherent transmission loss from sorted crossings with geometric Gaussian beams: every ray
+		/// spreads its share of the launch energy over a Gaussian whose width is the distance to the
+		/// neighbouring rays of the same column. If tracedRays is given, only those rays of the fan were
+		/// traced: they are each other's neighbours and every ray stands for the angles halfway to them.
+		/// </summary>
+		std::vector<float> ComputeTransmissionLoss(const LaunchFan& fan, const FieldGrid& grid,
+			const std::vector<RayCrossing>& crossings, double minBeamWidth, const std::vector<uint32_t>* tracedRays = nullptr);
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "SoundSpeed.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Explicit Runge-Kutta tableaus, mirroring SONAR_RK_TABLEAU in SonarConfig.hlsl.
+		/// </summary>
+		enum class Integrator : uint32_t {
+			Euler = 0,
+			Midpoint = 1,
+			Rk4 = 2,
+			// Exact circular arcs where the profile is isovelocity or linear, RK4 elsewhere. CPU only.
+			Analytic = 3
+		};
+
+		/// <summary>
+		/// State of a ray in cylindrical coordinates: range r and depth z (positive downwards) in metres,
+		/// the slowness components xi = cos(theta) / c and zeta = sin(theta) / c, and the travel time tau.
+		/// The same quantities as ray_data in SonarUtils.hlsl, plus the travel time.
+		/// </summary>
+		template <typename Real>
+		struct RayStateT {
+			Real r;
+			Real z;
+			Real xi;
+			Real zeta;
+			Real tau;
+		};
+
+		using RayState = RayStateT<double>;
+		using RayStateF = RayStateT<float>;
+
+		template <typename Real>
+		inline RayStateT<Real> AddScaled(const RayStateT<Real>& a, const RayStateT<Real>& b, Real scale)
+		{
+			return { a.r + b.r * scale, a.z + b.z * scale, a.xi + b.xi * scale, a.zeta + b.zeta * scale, a.tau + b.tau * scale };
+		}
+
+		/// <summary>
+		/// Starts a ray at (r, z) with a launch angle in radians from the horizontal, positive downwards.
+		/// </summary>
+		template <typename Real>
+		inline RayStateT<Real> InitializeRay(const SoundSpeedProfile& profile, Real r, Real z, Real launchAngle)
+		{
+			const Real c = static_cast<Real>(profile.Evaluate(z).c);
+			return { r, z, std::cos(launchAngle) / c, std::sin(launchAngle) / c, Real(0) };
+		}
+
+		/// <summary>
+		/// Right-hand side of the ray equations with arc length s as the parameter:
+		/// dr/ds = c xi, dz/ds = c zeta, dxi/ds = -c_r / c^2, dzeta/ds = -c_z / c^2, dtau/ds = 1 / c.
+		/// </summary>
+		template <typename Real>
+		inline RayStateT<Real> RayDerivative(const SoundSpeedProfile& profile, const RayStateT<Real>& ray)
+		{
+			const SoundSpeedSample sample = profile.Evaluate(ray.z);
+			const Real c = static_cast<Real>(sample.c);
+			const Real inverseC = Real(1) / c;
+
+			return { c * ray.xi, c * ray.zeta, Real(0), -static_cast<Real>(sample.dcdz) * inverseC * inverseC, inverseC };
+		}
+
+		/// <summary>
+		/// Closed form step for a sound speed that is linear in depth, c = c0 + g z: the ray invariant
+		/// xi = cos(theta) / c is constant and the angle turns at dtheta/ds = -g xi, so the path is a
+		/// circular arc and the travel time integrates to (atanh(sin theta0) - atanh(sin theta1)) / g.
+		/// </summary>
+		template <typename Real>
+		inline RayStateT<Real> AnalyticStep(const SoundSpeedProfile& profile, const RayStateT<Real>& ray, Real h)
+		{
+			const SoundSpeedSample sample = profile.Evaluate(ray.z);
+			const Real c = static_cast<Real>(sample.c);
+			const Real g = static_cast<Real>(sample.dcdz);
+			const Real theta0 = std::atan2(ray.zeta, ray.xi);
+			const Real k = g * ray.xi;
+
+			RayStateT<Real> next = ray;
+			if (std::abs(k * h) < Real(1e-7)) {
+				// Straight segment; the midpoint speed keeps the travel time second order in g.
+				const Real sinTheta = std::sin(theta0);
+				next.r += h * std::cos(theta0);
+				next.z += h * sinTheta;
+				next.tau += h / (c + g * Real(0.5) * h * sinTheta);
+				return next;
+			}
+
+			const Real theta1 = theta0 - k * h;
+			next.r += (std::sin(theta0) - std::sin(theta1)) / k;
+			next.z += (std::cos(theta1) - std::cos(theta0)) / k;
+			next.zeta = ray.xi * std::tan(theta1);
+			next.tau += (std::atanh(std::sin(theta0)) - std::atanh(std::sin(theta1))) / g;
+			return next;
+		}
+
+		/// <summary>
+		/// Advances a ray by one arc length step h.
+		/// </summary>
+		template <typename Real>
+		inline RayStateT<Real> IntegrateStep(const SoundSpeedProfile& profile, const RayStateT<Real>& ray, Real h, Integrator integrator = Integrator::Rk4)
+		{
+			switch (integrator) {
+			case Integrator::Analytic:
+				if (profile.GetKind() == SoundSpeedProfile::Kind::Isovelocity || profile.GetKind() == SoundSpeedProfile::Kind::LinearGradient) {
+					return AnalyticStep(profile, ray, h);
+				}
+				return IntegrateStep(profile, ray, h, Integrator::Rk4);
+
+			case Integrator::Euler:
+				return AddScaled(ray, RayDerivative(profile, ray), h);
+
+			case Integrator::Midpoint: {
+				const RayStateT<Real> k1 = RayDerivative(profile, ray);
+				const RayStateT<Real> k2 = RayDerivative(profile, AddScaled(ray, k1, h * Real(0.5)));
+				return AddScaled(ray, k2, h);
+			}
+
+			default: {
+				const RayStateT<Real> k1 = RayDerivative(profile, ray);
+				const RayStateT<Real> k2 = RayDerivative(profile, AddScaled(ray, k1, h * Real(0.5)));
+				const RayStateT<Real> k3 = RayDerivative(profile, AddScaled(ray, k2, h * Real(0.5)));
+				const RayStateT<Real> k4 = RayDerivative(profile, AddScaled(ray, k3, h));
+
+				RayStateT<Real> next = AddScaled(ray, k1, h / Real(6));
+				next = AddScaled(next, k2, h / Real(3));
+				next = AddScaled(next, k3, h / Real(3));
+				return AddScaled(next, k4, h / Real(6));
+			}
+			}
+		}
+	}
+}
@@ -0,0 +1,13 @@
+#include "pch.h"
+#include "RayMarch.h"
+
+const char* SonarPropagation::Sonar::GetRayTerminationName(RayTermination termination)
+{
+	switch (termination) {
+	case RayTermination::MaxSteps:		return "max steps";
+	case RayTermination::MaxRange:		return "max range";
+	case RayTermination::MaxBounces:	return "max bounces";
+	case RayTermination::Stopped:		return "stopped";
+	default:							return "unknown";
+	}
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "BottomProfile.h"
+#include "RayIntegrator.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Limits of a march; the defaults reproduce the constants of SonarConfig.hlsl.
+		/// </summary>
+		struct RayMarchConfig {
+			double stepSize = 1.0;
+			uint32_t maxSteps = 100000;
+			// Bottom depth at range 0 and its slope dz/dr; positive slopes get deeper with range.
+			// A bottom profile, if set, replaces both.
+			double bottomDepth = 6800.0;
+			double bottomSlope = 0.0;
+			const BottomProfile* bottomProfile = nullptr;
+			double maxRange = 100000.0;
+			uint32_t maxBounces = 8;
+			Integrator integrator = Integrator::Rk4;
+
+			// Step doubling error control: a positive tolerance (metres of position error per step)
+			// lets the step size float between the limits, starting at stepSize.
+			double tolerance = 0.0;
+			double minStepSize = 0.05;
+			double maxStepSize = 100.0;
+
+			double BottomDepthAt(double r) const { return bottomProfile ? bottomProfile->DepthAt(r) : bottomDepth + bottomSlope * r; }
+			double BottomSlopeAt(double r) const { return bottomProfile ? bottomProfile->SlopeAt(r) : bottomSlope; }
+		};
+
+		enum class RayTermination : uint32_t {
+			MaxSteps,
+			MaxRange,
+			MaxBounces,
+			Stopped
+		};
+
+		const char* GetRayTerminationName(RayTermination termination);
+
+		template <typename Real>
+		struct RayMarchResultT {
+			RayStateT<Real> state;
+			uint32_t steps = 0;
+			uint32_t surfaceBounces = 0;
+			uint32_t bottomBounces = 0;
+			RayTermination termination = RayTermination::MaxSteps;
+		};
+
+		using RayMarchResult = RayMarchResultT<double>;
+
+		/// <summary>
+		/// Visitor of RayMarch() that looks at nothing.
+		/// </summary>
+		struct NullRayVisitor {
+			template <typename Real>
+			bool operator()(const RayStateT<Real>&, const RayStateT<Real>&, const RayMarchResultT<Real>&) const { return true; }
+		};
+
+		enum class BoundaryHit : uint32_t {
+			None,
+			Surface,
+			Bottom
+		};
+
+		/// <summary>
+		/// Turns the slowness vector of a ray on the bottom back into the water by reflecting it about
+		/// the bottom normal; its length 1 / c does not change. Rays already heading away are left alone.
+		/// </summary>
+		template <typename Real>
+		inline void ReflectOffBottom(const RayMarchConfig& config, RayStateT<Real>& ray)
+		{
+			const double bottomSlope = config.BottomSlopeAt(static_cast<double>(ray.r));
+			if (bottomSlope == 0.0) {
+				ray.zeta = -std::abs(ray.zeta);
+				return;
+			}
+
+			// Unit normal (-slope, 1) / |(-slope, 1)|, pointing into the bottom.
+			const Real slope = static_cast<Real>(bottomSlope);
+			const Real inverseLength = Real(1) / std::sqrt(Real(1) + slope * slope);
+			const Real nr = -slope * inverseLength;
+			const Real nz = inverseLength;
+			const Real dot = ray.xi * nr + ray.zeta * nz;
+			if (dot <= Real(0)) {
+				return;
+			}
+
+			ray.xi -= Real(2) * dot * nr;
+			ray.zeta -= Real(2) * dot * nz;
+		}
+
+		/// <summary>
+		/// Redoes the step from -> next, which left the water, with the length at which the ray meets the
+		/// boundary. clearance(state) is the distance to the boundary, positive in the water. The length
+		/// is found by regula falsi on the step fraction; the chord estimate alone is off by the ray
+		/// curvature, which the adaptive step sizes make noticeable.
+		/// </summary>
+		template <typename Real, typename Clearance>
+		inline RayStateT<Real> StepToBoundary(const SoundSpeedProfile& profile, const RayMarchConfig& config,
+			const RayStateT<Real>& from, const RayStateT<Real>& next, Real h, Clearance clearance)
+		{
+			Real inside = Real(0);
+			Real insideClearance = clearance(from);
+			Real outside = Real(1);
+			Real outsideClearance = clearance(next);
+			RayStateT<Real> landed = next;
+
+			for (int iteration = 0; iteration < 4; ++iteration) {
+				const Real fraction = std::min(outside, std::max(inside,
+					inside + (outside - inside) * insideClearance / (insideClearance - outsideClearance)));
+				landed = IntegrateStep(profile, from, h * fraction, config.integrator);
+
+				const Real remaining = clearance(landed);
+				if (std::abs(remaining) < Real(1e-3)) {
+					break;
+				}
+				if (remaining > Real(0)) {
+					inside = fraction;
+					insideClearance = remaining;
+				}
+				else {
+					outside = fraction;
+					outsideClearance = remaining;
+				}
+			}
+
+			return landed;
+		}
+
+		/// <summary>
+		/// Reflects a step from -> next that left the water: the ray is stepped onto the boundary and its
+		/// direction reflected there. Folding the overshoot back instead would leave
+		/// xi^2 + zeta^2 != 1 / c^2 wherever c varies with depth, and make the error depend on the step size.
+		/// </summary>
+		template <typename Real>
+		inline BoundaryHit ResolveBoundaries(const SoundSpeedProfile& profile, const RayMarchConfig& config,
+			const RayStateT<Real>& from, RayStateT<Real>& next, Real h)
+		{
+			if (next.z < Real(0)) {
+				next = StepToBoundary(profile, config, from, next, h, [](const RayStateT<Real>& ray) { return ray.z; });
+				next.z = Real(0);
+				next.zeta = std::abs(next.zeta);
+				return BoundaryHit::Surface;
+			}
+
+			auto clearance = [&config](const RayStateT<Real>& ray) {
+				return static_cast<Real>(config.BottomDepthAt(static_cast<double>(ray.r))) - ray.z;
+			};
+			if (!(clearance(next) < Real(0))) {
+				return BoundaryHit::None;
+			}
+
+			next = StepToBoundary(profile, config, from, next, h, clearance);
+			next.z = static_cast<Real>(config.BottomDepthAt(static_cast<double>(next.r)));
+			ReflectOffBottom(config, next);
+			return BoundaryHit::Bottom;
+		}
+
+		/// <summary>
+		/// Integrates a ray through the water column between the pressure release surface at z = 0 and the
+		/// bottom, reflecting specularly at both (see ResolveBoundaries()). After every step the visitor
+		/// receives the segment (from, to), which ends on the boundary with the reflected direction when
+		/// the ray hit one, and the bounce counts of the segment, not counting that reflection; returning
+		/// false stops the march.
+		/// </summary>
+		template <typename Real, typename Visitor>
+		RayMarchResultT<Real> RayMarch(const SoundSpeedProfile& profile, const RayStateT<Real>& start, const RayMarchConfig& config, Visitor&& visit)
+		{
+			const Real maxRange = static_cast<Real>(config.maxRange);
+			const bool adaptive = config.tolerance > 0.0;
+			const Real tolerance = static_cast<Real>(config.tolerance);
+			const Real minStep = static_cast<Real>(config.minStepSize);
+			const Real maxStep = static_cast<Real>(config.maxStepSize);
+			Real h = static_cast<Real>(config.stepSize);
+
+			RayMarchResultT<Real> result;
+			result.state = start;
+
+			for (; result.steps < config.maxSteps; ++result.steps) {
+				RayStateT<Real> next;
+				Real taken = h;
+
+				if (!adaptive) {
+					next = IntegrateStep(profile, result.state, h, config.integrator);
+				}
+				else {
+					// Compare one full step with two half steps; keep the more accurate pair.
+					for (;;) {
+						const RayStateT<Real> full = IntegrateStep(profile, result.state, h, config.integrator);
+						const RayStateT<Real> half = IntegrateStep(profile, result.state, h * Real(0.5), config.integrator);
+						next = IntegrateStep(profile, half, h * Real(0.5), config.integrator);
+
+						// A direction error keeps moving the ray after the step; weigh it by the step it
+						// would go on for.
+						const Real directionError = std::abs(full.zeta - next.zeta) * static_cast<Real>(profile.Evaluate(next.z).c) * h;
+						const Real error = std::max(std::max(std::abs(full.r - next.r), std::abs(full.z - next.z)), directionError);
+						if (error > tolerance && h * Real(0.5) >= minStep) {
+							h *= Real(0.5);
+							continue;
+						}
+						taken = h;
+						if (error * Real(32) < tolerance && h * Real(2) <= maxStep) {
+							h *= Real(2);
+						}
+						break;
+					}
+				}
+
+				const BoundaryHit hit = ResolveBoundaries(profile, config, result.state, next, taken);
+				const bool keepGoing = visit(result.state, next, result);
+
+				if (hit == BoundaryHit::Surface) {
+					++result.surfaceBounces;
+				}
+				else if (hit == BoundaryHit::Bottom) {
+					++result.bottomBounces;
+				}
+				result.state = next;
+
+				if (!keepGoing) {
+					++result.steps;
+					result.termination = RayTermination::Stopped;
+					return result;
+				}
+				if (result.surfaceBounces + result.bottomBounces > config.maxBounces) {
+					++result.steps;
+					result.termination = RayTermination::MaxBounces;
+					return result;
+				}
+				if (next.r > maxRange || next.r < Real(0)) {
+					++result.steps;
+					result.termination = RayTermination::MaxRange;
+					return result;
+				}
+			}
+
+			result.termination = RayTermination::MaxSteps;
+			return result;
+		}
+
+		template <typename Real>
+		RayMarchResultT<Real> RayMarch(const SoundSpeedProfile& profile, const RayStateT<Real>& start, const RayMarchConfig& config)
+		{
+			return RayMarch(profile, start, config, NullRayVisitor());
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "RayPacket.h"
+
+#if defined(SONAR_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+void SonarPropagation::Sonar::LoadPacket(RayPacket4& packet, const RayStateF* rays, size_t count)
+{
+	for (size_t lane = 0; lane < RayPacket4::c_width; ++lane) {
+		const RayStateF& ray = rays[lane < count ? lane : count - 1];
+		packet.r[lane] = ray.r;
+		packet.z[lane] = ray.z;
+		packet.xi[lane] = ray.xi;
+		packet.zeta[lane] = ray.zeta;
+		packet.tau[lane] = ray.tau;
+	}
+}
+
+void SonarPropagation::Sonar::StorePacket(const RayPacket4& packet, RayStateF* rays, size_t count)
+{
+	for (size_t lane = 0; lane < count && lane < RayPacket4::c_width; ++lane) {
+		rays[lane] = { packet.r[lane], packet.z[lane], packet.xi[lane], packet.zeta[lane], packet.tau[lane] };
+	}
+}
+
+#if defined(SONAR_SIMD_SSE)
+
+namespace {
+
+	struct PacketRegisters {
+		__m128 r, z, xi, zeta, tau;
+	};
+
+	// dr, dz, dzeta and dtau of every lane; dxi is always zero for range independent profiles.
+	inline PacketRegisters Derivative(const SonarPropagation::Sonar::SoundSpeedProfile& profile, const PacketRegisters& ray)
+	{
+		alignas(16) float depths[4];
+		alignas(16) float speeds[4];
+		alignas(16) float gradients[4];
+		_mm_store_ps(depths, ray.z);
+
+		for (int lane = 0; lane < 4; ++lane) {
+			const SonarPropagation::Sonar::SoundSpeedSample sample = profile.Evaluate(depths[lane]);
+			speeds[lane] = static_cast<float>(sample.c);
+			gradients[lane] = static_cast<float>(sample.dcdz);
+		}
+
+		const __m128 c = _mm_load_ps(speeds);
+		const __m128 inverseC = _mm_div_ps(_mm_set1_ps(1.0f), c);
+		const __m128 gradient = _mm_load_ps(gradients);
+
+		PacketRegisters derivative;
+		derivative.r = _mm_mul_ps(c, ray.xi);
+		derivative.z = _mm_mul_ps(c, ray.zeta);
+		derivative.xi = _mm_setzero_ps();
+		derivative.zeta = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(gradient, _mm_mul_ps(inverseC, inverseC)));
+		derivative.tau = inverseC;
+		return derivative;
+	}
+
+	inline PacketRegisters AddScaled(const PacketRegisters& a, const PacketRegisters& b, __m128 scale)
+	{
+		PacketRegisters result;
+		result.r = _mm_add_ps(a.r, _mm_mul_ps(b.r, scale));
+		result.z = _mm_add_ps(a.z, _mm_mul_ps(b.z, scale));
+		result.xi = _mm_add_ps(a.xi, _mm_mul_ps(b.xi, scale));
+		result.zeta = _mm_add_ps(a.zeta, _mm_mul_ps(b.zeta, scale));
+		result.tau = _mm_add_ps(a.tau, _mm_mul_ps(b.tau, scale));
+		return result;
+	}
+}
+
+void SonarPropagation::Sonar::IntegrateStep4(const SoundSpeedProfile& profile, RayPacket4& packet, float h)
+{
+	PacketRegisters ray;
+	ray.r = _mm_load_ps(packet.r);
+	ray.z = _mm_load_ps(packet.z);
+	ray.xi = _mm_load_ps(packet.xi);
+	ray.zeta = _mm_load_ps(packet.zeta);
+	ray.tau = _mm_load_ps(packet.tau);
+
+	const __m128 half = _mm_set1_ps(h * 0.5f);
+	const __m128 full = _mm_set1_ps(h);
+
+	const PacketRegisters k1 = Derivative(profile, ray);
+	const PacketRegisters k2 = Derivative(profile, AddScaled(ray, k1, half));
+	const PacketRegisters k3 = Derivative(profile, AddScaled(ray, k2, half));
+	const PacketRegisters k4 = Derivative(profile, AddScaled(ray, k3, full));
+
+	const __m128 sixth = _mm_set1_ps(h / 6.0f);
+	const __m128 third = _mm_set1_ps(h / 3.0f);
+	PacketRegisters next = AddScaled(ray, k1, sixth);
+	next = AddScaled(next, k2, third);
+	next = AddScaled(next, k3, third);
+	next = AddScaled(next, k4, sixth);
+
+	_mm_store_ps(packet.r, next.r);
+	_mm_store_ps(packet.z, next.z);
+	_mm_store_ps(packet.xi, next.xi);
+	_mm_store_ps(packet.zeta, next.zeta);
+	_mm_store_ps(packet.tau, next.tau);
+}
+
+#else
+
+void SonarPropagation::Sonar::IntegrateStep4(const SoundSpeedProfile& profile, RayPacket4& packet, float h)
+{
+	RayStateF rays[RayPacket4::c_width];
+	StorePacket(packet, rays, RayPacket4::c_width);
+
+	for (RayStateF& ray : rays) {
+		ray = IntegrateStep(profile, ray, h);
+	}
+
+	LoadPacket(packet, rays, RayPacket4::c_width);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+#include "RayIntegrator.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Four single precision rays in structure-of-arrays form, so one SSE instruction advances the
+		/// same component of every ray. Unused lanes keep integrating whatever they hold; callers
+		/// ignore them when storing.
+		/// </summary>
+		struct alignas(16) RayPacket4 {
+			static const size_t c_width = 4;
+
+			float r[c_width];
+			float z[c_width];
+			float xi[c_width];
+			float zeta[c_width];
+			float tau[c_width];
+		};
+
+		/// <summary>
+		/// Fills the packet from up to four rays; missing lanes repeat the last ray.
+		/// </summary>
+		void LoadPacket(RayPacket4& packet, const RayStateF* rays, size_t count);
+
+		void StorePacket(const RayPacket4& packet, RayStateF* rays, size_t count);
+
+		/// <summary>
+		/// One RK4 step of every lane. Matches IntegrateStep() on each ray up to float rounding; the
+		/// profile is still evaluated per lane, only the arithmetic around it is vectorized.
+		/// Falls back to a scalar loop on targets without SSE.
+		/// </summary>
+		void IntegrateStep4(const SoundSpeedProfile& profile, RayPacket4& packet, float h);
+	}
+}
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "ReceiverGrid.h"
+
+#include <limits>
+#include <stdexcept>
+
+//--------------------------------------------------------------------------------------
+// ReceiverGrid implementation
+
+SonarPropagation::Sonar::ReceiverGrid::ReceiverGrid(std::vector<ReceiverPoint> receivers, double cellSize)
+	: m_receivers(std::move(receivers))
+{
+	if (m_receivers.size() > std::numeric_limits<uint32_t>::max() / 2) {
+		throw std::invalid_argument("ReceiverGrid: too many receivers");
+	}
+
+	for (const ReceiverPoint& receiver : m_receivers) {
+		if (!std::isfinite(receiver.range) || !std::isfinite(receiver.depth) || !std::isfinite(receiver.radius) || receiver.radius < 0.0) {
+			throw std::invalid_argument("ReceiverGrid: receivers need a finite position and a radius of at least 0");
+		}
+		m_maxRadius = std::max(m_maxRadius, receiver.radius);
+	}
+
+	if (!(cellSize > 0.0)) {
+		cellSize = m_maxRadius > 0.0 ? 2.0 * m_maxRadius : 1.0;
+	}
+	m_cellSize = cellSize;
+	m_inverseCellSize = 1.0 / cellSize;
+
+	size_t bucketCount = 1;
+	while (bucketCount < 2 * m_receivers.size()) {
+		bucketCount *= 2;
+	}
+	m_bucketMask = bucketCount - 1;
+
+	// Counting sort of the receivers by bucket.
+	std::vector<size_t> buckets(m_receivers.size());
+	m_bucketStart.assign(bucketCount + 1, 0);
+	for (size_t receiver = 0; receiver < m_receivers.size(); ++receiver) {
+		buckets[receiver] = GetBucket(GetCell(m_receivers[receiver].range), GetCell(m_receivers[receiver].depth));
+		++m_bucketStart[buckets[receiver] + 1];
+	}
+	for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+		m_bucketStart[bucket + 1] += m_bucketStart[bucket];
+	}
+
+	std::vector<uint32_t> next(m_bucketStart.begin(), m_bucketStart.end() - 1);
+	m_entries.resize(m_receivers.size());
+	for (size_t receiver = 0; receiver < m_receivers.size(); ++receiver) {
+		const ReceiverPoint& point = m_receivers[receiver];
+		m_entries[next[buckets[receiver]]++] = { GetCell(point.range), GetCell(point.depth), static_cast<uint32_t>(receiver) };
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// ReceiverCapture implementation
+
+void SonarPropagation::Sonar::ReceiverCapture::AddSegment(double r0, double z0, double tau0, double r1, double z1, double tau1,
+	uint32_t surfaceBounces, uint32_t bottomBounces, double intensity)
+{
+	for (Pass& pass : m_passes) {
+		pass.touched = false;
+	}
+
+	const double dr = r1 - r0;
+	const double dz = z1 - z0;
+	const double lengthSquared = dr * dr + dz * dz;
+	const std::vector<ReceiverPoint>& receivers = m_grid->GetReceivers();
+
+	m_grid->ForEachCandidate(r0, z0, r1, z1, [&](uint32_t receiver) {
+		// Closest point of the segment to the receiver.
+		const ReceiverPoint& point = receivers[receiver];
+		const double t = lengthSquared > 0.0
+			? std::max(0.0, std::min(1.0, ((point.range - r0) * dr + (point.depth - z0) * dz) / lengthSquared)) : 0.0;
+		const double distance = std::hypot(r0 + t * dr - point.range, z0 + t * dz - point.depth);
+		if (distance > point.radius) {
+			return;
+		}
+
+		auto pass = std::find_if(m_passes.begin(), m_passes.end(), [receiver](const Pass& open) { return open.closest.receiver == receiver; });
+		if (pass == m_passes.end()) {
+			Pass opened;
+			opened.closest.receiver = receiver;
+			opened.closest.ray = m_ray;
+			opened.closest.distance = std::numeric_limits<double>::infinity();
+			m_passes.push_back(opened);
+			pass = m_passes.end() - 1;
+		}
+
+		pass->touched = true;
+		if (distance < pass->closest.distance) {
+			pass->closest.time = tau0 + t * (tau1 - tau0);
+			pass->closest.distance = distance;
+			pass->closest.surfaceBounces = surfaceBounces;
+			pass->closest.bottomBounces = bottomBounces;
+			pass->closest.intensity = intensity;
+		}
+	});
+
+	// Passes the segment did not touch are over.
+	auto over = std::partition(m_passes.begin(), m_passes.end(), [](const Pass& pass) { return pass.touched; });
+	for (auto pass = over; pass != m_passes.end(); ++pass) {
+		m_arrivals->push_back(pass->closest);
+	}
+	m_passes.erase(over, m_passes.end());
+}
+
+void SonarPropagation::Sonar::ReceiverCapture::Finish()
+{
+	for (const Pass& pass : m_passes) {
+		m_arrivals->push_back(pass.closest);
+	}
+	m_passes.clear();
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// A receiver in the range-depth plane of a fan. Rays passing within radius of it arrive at it.
+		/// </summary>
+		struct ReceiverPoint {
+			double range;
+			double depth;
+			double radius;
+		};
+
+		/// <summary>
+		/// A ray passing a receiver, at the point of its closest approach.
+		/// </summary>
+		struct ReceiverArrival {
+			uint32_t receiver;
+			uint32_t ray;
+			double time;
+			// Distance of the closest approach, at most the radius of the receiver.
+			double distance;
+			uint32_t surfaceBounces;
+			uint32_t bottomBounces;
+			// Intensity factor of the ray tube, as for RayCrossing.
+			double intensity;
+		};
+
+		/// <summary>
+		/// Receivers hashed into square cells of the range-depth plane, so that a ray step only looks at
+		/// the receivers around it. Every receiver sits in the cell of its centre, and a segment visits the
+		/// cells it crosses widened by the largest radius, row by row; the cells live in an open hash table
+		/// of at least twice as many buckets as receivers, so memory follows the receivers rather than the
+		/// extent of the field.
+		/// </summary>
+		class ReceiverGrid {
+		public:
+			ReceiverGrid() = default;
+
+			/// <summary>
+			/// A cell size of 0 picks twice the largest radius. Throws std::invalid_argument if a receiver
+			/// is not finite or has a negative radius.
+			/// </summary>
+			explicit ReceiverGrid(std::vector<ReceiverPoint> receivers, double cellSize = 0.0);
+
+			bool IsEmpty() const { return m_receivers.empty(); }
+			size_t GetReceiverCount() const { return m_receivers.size(); }
+			const std::vector<ReceiverPoint>& GetReceivers() const { return m_receivers; }
+			double GetCellSize() const { return m_cellSize; }
+
+			/// <summary>
+			/// Calls visit(receiver) once for every receiver whose disc might reach the segment from
+			/// (r0, z0) to (r1, z1). The caller still has to measure the distance.
+			/// </summary>
+			template <typename Visit>
+			void ForEachCandidate(double r0, double z0, double r1, double z1, Visit&& visit) const;
+
+		private:
+			struct Entry {
+				int32_t column;
+				int32_t row;
+				uint32_t receiver;
+			};
+
+			int32_t GetCell(double value) const;
+			size_t GetBucket(int32_t column, int32_t row) const;
+
+			std::vector<ReceiverPoint> m_receivers;
+			// Entries of bucket b are m_entries[m_bucketStart[b]] to m_entries[m_bucketStart[b + 1]].
+			std::vector<uint32_t> m_bucketStart;
+			std::vector<Entry> m_entries;
+			size_t m_bucketMask = 0;
+			double m_cellSize = 1.0;
+			double m_inverseCellSize = 1.0;
+			double m_maxRadius = 0.0;
+		};
+
+		/// <summary>
+		/// Turns the segments of one ray into arrivals. While consecutive segments stay within the radius
+		/// of a receiver the ray is passing it; the pass becomes one arrival, at its closest point, once a
+		/// segment leaves the radius or the ray ends.
+		/// </summary>
+		class ReceiverCapture {
+		public:
+			ReceiverCapture(const ReceiverGrid& grid, uint32_t ray, std::vector<ReceiverArrival>& arrivals)
+				: m_grid(&grid), m_ray(ray), m_arrivals(&arrivals) {}
+
+			/// <summary>
+			/// The segment from (r0, z0) at time tau0 to (r1, z1) at tau1, with the bounce counts and the
+			/// intensity factor of the ray along it.
+			/// </summary>
+			void AddSegment(double r0, double z0, double tau0, double r1, double z1, double tau1,
+				uint32_t surfaceBounces, uint32_t bottomBounces, double intensity);
+
+			/// <summary>
+			/// Ends the passes still open; call once the ray stops.
+			/// </summary>
+			void Finish();
+
+		private:
+			struct Pass {
+				ReceiverArrival closest;
+				bool touched;
+			};
+
+			const ReceiverGrid* m_grid;
+			uint32_t m_ray;
+			std::vector<ReceiverArrival>* m_arrivals;
+			// Receivers the ray is passing; a handful at most, so they are searched linearly.
+			std::vector<Pass> m_passes;
+		};
+
+		inline int32_t ReceiverGrid::GetCell(double value) const
+		{
+			// Clamped well inside int32_t, so loops over cells cannot overflow.
+			const double cell = std::floor(value * m_inverseCellSize);
+			return static_cast<int32_t>(std::max(-1073741824.0, std::min(1073741824.0, cell)));
+		}
+
+		inline size_t ReceiverGrid::GetBucket(int32_t column, int32_t row) const
+		{
+			const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(column)) << 32) | static_cast<uint32_t>(row);
+			uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+			hash ^= hash >> 31;
+			return static_cast<size_t>(hash) & m_bucketMask;
+		}
+
+		template <typename Visit>
+		void ReceiverGrid::ForEachCandidate(double r0, double z0, double r1, double z1, Visit&& visit) const
+		{
+			if (m_receivers.empty()) {
+				return;
+			}
+
+			const double dr = r1 - r0;
+			const double dz = z1 - z0;
+			const int32_t firstRow = GetCell(std::min(z0, z1) - m_maxRadius);
+			const int32_t lastRow = GetCell(std::max(z0, z1) + m_maxRadius);
+
+			for (int32_t row = firstRow; row <= lastRow; ++row) {
+				// The part of the segment within the largest radius of the row, as a span of columns; a
+				// long diagonal step visits a band of cells along it rather than its whole bounding box.
+				double t0 = 0.0;
+				double t1 = 1.0;
+				if (dz != 0.0) {
+					const double top = (row * m_cellSize - m_maxRadius - z0) / dz;
+					const double bottom = ((row + 1) * m_cellSize + m_maxRadius - z0) / dz;
+					t0 = std::max(0.0, std::min(top, bottom));
+					t1 = std::min(1.0, std::max(top, bottom));
+					if (t0 > t1) {
+						continue;
+					}
+				}
+
+				const double ra = r0 + t0 * dr;
+				const double rb = r0 + t1 * dr;
+				const int32_t firstColumn = GetCell(std::min(ra, rb) - m_maxRadius);
+				const int32_t lastColumn = GetCell(std::max(ra, rb) + m_maxRadius);
+				for (int32_t column = firstColumn; column <= lastColumn; ++column) {
+					const size_t bucket = GetBucket(column, row);
+					for (uint32_t entry = m_bucketStart[bucket]; entry < m_bucketStart[bucket + 1]; ++entry) {
+						// Other cells can share the bucket.
+						if (m_entries[entry].column == column && m_entries[entry].row == row) {
+							visit(m_entries[entry].receiver);
+						}
+					}
+				}
+			}
+		}
+	}
+}
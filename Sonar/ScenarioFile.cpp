@@ -0,0 +1,609 @@
+#include "pch.h"
+#include "ScenarioFile.h"
+#include "CastIngest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	const char* c_magic = "sonar-scenario";
+	const int c_version = 1;
+	const double c_degrees = 3.14159265358979323846 / 180.0;
+
+	const char* c_kinds[] = {
+		"mesh", "transform", "material", "instance", "heightfield", "sound_speed", "environment", "source", "receiver", "grid"
+	};
+
+	std::runtime_error EntityError(const ScenarioEntity& entity, const std::string& message) {
+		std::ostringstream stream;
+		stream << "Scenario line " << entity.line << " (" << entity.kind << ' ' << entity.name << "): " << message;
+		return std::runtime_error(stream.str());
+	}
+
+	bool ParseNumber(const std::string& text, double& value) {
+		if (text.empty()) {
+			return false;
+		}
+
+		char* end = nullptr;
+		errno = 0;
+		value = std::strtod(text.c_str(), &end);
+		return errno == 0 && *end == '\0';
+	}
+
+	std::vector<std::string> SplitList(const std::string& text) {
+		std::vector<std::string> items;
+		std::string::size_type begin = 0;
+		while (true) {
+			const std::string::size_type comma = text.find(',', begin);
+			items.push_back(text.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin));
+			if (comma == std::string::npos) {
+				return items;
+			}
+			begin = comma + 1;
+		}
+	}
+
+	const ScenarioEntity* FindSingle(const ScenarioDescription& scenario, const char* kind) {
+		const ScenarioEntity* single = nullptr;
+		for (const ScenarioEntity& entity : scenario.GetEntities()) {
+			if (entity.kind == kind) {
+				if (single) {
+					throw EntityError(entity, std::string("a scenario has at most one ") + kind);
+				}
+				single = &entity;
+			}
+		}
+		return single;
+	}
+
+	template <typename Value>
+	const Value& Lookup(const std::map<std::string, Value>& table, const ScenarioEntity& entity, const char* key, const char* kind) {
+		const std::string name = entity.GetString(key);
+		auto found = table.find(name);
+		if (found == table.end()) {
+			throw EntityError(entity, name.empty() ? std::string("needs ") + key + "=" : std::string("unknown ") + kind + ' ' + name);
+		}
+		return found->second;
+	}
+
+	SoundSpeedProfile MakeProfile(const ScenarioDescription& scenario, const ScenarioEntity& entity) {
+		const std::string profile = entity.GetString("profile", "isovelocity");
+		if (profile == "isovelocity") {
+			return SoundSpeedProfile::Isovelocity(entity.GetDouble("speed", 1500.0));
+		}
+		if (profile == "linear") {
+			return SoundSpeedProfile::LinearGradient(entity.GetDouble("surface_speed", 1500.0), entity.GetDouble("gradient", 0.0));
+		}
+		if (profile == "munk") {
+			return SoundSpeedProfile::Munk(entity.GetDouble("axis_depth", 1300.0), entity.GetDouble("axis_speed", 1500.0),
+				entity.GetDouble("scale_depth", 1300.0), entity.GetDouble("epsilon", 0.00737));
+		}
+		if (profile == "table") {
+			const std::vector<double> depths = entity.GetList("depths");
+			const std::vector<double> speeds = entity.GetList("speeds");
+			if (depths.size() < 2 || depths.size() != speeds.size()) {
+				throw EntityError(entity, "a table needs as many depths as speeds, at least two");
+			}
+			if (!std::is_sorted(depths.begin(), depths.end())) {
+				throw EntityError(entity, "table depths have to be increasing");
+			}
+			return SoundSpeedProfile::FromSamples(depths, speeds, entity.GetDouble("spacing", 1.0));
+		}
+		if (profile == "casts") {
+			CastIngestSettings settings;
+			const std::string formula = entity.GetString("formula", "mackenzie");
+			if (formula != "mackenzie" && formula != "compact_mackenzie") {
+				throw EntityError(entity, "formula is mackenzie or compact_mackenzie");
+			}
+			settings.formula = formula == "mackenzie" ? SoundSpeedFormula::Mackenzie : SoundSpeedFormula::CompactMackenzie;
+			settings.depthSpacing = entity.GetDouble("spacing", settings.depthSpacing);
+			settings.maxDepth = entity.GetDouble("max_depth", settings.maxDepth);
+			settings.rangeBinWidth = entity.GetDouble("bin_width", settings.rangeBinWidth);
+			settings.defaultSalinity = entity.GetDouble("salinity", settings.defaultSalinity);
+
+			// The engine is range independent: it takes the profile at the range of the source.
+			try {
+				return LoadCasts(scenario.ResolvePath(entity.GetString("file")), settings).GetProfileAt(entity.GetDouble("range", 0.0));
+			}
+			catch (const std::exception& exception) {
+				throw EntityError(entity, exception.what());
+			}
+		}
+		throw EntityError(entity, "unknown profile " + profile);
+	}
+
+	std::vector<std::string> GetInstanceOrder(const ScenarioDescription& scenario) {
+		std::vector<std::string> names;
+		for (const ScenarioEntity& entity : scenario.GetEntities()) {
+			if (entity.kind == "instance") {
+				names.push_back(entity.name);
+			}
+		}
+		// Heightfields come after the instances, with names of their own.
+		for (const ScenarioEntity& entity : scenario.GetEntities()) {
+			if (entity.kind == "heightfield") {
+				names.push_back("heightfield " + entity.name);
+			}
+		}
+		return names;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// ScenarioEntity implementation
+
+std::string SonarPropagation::Sonar::ScenarioEntity::GetString(const std::string& key, const std::string& fallback) const
+{
+	auto found = values.find(key);
+	return found == values.end() ? fallback : found->second;
+}
+
+double SonarPropagation::Sonar::ScenarioEntity::GetDouble(const std::string& key, double fallback) const
+{
+	auto found = values.find(key);
+	if (found == values.end()) {
+		return fallback;
+	}
+
+	double value;
+	if (!ParseNumber(found->second, value)) {
+		throw EntityError(*this, key + " is not a number");
+	}
+	return value;
+}
+
+uint32_t SonarPropagation::Sonar::ScenarioEntity::GetUInt(const std::string& key, uint32_t fallback) const
+{
+	const double value = GetDouble(key, fallback);
+	if (value < 0.0 || value > 4294967295.0 || value != static_cast<double>(static_cast<uint32_t>(value))) {
+		throw EntityError(*this, key + " is not a count");
+	}
+	return static_cast<uint32_t>(value);
+}
+
+Vector3 SonarPropagation::Sonar::ScenarioEntity::GetVector(const std::string& key, const Vector3& fallback) const
+{
+	if (!Has(key)) {
+		return fallback;
+	}
+
+	const std::vector<double> list = GetList(key);
+	if (list.size() != 3) {
+		throw EntityError(*this, key + " needs three values");
+	}
+	return { list[0], list[1], list[2] };
+}
+
+std::vector<double> SonarPropagation::Sonar::ScenarioEntity::GetList(const std::string& key) const
+{
+	std::vector<double> list;
+	auto found = values.find(key);
+	if (found == values.end()) {
+		return list;
+	}
+
+	for (const std::string& item : SplitList(found->second)) {
+		double value;
+		if (!ParseNumber(item, value)) {
+			throw EntityError(*this, key + " has a value that is not a number");
+		}
+		list.push_back(value);
+	}
+	return list;
+}
+
+//--------------------------------------------------------------------------------------
+// ScenarioDescription implementation
+
+ScenarioDescription SonarPropagation::Sonar::ScenarioDescription::Parse(std::istream& stream, const std::string& source)
+{
+	ScenarioDescription scenario;
+	scenario.m_source = source;
+
+	auto error = [&](uint32_t line, const std::string& message) {
+		std::ostringstream text;
+		text << source << " line " << line << ": " << message;
+		return std::runtime_error(text.str());
+	};
+
+	std::string text;
+	uint32_t lineNumber = 0;
+	bool headerRead = false;
+	while (std::getline(stream, text)) {
+		++lineNumber;
+
+		const std::string::size_type comment = text.find('#');
+		if (comment != std::string::npos) {
+			text.erase(comment);
+		}
+
+		std::istringstream line(text);
+		std::string kind;
+		if (!(line >> kind)) {
+			continue;
+		}
+
+		if (!headerRead) {
+			int version = 0;
+			if (kind != c_magic || !(line >> version) || version != c_version) {
+				throw error(lineNumber, "not a version 1 scenario");
+			}
+			headerRead = true;
+			continue;
+		}
+
+		if (std::find_if(std::begin(c_kinds), std::end(c_kinds), [&](const char* known) { return kind == known; }) == std::end(c_kinds)) {
+			throw error(lineNumber, "unknown kind " + kind);
+		}
+
+		ScenarioEntity entity;
+		entity.kind = kind;
+		entity.line = lineNumber;
+		if (!(line >> entity.name) || entity.name.find('=') != std::string::npos) {
+			throw error(lineNumber, kind + " needs a name");
+		}
+
+		std::string pair;
+		while (line >> pair) {
+			const std::string::size_type equals = pair.find('=');
+			if (equals == std::string::npos || equals == 0) {
+				throw error(lineNumber, "expected key=value, got " + pair);
+			}
+			if (!entity.values.insert({ pair.substr(0, equals), pair.substr(equals + 1) }).second) {
+				throw error(lineNumber, "duplicate key " + pair.substr(0, equals));
+			}
+		}
+
+		if (!scenario.m_index.insert({ { entity.kind, entity.name }, scenario.m_entities.size() }).second) {
+			throw error(lineNumber, "duplicate " + kind + ' ' + entity.name);
+		}
+		scenario.m_entities.push_back(std::move(entity));
+	}
+
+	if (!headerRead) {
+		throw error(lineNumber, "scenario is empty");
+	}
+	return scenario;
+}
+
+ScenarioDescription SonarPropagation::Sonar::ScenarioDescription::Load(const std::string& filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	return Parse(file, filename);
+}
+
+const ScenarioEntity* SonarPropagation::Sonar::ScenarioDescription::Find(const std::string& kind, const std::string& name) const
+{
+	auto found = m_index.find({ kind, name });
+	return found == m_index.end() ? nullptr : &m_entities[found->second];
+}
+
+std::string SonarPropagation::Sonar::ScenarioDescription::ResolvePath(const std::string& path) const
+{
+	const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+	const std::string::size_type slash = m_source.find_last_of("/\\");
+	if (absolute || slash == std::string::npos) {
+		return path;
+	}
+	return m_source.substr(0, slash + 1) + path;
+}
+
+//--------------------------------------------------------------------------------------
+
+ScenarioChanges SonarPropagation::Sonar::DiffScenarios(const ScenarioDescription& before, const ScenarioDescription& after)
+{
+	ScenarioChanges changes;
+
+	auto compare = [&](const ScenarioDescription& from, const ScenarioDescription& to, bool removal) {
+		for (const ScenarioEntity& entity : from.GetEntities()) {
+			const ScenarioEntity* other = to.Find(entity.kind, entity.name);
+			if (other && (removal || entity.SameDefinition(*other))) {
+				continue;
+			}
+
+			if (entity.kind == "mesh") {
+				// A mesh nothing uses costs nothing; one in use changes its instances too.
+				if (other) {
+					changes.meshes.push_back(entity.name);
+				}
+			}
+			else if (entity.kind == "transform") {
+				changes.transformsChanged = true;
+			}
+			else if (entity.kind == "instance") {
+				if (!other || entity.GetString("mesh") != other->GetString("mesh") || entity.GetString("type") != other->GetString("type")) {
+					changes.instancesChanged = true;
+				}
+				if (other && entity.GetString("transform") != other->GetString("transform")) {
+					changes.transformsChanged = true;
+				}
+				if (other && entity.GetString("material") != other->GetString("material")) {
+					changes.acousticsChanged = true;
+				}
+			}
+			else if (entity.kind == "heightfield") {
+				// Every heightfield is its own instance; a new grid keeps the instance but needs a new BLAS.
+				if (!other) {
+					changes.instancesChanged = true;
+				}
+				else if (entity.GetString("file") != other->GetString("file")) {
+					changes.meshes.push_back(entity.name);
+				}
+				if (other && entity.GetString("transform") != other->GetString("transform")) {
+					changes.transformsChanged = true;
+				}
+			}
+			else {
+				changes.acousticsChanged = true;
+			}
+		}
+	};
+
+	// Changed and added entities, then removed ones.
+	compare(after, before, false);
+	compare(before, after, true);
+
+	// Instance order is the order of the TLAS instances and of the hit group records.
+	if (GetInstanceOrder(before) != GetInstanceOrder(after)) {
+		changes.instancesChanged = true;
+	}
+
+	return changes;
+}
+
+ScenarioModel SonarPropagation::Sonar::BuildScenarioModel(const ScenarioDescription& scenario, MeshLibrary& library,
+	const std::vector<std::string>& reloadMeshes)
+{
+	ScenarioModel model;
+	std::map<std::string, SoundSpeedProfile> profiles;
+
+	for (const ScenarioEntity& entity : scenario.GetEntities()) {
+		if (entity.kind == "material") {
+			model.materials[entity.name].lossDb = entity.GetDouble("loss_db", 0.0);
+		}
+		else if (entity.kind == "mesh") {
+			size_t meshIndex;
+			if (entity.Has("file")) {
+				const std::string path = scenario.ResolvePath(entity.GetString("file"));
+				const bool reload = std::find(reloadMeshes.begin(), reloadMeshes.end(), entity.name) != reloadMeshes.end();
+				try {
+					meshIndex = reload ? library.ReloadWavefront(path) : library.LoadWavefront(path);
+				}
+				catch (const std::exception& exception) {
+					throw EntityError(entity, exception.what());
+				}
+			}
+			else if (entity.GetString("builtin") == "quad") {
+				// The quad of GetQuadVertices(1, 1): a unit square in the XZ plane facing +y.
+				if (!library.FindMesh("builtin:quad", meshIndex)) {
+					meshIndex = library.LoadPredefined(
+						{ { 0.5f, 0.0f, 0.5f }, { -0.5f, 0.0f, 0.5f }, { -0.5f, 0.0f, -0.5f }, { 0.5f, 0.0f, -0.5f } },
+						{ 0, 1, 2, 2, 3, 0 }, "builtin:quad");
+				}
+			}
+			else {
+				throw EntityError(entity, "needs file= or builtin=quad");
+			}
+			model.meshes[entity.name] = meshIndex;
+		}
+		else if (entity.kind == "transform") {
+			SceneTransform transform;
+			if (entity.Has("parent")) {
+				auto parent = model.transforms.find(entity.GetString("parent"));
+				if (parent == model.transforms.end()) {
+					throw EntityError(entity, "parent " + entity.GetString("parent") + " has to be declared before");
+				}
+				transform.parent = static_cast<int32_t>(parent->second);
+			}
+
+			const Vector3 rotation = entity.GetVector("rotation", { 0.0, 0.0, 0.0 });
+			transform.position = entity.GetVector("position", transform.position);
+			transform.rotation = { rotation.x * c_degrees, rotation.y * c_degrees, rotation.z * c_degrees };
+			transform.scale = entity.GetVector("scale", transform.scale);
+			model.transforms[entity.name] = model.scene.AddTransform(transform);
+		}
+		else if (entity.kind == "sound_speed") {
+			profiles.insert({ entity.name, MakeProfile(scenario, entity) });
+		}
+	}
+
+	// Everything below only refers to the entities above, wherever they were declared.
+	for (const ScenarioEntity& entity : scenario.GetEntities()) {
+		if (entity.kind == "instance") {
+			const std::string type = entity.GetString("type", "boundary");
+			if (type != "boundary" && type != "object") {
+				throw EntityError(entity, "type is boundary or object");
+			}
+
+			ReflectorModel reflector;
+			reflector.mesh = Lookup(model.meshes, entity, "mesh", "mesh");
+			reflector.transform = Lookup(model.transforms, entity, "transform", "transform");
+			reflector.type = type == "boundary" ? ObjectType::Boundary : ObjectType::Object;
+			model.scene.AddObject(reflector);
+			model.objectNames.push_back(entity.name);
+			model.objectMaterials.push_back(entity.Has("material") ? Lookup(model.materials, entity, "material", "material") : AcousticMaterial());
+		}
+		else if (entity.kind == "heightfield") {
+			if (!entity.Has("file")) {
+				throw EntityError(entity, "needs file=");
+			}
+
+			const std::string path = scenario.ResolvePath(entity.GetString("file"));
+			const bool reload = std::find(reloadMeshes.begin(), reloadMeshes.end(), entity.name) != reloadMeshes.end();
+			HeightfieldModel heightfield;
+			try {
+				heightfield.heightfield = reload ? library.ReloadHeightfield(path) : library.LoadHeightfield(path);
+			}
+			catch (const std::exception& exception) {
+				throw EntityError(entity, exception.what());
+			}
+			heightfield.transform = Lookup(model.transforms, entity, "transform", "transform");
+			model.scene.AddHeightfield(heightfield);
+			model.heightfields[entity.name] = heightfield.heightfield;
+			model.heightfieldNames.push_back(entity.name);
+		}
+		else if (entity.kind == "receiver") {
+			SoundReceiverModel receiver;
+			receiver.transform = Lookup(model.transforms, entity, "transform", "transform");
+			receiver.name = entity.name;
+			receiver.radius = entity.GetDouble("radius", receiver.radius);
+			if (!(receiver.radius >= 0.0)) {
+				throw EntityError(entity, "radius cannot be negative");
+			}
+			model.scene.AddSoundReceiver(receiver);
+		}
+	}
+
+	if (const ScenarioEntity* environment = FindSingle(scenario, "environment")) {
+		if (environment->Has("sound_speed")) {
+			model.environment.profile = Lookup(profiles, *environment, "sound_speed", "sound_speed");
+		}
+		else if (!profiles.empty()) {
+			model.environment.profile = profiles.begin()->second;
+		}
+
+		model.environment.bottomDepth = environment->GetDouble("bottom_depth", model.environment.bottomDepth);
+		model.environment.bottomSlope = environment->GetDouble("bottom_slope", model.environment.bottomSlope);
+		if (environment->Has("bottom_material")) {
+			model.environment.bottomLossDb = Lookup(model.materials, *environment, "bottom_material", "material").lossDb;
+		}
+		if (environment->Has("surface_material")) {
+			model.environment.surfaceLossDb = Lookup(model.materials, *environment, "surface_material", "material").lossDb;
+		}
+	}
+	else if (!profiles.empty()) {
+		model.environment.profile = profiles.begin()->second;
+	}
+
+	model.grid.maxDepth = model.environment.bottomDepth;
+	if (const ScenarioEntity* grid = FindSingle(scenario, "grid")) {
+		model.grid.maxRange = grid->GetDouble("max_range", model.grid.maxRange);
+		model.grid.rangeCount = std::max(1u, grid->GetUInt("ranges", model.grid.rangeCount));
+		model.grid.maxDepth = grid->GetDouble("max_depth", model.grid.maxDepth);
+		model.grid.depthCount = std::max(1u, grid->GetUInt("depths", model.grid.depthCount));
+	}
+
+	// Sources take their depth from the hierarchy, so they come once every transform is known.
+	const std::vector<Matrix4x3> world = model.scene.ComputeWorldTransforms();
+	for (const ScenarioEntity& entity : scenario.GetEntities()) {
+		if (entity.kind != "source") {
+			continue;
+		}
+
+		SoundSourceModel source;
+		source.transform = Lookup(model.transforms, entity, "transform", "transform");
+		source.name = entity.name;
+		source.bearing = entity.GetDouble("bearing", 0.0) * c_degrees;
+		source.frequency = entity.GetDouble("frequency", 0.0);
+		if (source.frequency < 0.0) {
+			throw EntityError(entity, "frequency cannot be negative");
+		}
+
+		const std::vector<double> angles = entity.GetList("angles");
+		if (!angles.empty() && angles.size() != 2) {
+			throw EntityError(entity, "angles needs a minimum and a maximum");
+		}
+		if (angles.size() == 2) {
+			source.fan.minAngle = angles[0];
+			source.fan.maxAngle = angles[1];
+		}
+		source.fan.rayCount = std::max(1u, entity.GetUInt("rays", source.fan.rayCount));
+		source.fan.sourceDepth = -world[source.transform].TransformPoint(Vector3{ 0.0, 0.0, 0.0 }).y;
+		model.scene.AddSoundSource(source);
+	}
+
+	return model;
+}
+
+//--------------------------------------------------------------------------------------
+// ScenarioWatcher implementation
+
+bool SonarPropagation::Sonar::ScenarioWatcher::Poll(const ScenarioDescription& current, ScenarioDescription& next, ScenarioChanges& changes)
+{
+	changes = ScenarioChanges();
+
+	const FileStamp stamp = GetStamp(m_filename);
+	const bool scenarioModified = m_polled ? !(stamp == m_scenarioStamp) : stamp.exists;
+	m_polled = true;
+	m_scenarioStamp = stamp;
+
+	if (scenarioModified) {
+		if (!stamp.exists) {
+			m_lastError = m_filename + " was removed; keeping the scenario";
+			return false;
+		}
+
+		try {
+			next = ScenarioDescription::Load(m_filename);
+		}
+		catch (const std::exception& exception) {
+			m_lastError = exception.what();
+			return false;
+		}
+
+		m_lastError.clear();
+		changes = DiffScenarios(current, next);
+	}
+
+	// Mesh, heightfield and cast files are only compared with the stamps taken at the previous poll, so a file that
+	// is new to the scenario is not reported twice.
+	const ScenarioDescription& scenario = scenarioModified ? next : current;
+	std::map<std::string, FileStamp> fileStamps;
+	for (const ScenarioEntity& entity : scenario.GetEntities()) {
+		if ((entity.kind != "mesh" && entity.kind != "heightfield" && entity.kind != "sound_speed") || !entity.Has("file")) {
+			continue;
+		}
+
+		const std::string path = scenario.ResolvePath(entity.GetString("file"));
+		auto inserted = fileStamps.insert({ path, FileStamp() });
+		if (inserted.second) {
+			inserted.first->second = GetStamp(path);
+		}
+
+		auto previous = m_fileStamps.find(path);
+		if (previous == m_fileStamps.end() || previous->second == inserted.first->second) {
+			continue;
+		}
+		if (entity.kind == "sound_speed") {
+			changes.acousticsChanged = true;
+		}
+		else if (std::find(changes.meshes.begin(), changes.meshes.end(), entity.name) == changes.meshes.end()) {
+			changes.meshes.push_back(entity.name);
+		}
+	}
+	m_fileStamps.swap(fileStamps);
+
+	if (!scenarioModified) {
+		if (changes.IsEmpty()) {
+			return false;
+		}
+		next = current;
+	}
+
+	return !changes.IsEmpty();
+}
+
+ScenarioWatcher::FileStamp SonarPropagation::Sonar::ScenarioWatcher::GetStamp(const std::string& filename)
+{
+	FileStamp stamp;
+	struct stat status;
+	if (stat(filename.c_str(), &status) == 0) {
+		stamp.exists = true;
+		stamp.modified = status.st_mtime;
+		stamp.size = static_cast<int64_t>(status.st_size);
+	}
+	return stamp;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PropagationEngine.h"
+#include "SceneModel.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// One line of a scenario file: "kind name key=value ...". Values are kept as text so that two
+		/// versions of a file can be compared entity by entity.
+		/// </summary>
+		struct ScenarioEntity {
+			std::string kind;
+			std::string name;
+			std::map<std::string, std::string> values;
+			uint32_t line = 0;
+
+			bool Has(const std::string& key) const { return values.count(key) != 0; }
+			std::string GetString(const std::string& key, const std::string& fallback = std::string()) const;
+
+			// The getters below throw std::runtime_error naming the line if a value does not parse.
+			double GetDouble(const std::string& key, double fallback) const;
+			uint32_t GetUInt(const std::string& key, uint32_t fallback) const;
+			Vector3 GetVector(const std::string& key, const Vector3& fallback) const;
+			std::vector<double> GetList(const std::string& key) const;
+
+			bool SameDefinition(const ScenarioEntity& other) const { return values == other.values; }
+		};
+
+		/// <summary>
+		/// Parsed scenario file. The format is line based:
+		///
+		///   sonar-scenario 1
+		///   mesh       seamount  file=seamount.obj          (or builtin=quad: unit square in XZ)
+		///   transform  world
+		///   transform  seabed    parent=world position=0,-1000,0 rotation=0,0,0 scale=1,1,1
+		///   material   sand      loss_db=1.5
+		///   instance   floor     mesh=seamount transform=seabed type=boundary material=sand
+		///   heightfield survey   file=survey.asc transform=seabed   (ESRI ASCII grid, always a boundary)
+		///   sound_speed water    profile=munk               (isovelocity, linear, munk, table or casts)
+		///   sound_speed survey   profile=casts file=survey.casts range=0 spacing=5 max_depth=5000
+		///   environment ocean    sound_speed=water bottom_depth=1000 bottom_material=sand
+		///   source     ping      transform=sonar bearing=0 angles=-20,20 rays=101 frequency=3500
+		///   receiver   hydrophone transform=buoy radius=10   (rays within radius arrive at it)
+		///   grid       field     max_range=10000 ranges=10 max_depth=1000 depths=50
+		///
+		/// Angles are in degrees, lengths in metres, frequencies in Hz. '#' starts a comment. Names are unique per kind,
+		/// and transforms have to be declared after their parent.
+		/// </summary>
+		class ScenarioDescription {
+		public:
+			/// <summary>
+			/// Parses a scenario. source names it in error messages and is the directory mesh files are
+			/// relative to. Throws std::runtime_error naming the line of the first error.
+			/// </summary>
+			static ScenarioDescription Parse(std::istream& stream, const std::string& source);
+
+			static ScenarioDescription Load(const std::string& filename);
+
+			const std::vector<ScenarioEntity>& GetEntities() const { return m_entities; }
+			const ScenarioEntity* Find(const std::string& kind, const std::string& name) const;
+			const std::string& GetSource() const { return m_source; }
+
+			/// <summary>
+			/// A path given in the scenario, relative to the directory of the scenario file unless absolute.
+			/// </summary>
+			std::string ResolvePath(const std::string& path) const;
+
+		private:
+			std::string m_source;
+			std::vector<ScenarioEntity> m_entities;
+			std::map<std::pair<std::string, std::string>, size_t> m_index;
+		};
+
+		/// <summary>
+		/// What a new version of a scenario changes, in terms of the work each consumer has to redo.
+		/// </summary>
+		struct ScenarioChanges {
+			// Meshes and heightfields whose definition or file changed: their geometry is reloaded and
+			// their BLAS rebuilt.
+			std::vector<std::string> meshes;
+			// Instances or heightfields were added, removed or moved to another mesh: TLAS rebuild and a
+			// new SBT layout.
+			bool instancesChanged = false;
+			// Only transforms moved: the TLAS is refitted.
+			bool transformsChanged = false;
+			// Materials, sound speed, environment, sources, receivers or the grid: nothing on the GPU.
+			bool acousticsChanged = false;
+
+			bool IsEmpty() const { return meshes.empty() && !instancesChanged && !transformsChanged && !acousticsChanged; }
+		};
+
+		ScenarioChanges DiffScenarios(const ScenarioDescription& before, const ScenarioDescription& after);
+
+		struct AcousticMaterial {
+			// Loss per reflection in dB.
+			double lossDb = 0.0;
+		};
+
+		/// <summary>
+		/// A scenario resolved into a SceneModel plus what the CPU engine needs to propagate it.
+		/// </summary>
+		struct ScenarioModel {
+			SceneModel scene;
+			// Scenario names of meshes, transforms and instances, mapped to library and scene indices.
+			std::map<std::string, size_t> meshes;
+			std::map<std::string, size_t> transforms;
+			std::vector<std::string> objectNames;
+			// Library indices of the heightfields, and their names in scene order.
+			std::map<std::string, size_t> heightfields;
+			std::vector<std::string> heightfieldNames;
+			std::vector<AcousticMaterial> objectMaterials;
+			std::map<std::string, AcousticMaterial> materials;
+
+			Environment environment = Environment(SoundSpeedProfile::Isovelocity(1500.0));
+			FieldGrid grid;
+		};
+
+		/// <summary>
+		/// Resolves a scenario against a mesh library. Meshes and heightfields already in the library are
+		/// shared rather than loaded again, except those listed in reloadMeshes, whose files are parsed anew.
+		/// Throws std::runtime_error on unknown references or meshes that cannot be loaded.
+		/// </summary>
+		ScenarioModel BuildScenarioModel(const ScenarioDescription& scenario, MeshLibrary& library,
+			const std::vector<std::string>& reloadMeshes = std::vector<std::string>());
+
+		/// <summary>
+		/// Polls a scenario file and the mesh, heightfield and cast files it references for modifications.
+		/// </summary>
+		class ScenarioWatcher {
+		public:
+			explicit ScenarioWatcher(std::string filename) : m_filename(std::move(filename)) {}
+
+			/// <summary>
+			/// Returns true if the scenario file or a file it references changed since the last call and the
+			/// scenario still parses; next then holds it and changes what it changes against current.
+			/// A scenario that does not parse is skipped until it is modified again, see GetLastError().
+			/// The first call reports the file if it exists.
+			/// </summary>
+			bool Poll(const ScenarioDescription& current, ScenarioDescription& next, ScenarioChanges& changes);
+
+			const std::string& GetFilename() const { return m_filename; }
+			const std::string& GetLastError() const { return m_lastError; }
+
+		private:
+			struct FileStamp {
+				bool exists = false;
+				time_t modified = 0;
+				int64_t size = 0;
+
+				bool operator==(const FileStamp& other) const {
+					return exists == other.exists && modified == other.modified && size == other.size;
+				}
+			};
+
+			static FileStamp GetStamp(const std::string& filename);
+
+			std::string m_filename;
+			bool m_polled = false;
+			FileStamp m_scenarioStamp;
+			std::map<std::string, FileStamp> m_fileStamps;
+			std::string m_lastError;
+		};
+	}
+}
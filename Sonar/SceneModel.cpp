@@ -0,0 +1,648 @@
+#include "pch.h"
+#include "SceneModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// The app compiles the loader into ObjectLibrary.cpp; the console tools get it from here.
+#ifdef __cplusplus_winrt
+#undef TINYOBJLOADER_IMPLEMENTATION
+#elif !defined(TINYOBJLOADER_IMPLEMENTATION)
+#define TINYOBJLOADER_IMPLEMENTATION
+#endif
+#include "../Common/thirdparty/tiny_obj_loader.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	void ComputeBounds(MeshData& mesh) {
+		if (mesh.positions.empty()) {
+			return;
+		}
+
+		mesh.boundsMin = mesh.boundsMax = mesh.positions[0];
+		for (const Float3& p : mesh.positions) {
+			mesh.boundsMin = { std::min(mesh.boundsMin.x, p.x), std::min(mesh.boundsMin.y, p.y), std::min(mesh.boundsMin.z, p.z) };
+			mesh.boundsMax = { std::max(mesh.boundsMax.x, p.x), std::max(mesh.boundsMax.y, p.y), std::max(mesh.boundsMax.z, p.z) };
+		}
+	}
+
+	void ValidateIndices(const std::vector<Float3>& positions, const std::vector<uint32_t>& indices) {
+		if (indices.size() % 3 != 0) {
+			throw std::invalid_argument("MeshLibrary: index count is not a multiple of three");
+		}
+		for (uint32_t index : indices) {
+			if (index >= positions.size()) {
+				throw std::invalid_argument("MeshLibrary: index outside the vertex array");
+			}
+		}
+	}
+
+	const char c_lodMagic[4] = { 'S', 'P', 'M', 'L' };
+	const uint32_t c_lodVersion = 1;
+
+	bool ReadFile(const std::string& filename, std::string& contents) {
+		std::ifstream file(filename.c_str(), std::ios::binary);
+		if (!file) {
+			return false;
+		}
+
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		contents = stream.str();
+		return true;
+	}
+
+	// FNV-1a of the source file and of every setting the chain depends on.
+	uint64_t HashLodSource(const std::string& contents, const SimplifySettings& settings) {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		auto update = [&hash](const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+			}
+		};
+
+		update(contents.data(), contents.size());
+		update(&settings.reduction, sizeof(settings.reduction));
+		update(&settings.minTriangles, sizeof(settings.minTriangles));
+		update(&settings.maxLevels, sizeof(settings.maxLevels));
+		update(&settings.chunkTriangles, sizeof(settings.chunkTriangles));
+		return hash;
+	}
+
+	template <typename T>
+	void WriteArray(std::ostream& stream, const std::vector<T>& values) {
+		const uint64_t count = values.size();
+		stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		stream.write(reinterpret_cast<const char*>(values.data()), count * sizeof(T));
+	}
+
+	template <typename T>
+	bool ReadValue(const std::string& contents, size_t& offset, T& value) {
+		if (contents.size() - offset < sizeof(T)) {
+			return false;
+		}
+		memcpy(&value, contents.data() + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	template <typename T>
+	bool ReadArray(const std::string& contents, size_t& offset, std::vector<T>& values) {
+		uint64_t count;
+		if (!ReadValue(contents, offset, count) || count > (contents.size() - offset) / sizeof(T)) {
+			return false;
+		}
+		values.resize(static_cast<size_t>(count));
+		memcpy(values.data(), contents.data() + offset, values.size() * sizeof(T));
+		offset += values.size() * sizeof(T);
+		return true;
+	}
+
+	// Truncated, outdated or foreign caches are misses and get overwritten.
+	bool ReadLodCache(const std::string& path, uint64_t key, MeshData& mesh) {
+		std::string contents;
+		if (!ReadFile(path, contents) || contents.size() < sizeof(c_lodMagic) || memcmp(contents.data(), c_lodMagic, sizeof(c_lodMagic)) != 0) {
+			return false;
+		}
+
+		size_t offset = sizeof(c_lodMagic);
+		uint32_t version, levelCount;
+		uint64_t cachedKey;
+		if (!ReadValue(contents, offset, version) || version != c_lodVersion ||
+			!ReadValue(contents, offset, cachedKey) || cachedKey != key ||
+			!ReadArray(contents, offset, mesh.positions) || !ReadArray(contents, offset, mesh.indices) ||
+			!ReadValue(contents, offset, levelCount)) {
+			return false;
+		}
+
+		mesh.lods.resize(levelCount);
+		for (MeshLevel& level : mesh.lods) {
+			if (!ReadValue(contents, offset, level.error) || !ReadArray(contents, offset, level.positions) || !ReadArray(contents, offset, level.indices)) {
+				return false;
+			}
+		}
+		return offset == contents.size();
+	}
+
+	void WriteLodCache(const std::string& path, uint64_t key, const MeshData& mesh) {
+		// Written to a temporary file first, so readers never see a partial cache.
+		std::ostringstream suffix;
+		suffix << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+		const std::string temporaryPath = path + suffix.str();
+
+		{
+			std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+			if (!file) {
+				return;
+			}
+
+			const uint32_t levelCount = static_cast<uint32_t>(mesh.lods.size());
+			file.write(c_lodMagic, sizeof(c_lodMagic));
+			file.write(reinterpret_cast<const char*>(&c_lodVersion), sizeof(c_lodVersion));
+			file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+			WriteArray(file, mesh.positions);
+			WriteArray(file, mesh.indices);
+			file.write(reinterpret_cast<const char*>(&levelCount), sizeof(levelCount));
+			for (const MeshLevel& level : mesh.lods) {
+				file.write(reinterpret_cast<const char*>(&level.error), sizeof(level.error));
+				WriteArray(file, level.positions);
+				WriteArray(file, level.indices);
+			}
+			if (!file) {
+				file.close();
+				std::remove(temporaryPath.c_str());
+				return;
+			}
+		}
+
+		// rename() does not replace an existing file everywhere.
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+			std::remove(path.c_str());
+			if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+				std::remove(temporaryPath.c_str());
+			}
+		}
+	}
+
+	// Meshes of the same name in different folders get caches of their own.
+	std::string GetLodCachePath(const std::string& directory, const std::string& filename) {
+		const size_t separator = filename.find_last_of("/\\");
+		std::ostringstream path;
+		path << directory << '/' << filename.substr(separator == std::string::npos ? 0 : separator + 1) << '.'
+			<< std::hex << std::setw(16) << std::setfill('0') << std::hash<std::string>()(filename) << ".lods";
+		return path.str();
+	}
+
+	Matrix4x3 MakeMatrix(double m00, double m01, double m02, double m10, double m11, double m12, double m20, double m21, double m22) {
+		Matrix4x3 matrix = { { { m00, m01, m02 }, { m10, m11, m12 }, { m20, m21, m22 }, { 0.0, 0.0, 0.0 } } };
+		return matrix;
+	}
+
+	// Level of a mesh for the point of the track at range. The tolerance is in world units, the errors
+	// of the levels in model units.
+	size_t SelectTrackLevel(const MeshData& mesh, const LodPolicy& lod, double range, double scale) {
+		if (mesh.lods.empty()) {
+			return 0;
+		}
+		if (lod.fixedLevel >= 0) {
+			return std::min(static_cast<size_t>(lod.fixedLevel), mesh.lods.size());
+		}
+		return SelectLod(mesh.lods, scale > 0.0 ? GetLodTolerance(lod.frequency, range) / scale : 0.0);
+	}
+
+	// Lowers the depths of samples firstSample to lastSample of a track to those of the triangles, in
+	// world space, under them.
+	void RasterizeBoundary(const std::vector<Vector3>& vertices, const std::vector<uint32_t>& indices, const Vector3& origin,
+		double directionX, double directionZ, double spacing, size_t firstSample, size_t lastSample, std::vector<double>& depths,
+		uint32_t surface, std::vector<uint32_t>* surfaces) {
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			const Vector3* corners[3] = { &vertices[indices[i]], &vertices[indices[i + 1]], &vertices[indices[i + 2]] };
+
+			// Track coordinates: a along the track, b across it.
+			double a[3];
+			double b[3];
+			for (int c = 0; c < 3; ++c) {
+				const double dx = corners[c]->x - origin.x;
+				const double dz = corners[c]->z - origin.z;
+				a[c] = dx * directionX + dz * directionZ;
+				b[c] = dz * directionX - dx * directionZ;
+			}
+
+			// The track is the line b = 0; triangles entirely on one side of it are never under it.
+			if ((b[0] > 0.0 && b[1] > 0.0 && b[2] > 0.0) || (b[0] < 0.0 && b[1] < 0.0 && b[2] < 0.0)) {
+				continue;
+			}
+
+			const double area = (a[1] - a[0]) * (b[2] - b[0]) - (a[2] - a[0]) * (b[1] - b[0]);
+			if (std::abs(area) < 1e-12) {
+				continue;
+			}
+
+			const double minA = std::max(0.0, std::min(a[0], std::min(a[1], a[2])));
+			const double maxA = std::min((lastSample + 1) * spacing, std::max(a[0], std::max(a[1], a[2])));
+			if (minA > maxA) {
+				continue;
+			}
+
+			const size_t first = std::max(firstSample, static_cast<size_t>(std::ceil(minA / spacing)));
+			const size_t last = std::min(lastSample, static_cast<size_t>(std::floor(maxA / spacing)));
+			for (size_t sample = first; sample <= last; ++sample) {
+				const double s = sample * spacing;
+
+				// Barycentric coordinates of (s, 0) in the projected triangle.
+				const double w1 = ((s - a[0]) * (b[2] - b[0]) - (a[2] - a[0]) * (0.0 - b[0])) / area;
+				const double w2 = ((a[1] - a[0]) * (0.0 - b[0]) - (s - a[0]) * (b[1] - b[0])) / area;
+				const double w0 = 1.0 - w1 - w2;
+				const double epsilon = -1e-9;
+				if (w0 < epsilon || w1 < epsilon || w2 < epsilon) {
+					continue;
+				}
+
+				const double depth = -(w0 * corners[0]->y + w1 * corners[1]->y + w2 * corners[2]->y);
+				if (depth > 0.0 && depth < depths[sample]) {
+					depths[sample] = depth;
+					if (surfaces) {
+						(*surfaces)[sample] = surface;
+					}
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// MeshLibrary implementation
+
+void SonarPropagation::Sonar::MeshLibrary::EnableLods(const SimplifySettings& settings, const std::string& cacheDirectory)
+{
+	m_lodsEnabled = true;
+	m_lodSettings = settings;
+	m_lodCacheDirectory = cacheDirectory;
+
+	for (MeshData& mesh : m_meshes) {
+		mesh.lods = BuildLodChain(mesh.positions, mesh.indices, m_lodSettings);
+	}
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::LoadWavefront(const std::string& filename)
+{
+	size_t meshIndex;
+	if (FindMesh(filename, meshIndex)) {
+		return meshIndex;
+	}
+
+	MeshData mesh = m_lodsEnabled ? ReadWavefrontWithLods(filename) : ReadWavefront(filename);
+	ValidateIndices(mesh.positions, mesh.indices);
+
+	return AddMesh(std::move(mesh));
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::ReloadWavefront(const std::string& filename)
+{
+	size_t meshIndex;
+	if (!FindMesh(filename, meshIndex)) {
+		return LoadWavefront(filename);
+	}
+
+	MeshData mesh = m_lodsEnabled ? ReadWavefrontWithLods(filename) : ReadWavefront(filename);
+	ValidateIndices(mesh.positions, mesh.indices);
+
+	m_meshes[meshIndex] = std::move(mesh);
+	return meshIndex;
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::LoadPredefined(std::vector<Float3> positions, std::vector<uint32_t> indices,
+	const std::string& source)
+{
+	ValidateIndices(positions, indices);
+
+	MeshData mesh;
+	mesh.source = source;
+	mesh.positions = std::move(positions);
+	mesh.indices = std::move(indices);
+	ComputeBounds(mesh);
+	if (m_lodsEnabled) {
+		mesh.lods = BuildLodChain(mesh.positions, mesh.indices, m_lodSettings);
+	}
+
+	return AddMesh(std::move(mesh));
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::AddMesh(MeshData mesh)
+{
+	const std::string source = mesh.source;
+	m_meshes.push_back(std::move(mesh));
+	if (!source.empty()) {
+		m_meshByFile[source] = m_meshes.size() - 1;
+	}
+	return m_meshes.size() - 1;
+}
+
+bool SonarPropagation::Sonar::MeshLibrary::FindMesh(const std::string& source, size_t& index) const
+{
+	auto found = m_meshByFile.find(source);
+	if (found == m_meshByFile.end()) {
+		return false;
+	}
+
+	index = found->second;
+	return true;
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::LoadHeightfield(const std::string& filename)
+{
+	size_t heightfieldIndex;
+	if (FindHeightfield(filename, heightfieldIndex)) {
+		return heightfieldIndex;
+	}
+
+	return AddHeightfield(Heightfield::LoadEsriAscii(filename), filename);
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::ReloadHeightfield(const std::string& filename)
+{
+	size_t heightfieldIndex;
+	if (!FindHeightfield(filename, heightfieldIndex)) {
+		return LoadHeightfield(filename);
+	}
+
+	m_heightfields[heightfieldIndex] = Heightfield::LoadEsriAscii(filename);
+	return heightfieldIndex;
+}
+
+size_t SonarPropagation::Sonar::MeshLibrary::AddHeightfield(Heightfield heightfield, const std::string& source)
+{
+	if (heightfield.IsEmpty()) {
+		throw std::invalid_argument("MeshLibrary: empty heightfield");
+	}
+
+	m_heightfields.push_back(std::move(heightfield));
+	if (!source.empty()) {
+		m_heightfieldByFile[source] = m_heightfields.size() - 1;
+	}
+	return m_heightfields.size() - 1;
+}
+
+bool SonarPropagation::Sonar::MeshLibrary::FindHeightfield(const std::string& source, size_t& index) const
+{
+	auto found = m_heightfieldByFile.find(source);
+	if (found == m_heightfieldByFile.end()) {
+		return false;
+	}
+
+	index = found->second;
+	return true;
+}
+
+MeshData SonarPropagation::Sonar::MeshLibrary::ReadWavefront(const std::string& filename)
+{
+	tinyobj::ObjReaderConfig readerConfig;
+	readerConfig.triangulate = true;
+
+	tinyobj::ObjReader reader;
+	if (!reader.ParseFromFile(filename, readerConfig)) {
+		std::string error = reader.Error();
+		while (!error.empty() && (error.back() == '\n' || error.back() == '\r')) {
+			error.pop_back();
+		}
+		throw std::runtime_error("Could not load " + filename + ": " + error);
+	}
+
+	const tinyobj::attrib_t& attrib = reader.GetAttrib();
+
+	MeshData mesh;
+	mesh.source = filename;
+	mesh.positions.resize(attrib.vertices.size() / 3);
+	for (size_t v = 0; v < mesh.positions.size(); ++v) {
+		mesh.positions[v] = { attrib.vertices[3 * v + 0], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2] };
+	}
+
+	for (const tinyobj::shape_t& shape : reader.GetShapes()) {
+		for (const tinyobj::index_t& index : shape.mesh.indices) {
+			mesh.indices.push_back(static_cast<uint32_t>(index.vertex_index));
+		}
+	}
+
+	ComputeBounds(mesh);
+	return mesh;
+}
+
+MeshData SonarPropagation::Sonar::MeshLibrary::ReadWavefrontWithLods(const std::string& filename) const
+{
+	// The cache is keyed on the bytes of the file; an unreadable file is left to ReadWavefront() to report.
+	std::string contents;
+	const bool cached = !m_lodCacheDirectory.empty() && ReadFile(filename, contents);
+	const uint64_t key = cached ? HashLodSource(contents, m_lodSettings) : 0;
+	const std::string cachePath = cached ? GetLodCachePath(m_lodCacheDirectory, filename) : std::string();
+
+	MeshData mesh;
+	if (cached && ReadLodCache(cachePath, key, mesh)) {
+		mesh.source = filename;
+		ComputeBounds(mesh);
+		return mesh;
+	}
+
+	mesh = ReadWavefront(filename);
+	ValidateIndices(mesh.positions, mesh.indices);
+	mesh.lods = BuildLodChain(mesh.positions, mesh.indices, m_lodSettings);
+	if (cached) {
+		WriteLodCache(cachePath, key, mesh);
+	}
+	return mesh;
+}
+
+//--------------------------------------------------------------------------------------
+// Matrix4x3 implementation
+
+Matrix4x3 SonarPropagation::Sonar::Matrix4x3::Identity()
+{
+	return MakeMatrix(1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0);
+}
+
+Vector3 SonarPropagation::Sonar::Matrix4x3::TransformPoint(const Vector3& p) const
+{
+	return {
+		p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+		p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+		p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2]
+	};
+}
+
+Vector3 SonarPropagation::Sonar::Matrix4x3::TransformPoint(const Float3& p) const
+{
+	return TransformPoint(Vector3{ p.x, p.y, p.z });
+}
+
+Vector3 SonarPropagation::Sonar::Matrix4x3::TransformDirection(const Vector3& d) const
+{
+	return {
+		d.x * m[0][0] + d.y * m[1][0] + d.z * m[2][0],
+		d.x * m[0][1] + d.y * m[1][1] + d.z * m[2][1],
+		d.x * m[0][2] + d.y * m[1][2] + d.z * m[2][2]
+	};
+}
+
+Matrix4x3 SonarPropagation::Sonar::Matrix4x3::Inverse() const
+{
+	// Adjugate of the 3x3 part over its determinant; the translation is then carried back through it.
+	const double determinant =
+		m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+		m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+		m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	if (std::abs(determinant) < 1e-300) {
+		throw std::invalid_argument("Matrix4x3: the transform is not invertible");
+	}
+
+	const double inverse = 1.0 / determinant;
+	Matrix4x3 result = MakeMatrix(
+		(m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inverse,
+		(m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inverse,
+		(m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inverse,
+		(m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inverse,
+		(m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inverse,
+		(m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inverse,
+		(m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inverse,
+		(m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inverse,
+		(m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inverse);
+
+	const Vector3 translation = result.TransformDirection(Vector3{ m[3][0], m[3][1], m[3][2] });
+	result.m[3][0] = -translation.x;
+	result.m[3][1] = -translation.y;
+	result.m[3][2] = -translation.z;
+	return result;
+}
+
+Matrix4x3 SonarPropagation::Sonar::Matrix4x3::operator*(const Matrix4x3& other) const
+{
+	Matrix4x3 result;
+	for (int row = 0; row < 4; ++row) {
+		for (int column = 0; column < 3; ++column) {
+			result.m[row][column] = m[row][0] * other.m[0][column] + m[row][1] * other.m[1][column] + m[row][2] * other.m[2][column] +
+				(row == 3 ? other.m[3][column] : 0.0);
+		}
+	}
+	return result;
+}
+
+double SonarPropagation::Sonar::Matrix4x3::GetMaxScale() const
+{
+	// Rows are the images of the axes; for a scale and rotation the longest is the largest stretch.
+	double scale = 0.0;
+	for (int row = 0; row < 3; ++row) {
+		scale = std::max(scale, std::sqrt(m[row][0] * m[row][0] + m[row][1] * m[row][1] + m[row][2] * m[row][2]));
+	}
+	return scale;
+}
+
+//--------------------------------------------------------------------------------------
+// SceneTransform implementation
+
+Matrix4x3 SonarPropagation::Sonar::SceneTransform::LocalToParent() const
+{
+	const double cp = std::cos(rotation.x), sp = std::sin(rotation.x);
+	const double cy = std::cos(rotation.y), sy = std::sin(rotation.y);
+	const double cr = std::cos(rotation.z), sr = std::sin(rotation.z);
+
+	// Roll about z, then pitch about x, then yaw about y, in the left-handed row-vector convention of DirectXMath.
+	const Matrix4x3 rollMatrix = MakeMatrix(cr, sr, 0.0, -sr, cr, 0.0, 0.0, 0.0, 1.0);
+	const Matrix4x3 pitchMatrix = MakeMatrix(1.0, 0.0, 0.0, 0.0, cp, sp, 0.0, -sp, cp);
+	const Matrix4x3 yawMatrix = MakeMatrix(cy, 0.0, -sy, 0.0, 1.0, 0.0, sy, 0.0, cy);
+
+	Matrix4x3 result = MakeMatrix(scale.x, 0.0, 0.0, 0.0, scale.y, 0.0, 0.0, 0.0, scale.z) * rollMatrix * pitchMatrix * yawMatrix;
+	result.m[3][0] = position.x;
+	result.m[3][1] = position.y;
+	result.m[3][2] = position.z;
+	return result;
+}
+
+//--------------------------------------------------------------------------------------
+// SceneModel implementation
+
+size_t SonarPropagation::Sonar::SceneModel::AddTransform(const SceneTransform& transform)
+{
+	if (transform.parent >= static_cast<int32_t>(m_transforms.size())) {
+		throw std::invalid_argument("SceneModel: a transform has to be added after its parent");
+	}
+
+	m_transforms.push_back(transform);
+	return m_transforms.size() - 1;
+}
+
+std::vector<Matrix4x3> SonarPropagation::Sonar::SceneModel::ComputeWorldTransforms() const
+{
+	std::vector<Matrix4x3> world(m_transforms.size());
+	for (size_t node = 0; node < m_transforms.size(); ++node) {
+		const SceneTransform& transform = m_transforms[node];
+		world[node] = transform.parent < 0 ? transform.LocalToParent() : transform.LocalToParent() * world[transform.parent];
+	}
+	return world;
+}
+
+//--------------------------------------------------------------------------------------
+
+BottomProfile SonarPropagation::Sonar::ExtractBottomProfile(const SceneModel& scene, const MeshLibrary& library, const Vector3& origin,
+	double bearing, double maxRange, double spacing, double fallbackDepth, const LodPolicy& lod, std::vector<uint32_t>* surfaces)
+{
+	const size_t sampleCount = static_cast<size_t>(std::ceil(maxRange / spacing)) + 1;
+	if (surfaces) {
+		surfaces->assign(sampleCount, c_noBottomSurface);
+	}
+	const double directionX = std::cos(bearing);
+	const double directionZ = std::sin(bearing);
+
+	std::vector<double> depths(sampleCount, std::numeric_limits<double>::infinity());
+	const std::vector<Matrix4x3> world = scene.ComputeWorldTransforms();
+
+	std::vector<Vector3> vertices;
+	for (size_t object = 0; object < scene.m_objects.size(); ++object) {
+		const ReflectorModel& reflector = scene.m_objects[object];
+		if (reflector.type != ObjectType::Boundary) {
+			continue;
+		}
+
+		const MeshData& mesh = library.GetMesh(reflector.mesh);
+		const Matrix4x3& transform = world[reflector.transform];
+		const double scale = transform.GetMaxScale();
+
+		// Runs of samples on the same level. The tolerance grows with range, so every level gets one run.
+		for (size_t firstSample = 0; firstSample < sampleCount;) {
+			const size_t level = SelectTrackLevel(mesh, lod, firstSample * spacing, scale);
+			size_t lastSample = firstSample;
+			while (lastSample + 1 < sampleCount && SelectTrackLevel(mesh, lod, (lastSample + 1) * spacing, scale) == level) {
+				++lastSample;
+			}
+
+			const std::vector<Float3>& positions = level == 0 ? mesh.positions : mesh.lods[level - 1].positions;
+			const std::vector<uint32_t>& indices = level == 0 ? mesh.indices : mesh.lods[level - 1].indices;
+			vertices.resize(positions.size());
+			for (size_t v = 0; v < positions.size(); ++v) {
+				vertices[v] = transform.TransformPoint(positions[v]);
+			}
+
+			RasterizeBoundary(vertices, indices, origin, directionX, directionZ, spacing, firstSample, lastSample, depths,
+				static_cast<uint32_t>(object), surfaces);
+			firstSample = lastSample + 1;
+		}
+	}
+
+	// Heightfields are shot straight down from the surface at every sample. The world ray maps to a
+	// local one with the same parameter, so t is the depth below the surface.
+	for (size_t index = 0; index < scene.m_heightfields.size(); ++index) {
+		const HeightfieldModel& model = scene.m_heightfields[index];
+		const Heightfield& heightfield = library.GetHeightfield(model.heightfield);
+		const Matrix4x3 toLocal = world[model.transform].Inverse();
+		const Vector3 down = toLocal.TransformDirection(Vector3{ 0.0, -1.0, 0.0 });
+
+		for (size_t sample = 0; sample < sampleCount; ++sample) {
+			const double s = sample * spacing;
+			const Vector3 top = toLocal.TransformPoint(Vector3{ origin.x + s * directionX, 0.0, origin.z + s * directionZ });
+
+			HeightfieldHit hit;
+			if (heightfield.Intersect(top, down, 0.0, depths[sample], hit) && hit.t > 0.0) {
+				depths[sample] = hit.t;
+				if (surfaces) {
+					(*surfaces)[sample] = static_cast<uint32_t>(scene.m_objects.size() + index);
+				}
+			}
+		}
+	}
+
+	for (double& depth : depths) {
+		if (std::isinf(depth)) {
+			depth = fallbackDepth;
+		}
+	}
+
+	return BottomProfile(std::move(depths), spacing);
+}
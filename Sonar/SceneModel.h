@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../Common/ObjectType.h"
+#include "BottomProfile.h"
+#include "Heightfield.h"
+#include "MeshSimplifier.h"
+#include "PropagationEngine.h"
+#include "Vector3.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Triangle list of a mesh in model space, as ObjectLibrary keeps it on the GPU.
+		/// </summary>
+		struct MeshData {
+			// File the mesh was loaded from; empty for predefined meshes.
+			std::string source;
+			std::vector<Float3> positions;
+			std::vector<uint32_t> indices;
+			Float3 boundsMin = { 0.0f, 0.0f, 0.0f };
+			Float3 boundsMax = { 0.0f, 0.0f, 0.0f };
+			// Coarser levels of detail, finest first, if the library builds them.
+			std::vector<MeshLevel> lods;
+		};
+
+		/// <summary>
+		/// CPU counterpart of ObjectLibrary: the same load calls, but the geometry stays in system memory
+		/// and a file is only parsed once however many times it is loaded.
+		/// </summary>
+		class MeshLibrary {
+		public:
+			/// <summary>
+			/// Builds a level of detail chain for every mesh, those already loaded included. With a cache
+			/// directory, the chain of a Wavefront file loaded from then on is cached there, together with the
+			/// full mesh, and read from there instead of the file while the file and the settings are unchanged.
+			/// The directory must exist; a cache that cannot be written is skipped.
+			/// </summary>
+			void EnableLods(const SimplifySettings& settings, const std::string& cacheDirectory = std::string());
+
+			bool HasLods() const { return m_lodsEnabled; }
+
+			/// <summary>
+			/// Loads a Wavefront OBJ file, triangulated, or returns the index it was loaded at before.
+			/// Throws std::runtime_error if the file cannot be parsed.
+			/// </summary>
+			size_t LoadWavefront(const std::string& filename);
+
+			/// <summary>
+			/// Parses a file loaded before again and replaces its geometry, keeping its index. Loads it
+			/// if it was not. On a parse error the old geometry is kept and std::runtime_error thrown.
+			/// </summary>
+			size_t ReloadWavefront(const std::string& filename);
+
+			/// <summary>
+			/// Adds a mesh. A non-empty source names it for FindMesh(), like the file of LoadWavefront().
+			/// </summary>
+			size_t LoadPredefined(std::vector<Float3> positions, std::vector<uint32_t> indices, const std::string& source = std::string());
+
+			bool FindMesh(const std::string& source, size_t& index) const;
+
+			const MeshData& GetMesh(size_t index) const { return m_meshes[index]; }
+			size_t GetMeshCount() const { return m_meshes.size(); }
+
+			/// <summary>
+			/// Loads an ESRI ASCII grid, or returns the index it was loaded at before. Heightfields are
+			/// numbered apart from meshes. Throws std::runtime_error if the file cannot be parsed.
+			/// </summary>
+			size_t LoadHeightfield(const std::string& filename);
+
+			/// <summary>
+			/// Like ReloadWavefront(), for heightfields.
+			/// </summary>
+			size_t ReloadHeightfield(const std::string& filename);
+
+			size_t AddHeightfield(Heightfield heightfield, const std::string& source = std::string());
+
+			bool FindHeightfield(const std::string& source, size_t& index) const;
+
+			const Heightfield& GetHeightfield(size_t index) const { return m_heightfields[index]; }
+			size_t GetHeightfieldCount() const { return m_heightfields.size(); }
+
+		private:
+			static MeshData ReadWavefront(const std::string& filename);
+			// ReadWavefront() with the LOD chain, from the cache if it is current.
+			MeshData ReadWavefrontWithLods(const std::string& filename) const;
+			size_t AddMesh(MeshData mesh);
+
+			bool m_lodsEnabled = false;
+			SimplifySettings m_lodSettings;
+			std::string m_lodCacheDirectory;
+
+			std::vector<MeshData> m_meshes;
+			std::map<std::string, size_t> m_meshByFile;
+
+			std::vector<Heightfield> m_heightfields;
+			std::map<std::string, size_t> m_heightfieldByFile;
+		};
+
+		/// <summary>
+		/// Affine transform in row-vector form, like the XMMATRIX of Scene::Transform: p' = p * M.
+		/// The fourth row holds the translation.
+		/// </summary>
+		struct Matrix4x3 {
+			double m[4][3];
+
+			static Matrix4x3 Identity();
+
+			Vector3 TransformPoint(const Vector3& p) const;
+			Vector3 TransformPoint(const Float3& p) const;
+			// Without the translation.
+			Vector3 TransformDirection(const Vector3& d) const;
+
+			// Throws std::invalid_argument if the transform is singular, such as one with a zero scale.
+			Matrix4x3 Inverse() const;
+
+			// Applies this transform, then other.
+			Matrix4x3 operator*(const Matrix4x3& other) const;
+
+			// Largest factor the transform stretches a length by, for a scale and rotation.
+			double GetMaxScale() const;
+		};
+
+		/// <summary>
+		/// Node of the transform hierarchy. Rotation holds pitch, yaw and roll in radians, applied in the
+		/// order of XMMatrixRotationRollPitchYaw; scale, then rotation, then translation.
+		/// </summary>
+		struct SceneTransform {
+			Vector3 position = { 0.0, 0.0, 0.0 };
+			Vector3 rotation = { 0.0, 0.0, 0.0 };
+			Vector3 scale = { 1.0, 1.0, 1.0 };
+			// Index of the parent transform, or -1. Parents are added before their children.
+			int32_t parent = -1;
+
+			Matrix4x3 LocalToParent() const;
+		};
+
+		struct ReflectorModel {
+			size_t transform;
+			size_t mesh;
+			ObjectType type;
+		};
+
+		/// <summary>
+		/// A heightfield of a MeshLibrary placed in the scene. Heightfields are bathymetry, so they are
+		/// always Boundary surfaces.
+		/// </summary>
+		struct HeightfieldModel {
+			size_t transform;
+			size_t heightfield;
+		};
+
+		/// <summary>
+		/// A fan of rays leaving the source along a bearing in the horizontal plane, measured in radians
+		/// from +x towards +z. The source depth of the fan is taken from the transform.
+		/// </summary>
+		struct SoundSourceModel {
+			size_t transform;
+			std::string name;
+			double bearing = 0.0;
+			// Centre frequency in Hz, or 0 if not given. Picks the levels of detail of the boundaries.
+			double frequency = 0.0;
+			LaunchFan fan;
+		};
+
+		struct SoundReceiverModel {
+			size_t transform;
+			std::string name;
+			// Rays passing closer than this, in metres, arrive at the receiver.
+			double radius = 10.0;
+		};
+
+		/// <summary>
+		/// CPU counterpart of Scene without any D3D resources: reflectors referencing meshes of a
+		/// MeshLibrary, heightfields, sound sources and receivers, all hanging off one transform hierarchy. y points up
+		/// and the surface is y = 0, as in the raytracing scene; depth is -y.
+		/// </summary>
+		class SceneModel {
+		public:
+			/// <summary>
+			/// Adds a node; throws std::invalid_argument if its parent is not an earlier node.
+			/// </summary>
+			size_t AddTransform(const SceneTransform& transform);
+
+			void AddObject(const ReflectorModel& reflector) { m_objects.push_back(reflector); }
+			void AddHeightfield(const HeightfieldModel& heightfield) { m_heightfields.push_back(heightfield); }
+			void AddSoundSource(const SoundSourceModel& source) { m_soundSources.push_back(source); }
+			void AddSoundReceiver(const SoundReceiverModel& receiver) { m_soundReceivers.push_back(receiver); }
+
+			/// <summary>
+			/// Local to world matrices of every node, in node order.
+			/// </summary>
+			std::vector<Matrix4x3> ComputeWorldTransforms() const;
+
+			std::vector<SceneTransform> m_transforms;
+			std::vector<ReflectorModel> m_objects;
+			std::vector<HeightfieldModel> m_heightfields;
+			std::vector<SoundSourceModel> m_soundSources;
+			std::vector<SoundReceiverModel> m_soundReceivers;
+		};
+
+		/// <summary>
+		/// Which level of detail of a boundary mesh the bottom is taken from.
+		/// </summary>
+		struct LodPolicy {
+			// With a frequency, every point of the track uses the coarsest level within GetLodTolerance()
+			// of its range; without one, the full mesh.
+			double frequency = 0.0;
+			// If not negative, this level everywhere instead, 0 being the full mesh.
+			int32_t fixedLevel = -1;
+		};
+
+		// Surface of a point of the track where no boundary lies below the water surface.
+		const uint32_t c_noBottomSurface = 0xFFFFFFFF;
+
+		/// <summary>
+		/// Depth of the shallowest Boundary surface or heightfield below the water surface under points
+		/// spaced along a track from origin towards bearing. Points where no boundary lies below the
+		/// surface get fallbackDepth. Boundary meshes with levels of detail are used at the level lod picks.
+		/// If surfaces is given, it gets the surface of every point: the index of a reflector in
+		/// scene.m_objects, the number of reflectors plus the index of a heightfield, or c_noBottomSurface.
+		/// </summary>
+		BottomProfile ExtractBottomProfile(const SceneModel& scene, const MeshLibrary& library, const Vector3& origin,
+			double bearing, double maxRange, double spacing, double fallbackDepth, const LodPolicy& lod = LodPolicy(),
+			std::vector<uint32_t>* surfaces = nullptr);
+	}
+}
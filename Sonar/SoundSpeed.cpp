@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "SoundSpeed.h"
+
+#include <limits>
+#include <stdexcept>
+
+#if defined(SONAR_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+double SonarPropagation::Sonar::MackenzieSoundSpeed(double temperature, double salinity, double depth)
+{
+	const double t = temperature;
+	const double s = salinity - 35.0;
+	const double d = depth;
+
+	return 1448.96 + 4.591 * t - 5.304e-2 * t * t + 2.374e-4 * t * t * t +
+		1.340 * s + 1.630e-2 * d + 1.675e-7 * d * d -
+		1.025e-2 * t * s - 7.139e-13 * t * d * d * d;
+}
+
+double SonarPropagation::Sonar::MackenzieSoundSpeedGradient(double temperature, double salinity, double depth)
+{
+	(void)salinity;
+	return 1.630e-2 + 3.350e-7 * depth - 3.0 * 7.139e-13 * temperature * depth * depth;
+}
+
+double SonarPropagation::Sonar::CompactMackenzieSoundSpeed(double temperature, double depth)
+{
+	const double t = temperature;
+	return 1448.96 + 4.591 * t - 5.304e-2 * t * t + 2.374e-4 * t * t * t + 1.6e-2 * depth;
+}
+
+double SonarPropagation::Sonar::EvaluateSoundSpeed(SoundSpeedFormula formula, double temperature, double salinity, double depth)
+{
+	switch (formula) {
+	case SoundSpeedFormula::CompactMackenzie:
+		return CompactMackenzieSoundSpeed(temperature, depth);
+	default:
+		return MackenzieSoundSpeed(temperature, salinity, depth);
+	}
+}
+
+void SonarPropagation::Sonar::ConvertToSoundSpeed(SoundSpeedFormula formula, const double* temperatures, const double* salinities,
+	const double* depths, double* speeds, size_t count)
+{
+	size_t i = 0;
+
+#if defined(SONAR_SIMD_SSE)
+	// Each product is formed in the order the scalar expressions use, e.g. (5.304e-2 * t) * t.
+	const auto scaled = [](double factor, __m128d value) { return _mm_mul_pd(_mm_set1_pd(factor), value); };
+
+	for (; i + 2 <= count; i += 2) {
+		const __m128d t = _mm_loadu_pd(temperatures + i);
+		const __m128d d = _mm_loadu_pd(depths + i);
+
+		__m128d c = _mm_add_pd(_mm_set1_pd(1448.96), scaled(4.591, t));
+		c = _mm_sub_pd(c, _mm_mul_pd(scaled(5.304e-2, t), t));
+		c = _mm_add_pd(c, _mm_mul_pd(_mm_mul_pd(scaled(2.374e-4, t), t), t));
+
+		if (formula == SoundSpeedFormula::CompactMackenzie) {
+			c = _mm_add_pd(c, scaled(1.6e-2, d));
+		}
+		else {
+			const __m128d s = _mm_sub_pd(_mm_loadu_pd(salinities + i), _mm_set1_pd(35.0));
+			c = _mm_add_pd(c, scaled(1.340, s));
+			c = _mm_add_pd(c, scaled(1.630e-2, d));
+			c = _mm_add_pd(c, _mm_mul_pd(scaled(1.675e-7, d), d));
+			c = _mm_sub_pd(c, _mm_mul_pd(scaled(1.025e-2, t), s));
+			c = _mm_sub_pd(c, _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(scaled(7.139e-13, t), d), d), d));
+		}
+
+		_mm_storeu_pd(speeds + i, c);
+	}
+#endif
+
+	for (; i < count; ++i) {
+		speeds[i] = EvaluateSoundSpeed(formula, temperatures[i], salinities[i], depths[i]);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// SoundSpeedProfile implementation
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::Isovelocity(double speed)
+{
+	SoundSpeedProfile profile;
+	profile.m_kind = Kind::Isovelocity;
+	profile.m_a = speed;
+	return profile;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::LinearGradient(double surfaceSpeed, double gradient)
+{
+	SoundSpeedProfile profile;
+	profile.m_kind = Kind::LinearGradient;
+	profile.m_a = surfaceSpeed;
+	profile.m_b = gradient;
+	return profile;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::Munk(double axisDepth, double axisSpeed, double scaleDepth, double epsilon)
+{
+	if (scaleDepth <= 0.0) {
+		throw std::invalid_argument("Munk profile scale depth must be positive");
+	}
+
+	SoundSpeedProfile profile;
+	profile.m_kind = Kind::Munk;
+	profile.m_a = axisDepth;
+	profile.m_b = axisSpeed;
+	profile.m_c = scaleDepth;
+	profile.m_d = epsilon;
+	return profile;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::FromSamples(const std::vector<double>& depths, const std::vector<double>& speeds, double spacing)
+{
+	if (depths.empty() || depths.size() != speeds.size()) {
+		throw std::invalid_argument("Sound speed samples need one speed per depth");
+	}
+	if (spacing <= 0.0) {
+		throw std::invalid_argument("Sound speed table spacing must be positive");
+	}
+
+	SoundSpeedProfile profile;
+	profile.m_kind = Kind::Table;
+	profile.m_spacing = spacing;
+	profile.m_inverseSpacing = 1.0 / spacing;
+
+	const size_t nodeCount = static_cast<size_t>(std::ceil(depths.back() / spacing)) + 1;
+	profile.m_speeds.resize(nodeCount);
+
+	// The samples are sorted, so one cursor walks them while the grid is filled.
+	size_t sample = 0;
+	for (size_t node = 0; node < nodeCount; ++node) {
+		const double z = node * spacing;
+		while (sample + 1 < depths.size() && depths[sample + 1] <= z) {
+			++sample;
+		}
+
+		if (sample + 1 >= depths.size() || z <= depths[sample]) {
+			profile.m_speeds[node] = speeds[sample];
+		}
+		else {
+			const double t = (z - depths[sample]) / (depths[sample + 1] - depths[sample]);
+			profile.m_speeds[node] = speeds[sample] + t * (speeds[sample + 1] - speeds[sample]);
+		}
+	}
+
+	profile.m_gradients.resize(nodeCount, 0.0);
+	for (size_t node = 0; node + 1 < nodeCount; ++node) {
+		profile.m_gradients[node] = (profile.m_speeds[node + 1] - profile.m_speeds[node]) * profile.m_inverseSpacing;
+	}
+
+	return profile;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::FromFormula(SoundSpeedFormula formula, double temperature, double salinity, double maxDepth, double spacing)
+{
+	if (spacing <= 0.0) {
+		throw std::invalid_argument("Sound speed table spacing must be positive");
+	}
+
+	const size_t nodeCount = static_cast<size_t>(std::ceil(maxDepth / spacing)) + 1;
+	std::vector<double> depths(nodeCount);
+	std::vector<double> speeds(nodeCount);
+
+	for (size_t node = 0; node < nodeCount; ++node) {
+		depths[node] = node * spacing;
+		speeds[node] = EvaluateSoundSpeed(formula, temperature, salinity, depths[node]);
+	}
+
+	return FromSamples(depths, speeds, spacing);
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfile::Tabulate(double maxDepth, double spacing) const
+{
+	if (spacing <= 0.0) {
+		throw std::invalid_argument("Sound speed table spacing must be positive");
+	}
+
+	const size_t nodeCount = static_cast<size_t>(std::ceil(maxDepth / spacing)) + 1;
+	std::vector<double> depths(nodeCount);
+	std::vector<double> speeds(nodeCount);
+
+	for (size_t node = 0; node < nodeCount; ++node) {
+		depths[node] = node * spacing;
+		speeds[node] = Evaluate(depths[node]).c;
+	}
+
+	return FromSamples(depths, speeds, spacing);
+}
+
+bool SonarPropagation::Sonar::SoundSpeedProfile::operator==(const SoundSpeedProfile& other) const
+{
+	return m_kind == other.m_kind && m_a == other.m_a && m_b == other.m_b && m_c == other.m_c && m_d == other.m_d &&
+		m_spacing == other.m_spacing && m_speeds == other.m_speeds && m_gradients == other.m_gradients;
+}
+
+double SonarPropagation::Sonar::SoundSpeedProfile::GetMaxDepth() const
+{
+	if (m_kind != Kind::Table) {
+		return std::numeric_limits<double>::infinity();
+	}
+	return (m_speeds.size() - 1) * m_spacing;
+}
+
+//--------------------------------------------------------------------------------------
+// SoundSpeedProfileSet implementation
+
+SonarPropagation::Sonar::SoundSpeedProfileSet::SoundSpeedProfileSet(std::vector<double> ranges, std::vector<double> speeds, double spacing)
+	: m_ranges(std::move(ranges)), m_speeds(std::move(speeds)), m_spacing(spacing)
+{
+	if (m_ranges.empty() || m_speeds.empty() || m_speeds.size() % m_ranges.size() != 0) {
+		throw std::invalid_argument("Sound speed profile set needs the same number of speeds per range");
+	}
+	if (spacing <= 0.0) {
+		throw std::invalid_argument("Sound speed table spacing must be positive");
+	}
+	for (size_t profile = 1; profile < m_ranges.size(); ++profile) {
+		if (!(m_ranges[profile] > m_ranges[profile - 1])) {
+			throw std::invalid_argument("Sound speed profile set ranges must be increasing");
+		}
+	}
+
+	m_nodeCount = m_speeds.size() / m_ranges.size();
+	m_inverseSpacing = 1.0 / spacing;
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfileSet::GetProfile(size_t profile) const
+{
+	std::vector<double> depths(m_nodeCount);
+	for (size_t node = 0; node < m_nodeCount; ++node) {
+		depths[node] = node * m_spacing;
+	}
+
+	const double* speeds = GetSpeeds(profile);
+	return SoundSpeedProfile::FromSamples(depths, std::vector<double>(speeds, speeds + m_nodeCount), m_spacing);
+}
+
+SonarPropagation::Sonar::SoundSpeedProfile SonarPropagation::Sonar::SoundSpeedProfileSet::GetProfileAt(double range) const
+{
+	size_t profile;
+	double weight;
+	FindRangeCell(range, profile, weight);
+	if (weight == 0.0) {
+		return GetProfile(profile);
+	}
+
+	std::vector<double> depths(m_nodeCount);
+	std::vector<double> speeds(m_nodeCount);
+	const double* near = GetSpeeds(profile);
+	const double* far = GetSpeeds(profile + 1);
+	for (size_t node = 0; node < m_nodeCount; ++node) {
+		depths[node] = node * m_spacing;
+		speeds[node] = near[node] + weight * (far[node] - near[node]);
+	}
+	return SoundSpeedProfile::FromSamples(depths, speeds, m_spacing);
+}
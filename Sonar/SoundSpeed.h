@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SONAR_SIMD_SSE 1
+#endif
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// Empirical sound speed formulas, mirroring the SONAR_SSP_MODEL choices of SonarConfig.hlsl.
+		/// </summary>
+		enum class SoundSpeedFormula : uint32_t {
+			Mackenzie = 0,
+			CompactMackenzie = 1
+		};
+
+		/// <summary>
+		/// Mackenzie (1981) nine-term equation in m/s. Temperature in degrees Celsius, salinity in ppt,
+		/// depth in metres. Valid for 0-30 C, 30-40 ppt and 0-8000 m.
+		/// </summary>
+		double MackenzieSoundSpeed(double temperature, double salinity, double depth);
+
+		/// <summary>
+		/// Derivative of MackenzieSoundSpeed() with respect to depth at constant temperature and salinity.
+		/// </summary>
+		double MackenzieSoundSpeedGradient(double temperature, double salinity, double depth);
+
+		/// <summary>
+		/// The Mackenzie equation without the salinity and higher order depth terms, as in SonarEq.hlsl.
+		/// </summary>
+		double CompactMackenzieSoundSpeed(double temperature, double depth);
+
+		double EvaluateSoundSpeed(SoundSpeedFormula formula, double temperature, double salinity, double depth);
+
+		/// <summary>
+		/// EvaluateSoundSpeed() over arrays, two samples per SSE2 instruction. The terms are added in
+		/// the order of the scalar formulas, so the results are identical to them.
+		/// </summary>
+		void ConvertToSoundSpeed(SoundSpeedFormula formula, const double* temperatures, const double* salinities,
+			const double* depths, double* speeds, size_t count);
+
+		/// <summary>
+		/// Sound speed and its vertical gradient at one depth. Profiles are range independent, so the
+		/// range derivative of the ray equations is always zero.
+		/// </summary>
+		struct SoundSpeedSample {
+			double c;
+			double dcdz;
+		};
+
+		/// <summary>
+		/// Range independent sound speed profile c(z), depth positive downwards. Analytic profiles are
+		/// evaluated exactly; measured ones are resampled onto a uniform depth grid and interpolated
+		/// linearly, so a lookup costs one multiply and one index regardless of the sample count.
+		/// </summary>
+		class SoundSpeedProfile {
+		public:
+			enum class Kind : uint32_t {
+				Isovelocity,
+				LinearGradient,
+				Munk,
+				Table
+			};
+
+			static SoundSpeedProfile Isovelocity(double speed);
+			static SoundSpeedProfile LinearGradient(double surfaceSpeed, double gradient);
+
+			/// <summary>
+			/// Canonical Munk profile c1 * (1 + eps * (eta - 1 + exp(-eta))), eta = 2 (z - z1) / B.
+			/// </summary>
+			static SoundSpeedProfile Munk(double axisDepth = 1300.0, double axisSpeed = 1500.0,
+				double scaleDepth = 1300.0, double epsilon = 0.00737);
+
+			/// <summary>
+			/// Resamples measured (depth, speed) pairs, sorted by depth, onto a grid with the given spacing.
+			/// </summary>
+			static SoundSpeedProfile FromSamples(const std::vector<double>& depths, const std::vector<double>& speeds, double spacing);
+
+			/// <summary>
+			/// Tabulates a formula for a water column of constant temperature and salinity.
+			/// </summary>
+			static SoundSpeedProfile FromFormula(SoundSpeedFormula formula, double temperature, double salinity,
+				double maxDepth, double spacing);
+
+			/// <summary>
+			/// Table version of this profile down to maxDepth.
+			/// </summary>
+			SoundSpeedProfile Tabulate(double maxDepth, double spacing) const;
+
+			/// <summary>
+			/// Speed and gradient at depth z. Tables hold their end values beyond the sampled range.
+			/// </summary>
+			SoundSpeedSample Evaluate(double z) const;
+
+			Kind GetKind() const { return m_kind; }
+			double GetSpacing() const { return m_spacing; }
+			double GetMaxDepth() const;
+
+			/// <summary>
+			/// Same kind and the same parameters or table.
+			/// </summary>
+			bool operator==(const SoundSpeedProfile& other) const;
+			bool operator!=(const SoundSpeedProfile& other) const { return !(*this == other); }
+
+		private:
+			SoundSpeedProfile() = default;
+
+			Kind m_kind = Kind::Isovelocity;
+
+			// Isovelocity: a. Linear: a + b z. Munk: axis depth a, axis speed b, scale c, epsilon d.
+			double m_a = 1500.0;
+			double m_b = 0.0;
+			double m_c = 0.0;
+			double m_d = 0.0;
+
+			// Table: speed at every grid node and the gradient of the cell starting at it.
+			std::vector<double> m_speeds;
+			std::vector<double> m_gradients;
+			double m_spacing = 0.0;
+			double m_inverseSpacing = 0.0;
+		};
+
+		// Inline, since the integrator evaluates the profile once per stage of every step.
+		inline SoundSpeedSample SoundSpeedProfile::Evaluate(double z) const
+		{
+			switch (m_kind) {
+			case Kind::Isovelocity:
+				return { m_a, 0.0 };
+			case Kind::LinearGradient:
+				return { m_a + m_b * z, m_b };
+			case Kind::Munk: {
+				const double eta = 2.0 * (z - m_a) / m_c;
+				const double decay = std::exp(-eta);
+				return { m_b * (1.0 + m_d * (eta - 1.0 + decay)), m_b * m_d * (2.0 / m_c) * (1.0 - decay) };
+			}
+			default: {
+				const double position = z * m_inverseSpacing;
+				const size_t last = m_speeds.size() - 1;
+				if (!(position > 0.0)) {
+					return { m_speeds[0], 0.0 };
+				}
+				if (position >= static_cast<double>(last)) {
+					return { m_speeds[last], 0.0 };
+				}
+
+				const size_t cell = static_cast<size_t>(position);
+				return { m_speeds[cell] + (z - cell * m_spacing) * m_gradients[cell], m_gradients[cell] };
+			}
+			}
+		}
+
+		/// <summary>
+		/// Sound speed and its derivatives in depth and range at one point of a range dependent profile.
+		/// </summary>
+		struct RangeSoundSpeedSample {
+			double c;
+			double dcdz;
+			double dcdr;
+		};
+
+		/// <summary>
+		/// Range dependent sound speed c(r, z): measured profiles at increasing ranges, all sampled on
+		/// the same uniform depth grid and packed profile after profile, so a lookup touches two
+		/// adjacent rows. Speeds are interpolated linearly in depth and in range, and hold their end
+		/// values beyond the grid.
+		/// </summary>
+		class SoundSpeedProfileSet {
+		public:
+			SoundSpeedProfileSet() = default;
+
+			/// <summary>
+			/// speeds holds the same number of depth nodes for every range, range after range.
+			/// Ranges must be strictly increasing. Throws std::invalid_argument otherwise.
+			/// </summary>
+			SoundSpeedProfileSet(std::vector<double> ranges, std::vector<double> speeds, double spacing);
+
+			bool IsEmpty() const { return m_ranges.empty(); }
+			size_t GetProfileCount() const { return m_ranges.size(); }
+			size_t GetNodeCount() const { return m_nodeCount; }
+			double GetRange(size_t profile) const { return m_ranges[profile]; }
+			double GetSpacing() const { return m_spacing; }
+			double GetMaxDepth() const { return (m_nodeCount - 1) * m_spacing; }
+			const double* GetSpeeds(size_t profile) const { return &m_speeds[profile * m_nodeCount]; }
+
+			/// <summary>
+			/// Table profile of one range, for the range independent engine.
+			/// </summary>
+			SoundSpeedProfile GetProfile(size_t profile) const;
+
+			/// <summary>
+			/// Table profile interpolated between the two profiles around range.
+			/// </summary>
+			SoundSpeedProfile GetProfileAt(double range) const;
+
+			RangeSoundSpeedSample Evaluate(double r, double z) const;
+
+		private:
+			// First profile of the pair around r and the weight of the second one.
+			void FindRangeCell(double r, size_t& profile, double& weight) const;
+
+			std::vector<double> m_ranges;
+			std::vector<double> m_speeds;
+			size_t m_nodeCount = 0;
+			double m_spacing = 0.0;
+			double m_inverseSpacing = 0.0;
+		};
+
+		inline void SoundSpeedProfileSet::FindRangeCell(double r, size_t& profile, double& weight) const
+		{
+			const size_t last = m_ranges.size() - 1;
+			if (last == 0 || !(r > m_ranges[0])) {
+				profile = 0;
+				weight = 0.0;
+				return;
+			}
+			if (r >= m_ranges[last]) {
+				profile = last - 1;
+				weight = 1.0;
+				return;
+			}
+
+			profile = static_cast<size_t>(std::upper_bound(m_ranges.begin(), m_ranges.end(), r) - m_ranges.begin()) - 1;
+			weight = (r - m_ranges[profile]) / (m_ranges[profile + 1] - m_ranges[profile]);
+		}
+
+		inline RangeSoundSpeedSample SoundSpeedProfileSet::Evaluate(double r, double z) const
+		{
+			size_t profile;
+			double weight;
+			FindRangeCell(r, profile, weight);
+
+			// Depth cell and position in it, clamped like SoundSpeedProfile::Evaluate().
+			const double position = z * m_inverseSpacing;
+			size_t cell = 0;
+			double t = 0.0;
+			bool inside = false;
+			if (position >= static_cast<double>(m_nodeCount - 1)) {
+				cell = m_nodeCount - 1;
+			}
+			else if (position > 0.0) {
+				cell = static_cast<size_t>(position);
+				t = position - cell;
+				inside = true;
+			}
+
+			const double* near = &m_speeds[profile * m_nodeCount + cell];
+			const double nearC = inside ? near[0] + t * (near[1] - near[0]) : near[0];
+			const double nearGradient = inside ? (near[1] - near[0]) * m_inverseSpacing : 0.0;
+			if (m_ranges.size() == 1) {
+				return { nearC, nearGradient, 0.0 };
+			}
+
+			const double* far = near + m_nodeCount;
+			const double farC = inside ? far[0] + t * (far[1] - far[0]) : far[0];
+			const double farGradient = inside ? (far[1] - far[0]) * m_inverseSpacing : 0.0;
+			const bool between = r > m_ranges.front() && r < m_ranges.back();
+			return {
+				nearC + weight * (farC - nearC),
+				nearGradient + weight * (farGradient - nearGradient),
+				between ? (farC - nearC) / (m_ranges[profile + 1] - m_ranges[profile]) : 0.0
+			};
+		}
+	}
+}
@@ -0,0 +1,511 @@
+#include "pch.h"
+#include "TileCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	const char* const c_magic = "sonar-tiles";
+	const int c_version = 1;
+
+	[[noreturn]] void FailAt(const std::string& source, uint64_t line, const std::string& message) {
+		std::ostringstream stream;
+		stream << source << " line " << line << ": " << message;
+		throw std::runtime_error(stream.str());
+	}
+
+	bool ParseDouble(const std::string& text, double& value) {
+		std::istringstream stream(text);
+		return (stream >> value) && stream.eof();
+	}
+
+	std::string ResolvePath(const std::string& source, const std::string& path) {
+		const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+		const std::string::size_type slash = source.find_last_of("/\\");
+		if (absolute || slash == std::string::npos) {
+			return path;
+		}
+		return source.substr(0, slash + 1) + path;
+	}
+
+	int32_t FloorToTile(double position) {
+		return static_cast<int32_t>(std::floor(position));
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// TileSet implementation
+
+SonarPropagation::Sonar::TileSet::TileSet(double cellSize, uint32_t tileCells, double originX, double originZ)
+	: m_cellSize(cellSize), m_tileCells(tileCells), m_originX(originX), m_originZ(originZ)
+{
+	if (!(cellSize > 0.0) || tileCells == 0) {
+		throw std::invalid_argument("TileSet: the cell size and the tile size have to be positive");
+	}
+}
+
+TileSet SonarPropagation::Sonar::TileSet::Read(std::istream& stream, const std::string& source)
+{
+	TileSet tiles;
+	bool headerRead = false;
+	bool tileSetRead = false;
+
+	std::string text;
+	uint64_t lineNumber = 0;
+	while (std::getline(stream, text)) {
+		++lineNumber;
+
+		const std::string::size_type comment = text.find('#');
+		if (comment != std::string::npos) {
+			text.erase(comment);
+		}
+
+		std::istringstream line(text);
+		std::string kind;
+		if (!(line >> kind)) {
+			continue;
+		}
+
+		if (!headerRead) {
+			int version = 0;
+			if (kind != c_magic || !(line >> version) || version != c_version) {
+				FailAt(source, lineNumber, "not a version 1 tile set");
+			}
+			headerRead = true;
+			continue;
+		}
+
+		TileKey key = { 0, 0 };
+		if (kind == "tile") {
+			if (!tileSetRead) {
+				FailAt(source, lineNumber, "tile before the tileset line");
+			}
+			if (!(line >> key.column >> key.row)) {
+				FailAt(source, lineNumber, "tile needs a column and a row");
+			}
+		}
+		else if (kind != "tileset") {
+			FailAt(source, lineNumber, "unknown kind " + kind);
+		}
+		else if (tileSetRead) {
+			FailAt(source, lineNumber, "duplicate tileset line");
+		}
+
+		std::map<std::string, std::string> values;
+		std::string pair;
+		while (line >> pair) {
+			const std::string::size_type equals = pair.find('=');
+			if (equals == std::string::npos || equals == 0) {
+				FailAt(source, lineNumber, "expected key=value, got " + pair);
+			}
+			if (!values.insert({ pair.substr(0, equals), pair.substr(equals + 1) }).second) {
+				FailAt(source, lineNumber, "duplicate key " + pair.substr(0, equals));
+			}
+		}
+
+		if (kind == "tile") {
+			auto file = values.find("file");
+			if (file == values.end() || values.size() != 1) {
+				FailAt(source, lineNumber, "tile takes file= and nothing else");
+			}
+			if (tiles.HasTile(key)) {
+				FailAt(source, lineNumber, "duplicate tile");
+			}
+			tiles.AddTile(key, ResolvePath(source, file->second));
+			continue;
+		}
+
+		double cellSize = 0.0;
+		double tileCells = 0.0;
+		double originX = 0.0;
+		double originZ = 0.0;
+		for (const auto& value : values) {
+			if (value.first == "cellsize") {
+				if (!ParseDouble(value.second, cellSize) || !(cellSize > 0.0)) {
+					FailAt(source, lineNumber, "cellsize has to be a positive number");
+				}
+			}
+			else if (value.first == "tilesize") {
+				if (!ParseDouble(value.second, tileCells) || !(tileCells >= 1.0) || tileCells != std::floor(tileCells) || tileCells > 65536.0) {
+					FailAt(source, lineNumber, "tilesize has to be a whole number of cells between 1 and 65536");
+				}
+			}
+			else if (value.first == "origin") {
+				const std::string::size_type comma = value.second.find(',');
+				if (comma == std::string::npos || !ParseDouble(value.second.substr(0, comma), originX) ||
+					!ParseDouble(value.second.substr(comma + 1), originZ)) {
+					FailAt(source, lineNumber, "origin takes x,z");
+				}
+			}
+			else {
+				FailAt(source, lineNumber, "unknown key " + value.first);
+			}
+		}
+		if (cellSize == 0.0 || tileCells == 0.0) {
+			FailAt(source, lineNumber, "tileset needs cellsize= and tilesize=");
+		}
+
+		tiles = TileSet(cellSize, static_cast<uint32_t>(tileCells), originX, originZ);
+		tileSetRead = true;
+	}
+
+	if (!tileSetRead) {
+		FailAt(source, lineNumber, "tile set has no tileset line");
+	}
+	return tiles;
+}
+
+TileSet SonarPropagation::Sonar::TileSet::Load(const std::string& filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	return Read(file, filename);
+}
+
+void SonarPropagation::Sonar::TileSet::AddTile(const TileKey& key, const std::string& file)
+{
+	if (!m_files.insert({ key, file }).second) {
+		throw std::invalid_argument("TileSet: tile " + std::to_string(key.column) + ' ' + std::to_string(key.row) + " is already in the index");
+	}
+}
+
+bool SonarPropagation::Sonar::TileSet::FindTile(const TileKey& key, std::string& file) const
+{
+	auto found = m_files.find(key);
+	if (found == m_files.end()) {
+		return false;
+	}
+	file = found->second;
+	return true;
+}
+
+TileKey SonarPropagation::Sonar::TileSet::GetTileAt(double x, double z) const
+{
+	const double extent = GetTileExtent();
+	return { FloorToTile((x - m_originX) / extent), FloorToTile((z - m_originZ) / extent) };
+}
+
+void SonarPropagation::Sonar::TileSet::ToTileSpace(const TileKey& key, double x, double z, double& localX, double& localZ) const
+{
+	const double extent = GetTileExtent();
+	localX = x - m_originX - key.column * extent;
+	localZ = z - m_originZ - key.row * extent;
+}
+
+std::vector<TileKey> SonarPropagation::Sonar::TileSet::GetTilesAlong(double originX, double originZ, double directionX, double directionZ,
+	double tFrom, double tTo) const
+{
+	std::vector<TileKey> keys;
+	if (tTo < tFrom) {
+		return keys;
+	}
+
+	// Amanatides-Woo over the squares of the tiles.
+	const double extent = GetTileExtent();
+	const double infinity = std::numeric_limits<double>::infinity();
+	TileKey key = GetTileAt(originX + tFrom * directionX, originZ + tFrom * directionZ);
+
+	const int32_t stepX = directionX > 0.0 ? 1 : (directionX < 0.0 ? -1 : 0);
+	const int32_t stepZ = directionZ > 0.0 ? 1 : (directionZ < 0.0 ? -1 : 0);
+	const double deltaX = stepX ? extent / std::abs(directionX) : infinity;
+	const double deltaZ = stepZ ? extent / std::abs(directionZ) : infinity;
+	double nextX = stepX ? (m_originX + (key.column + (stepX > 0 ? 1 : 0)) * extent - originX) / directionX : infinity;
+	double nextZ = stepZ ? (m_originZ + (key.row + (stepZ > 0 ? 1 : 0)) * extent - originZ) / directionZ : infinity;
+
+	for (;;) {
+		if (HasTile(key)) {
+			keys.push_back(key);
+		}
+
+		if (std::min(nextX, nextZ) > tTo) {
+			break;
+		}
+		if (nextX < nextZ) {
+			key.column += stepX;
+			nextX += deltaX;
+		}
+		else {
+			key.row += stepZ;
+			nextZ += deltaZ;
+		}
+	}
+	return keys;
+}
+
+Heightfield SonarPropagation::Sonar::TileSet::LoadTile(const TileKey& key) const
+{
+	std::string file;
+	if (!FindTile(key, file)) {
+		throw std::runtime_error("TileSet: no tile " + std::to_string(key.column) + ' ' + std::to_string(key.row));
+	}
+
+	Heightfield tile = Heightfield::LoadEsriAscii(file);
+	if (std::abs(tile.GetCellSize() - m_cellSize) > 1e-9 * m_cellSize) {
+		throw std::runtime_error(file + ": cell size differs from the one of the tile set");
+	}
+	if (tile.GetCellColumns() > m_tileCells || tile.GetCellRows() > m_tileCells) {
+		throw std::runtime_error(file + ": grid is larger than a tile");
+	}
+	return tile;
+}
+
+//--------------------------------------------------------------------------------------
+// TileCache implementation
+
+SonarPropagation::Sonar::TileCache::TileCache(Loader loader, size_t budgetBytes)
+	: m_loader(std::move(loader)), m_budget(budgetBytes)
+{
+	m_prefetchThread = std::thread([this]() { RunPrefetch(); });
+}
+
+SonarPropagation::Sonar::TileCache::~TileCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queued.notify_all();
+	m_prefetchThread.join();
+}
+
+std::shared_ptr<const Heightfield> SonarPropagation::Sonar::TileCache::Acquire(const TileKey& key)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto found = m_entries.find(key);
+	if (found != m_entries.end() && found->second.tile) {
+		Entry& entry = found->second;
+		m_recent.splice(m_recent.begin(), m_recent, entry.recent);
+		++m_stats.hits;
+		if (entry.prefetched) {
+			++m_stats.prefetchHits;
+			entry.prefetched = false;
+		}
+		return entry.tile;
+	}
+
+	// Waiting for the rest of a prefetch still saves the caller the load, so it counts as a prefetch hit
+	// rather than a blocking load; which of the two it is would otherwise depend on the timing of the run.
+	if (found != m_entries.end() && found->second.loading) {
+		if (found->second.prefetched) {
+			++m_stats.prefetchWaits;
+		}
+		m_loaded.wait(lock, [&]() {
+			found = m_entries.find(key);
+			return found == m_entries.end() || !found->second.loading;
+		});
+	}
+
+	if (found != m_entries.end()) {
+		Entry& entry = found->second;
+		if (entry.tile) {
+			m_recent.splice(m_recent.begin(), m_recent, entry.recent);
+			if (entry.prefetched) {
+				++m_stats.prefetchHits;
+				entry.prefetched = false;
+			}
+			else {
+				++m_stats.blockingLoads;
+			}
+			return entry.tile;
+		}
+
+		// A failed prefetch; its error is reported once, the next Acquire() tries again.
+		const std::exception_ptr error = entry.error;
+		m_entries.erase(found);
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	++m_stats.blockingLoads;
+	m_entries[key].loading = true;
+	lock.unlock();
+
+	Heightfield tile;
+	try {
+		tile = m_loader(key);
+	}
+	catch (...) {
+		lock.lock();
+		m_entries.erase(key);
+		m_loaded.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	std::shared_ptr<const Heightfield> stored = Store(key, std::move(tile));
+	m_loaded.notify_all();
+	return stored;
+}
+
+void SonarPropagation::Sonar::TileCache::Prefetch(const std::vector<TileKey>& keys)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.clear();
+		for (const TileKey& key : keys) {
+			auto found = m_entries.find(key);
+			// A failed prefetch is tried again rather than left for an Acquire() to clear.
+			if (found != m_entries.end() && found->second.error) {
+				m_entries.erase(found);
+				found = m_entries.end();
+			}
+			if (found == m_entries.end()) {
+				m_queue.push_back(key);
+			}
+		}
+	}
+	m_queued.notify_one();
+}
+
+TileCacheStats SonarPropagation::Sonar::TileCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void SonarPropagation::Sonar::TileCache::RunPrefetch()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_queued.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+		if (m_stopping) {
+			return;
+		}
+
+		const TileKey key = m_queue.front();
+		m_queue.pop_front();
+		if (m_entries.count(key)) {
+			continue;
+		}
+
+		Entry& entry = m_entries[key];
+		entry.loading = true;
+		entry.prefetched = true;
+		lock.unlock();
+
+		Heightfield tile;
+		std::exception_ptr error;
+		try {
+			tile = m_loader(key);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		++m_stats.prefetchLoads;
+		if (error) {
+			Entry& failed = m_entries[key];
+			failed.loading = false;
+			failed.error = error;
+		}
+		else {
+			Store(key, std::move(tile));
+		}
+		m_loaded.notify_all();
+	}
+}
+
+std::shared_ptr<const Heightfield> SonarPropagation::Sonar::TileCache::Store(const TileKey& key, Heightfield tile)
+{
+	Entry& entry = m_entries[key];
+	entry.bytes = tile.GetMemorySize();
+	entry.tile = std::make_shared<const Heightfield>(std::move(tile));
+	entry.loading = false;
+	m_recent.push_front(key);
+	entry.recent = m_recent.begin();
+
+	m_stats.residentBytes += entry.bytes;
+	m_stats.peakBytes = std::max(m_stats.peakBytes, m_stats.residentBytes);
+
+	// Held while evicting, so the new tile is not the one that goes.
+	std::shared_ptr<const Heightfield> stored = entry.tile;
+	Evict();
+	return stored;
+}
+
+void SonarPropagation::Sonar::TileCache::Evict()
+{
+	auto candidate = m_recent.end();
+	while (m_stats.residentBytes > m_budget && candidate != m_recent.begin()) {
+		--candidate;
+
+		auto found = m_entries.find(*candidate);
+		if (found->second.tile.use_count() > 1) {
+			continue;
+		}
+
+		m_stats.residentBytes -= found->second.bytes;
+		++m_stats.evictions;
+		m_entries.erase(found);
+		candidate = m_recent.erase(candidate);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+
+BottomProfile SonarPropagation::Sonar::ExtractBottomProfile(const TileSet& tiles, TileCache& cache, const Vector3& origin,
+	double bearing, double maxRange, double spacing, double fallbackDepth, double lookahead)
+{
+	const size_t sampleCount = static_cast<size_t>(std::ceil(maxRange / spacing)) + 1;
+	const double directionX = std::cos(bearing);
+	const double directionZ = std::sin(bearing);
+	const double tolerance = 1e-9 * tiles.GetTileExtent();
+
+	std::vector<double> depths(sampleCount, fallbackDepth);
+
+	TileKey current = { 0, 0 };
+	bool hasCurrent = false;
+	std::shared_ptr<const Heightfield> tile;
+
+	for (size_t sample = 0; sample < sampleCount; ++sample) {
+		const double s = sample * spacing;
+		const double x = origin.x + s * directionX;
+		const double z = origin.z + s * directionZ;
+
+		const TileKey key = tiles.GetTileAt(x, z);
+		if (!hasCurrent || key != current) {
+			current = key;
+			hasCurrent = true;
+
+			// Let go of the previous tile first, so the cache can evict it to make room.
+			tile.reset();
+			if (tiles.HasTile(key)) {
+				tile = cache.Acquire(key);
+			}
+
+			std::vector<TileKey> ahead = tiles.GetTilesAlong(origin.x, origin.z, directionX, directionZ, s, std::min(maxRange, s + lookahead));
+			ahead.erase(std::remove(ahead.begin(), ahead.end(), key), ahead.end());
+			cache.Prefetch(ahead);
+		}
+
+		if (!tile) {
+			continue;
+		}
+
+		double localX = 0.0;
+		double localZ = 0.0;
+		tiles.ToTileSpace(key, x, z, localX, localZ);
+		if (localX > tile->GetCellColumns() * tile->GetCellSize() + tolerance || localZ > tile->GetCellRows() * tile->GetCellSize() + tolerance) {
+			continue;
+		}
+
+		const double depth = -tile->HeightAt(localX, localZ);
+		if (depth > 0.0) {
+			depths[sample] = depth;
+		}
+	}
+
+	return BottomProfile(std::move(depths), spacing);
+}
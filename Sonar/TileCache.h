@@ -0,0 +1,198 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BottomProfile.h"
+#include "Heightfield.h"
+#include "Vector3.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		struct TileKey {
+			int32_t column;
+			int32_t row;
+
+			bool operator==(const TileKey& other) const { return column == other.column && row == other.row; }
+			bool operator!=(const TileKey& other) const { return !(*this == other); }
+			bool operator<(const TileKey& other) const { return row < other.row || (row == other.row && column < other.column); }
+		};
+
+		/// <summary>
+		/// Spatial index of a survey split into square heightfield tiles, read from a tile set file:
+		///
+		///   sonar-tiles 1
+		///   # cellsize in metres, tilesize in cells; tile (0, 0) has its corner at origin (x, z)
+		///   tileset     cellsize=10 tilesize=1024 origin=0,0
+		///   tile        0 0 file=survey_0_0.asc
+		///   tile        1 0 file=survey_1_0.asc
+		///
+		/// Tile (c, r) covers x in origin.x + [c, c + 1) * tilesize * cellsize and likewise z, so its
+		/// ESRI ASCII grid has tilesize + 1 samples a side and shares its edges with its neighbours.
+		/// Tiles on the border of the survey may be smaller. Only the index is read; the grids are
+		/// loaded through a TileCache.
+		/// </summary>
+		class TileSet {
+		public:
+			TileSet() = default;
+
+			/// <summary>
+			/// An empty index. Throws std::invalid_argument if the cell size or the tile size is not positive.
+			/// </summary>
+			TileSet(double cellSize, uint32_t tileCells, double originX = 0.0, double originZ = 0.0);
+
+			/// <summary>
+			/// Relative tile files are resolved against the directory of source. Throws
+			/// std::runtime_error naming the line of malformed input.
+			/// </summary>
+			static TileSet Read(std::istream& stream, const std::string& source);
+
+			static TileSet Load(const std::string& filename);
+
+			/// <summary>
+			/// Throws std::invalid_argument if the tile is already in the index.
+			/// </summary>
+			void AddTile(const TileKey& key, const std::string& file);
+
+			bool FindTile(const TileKey& key, std::string& file) const;
+			bool HasTile(const TileKey& key) const { return m_files.count(key) != 0; }
+			size_t GetTileCount() const { return m_files.size(); }
+
+			double GetCellSize() const { return m_cellSize; }
+			uint32_t GetTileCells() const { return m_tileCells; }
+			double GetTileExtent() const { return m_cellSize * m_tileCells; }
+
+			/// <summary>
+			/// Tile whose square contains (x, z), whether the index has it or not.
+			/// </summary>
+			TileKey GetTileAt(double x, double z) const;
+
+			/// <summary>
+			/// Position of (x, z) in the local space of a tile, where its heightfield has its first sample at 0.
+			/// </summary>
+			void ToTileSpace(const TileKey& key, double x, double z, double& localX, double& localZ) const;
+
+			/// <summary>
+			/// Tiles of the index crossed by the segment from origin + tFrom * direction to
+			/// origin + tTo * direction in the horizontal plane, in the order the segment enters them.
+			/// </summary>
+			std::vector<TileKey> GetTilesAlong(double originX, double originZ, double directionX, double directionZ,
+				double tFrom, double tTo) const;
+
+			/// <summary>
+			/// Loads the grid of a tile and checks that it fits its square; the loader of a TileCache.
+			/// Throws std::runtime_error if the tile is not in the index or its grid does not match.
+			/// </summary>
+			Heightfield LoadTile(const TileKey& key) const;
+
+		private:
+			double m_cellSize = 1.0;
+			uint32_t m_tileCells = 1;
+			double m_originX = 0.0;
+			double m_originZ = 0.0;
+			std::map<TileKey, std::string> m_files;
+		};
+
+		struct TileCacheStats {
+			// Acquire() calls that found their tile resident.
+			uint64_t hits = 0;
+			// Acquire() calls that had to wait for their tile to be loaded, by the caller or another caller.
+			uint64_t blockingLoads = 0;
+			// Tiles loaded by the prefetch thread, and how many of those were acquired before eviction.
+			uint64_t prefetchLoads = 0;
+			uint64_t prefetchHits = 0;
+			// Prefetch hits that found their tile still loading and waited for the rest of the load.
+			uint64_t prefetchWaits = 0;
+			uint64_t evictions = 0;
+			size_t residentBytes = 0;
+			size_t peakBytes = 0;
+		};
+
+		/// <summary>
+		/// Least recently used cache of heightfield tiles under a memory budget, with a prefetch thread.
+		/// Acquire() only blocks when its tile is neither resident nor already loaded by the prefetch
+		/// thread; Prefetch() queues the tiles the caller is heading to, replacing the previous queue.
+		///
+		/// Tiles leave the cache least recently used first once the resident bytes exceed the budget.
+		/// Tiles still held through an Acquire() result are not evicted, so the budget is only exceeded
+		/// by the tiles in use; it should fit the prefetch distance plus one tile per caller.
+		/// </summary>
+		class TileCache {
+		public:
+			typedef std::function<Heightfield(const TileKey&)> Loader;
+
+			TileCache(Loader loader, size_t budgetBytes);
+			~TileCache();
+
+			TileCache(const TileCache&) = delete;
+			TileCache& operator=(const TileCache&) = delete;
+
+			/// <summary>
+			/// The tile, loaded on the calling thread if need be. Rethrows the exception of its loader.
+			/// </summary>
+			std::shared_ptr<const Heightfield> Acquire(const TileKey& key);
+
+			/// <summary>
+			/// Queues tiles for the prefetch thread, nearest first. Tiles already resident or loading are skipped;
+			/// a tile whose prefetch failed is queued again.
+			/// </summary>
+			void Prefetch(const std::vector<TileKey>& keys);
+
+			TileCacheStats GetStats() const;
+			size_t GetBudget() const { return m_budget; }
+
+		private:
+			struct Entry {
+				std::shared_ptr<const Heightfield> tile;
+				size_t bytes = 0;
+				bool loading = false;
+				bool prefetched = false;
+				std::exception_ptr error;
+				std::list<TileKey>::iterator recent;
+			};
+
+			void RunPrefetch();
+			// Stores a loaded tile and evicts down to the budget. Called with m_mutex held.
+			std::shared_ptr<const Heightfield> Store(const TileKey& key, Heightfield tile);
+			void Evict();
+
+			Loader m_loader;
+			size_t m_budget;
+
+			mutable std::mutex m_mutex;
+			std::condition_variable m_loaded;
+			std::condition_variable m_queued;
+			std::map<TileKey, Entry> m_entries;
+			// Resident tiles, most recently acquired first.
+			std::list<TileKey> m_recent;
+			std::deque<TileKey> m_queue;
+			bool m_stopping = false;
+			TileCacheStats m_stats;
+
+			// Started last, so every member it uses exists.
+			std::thread m_prefetchThread;
+		};
+
+		/// <summary>
+		/// ExtractBottomProfile() over a tile set instead of a scene: the depth under every point of the
+		/// track, tile by tile. The tiles the track enters within lookahead metres of the current point are
+		/// prefetched, so only a tile missing from the cache and not yet prefetched stalls the extraction.
+		/// Points over no tile, or where the seabed is above the surface, get fallbackDepth.
+		/// </summary>
+		BottomProfile ExtractBottomProfile(const TileSet& tiles, TileCache& cache, const Vector3& origin,
+			double bearing, double maxRange, double spacing, double fallbackDepth, double lookahead);
+	}
+}
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "TrajectoryCache.h"
+
+#include "../Common/Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	uint64_t GetAngleBits(double angle) {
+		uint64_t bits;
+		std::memcpy(&bits, &angle, sizeof(bits));
+		return bits;
+	}
+
+	bool HaveSameRays(const LaunchFan& a, const LaunchFan& b) {
+		return a.minAngle == b.minAngle && a.maxAngle == b.maxAngle && a.rayCount == b.rayCount;
+	}
+
+	// Nodes of the map from launch angles to stored paths, roughly.
+	const size_t c_pathIndexBytes = 64;
+}
+
+//--------------------------------------------------------------------------------------
+// TrajectoryCache implementation
+
+bool SonarPropagation::Sonar::TrajectoryCache::SourceKey::operator<(const SourceKey& other) const
+{
+	if (depth != other.depth) {
+		return depth < other.depth;
+	}
+	if (environmentVersion != other.environmentVersion) {
+		return environmentVersion < other.environmentVersion;
+	}
+	if (mode != other.mode) {
+		return mode < other.mode;
+	}
+	if (stepSize != other.stepSize) {
+		return stepSize < other.stepSize;
+	}
+	if (tolerance != other.tolerance) {
+		return tolerance < other.tolerance;
+	}
+	if (maxSteps != other.maxSteps) {
+		return maxSteps < other.maxSteps;
+	}
+	if (maxBounces != other.maxBounces) {
+		return maxBounces < other.maxBounces;
+	}
+	return maxRange < other.maxRange;
+}
+
+bool SonarPropagation::Sonar::TrajectoryCache::SourceKey::IsNeighbour(const SourceKey& other) const
+{
+	return environmentVersion == other.environmentVersion && mode == other.mode && stepSize == other.stepSize &&
+		tolerance == other.tolerance && maxSteps == other.maxSteps && maxBounces == other.maxBounces && maxRange == other.maxRange;
+}
+
+SonarPropagation::Sonar::TrajectoryCache::TrajectoryCache(size_t budgetBytes, double sourceQuantum, const PathTolerance& tolerance)
+	: m_budget(budgetBytes), m_sourceQuantum(std::max(0.0, sourceQuantum)), m_tolerance(tolerance)
+{
+	// Fails early on tolerances the encoder rejects.
+	PathEncoder check(tolerance);
+}
+
+TrajectoryCache::SourceKey SonarPropagation::Sonar::TrajectoryCache::MakeKey(uint64_t environmentVersion, const LaunchFan& fan,
+	const FieldGrid& grid, const PropagationSettings& settings) const
+{
+	const double depth = m_sourceQuantum > 0.0 ? std::round(fan.sourceDepth / m_sourceQuantum) * m_sourceQuantum : fan.sourceDepth;
+	return { depth, environmentVersion, settings.mode, settings.stepSize, settings.tolerance, settings.maxSteps, settings.maxBounces, grid.maxRange };
+}
+
+PropagationResult SonarPropagation::Sonar::TrajectoryCache::Propagate(const Environment& environment, uint64_t environmentVersion,
+	const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings, const ReceiverGrid* receivers)
+{
+	SONAR_PROFILE_SCOPE("TrajectoryCache::Propagate");
+
+	const SourceKey key = MakeKey(environmentVersion, fan, grid, settings);
+	LaunchFan source = fan;
+	source.sourceDepth = key.depth;
+
+	auto inserted = m_sources.emplace(key, Source(m_tolerance));
+	Source& entry = inserted.first->second;
+	if (inserted.second) {
+		m_recent.push_front(key);
+		entry.recent = m_recent.begin();
+	}
+	else {
+		m_recent.splice(m_recent.begin(), m_recent, entry.recent);
+	}
+
+	const bool refine = settings.refinementLevels > 0 && fan.rayCount > 1;
+	PropagationSettings refineSettings = settings;
+	if (!refine) {
+		refineSettings.refinementLevels = 0;
+	}
+
+	const LaunchFan refined = GetRefinedFan(source, refineSettings.refinementLevels);
+	const std::vector<uint32_t> seeds = refine ? FindSeedRays(key, refined) : std::vector<uint32_t>();
+
+	const ReceiverGrid noReceivers;
+	PropagationResult result = RefineFan(source, grid, refineSettings, seeds, [&](const std::vector<uint32_t>& rays, std::vector<RayTrace>& traces) {
+		TraceWave(entry, environment, refined, grid, settings, receivers ? *receivers : noReceivers, rays, traces);
+	});
+
+	if (refine) {
+		entry.refinedFan = refined;
+		entry.refinedRays = result.tracedRays;
+		if (entry.refinedRays.empty()) {
+			for (uint32_t ray = 0; ray < refined.rayCount; ++ray) {
+				entry.refinedRays.push_back(ray);
+			}
+		}
+	}
+
+	Evict(key);
+	m_stats.sourceCount = m_sources.size();
+	return result;
+}
+
+bool SonarPropagation::Sonar::TrajectoryCache::FindPath(uint64_t environmentVersion, const LaunchFan& fan, const FieldGrid& grid,
+	const PropagationSettings& settings, uint32_t ray, RayPath& path) const
+{
+	auto source = m_sources.find(MakeKey(environmentVersion, fan, grid, settings));
+	if (source == m_sources.end()) {
+		return false;
+	}
+
+	auto found = source->second.paths.find(GetAngleBits(fan.GetLaunchAngle(ray)));
+	if (found == source->second.paths.end()) {
+		return false;
+	}
+	source->second.store.Decode(found->second, path);
+	return true;
+}
+
+void SonarPropagation::Sonar::TrajectoryCache::Clear()
+{
+	m_sources.clear();
+	m_recent.clear();
+	m_stats.sourceCount = 0;
+	m_stats.residentBytes = 0;
+}
+
+void SonarPropagation::Sonar::TrajectoryCache::TraceWave(Source& source, const Environment& environment, const LaunchFan& fan,
+	const FieldGrid& grid, const PropagationSettings& settings, const ReceiverGrid& receivers, const std::vector<uint32_t>& rays,
+	std::vector<RayTrace>& traces)
+{
+	std::vector<uint32_t> missing;
+	std::vector<size_t> missingTraces;
+	for (size_t i = 0; i < rays.size(); ++i) {
+		if (!source.paths.count(GetAngleBits(fan.GetLaunchAngle(rays[i])))) {
+			missing.push_back(rays[i]);
+			missingTraces.push_back(i);
+		}
+	}
+
+	std::vector<PathEncoder> paths;
+	TracePaths(environment, fan, grid, settings, missing, m_tolerance, paths);
+	for (size_t i = 0; i < missing.size(); ++i) {
+		traces[missingTraces[i]].steps = paths[i].GetStepCount();
+		source.paths.emplace(GetAngleBits(fan.GetLaunchAngle(missing[i])), source.store.Add(paths[i]));
+	}
+	m_stats.tracedRays += missing.size();
+	m_stats.cachedRays += rays.size() - missing.size();
+
+	const size_t bytes = source.store.GetBytes() + source.paths.size() * c_pathIndexBytes;
+	m_stats.residentBytes = m_stats.residentBytes - source.bytes + bytes;
+	source.bytes = bytes;
+
+	std::vector<uint32_t> found(rays.size());
+	for (size_t i = 0; i < rays.size(); ++i) {
+		found[i] = source.paths.find(GetAngleBits(fan.GetLaunchAngle(rays[i])))->second;
+	}
+
+	// Replays are independent, so they run on the threads of the settings too.
+	const uint32_t threadCount = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(settings.threadCount, rays.size())));
+	std::atomic<size_t> nextRay(0);
+	auto work = [&]() {
+		RayPath path;
+		for (size_t i = nextRay++; i < rays.size(); i = nextRay++) {
+			RayTrace& trace = traces[i];
+			source.store.Decode(found[i], path);
+			ReplayPath(path, grid, receivers, rays[i], settings.recordBottomHits, trace);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t thread = 1; thread < threadCount; ++thread) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+std::vector<uint32_t> SonarPropagation::Sonar::TrajectoryCache::FindSeedRays(const SourceKey& key, const LaunchFan& refined) const
+{
+	const Source* nearest = nullptr;
+	double nearestDistance = 0.0;
+	for (const auto& entry : m_sources) {
+		if (!entry.first.IsNeighbour(key) || !HaveSameRays(entry.second.refinedFan, refined) || entry.second.refinedRays.empty()) {
+			continue;
+		}
+
+		const double distance = std::abs(entry.first.depth - key.depth);
+		if (!nearest || distance < nearestDistance) {
+			nearest = &entry.second;
+			nearestDistance = distance;
+		}
+	}
+	return nearest ? nearest->refinedRays : std::vector<uint32_t>();
+}
+
+void SonarPropagation::Sonar::TrajectoryCache::Evict(const SourceKey& keep)
+{
+	auto candidate = m_recent.end();
+	while (m_stats.residentBytes > m_budget && candidate != m_recent.begin()) {
+		--candidate;
+		if (!(*candidate < keep) && !(keep < *candidate)) {
+			continue;
+		}
+
+		auto found = m_sources.find(*candidate);
+		m_stats.residentBytes -= found->second.bytes;
+		++m_stats.evictions;
+		m_sources.erase(found);
+		candidate = m_recent.erase(candidate);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "PropagationEngine.h"
+#include "ReceiverGrid.h"
+#include "TrajectoryStore.h"
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		struct TrajectoryCacheStats {
+			// Rays whose paths were found in the cache, and rays traced for it.
+			uint64_t cachedRays = 0;
+			uint64_t tracedRays = 0;
+			// Sources whose paths were dropped to stay within the budget.
+			uint64_t evictions = 0;
+			size_t sourceCount = 0;
+			size_t residentBytes = 0;
+		};
+
+		/// <summary>
+		/// Paths of the rays of earlier propagations, so that moving receivers costs no tracing at all:
+		/// their arrivals, and the crossings and transmission loss of the field, are replayed from the
+		/// paths, to within the tolerance they are stored with. Paths are kept per source, in a
+		/// TrajectoryStore, keyed by its depth rounded to sourceQuantum, the version of
+		/// the environment, the settings that shape a path and the range it was traced to; within a
+		/// source, by launch angle, so that fans of other sizes share the rays they have in common.
+		///
+		/// A source moved to a depth it has not seen is traced again. With an adaptive fan, the rays
+		/// the nearest source of the same environment refined are traced in the first wave, which
+		/// spares most of the waves; a source dragged back and forth only ever replays.
+		///
+		/// Sources leave least recently used first once the paths exceed the budget; the one in use
+		/// stays, whatever its size.
+		/// </summary>
+		class TrajectoryCache {
+		public:
+			/// <summary>
+			/// Sources are traced from their depth rounded to a multiple of sourceQuantum metres, or
+			/// from their exact depth if it is 0.
+			/// </summary>
+			explicit TrajectoryCache(size_t budgetBytes, double sourceQuantum = 1.0, const PathTolerance& tolerance = PathTolerance());
+
+			/// <summary>
+			/// RunPropagation() through the cache. environmentVersion must change whenever anything in
+			/// the environment does; the cache cannot tell.
+			/// </summary>
+			PropagationResult Propagate(const Environment& environment, uint64_t environmentVersion, const LaunchFan& fan,
+				const FieldGrid& grid, const PropagationSettings& settings, const ReceiverGrid* receivers = nullptr);
+
+			/// <summary>
+			/// Decodes the path of a ray of a fan propagated before, in the same environment and with the
+			/// same settings. Returns false if the cache does not have it.
+			/// </summary>
+			bool FindPath(uint64_t environmentVersion, const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings,
+				uint32_t ray, RayPath& path) const;
+
+			void Clear();
+
+			const TrajectoryCacheStats& GetStats() const { return m_stats; }
+			size_t GetBudget() const { return m_budget; }
+			double GetSourceQuantum() const { return m_sourceQuantum; }
+			const PathTolerance& GetTolerance() const { return m_tolerance; }
+
+		private:
+			struct SourceKey {
+				double depth;
+				uint64_t environmentVersion;
+				EngineMode mode;
+				double stepSize;
+				double tolerance;
+				uint32_t maxSteps;
+				uint32_t maxBounces;
+				double maxRange;
+
+				bool operator<(const SourceKey& other) const;
+				// Same key but for the depth.
+				bool IsNeighbour(const SourceKey& other) const;
+			};
+
+			struct Source {
+				explicit Source(const PathTolerance& tolerance) : store(tolerance) {}
+
+				TrajectoryStore store;
+				// Paths in the store, keyed by the bits of the launch angle, which is exact for the rays two fans share.
+				std::map<uint64_t, uint32_t> paths;
+				size_t bytes = 0;
+				// Refinement of the last adaptive fan propagated from the source.
+				LaunchFan refinedFan;
+				std::vector<uint32_t> refinedRays;
+				std::list<SourceKey>::iterator recent;
+			};
+
+			SourceKey MakeKey(uint64_t environmentVersion, const LaunchFan& fan, const FieldGrid& grid, const PropagationSettings& settings) const;
+			// Traces the rays of the fan that are missing, then replays every ray. Fills traces[i] for rays[i].
+			void TraceWave(Source& source, const Environment& environment, const LaunchFan& fan, const FieldGrid& grid,
+				const PropagationSettings& settings, const ReceiverGrid& receivers, const std::vector<uint32_t>& rays,
+				std::vector<RayTrace>& traces);
+			// Rays of the nearest source with a refinement of the same fan, its own first.
+			std::vector<uint32_t> FindSeedRays(const SourceKey& key, const LaunchFan& refined) const;
+			void Evict(const SourceKey& keep);
+
+			size_t m_budget;
+			double m_sourceQuantum;
+			PathTolerance m_tolerance;
+			std::map<SourceKey, Source> m_sources;
+			// Most recently propagated first.
+			std::list<SourceKey> m_recent;
+			TrajectoryCacheStats m_stats;
+		};
+	}
+}
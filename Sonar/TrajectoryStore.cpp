@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "TrajectoryStore.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	enum PointFlags : uint8_t {
+		BouncesChanged = 1,
+		IntensityChanged = 2
+	};
+
+	void PutVarint(std::vector<uint8_t>& bytes, uint64_t value) {
+		while (value >= 0x80) {
+			bytes.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back(static_cast<uint8_t>(value));
+	}
+
+	void PutSigned(std::vector<uint8_t>& bytes, int64_t value) {
+		PutVarint(bytes, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+
+	uint64_t GetVarint(const uint8_t*& data) {
+		uint64_t value = 0;
+		for (int shift = 0; ; shift += 7) {
+			const uint8_t byte = *data++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+	}
+
+	int64_t GetSigned(const uint8_t*& data) {
+		const uint64_t value = GetVarint(data);
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	bool IsSameTolerance(const PathTolerance& a, const PathTolerance& b) {
+		return a.position == b.position && a.time == b.time;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// PathEncoder implementation
+
+SonarPropagation::Sonar::PathEncoder::PathEncoder(const PathTolerance& tolerance)
+	: m_tolerance(tolerance), m_positionQuantum(0.25 * tolerance.position), m_timeQuantum(0.25 * tolerance.time)
+{
+	if (!(tolerance.position > 0.0) || !(tolerance.time > 0.0)) {
+		throw std::invalid_argument("PathEncoder: the tolerances have to be positive");
+	}
+}
+
+void SonarPropagation::Sonar::PathEncoder::Add(const PathPoint& point)
+{
+	// The source is always kept.
+	if (m_inputCount++ == 0) {
+		Keep(point, point);
+	}
+	else if (!m_hasCandidate) {
+		StartRun(point);
+	}
+	else {
+		const bool sameAttributes = point.surfaceBounces == m_candidate.surfaceBounces && point.bottomBounces == m_candidate.bottomBounces &&
+			point.intensity == m_candidate.intensity;
+		if (!sameAttributes || !Extend(point)) {
+			Keep(m_candidate, m_candidatePrevious);
+			StartRun(point);
+		}
+		else {
+			m_candidate = point;
+			m_candidatePrevious = m_last;
+		}
+	}
+	m_last = point;
+}
+
+void SonarPropagation::Sonar::PathEncoder::Finish()
+{
+	if (m_hasCandidate) {
+		Keep(m_candidate, m_candidatePrevious);
+		m_hasCandidate = false;
+	}
+}
+
+SonarPropagation::Sonar::PathEncoder::QuantizedPoint SonarPropagation::Sonar::PathEncoder::Quantize(const PathPoint& point,
+	const PathPoint& previous) const
+{
+	const int64_t range = std::llround(point.range / m_positionQuantum);
+	const int64_t depth = std::llround(point.depth / m_positionQuantum);
+
+	// Rounding moves the point along the step by up to about a tenth of the position tolerance, which is
+	// more than the time tolerance at the speed of sound: move its time with it.
+	const double stepX = point.range - previous.range;
+	const double stepY = point.depth - previous.depth;
+	const double lengthSquared = stepX * stepX + stepY * stepY;
+	double time = point.time;
+	if (lengthSquared > 0.0) {
+		const double shift = ((range * m_positionQuantum - point.range) * stepX + (depth * m_positionQuantum - point.depth) * stepY) / lengthSquared;
+		time += shift * (point.time - previous.time);
+	}
+	return { range, depth, std::llround(time / m_timeQuantum) };
+}
+
+void SonarPropagation::Sonar::PathEncoder::Keep(const PathPoint& point, const PathPoint& previous)
+{
+	const QuantizedPoint quantized = Quantize(point, previous);
+	PutSigned(m_bytes, quantized.range - m_kept.range);
+	PutSigned(m_bytes, quantized.depth - m_kept.depth);
+	PutSigned(m_bytes, quantized.time - m_kept.time);
+
+	const bool bouncesChanged = point.surfaceBounces != m_keptSurfaceBounces || point.bottomBounces != m_keptBottomBounces;
+	const bool intensityChanged = point.intensity != m_keptIntensity;
+	m_bytes.push_back(static_cast<uint8_t>((bouncesChanged ? BouncesChanged : 0) | (intensityChanged ? IntensityChanged : 0)));
+	if (bouncesChanged) {
+		PutSigned(m_bytes, static_cast<int64_t>(point.surfaceBounces) - m_keptSurfaceBounces);
+		PutSigned(m_bytes, static_cast<int64_t>(point.bottomBounces) - m_keptBottomBounces);
+	}
+	if (intensityChanged) {
+		uint8_t raw[sizeof(double)];
+		std::memcpy(raw, &point.intensity, sizeof(raw));
+		m_bytes.insert(m_bytes.end(), raw, raw + sizeof(raw));
+	}
+
+	// Later segments start from the point as it decodes, so quantisation does not add up along the ray.
+	m_kept = quantized;
+	m_keptRange = quantized.range * m_positionQuantum;
+	m_keptDepth = quantized.depth * m_positionQuantum;
+	m_keptTime = quantized.time * m_timeQuantum;
+	m_keptSurfaceBounces = point.surfaceBounces;
+	m_keptBottomBounces = point.bottomBounces;
+	m_keptIntensity = point.intensity;
+	++m_pointCount;
+}
+
+void SonarPropagation::Sonar::PathEncoder::StartRun(const PathPoint& point)
+{
+	m_hasCandidate = true;
+	m_candidate = point;
+	m_candidatePrevious = m_last;
+	m_hasSector = false;
+	m_slopeLow = -std::numeric_limits<double>::infinity();
+	m_slopeHigh = std::numeric_limits<double>::infinity();
+	m_maxDistance = 0.0;
+}
+
+bool SonarPropagation::Sonar::PathEncoder::Extend(const PathPoint& point)
+{
+	// The candidate becomes a step inside the run: the chord has to pass within the tolerance of it.
+	const double x = m_candidate.range - m_keptRange;
+	const double y = m_candidate.depth - m_keptDepth;
+	const double distance = std::hypot(x, y);
+	m_maxDistance = std::max(m_maxDistance, distance);
+
+	if (distance > m_tolerance.position) {
+		const double halfWidth = std::asin(m_tolerance.position / distance);
+		if (!m_hasSector) {
+			m_referenceX = x / distance;
+			m_referenceY = y / distance;
+			m_sectorLow = -halfWidth;
+			m_sectorHigh = halfWidth;
+			m_hasSector = true;
+		}
+		else {
+			const double angle = std::atan2(m_referenceX * y - m_referenceY * x, m_referenceX * x + m_referenceY * y);
+			m_sectorLow = std::max(m_sectorLow, angle - halfWidth);
+			m_sectorHigh = std::min(m_sectorHigh, angle + halfWidth);
+			if (m_sectorLow > m_sectorHigh) {
+				return false;
+			}
+		}
+	}
+
+	// Times are interpolated by the fraction of the chord, which is about the distance from the kept point.
+	if (distance > 0.0) {
+		const double delay = m_candidate.time - m_keptTime;
+		m_slopeLow = std::max(m_slopeLow, (delay - m_tolerance.time) / distance);
+		m_slopeHigh = std::min(m_slopeHigh, (delay + m_tolerance.time) / distance);
+		if (m_slopeLow > m_slopeHigh) {
+			return false;
+		}
+	}
+
+	// The new point, as it would decode, has to end a chord through the sector, beyond every step inside it.
+	const QuantizedPoint end = Quantize(point, m_candidate);
+	const double endX = end.range * m_positionQuantum - m_keptRange;
+	const double endY = end.depth * m_positionQuantum - m_keptDepth;
+	const double endDistance = std::hypot(endX, endY);
+	if (!(endDistance > 0.0) || endDistance < m_maxDistance) {
+		return false;
+	}
+
+	if (m_hasSector) {
+		const double angle = std::atan2(m_referenceX * endY - m_referenceY * endX, m_referenceX * endX + m_referenceY * endY);
+		if (angle < m_sectorLow || angle > m_sectorHigh) {
+			return false;
+		}
+	}
+
+	const double slope = (end.time * m_timeQuantum - m_keptTime) / endDistance;
+	return slope >= m_slopeLow && slope <= m_slopeHigh;
+}
+
+//--------------------------------------------------------------------------------------
+// TrajectoryStore implementation
+
+uint32_t SonarPropagation::Sonar::TrajectoryStore::Add(const PathEncoder& path)
+{
+	if (!IsSameTolerance(path.GetTolerance(), m_tolerance)) {
+		throw std::invalid_argument("TrajectoryStore: the path was encoded with other tolerances");
+	}
+
+	const std::vector<uint8_t>& bytes = path.GetBytes();
+	Entry entry;
+	entry.size = static_cast<uint32_t>(bytes.size());
+	entry.pointCount = path.GetPointCount();
+	entry.stepCount = path.GetStepCount();
+
+	if (bytes.size() > c_arenaBytes) {
+		entry.arena = static_cast<uint32_t>(m_arenas.size());
+		entry.offset = 0;
+		m_arenas.emplace_back(bytes.begin(), bytes.end());
+		m_arenaBytes += bytes.size();
+	}
+	else {
+		if (!m_hasOpenArena || m_arenas[m_openArena].size() + bytes.size() > c_arenaBytes) {
+			m_openArena = m_arenas.size();
+			m_hasOpenArena = true;
+			m_arenas.emplace_back();
+			m_arenas.back().reserve(c_arenaBytes);
+			m_arenaBytes += c_arenaBytes;
+		}
+
+		std::vector<uint8_t>& arena = m_arenas[m_openArena];
+		entry.arena = static_cast<uint32_t>(m_openArena);
+		entry.offset = static_cast<uint32_t>(arena.size());
+		arena.insert(arena.end(), bytes.begin(), bytes.end());
+	}
+
+	m_entries.push_back(entry);
+	return static_cast<uint32_t>(m_entries.size() - 1);
+}
+
+void SonarPropagation::Sonar::TrajectoryStore::Decode(uint32_t index, RayPath& path) const
+{
+	const Entry& entry = m_entries[index];
+	const double positionQuantum = 0.25 * m_tolerance.position;
+	const double timeQuantum = 0.25 * m_tolerance.time;
+
+	path.points.clear();
+	path.points.reserve(entry.pointCount);
+
+	const uint8_t* data = m_arenas[entry.arena].data() + entry.offset;
+	int64_t range = 0;
+	int64_t depth = 0;
+	int64_t time = 0;
+	PathPoint point = {};
+	for (uint32_t i = 0; i < entry.pointCount; ++i) {
+		range += GetSigned(data);
+		depth += GetSigned(data);
+		time += GetSigned(data);
+		point.range = range * positionQuantum;
+		point.depth = depth * positionQuantum;
+		point.time = time * timeQuantum;
+
+		const uint8_t flags = *data++;
+		if (flags & BouncesChanged) {
+			point.surfaceBounces = static_cast<uint32_t>(point.surfaceBounces + GetSigned(data));
+			point.bottomBounces = static_cast<uint32_t>(point.bottomBounces + GetSigned(data));
+		}
+		if (flags & IntensityChanged) {
+			std::memcpy(&point.intensity, data, sizeof(double));
+			data += sizeof(double);
+		}
+		path.points.push_back(point);
+	}
+}
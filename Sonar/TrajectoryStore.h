@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		/// <summary>
+		/// A point of a traced ray. The bounce counts and the intensity factor are those of the segment
+		/// ending at the point; the first point is the source.
+		/// </summary>
+		struct PathPoint {
+			double range;
+			double depth;
+			double time;
+			double intensity;
+			uint32_t surfaceBounces;
+			uint32_t bottomBounces;
+		};
+
+		/// <summary>
+		/// A ray as a polyline, decoded from a TrajectoryStore.
+		/// </summary>
+		struct RayPath {
+			std::vector<PathPoint> points;
+		};
+
+		struct PathTolerance {
+			// Largest distance between a step of the ray and the polyline kept for it, in metres.
+			double position = 0.05;
+			// Largest error of the time interpolated along the polyline at a step, in seconds.
+			double time = 1e-5;
+		};
+
+		/// <summary>
+		/// Decimates a ray step by step as it is traced and encodes the points it keeps. A run of steps
+		/// becomes one segment for as long as every step stays within the tolerance of the chord from
+		/// the last kept point, which is tracked in constant time per step: the directions of the chords
+		/// that pass every step so far form an angular sector, and their time slopes an interval.
+		/// Reflections, and every other change of the bounce counts or the intensity factor, are kept.
+		///
+		/// Kept points are quantised to a quarter of the tolerances and delta encoded as variable
+		/// length integers, so a segment takes about six bytes. Rounding moves a point along the step
+		/// that reached it, time included, and segment ends are checked as they decode, so it never
+		/// takes a step outside the tolerances.
+		/// </summary>
+		class PathEncoder {
+		public:
+			/// <summary>
+			/// Throws std::invalid_argument if a tolerance is not positive.
+			/// </summary>
+			explicit PathEncoder(const PathTolerance& tolerance = PathTolerance());
+
+			void Add(const PathPoint& point);
+
+			/// <summary>
+			/// Keeps the last point; call once the ray stops.
+			/// </summary>
+			void Finish();
+
+			bool IsEmpty() const { return m_inputCount == 0; }
+			const PathTolerance& GetTolerance() const { return m_tolerance; }
+			const std::vector<uint8_t>& GetBytes() const { return m_bytes; }
+			uint32_t GetStepCount() const { return m_inputCount > 0 ? m_inputCount - 1 : 0; }
+			uint32_t GetPointCount() const { return m_pointCount; }
+
+		private:
+			struct QuantizedPoint {
+				int64_t range;
+				int64_t depth;
+				int64_t time;
+			};
+
+			// Rounds point, moving its time along the step from previous by as much as its position.
+			QuantizedPoint Quantize(const PathPoint& point, const PathPoint& previous) const;
+			void Keep(const PathPoint& point, const PathPoint& previous);
+			void StartRun(const PathPoint& point);
+			// Whether point can end the run, with the candidate so far as one more step inside it.
+			bool Extend(const PathPoint& point);
+
+			PathTolerance m_tolerance;
+			double m_positionQuantum;
+			double m_timeQuantum;
+			std::vector<uint8_t> m_bytes;
+			uint32_t m_inputCount = 0;
+			uint32_t m_pointCount = 0;
+
+			// Last kept point, as it decodes, and the attributes written with it.
+			QuantizedPoint m_kept = {};
+			double m_keptRange = 0.0;
+			double m_keptDepth = 0.0;
+			double m_keptTime = 0.0;
+			uint32_t m_keptSurfaceBounces = 0;
+			uint32_t m_keptBottomBounces = 0;
+			double m_keptIntensity = 0.0;
+
+			// The run from the kept point: its last step is the candidate end of the segment.
+			bool m_hasCandidate = false;
+			PathPoint m_candidate = {};
+			PathPoint m_candidatePrevious = {};
+			// Last point added.
+			PathPoint m_last = {};
+			// Chord directions, relative to m_reference, and time slopes that pass every step inside the run.
+			double m_referenceX = 1.0;
+			double m_referenceY = 0.0;
+			bool m_hasSector = false;
+			double m_sectorLow = 0.0;
+			double m_sectorHigh = 0.0;
+			double m_slopeLow = 0.0;
+			double m_slopeHigh = 0.0;
+			double m_maxDistance = 0.0;
+		};
+
+		/// <summary>
+		/// Encoded paths packed into arenas of 64 KiB, addressed by the index Add() returns. A path
+		/// never straddles two arenas; one larger than an arena gets an arena of its own.
+		/// </summary>
+		class TrajectoryStore {
+		public:
+			explicit TrajectoryStore(const PathTolerance& tolerance = PathTolerance()) : m_tolerance(tolerance) {}
+
+			/// <summary>
+			/// Stores a finished path. Throws std::invalid_argument if it was encoded with other tolerances.
+			/// </summary>
+			uint32_t Add(const PathEncoder& path);
+
+			/// <summary>
+			/// Replaces the points of path with those of the stored one.
+			/// </summary>
+			void Decode(uint32_t index, RayPath& path) const;
+
+			size_t GetPathCount() const { return m_entries.size(); }
+			uint32_t GetStepCount(uint32_t index) const { return m_entries[index].stepCount; }
+			uint32_t GetPointCount(uint32_t index) const { return m_entries[index].pointCount; }
+			// Arenas and index.
+			size_t GetBytes() const { return m_arenaBytes + m_entries.capacity() * sizeof(Entry); }
+			const PathTolerance& GetTolerance() const { return m_tolerance; }
+
+			static const size_t c_arenaBytes = 64 * 1024;
+
+		private:
+			struct Entry {
+				uint32_t arena;
+				uint32_t offset;
+				uint32_t size;
+				uint32_t pointCount;
+				uint32_t stepCount;
+			};
+
+			PathTolerance m_tolerance;
+			std::vector<std::vector<uint8_t>> m_arenas;
+			std::vector<Entry> m_entries;
+			size_t m_arenaBytes = 0;
+			// Arena small paths go to; the others hold a large path each.
+			size_t m_openArena = 0;
+			bool m_hasOpenArena = false;
+		};
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace SonarPropagation {
+	namespace Sonar {
+
+		struct Float3 {
+			float x;
+			float y;
+			float z;
+		};
+
+		struct Vector3 {
+			double x;
+			double y;
+			double z;
+		};
+	}
+}
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include "Common/AllocationCounter.h"
+#include "Common/FrameArena.h"
+#include "Common/PoolAllocator.h"
+#include "Sonar/PropagationEngine.h"
+
+using namespace SonarPropagation::Graphics::Utils;
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	struct SceneObject {
+		SceneObject(uint32_t model, float x) : model(model), x(x) {}
+
+		uint32_t model;
+		float x;
+	};
+
+	// What a frame does with its allocators: instances come and go, transient arrays live until the next frame.
+	float RunFrame(PoolAllocator<SceneObject>& pool, FrameArena& arena, uint32_t frame) {
+		SceneObject* objects[16];
+		for (uint32_t i = 0; i < 16; ++i) {
+			objects[i] = pool.Create(i, static_cast<float>(frame + i));
+		}
+
+		FrameArray<float> positions = arena.AllocateArray<float>(256);
+		FrameArray<uint32_t> barriers = arena.MakeArray<uint32_t>({ 1, 2, 3, 4 });
+		for (size_t i = 0; i < positions.size; ++i) {
+			positions.data[i] = objects[i % 16]->x;
+		}
+
+		float sum = static_cast<float>(barriers.data[3]);
+		for (uint32_t i = 0; i < 16; ++i) {
+			sum += positions.data[i];
+			pool.Destroy(objects[i]);
+		}
+
+		arena.Reset();
+		return sum;
+	}
+
+	Environment MakeEnvironment() {
+		Environment environment(SoundSpeedProfile::Munk());
+		environment.bottomDepth = 4000.0;
+		environment.bottomLossDb = 0.5;
+		return environment;
+	}
+
+	void CheckSame(const PropagationResult& a, const PropagationResult& b) {
+		SONAR_CHECK(a.crossings.size() == b.crossings.size());
+		for (size_t i = 0; i < a.crossings.size(); ++i) {
+			SONAR_CHECK(a.crossings[i].ray == b.crossings[i].ray && a.crossings[i].depth == b.crossings[i].depth);
+		}
+		SONAR_CHECK(a.transmissionLoss == b.transmissionLoss);
+		SONAR_CHECK(a.bottomHits.size() == b.bottomHits.size());
+		SONAR_CHECK(a.totalSteps == b.totalSteps);
+	}
+}
+
+void SonarPropagation::Validation::AddAllocationCountTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "AllocationCounter counts the global operator new of the calling thread", []() {
+		// Without the counting operators every check below would pass trivially.
+		SONAR_CHECK(AllocationCounter::IsEnabled());
+
+		ScopedAllocationCounter counter;
+		std::unique_ptr<int> value(new int(1));
+		std::vector<double> values(8);
+		SONAR_CHECK(counter.GetAllocations() == 2);
+	} });
+
+	tests.push_back({ "A warm frame of the pool and the frame arena does not allocate", []() {
+		PoolAllocator<SceneObject> pool(8);
+		FrameArena arena(256);
+
+		// The first frames grow the pool to two blocks and the arena past its overflow.
+		RunFrame(pool, arena, 0);
+		RunFrame(pool, arena, 1);
+
+		ScopedAllocationCounter counter;
+		for (uint32_t frame = 2; frame < 10; ++frame) {
+			RunFrame(pool, arena, frame);
+		}
+		SONAR_CHECK(counter.GetAllocations() == 0);
+		SONAR_CHECK(pool.GetStats().liveAllocations == 0);
+	} });
+
+	tests.push_back({ "A warm RunPropagation step does not allocate", []() {
+		const Environment environment = MakeEnvironment();
+		LaunchFan fan;
+		fan.rayCount = 61;
+		FieldGrid grid;
+		grid.maxRange = 20000.0;
+
+		for (EngineMode mode : { EngineMode::ScalarDouble, EngineMode::ScalarFloat, EngineMode::Simd, EngineMode::Adaptive }) {
+			PropagationSettings settings;
+			settings.mode = mode;
+			settings.stepSize = 20.0;
+			settings.recordBottomHits = true;
+
+			PropagationWorkspace workspace;
+			PropagationResult result;
+			RunPropagation(environment, fan, grid, settings, nullptr, workspace, result);
+
+			ScopedAllocationCounter counter;
+			RunPropagation(environment, fan, grid, settings, nullptr, workspace, result);
+			SONAR_CHECK(counter.GetAllocations() == 0);
+
+			CheckSame(result, RunPropagation(environment, fan, grid, settings));
+		}
+	} });
+}
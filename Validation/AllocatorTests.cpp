@@ -0,0 +1,330 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include "Common/FrameArena.h"
+#include "Common/PoolAllocator.h"
+#include "Common/RangeAllocator.h"
+#include "Common/RingAllocator.h"
+
+using namespace SonarPropagation::Graphics::Utils;
+
+namespace {
+
+	struct Counted {
+		explicit Counted(int* destroyed, int value = 0) : destroyed(destroyed), value(value) {}
+		~Counted() { ++*destroyed; }
+
+		int* destroyed;
+		int value;
+	};
+
+	const uint64_t c_pageAlignment = 256;
+
+	// The size BufferAllocator gives a dedicated page for a request larger than its page size.
+	uint64_t GetDedicatedPageSize(uint64_t size, uint64_t alignment) {
+		const uint64_t pageAlignment = std::max(alignment, c_pageAlignment);
+		return (size + pageAlignment - 1) & ~(pageAlignment - 1);
+	}
+}
+
+void SonarPropagation::Validation::AddAllocatorTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "PoolAllocator reuses the last freed slot", []() {
+		int destroyed = 0;
+		PoolAllocator<Counted> pool(4);
+
+		Counted* a = pool.Create(&destroyed, 1);
+		Counted* b = pool.Create(&destroyed, 2);
+		pool.Destroy(a);
+		SONAR_CHECK(destroyed == 1);
+
+		Counted* c = pool.Create(&destroyed, 3);
+		SONAR_CHECK(c == a);
+		SONAR_CHECK(c->value == 3);
+		SONAR_CHECK(b->value == 2);
+		SONAR_CHECK(pool.GetStats().liveAllocations == 2);
+		SONAR_CHECK(pool.GetStats().totalDeallocations == 1);
+		SONAR_CHECK(pool.GetStats().blockCount == 1);
+	} });
+
+	tests.push_back({ "PoolAllocator grows by whole blocks and keeps pointers stable", []() {
+		int destroyed = 0;
+		PoolAllocator<Counted> pool(4);
+
+		std::vector<Counted*> objects;
+		for (int i = 0; i < 10; ++i) {
+			objects.push_back(pool.Create(&destroyed, i));
+		}
+
+		SONAR_CHECK(pool.Capacity() == 12);
+		SONAR_CHECK(pool.GetStats().blockCount == 3);
+		for (int i = 0; i < 10; ++i) {
+			SONAR_CHECK(objects[i]->value == i);
+		}
+		SONAR_CHECK(pool.GetStats().peakAllocations == 10);
+	} });
+
+	tests.push_back({ "PoolAllocator Reset destroys live objects and keeps the blocks", []() {
+		int destroyed = 0;
+		PoolAllocator<Counted> pool(4);
+
+		for (int i = 0; i < 6; ++i) {
+			pool.Create(&destroyed, i);
+		}
+		pool.Reset();
+		SONAR_CHECK(destroyed == 6);
+		SONAR_CHECK(pool.GetStats().liveAllocations == 0);
+		SONAR_CHECK(pool.Capacity() == 8);
+
+		// Refilling the reserved capacity must not grow the pool.
+		for (int i = 0; i < 8; ++i) {
+			pool.Create(&destroyed, i);
+		}
+		SONAR_CHECK(pool.GetStats().blockCount == 2);
+
+		pool.Clear();
+		SONAR_CHECK(destroyed == 14);
+		SONAR_CHECK(pool.Capacity() == 0);
+	} });
+
+	tests.push_back({ "FrameArena aligns allocations and starts over after Reset", []() {
+		FrameArena arena(1024);
+
+		uint8_t* first = static_cast<uint8_t*>(arena.Allocate(3, 1));
+		void* aligned = arena.Allocate(16, 64);
+		SONAR_CHECK(reinterpret_cast<uintptr_t>(aligned) % 64 == 0);
+		SONAR_CHECK(arena.GetStats().liveAllocations == 2);
+
+		arena.Reset();
+		SONAR_CHECK(arena.GetStats().liveAllocations == 0);
+		SONAR_CHECK(arena.GetStats().bytesInUse == 0);
+		SONAR_CHECK(static_cast<uint8_t*>(arena.Allocate(3, 1)) == first);
+		SONAR_CHECK(arena.GetOverflowCount() == 0);
+	} });
+
+	tests.push_back({ "FrameArena serves overflow from the heap and grows on Reset", []() {
+		FrameArena arena(256);
+
+		FrameArray<uint32_t> values = arena.AllocateArray<uint32_t>(32);
+		FrameArray<uint32_t> overflow = arena.AllocateArray<uint32_t>(64);
+		SONAR_CHECK(arena.GetOverflowCount() == 1);
+		for (uint32_t i = 0; i < 64; ++i) {
+			overflow[i] = i;
+		}
+		SONAR_CHECK(overflow[63] == 63);
+		SONAR_CHECK(values.size == 32);
+
+		arena.Reset();
+		SONAR_CHECK(arena.Capacity() >= 256 + 64 * sizeof(uint32_t));
+
+		// The same frame fits once the arena has grown.
+		arena.AllocateArray<uint32_t>(32);
+		arena.AllocateArray<uint32_t>(64);
+		SONAR_CHECK(arena.GetOverflowCount() == 1);
+	} });
+
+	tests.push_back({ "FrameArena MakeArray copies the values", []() {
+		FrameArena arena(256);
+
+		FrameArray<int> values = arena.MakeArray({ 4, 5, 6 });
+		SONAR_CHECK(values.size == 3);
+		SONAR_CHECK(values[0] == 4 && values[1] == 5 && values[2] == 6);
+	} });
+
+	tests.push_back({ "RangeAllocator fits requests into dedicated pages sized for them", []() {
+		const uint64_t sizes[] = { 70000128ull, 100000000ull, 3000000000ull, 65ull * 1024 * 1024 + 1 };
+		const uint64_t alignments[] = { 256, 4, 65536 };
+
+		for (uint64_t size : sizes) {
+			for (uint64_t alignment : alignments) {
+				RangeAllocator page(GetDedicatedPageSize(size, alignment), c_pageAlignment);
+				RangeAllocation range = page.Allocate(size, alignment);
+				SONAR_CHECK(range.IsValid());
+				SONAR_CHECK(range.offset == 0);
+				SONAR_CHECK(range.size >= size);
+
+				page.Free(range);
+				SONAR_CHECK(page.GetStats().usedSize == 0);
+			}
+		}
+	} });
+
+	tests.push_back({ "RangeAllocator hands out its full capacity", []() {
+		const uint64_t granularities[] = { 1, 256 };
+		const uint64_t sizes[] = { 17, 1000, 4096 * 3 + 5, 1ull << 30 };
+
+		for (uint64_t granularity : granularities) {
+			for (uint64_t size : sizes) {
+				RangeAllocator allocator(size * granularity, granularity);
+				RangeAllocation all = allocator.Allocate(size * granularity);
+				SONAR_CHECK(all.IsValid());
+				SONAR_CHECK(allocator.GetStats().freeSize == 0);
+				SONAR_CHECK(!allocator.Allocate(1).IsValid());
+
+				allocator.Free(all);
+				SONAR_CHECK(allocator.GetStats().freeRangeCount == 1);
+			}
+		}
+	} });
+
+	tests.push_back({ "RangeAllocator hands out the exact rest after other allocations", []() {
+		RangeAllocator allocator(1000, 1);
+
+		RangeAllocation first = allocator.Allocate(100);
+		RangeAllocation second = allocator.Allocate(237);
+		SONAR_CHECK(first.IsValid() && second.IsValid());
+
+		RangeAllocation rest = allocator.Allocate(663);
+		SONAR_CHECK(rest.IsValid());
+		SONAR_CHECK(rest.offset == 337);
+		SONAR_CHECK(allocator.GetStats().freeSize == 0);
+
+		// A hole of exactly the request's size is found again once it is freed.
+		allocator.Free(second);
+		RangeAllocation refill = allocator.Allocate(237);
+		SONAR_CHECK(refill.IsValid());
+		SONAR_CHECK(refill.offset == 100);
+		SONAR_CHECK(!allocator.Allocate(1).IsValid());
+	} });
+
+	tests.push_back({ "RangeAllocator honours alignments above the granularity", []() {
+		RangeAllocator allocator(1 << 20, 256);
+
+		RangeAllocation small = allocator.Allocate(256);
+		RangeAllocation aligned = allocator.Allocate(1000, 65536);
+		SONAR_CHECK(small.IsValid() && aligned.IsValid());
+		SONAR_CHECK(aligned.offset % 65536 == 0);
+		SONAR_CHECK(aligned.offset >= small.offset + small.size);
+
+		allocator.Free(small);
+		allocator.Free(aligned);
+		RangeAllocatorStats stats = allocator.GetStats();
+		SONAR_CHECK(stats.usedSize == 0);
+		SONAR_CHECK(stats.freeRangeCount == 1);
+		SONAR_CHECK(stats.largestFreeRange == 1 << 20);
+	} });
+
+	tests.push_back({ "RangeAllocator refuses requests larger than what is free", []() {
+		RangeAllocator allocator(4096, 256);
+
+		SONAR_CHECK(!allocator.Allocate(4097).IsValid());
+		RangeAllocation half = allocator.Allocate(2048);
+		SONAR_CHECK(half.IsValid());
+		SONAR_CHECK(!allocator.Allocate(2049).IsValid());
+		SONAR_CHECK(allocator.Allocate(2048).IsValid());
+	} });
+
+	tests.push_back({ "RangeAllocator fills a descriptor heap exactly", []() {
+		// Descriptor heaps place one slot per unit, next to the three persistent raytracing slots.
+		for (uint32_t capacity = 4; capacity <= 1024; ++capacity) {
+			RangeAllocator slots(capacity, 1);
+			RangeAllocation raytracing = slots.Allocate(3);
+			RangeAllocation rest = slots.Allocate(capacity - 3);
+			SONAR_CHECK(raytracing.IsValid() && rest.IsValid());
+			SONAR_CHECK(rest.offset == 3);
+			SONAR_CHECK(slots.GetStats().freeSize == 0);
+		}
+
+		RangeAllocator slots(64, 1);
+		std::vector<RangeAllocation> single;
+		for (uint32_t slot = 0; slot < 64; ++slot) {
+			single.push_back(slots.Allocate(1));
+			SONAR_CHECK(single.back().IsValid());
+		}
+		SONAR_CHECK(!slots.Allocate(1).IsValid());
+
+		// Freeing a run of 20 slots makes room for exactly 20 again.
+		for (uint32_t slot = 30; slot < 50; ++slot) {
+			slots.Free(single[slot]);
+		}
+		RangeAllocation run = slots.Allocate(20);
+		SONAR_CHECK(run.IsValid());
+		SONAR_CHECK(run.offset == 30);
+		SONAR_CHECK(slots.GetStats().freeSize == 0);
+	} });
+
+	tests.push_back({ "RingAllocator wraps around to the start once the tail has moved", []() {
+		RingAllocator ring(1024);
+		uint64_t offset = 0;
+
+		SONAR_CHECK(ring.Allocate(400, 1, offset) && offset == 0);
+		ring.Submit(1);
+		SONAR_CHECK(ring.Allocate(400, 1, offset) && offset == 400);
+		ring.Submit(2);
+
+		// The end of the ring is too short, and [0, 400) is still in flight.
+		SONAR_CHECK(!ring.Allocate(300, 1, offset));
+		ring.Reclaim(1);
+		SONAR_CHECK(ring.Allocate(300, 1, offset) && offset == 0);
+		// The skipped end counts as used until the batch is reclaimed.
+		SONAR_CHECK(ring.GetUsedSize() == 924);
+
+		// Free space is now [300, 400) only.
+		SONAR_CHECK(!ring.Allocate(101, 1, offset));
+		SONAR_CHECK(ring.Allocate(100, 1, offset) && offset == 300);
+		SONAR_CHECK(ring.GetUsedSize() == 1024 && ring.GetPeakUsedSize() == 1024);
+		ring.Submit(3);
+
+		ring.Reclaim(3);
+		SONAR_CHECK(ring.GetUsedSize() == 0 && ring.GetPendingBatchCount() == 0);
+		SONAR_CHECK(ring.Allocate(1024, 1, offset) && offset == 0);
+	} });
+
+	tests.push_back({ "RingAllocator reclaims batches as their fences complete", []() {
+		RingAllocator ring(1 << 16);
+		uint64_t offset = 0;
+
+		// More batches than the queue starts with; the second submit of a fence is empty and adds none.
+		for (uint64_t fence = 1; fence <= 40; ++fence) {
+			SONAR_CHECK(ring.Allocate(100, 256, offset));
+			SONAR_CHECK(offset % 256 == 0);
+			ring.Submit(fence);
+			ring.Submit(fence);
+		}
+		SONAR_CHECK(ring.GetPendingBatchCount() == 40);
+		const uint64_t used = ring.GetUsedSize();
+
+		ring.Reclaim(0);
+		SONAR_CHECK(ring.GetPendingBatchCount() == 40 && ring.GetUsedSize() == used);
+
+		ring.Reclaim(25);
+		SONAR_CHECK(ring.GetPendingBatchCount() == 15);
+		SONAR_CHECK(ring.GetUsedSize() < used && ring.GetUsedSize() > 0);
+
+		// An allocation not yet submitted is kept past any fence.
+		SONAR_CHECK(ring.Allocate(100, 1, offset));
+		ring.Reclaim(40);
+		SONAR_CHECK(ring.GetPendingBatchCount() == 0 && ring.GetUsedSize() == 100);
+		ring.Submit(41);
+		ring.Reclaim(41);
+		SONAR_CHECK(ring.GetUsedSize() == 0);
+	} });
+
+	tests.push_back({ "RingAllocator refuses allocations larger than its free space", []() {
+		RingAllocator ring(1024);
+		uint64_t offset = 0;
+
+		SONAR_CHECK(!ring.Allocate(1025, 1, offset));
+		SONAR_CHECK(ring.Allocate(600, 1, offset));
+		SONAR_CHECK(!ring.Allocate(425, 1, offset));
+		// A refused request leaves the ring as it was.
+		SONAR_CHECK(ring.GetUsedSize() == 600);
+		// So does one that fits but not once aligned.
+		SONAR_CHECK(!ring.Allocate(400, 256, offset));
+		SONAR_CHECK(ring.Allocate(424, 1, offset) && offset == 600);
+		ring.Submit(1);
+		ring.Reclaim(1);
+
+		SONAR_CHECK(ring.Allocate(400, 1, offset) && offset == 0);
+		ring.Submit(2);
+		SONAR_CHECK(ring.Allocate(400, 1, offset) && offset == 400);
+		ring.Submit(3);
+		ring.Reclaim(2);
+
+		// 624 bytes free in total, but split between [800, 1024) and [0, 400).
+		SONAR_CHECK(ring.GetUsedSize() == 400);
+		SONAR_CHECK(!ring.Allocate(401, 1, offset));
+		SONAR_CHECK(ring.GetUsedSize() == 400);
+		SONAR_CHECK(ring.Allocate(400, 1, offset) && offset == 0);
+	} });
+}
@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include "Common/FrameRing.h"
+
+using namespace SonarPropagation::Graphics::Utils;
+
+void SonarPropagation::Validation::AddFrameRingTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "FrameRing waits for nothing until the slots wrap around", []() {
+		FrameRing ring(3);
+
+		std::vector<uint32_t> slots;
+		for (uint32_t frame = 0; frame < 3; ++frame) {
+			SONAR_CHECK(ring.BeginNextFrame() == 0);
+			slots.push_back(ring.GetCurrentSlot());
+			SONAR_CHECK(ring.EndFrame() == frame + 1);
+		}
+		SONAR_CHECK(slots[0] != slots[1] && slots[1] != slots[2] && slots[0] != slots[2]);
+
+		// The fourth frame reuses the slot of the first and has to wait for it to complete.
+		SONAR_CHECK(ring.BeginNextFrame() == 1);
+		SONAR_CHECK(ring.GetCurrentSlot() == slots[0]);
+		SONAR_CHECK(ring.EndFrame() == 4);
+	} });
+
+	tests.push_back({ "FrameRing waits on the frame that last used the slot", []() {
+		FrameRing ring(3);
+
+		for (uint64_t frame = 1; frame <= 30; ++frame) {
+			const uint32_t slot = static_cast<uint32_t>((frame - 1) % 3);
+			const uint64_t wait = ring.BeginFrame(slot);
+			SONAR_CHECK(wait == (frame > 3 ? frame - 3 : 0));
+			SONAR_CHECK(ring.EndFrame() == frame);
+			SONAR_CHECK(ring.GetLastSignaledValue() == frame);
+		}
+	} });
+
+	tests.push_back({ "FrameRing waits on the oldest frame beyond the latency", []() {
+		FrameRing ring(3, 2);
+		SONAR_CHECK(ring.GetMaxLatency() == 2);
+
+		SONAR_CHECK(ring.BeginFrame(0) == 0);
+		ring.EndFrame();
+		SONAR_CHECK(ring.BeginFrame(1) == 0);
+		ring.EndFrame();
+
+		// Slot 2 is unused, but with two frames in flight the oldest of them has to finish first.
+		SONAR_CHECK(ring.BeginFrame(2) == 1);
+		ring.EndFrame();
+		SONAR_CHECK(ring.BeginFrame(0) == 2);
+		ring.EndFrame();
+
+		ring.SetMaxLatency(1);
+		SONAR_CHECK(ring.BeginFrame(1) == 4);
+	} });
+
+	tests.push_back({ "FrameRing follows the slot order of the swap chain", []() {
+		FrameRing ring(3);
+
+		// Back buffer indices do not have to rotate in order, e.g. after a resize.
+		ring.BeginFrame(0);
+		ring.EndFrame();
+		ring.BeginFrame(2);
+		ring.EndFrame();
+		SONAR_CHECK(ring.BeginFrame(2) == 2);
+		ring.EndFrame();
+		SONAR_CHECK(ring.BeginFrame(0) == 1);
+		ring.EndFrame();
+
+		// Slot 1 was never used, but three frames are in flight: the oldest of them has to finish.
+		SONAR_CHECK(ring.BeginFrame(1) == 2);
+	} });
+
+	tests.push_back({ "FrameRing clamps the latency and resets its slots", []() {
+		FrameRing ring(2, 5);
+		SONAR_CHECK(ring.GetMaxLatency() == 2);
+		ring.SetMaxLatency(0);
+		SONAR_CHECK(ring.GetMaxLatency() == 1);
+
+		ring.BeginFrame(0);
+		const uint64_t first = ring.EndFrame();
+		const uint64_t idle = ring.Signal();
+		SONAR_CHECK(idle == first + 1);
+		SONAR_CHECK(ring.GetCurrentFenceValue() == idle + 1);
+
+		ring.ResetSlots();
+		SONAR_CHECK(ring.BeginFrame(0) == 0);
+		SONAR_CHECK(ring.EndFrame() == idle + 1);
+
+		bool threw = false;
+		try {
+			ring.BeginFrame(2);
+		}
+		catch (const std::out_of_range&) {
+			threw = true;
+		}
+		SONAR_CHECK(threw);
+	} });
+
+	tests.push_back({ "FenceRetireQueue releases objects once their fence completes", []() {
+		FenceRetireQueue<std::shared_ptr<int>> queue;
+		std::shared_ptr<int> a = std::make_shared<int>(1);
+		std::shared_ptr<int> b = std::make_shared<int>(2);
+		std::weak_ptr<int> weakA = a;
+		std::weak_ptr<int> weakB = b;
+
+		queue.Retire(std::move(a), 3);
+		queue.Retire(std::move(b), 5);
+		queue.Collect(2);
+		SONAR_CHECK(queue.GetSize() == 2);
+
+		queue.Collect(3);
+		SONAR_CHECK(queue.GetSize() == 1);
+		SONAR_CHECK(weakA.expired());
+		SONAR_CHECK(!weakB.expired());
+
+		queue.Collect(10);
+		SONAR_CHECK(queue.GetSize() == 0);
+		SONAR_CHECK(weakB.expired());
+	} });
+}
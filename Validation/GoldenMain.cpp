@@ -0,0 +1,186 @@
+#include "pch.h"
+#include "GoldenReference.h"
+#include "Sonar/TrajectoryCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace SonarPropagation::Sonar;
+using namespace SonarPropagation::Validation;
+
+namespace {
+
+	void PrintUsage() {
+		std::cout <<
+			"Usage: SonarGolden [options]\n"
+			"  --references <dir>     directory of the .golden files (default References)\n"
+			"  --mode <name|all>      engine mode to check (default all)\n"
+			"  --scenario <name>      check one scenario only\n"
+			"  --threads <n>          threads per propagation (default 1)\n"
+			"  --update               regenerate the references instead of checking\n";
+	}
+
+	// Holds the paths of every scenario with room to spare.
+	const size_t c_trajectoryCacheBudget = 256 * 1024 * 1024;
+
+	// The adaptive fan starts from every fourth ray, so its refined fan is the fan of the references.
+	// It halves intervals whose rays drift a cell apart: at the default of two cells it skips enough
+	// rays in the Munk profile to move the transmission loss by a decibel, more than the references allow.
+	const uint32_t c_refinementLevels = 2;
+
+	LaunchFan GetCoarseFan(const LaunchFan& fan) {
+		LaunchFan coarse = fan;
+		coarse.rayCount = ((fan.rayCount - 1) >> c_refinementLevels) + 1;
+		return coarse;
+	}
+
+	// The crossings of the rays an adaptive fan traced; the transmission loss stays that of the dense fan.
+	GoldenReference KeepTracedRays(GoldenReference reference, const std::vector<uint32_t>& tracedRays) {
+		if (!tracedRays.empty()) {
+			auto untraced = [&tracedRays](const RayCrossing& crossing) { return !std::binary_search(tracedRays.begin(), tracedRays.end(), crossing.ray); };
+			reference.crossings.erase(std::remove_if(reference.crossings.begin(), reference.crossings.end(), untraced), reference.crossings.end());
+		}
+		return reference;
+	}
+
+	std::string GetReferencePath(const std::string& directory, const GoldenScenario& scenario) {
+		return directory + "/" + scenario.name + ".golden";
+	}
+
+	void Report(const std::string& name, const GoldenComparison& comparison, uint32_t& checked, uint32_t& failures) {
+		std::cout << (comparison.Passed() ? "PASS " : "FAIL ") << name
+			<< "  depth max " << comparison.maxDepthError << " rms " << comparison.rmsDepthError
+			<< "  time rel " << comparison.maxRelativeTimeError
+			<< "  mismatched " << comparison.mismatchFraction
+			<< "  tl rms " << comparison.tlRmsError << " p95 " << comparison.tlP95Error << '\n';
+		for (const std::string& failure : comparison.failures) {
+			std::cout << "    " << failure << '\n';
+		}
+
+		++checked;
+		if (!comparison.Passed()) {
+			++failures;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string referenceDirectory = "References";
+	std::string modeName = "all";
+	std::string scenarioName;
+	uint32_t threadCount = 1;
+	bool update = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+
+		if (!std::strcmp(argv[i], "--references") && hasValue) {
+			referenceDirectory = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--mode") && hasValue) {
+			modeName = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--scenario") && hasValue) {
+			scenarioName = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--threads") && hasValue) {
+			threadCount = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		}
+		else if (!std::strcmp(argv[i], "--update")) {
+			update = true;
+		}
+		else {
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	std::vector<EngineMode> modes;
+	if (modeName == "all") {
+		for (uint32_t mode = 0; mode < static_cast<uint32_t>(EngineMode::Count); ++mode) {
+			modes.push_back(static_cast<EngineMode>(mode));
+		}
+	}
+	else {
+		EngineMode mode;
+		if (!ParseEngineMode(modeName, mode)) {
+			std::cerr << "Unknown mode " << modeName << '\n';
+			return 2;
+		}
+		modes.push_back(mode);
+	}
+
+	uint32_t failures = 0;
+	uint32_t checked = 0;
+
+	try {
+		for (const GoldenScenario& scenario : GetGoldenScenarios()) {
+			if (!scenarioName.empty() && scenario.name != scenarioName) {
+				continue;
+			}
+
+			const std::string path = GetReferencePath(referenceDirectory, scenario);
+
+			if (update) {
+				PropagationSettings settings = GetReferenceSettings();
+				settings.threadCount = threadCount;
+				const PropagationResult result = RunPropagation(scenario.environment, scenario.fan, scenario.grid, settings);
+
+				std::ofstream file(path.c_str());
+				if (!file) {
+					std::cerr << "Could not write " << path << '\n';
+					return 1;
+				}
+				WriteGoldenReference(file, MakeGoldenReference(scenario, result));
+				std::cout << "wrote " << path << " (" << result.crossings.size() << " crossings)\n";
+				continue;
+			}
+
+			std::ifstream file(path.c_str());
+			if (!file) {
+				std::cerr << "Missing reference " << path << "; run with --update to create it\n";
+				return 1;
+			}
+			const GoldenReference reference = ReadGoldenReference(file);
+
+			for (EngineMode mode : modes) {
+				PropagationSettings settings = GetModeSettings(mode);
+				settings.threadCount = threadCount;
+				const std::string name = scenario.name + '/' + GetEngineModeName(mode);
+				const PropagationResult result = RunPropagation(scenario.environment, scenario.fan, scenario.grid, settings);
+				Report(name, CompareToReference(reference, MakeGoldenReference(scenario, result), scenario.tolerances), checked, failures);
+
+				// The second propagation through the cache replays every ray from the paths the first one stored.
+				TrajectoryCache cache(c_trajectoryCacheBudget);
+				cache.Propagate(scenario.environment, 0, scenario.fan, scenario.grid, settings);
+				const uint64_t tracedRays = cache.GetStats().tracedRays;
+				const PropagationResult replayed = cache.Propagate(scenario.environment, 0, scenario.fan, scenario.grid, settings);
+
+				GoldenComparison comparison = CompareToReference(reference, MakeGoldenReference(scenario, replayed), scenario.tolerances);
+				if (cache.GetStats().tracedRays != tracedRays) {
+					comparison.failures.push_back("replay traced " + std::to_string(cache.GetStats().tracedRays - tracedRays) + " rays");
+				}
+				Report(name + "/cached", comparison, checked, failures);
+
+				PropagationSettings refineSettings = settings;
+				refineSettings.refinementLevels = c_refinementLevels;
+				refineSettings.refineDepthGap = scenario.grid.maxDepth / scenario.grid.depthCount;
+				const PropagationResult refined = RunPropagation(scenario.environment, GetCoarseFan(scenario.fan), scenario.grid, refineSettings);
+				Report(name + "/refined", CompareToReference(KeepTracedRays(reference, refined.tracedRays), MakeGoldenReference(scenario, refined),
+					scenario.tolerances), checked, failures);
+			}
+		}
+	}
+	catch (const std::exception& exception) {
+		std::cerr << "Golden check failed: " << exception.what() << '\n';
+		return 1;
+	}
+
+	if (!update) {
+		std::cout << checked - failures << " of " << checked << " checks passed\n";
+	}
+	return failures ? 1 : 0;
+}
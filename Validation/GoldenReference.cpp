@@ -0,0 +1,224 @@
+#include "pch.h"
+#include "GoldenReference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	const char* c_magic = "sonar-golden";
+	const int c_version = 1;
+
+	std::string FormatFailure(const char* metric, double value, double limit) {
+		std::ostringstream stream;
+		stream << metric << ' ' << value << " exceeds " << limit;
+		return stream.str();
+	}
+
+	std::runtime_error ParseError(size_t line, const std::string& message) {
+		std::ostringstream stream;
+		stream << "Golden reference line " << line << ": " << message;
+		return std::runtime_error(stream.str());
+	}
+}
+
+SonarPropagation::Validation::GoldenReference SonarPropagation::Validation::MakeGoldenReference(const GoldenScenario& scenario,
+	const PropagationResult& result)
+{
+	GoldenReference reference;
+	reference.scenario = scenario.name;
+	reference.rangeCount = scenario.grid.rangeCount;
+	reference.depthCount = scenario.grid.depthCount;
+	reference.crossings = result.crossings;
+	reference.transmissionLoss = result.transmissionLoss;
+	return reference;
+}
+
+void SonarPropagation::Validation::WriteGoldenReference(std::ostream& stream, const GoldenReference& reference)
+{
+	stream << c_magic << ' ' << c_version << '\n';
+	stream << "scenario " << reference.scenario << '\n';
+	stream << "grid " << reference.rangeCount << ' ' << reference.depthCount << '\n';
+
+	stream << std::setprecision(17);
+	for (const RayCrossing& crossing : reference.crossings) {
+		stream << "crossing " << crossing.column << ' ' << crossing.ray << ' ' << crossing.depth << ' ' << crossing.time << ' '
+			<< crossing.surfaceBounces << ' ' << crossing.bottomBounces << '\n';
+	}
+
+	stream << std::setprecision(9);
+	for (uint32_t column = 0; column < reference.rangeCount; ++column) {
+		stream << "tl " << column;
+		for (uint32_t row = 0; row < reference.depthCount; ++row) {
+			stream << ' ' << reference.transmissionLoss[static_cast<size_t>(column) * reference.depthCount + row];
+		}
+		stream << '\n';
+	}
+}
+
+SonarPropagation::Validation::GoldenReference SonarPropagation::Validation::ReadGoldenReference(std::istream& stream)
+{
+	GoldenReference reference;
+	std::vector<bool> columnsRead;
+	bool hasGrid = false;
+
+	std::string text;
+	size_t lineNumber = 0;
+	while (std::getline(stream, text)) {
+		++lineNumber;
+		if (text.empty()) {
+			continue;
+		}
+
+		std::istringstream line(text);
+		std::string keyword;
+		line >> keyword;
+
+		if (lineNumber == 1) {
+			int version = 0;
+			if (keyword != c_magic || !(line >> version) || version != c_version) {
+				throw ParseError(lineNumber, "not a version 1 golden reference");
+			}
+		}
+		else if (keyword == "scenario") {
+			line >> reference.scenario;
+		}
+		else if (keyword == "grid") {
+			if (!(line >> reference.rangeCount >> reference.depthCount)) {
+				throw ParseError(lineNumber, "bad grid");
+			}
+			reference.transmissionLoss.assign(static_cast<size_t>(reference.rangeCount) * reference.depthCount, 0.0f);
+			columnsRead.assign(reference.rangeCount, false);
+			hasGrid = true;
+		}
+		else if (keyword == "crossing") {
+			RayCrossing crossing = {};
+			if (!(line >> crossing.column >> crossing.ray >> crossing.depth >> crossing.time >> crossing.surfaceBounces >> crossing.bottomBounces)) {
+				throw ParseError(lineNumber, "bad crossing");
+			}
+			reference.crossings.push_back(crossing);
+		}
+		else if (keyword == "tl") {
+			uint32_t column = 0;
+			if (!hasGrid || !(line >> column) || column >= reference.rangeCount) {
+				throw ParseError(lineNumber, "tl column outside the grid");
+			}
+			for (uint32_t row = 0; row < reference.depthCount; ++row) {
+				if (!(line >> reference.transmissionLoss[static_cast<size_t>(column) * reference.depthCount + row])) {
+					throw ParseError(lineNumber, "too few tl values");
+				}
+			}
+			columnsRead[column] = true;
+		}
+		else {
+			throw ParseError(lineNumber, "unknown keyword " + keyword);
+		}
+	}
+
+	if (lineNumber == 0) {
+		throw std::runtime_error("Golden reference is empty");
+	}
+	if (!hasGrid || std::find(columnsRead.begin(), columnsRead.end(), false) != columnsRead.end()) {
+		throw std::runtime_error("Golden reference " + reference.scenario + " misses transmission loss columns");
+	}
+	return reference;
+}
+
+SonarPropagation::Validation::GoldenComparison SonarPropagation::Validation::CompareToReference(const GoldenReference& reference,
+	const GoldenReference& candidate, const GoldenTolerances& tolerances)
+{
+	GoldenComparison comparison;
+
+	if (reference.rangeCount != candidate.rangeCount || reference.depthCount != candidate.depthCount) {
+		comparison.failures.push_back("grids differ");
+		return comparison;
+	}
+
+	// Both sides are sorted by (column, ray); walk them together.
+	auto before = [](const RayCrossing& a, const RayCrossing& b) {
+		return a.column != b.column ? a.column < b.column : a.ray < b.ray;
+	};
+
+	size_t mismatches = 0;
+	size_t pairs = 0;
+	double squaredDepthError = 0.0;
+	size_t i = 0;
+	size_t j = 0;
+	while (i < reference.crossings.size() || j < candidate.crossings.size()) {
+		if (j == candidate.crossings.size() || (i < reference.crossings.size() && before(reference.crossings[i], candidate.crossings[j]))) {
+			++mismatches;
+			++i;
+			continue;
+		}
+		if (i == reference.crossings.size() || before(candidate.crossings[j], reference.crossings[i])) {
+			++mismatches;
+			++j;
+			continue;
+		}
+
+		const RayCrossing& expected = reference.crossings[i++];
+		const RayCrossing& actual = candidate.crossings[j++];
+		if (expected.surfaceBounces != actual.surfaceBounces || expected.bottomBounces != actual.bottomBounces) {
+			++mismatches;
+			continue;
+		}
+
+		const double depthError = std::abs(actual.depth - expected.depth);
+		comparison.maxDepthError = std::max(comparison.maxDepthError, depthError);
+		comparison.maxRelativeTimeError = std::max(comparison.maxRelativeTimeError, std::abs(actual.time - expected.time) / expected.time);
+		squaredDepthError += depthError * depthError;
+		++pairs;
+	}
+
+	comparison.rmsDepthError = pairs ? std::sqrt(squaredDepthError / pairs) : 0.0;
+	comparison.mismatchFraction = reference.crossings.empty() ? (candidate.crossings.empty() ? 0.0 : 1.0)
+		: static_cast<double>(mismatches) / reference.crossings.size();
+
+	std::vector<double> tlErrors;
+	for (size_t cell = 0; cell < reference.transmissionLoss.size(); ++cell) {
+		if (reference.transmissionLoss[cell] < tolerances.tlCeiling) {
+			tlErrors.push_back(std::abs(static_cast<double>(candidate.transmissionLoss[cell]) - reference.transmissionLoss[cell]));
+		}
+	}
+
+	if (!tlErrors.empty()) {
+		double squared = 0.0;
+		for (double error : tlErrors) {
+			squared += error * error;
+		}
+		comparison.tlRmsError = std::sqrt(squared / tlErrors.size());
+
+		// Nearest rank, like RollingHistogram.
+		const size_t rank = static_cast<size_t>(std::ceil(0.95 * tlErrors.size()));
+		std::nth_element(tlErrors.begin(), tlErrors.begin() + (rank - 1), tlErrors.end());
+		comparison.tlP95Error = tlErrors[rank - 1];
+	}
+
+	if (comparison.maxDepthError > tolerances.maxDepthError) {
+		comparison.failures.push_back(FormatFailure("max depth error", comparison.maxDepthError, tolerances.maxDepthError));
+	}
+	if (comparison.rmsDepthError > tolerances.rmsDepthError) {
+		comparison.failures.push_back(FormatFailure("rms depth error", comparison.rmsDepthError, tolerances.rmsDepthError));
+	}
+	if (comparison.maxRelativeTimeError > tolerances.maxRelativeTimeError) {
+		comparison.failures.push_back(FormatFailure("max relative time error", comparison.maxRelativeTimeError, tolerances.maxRelativeTimeError));
+	}
+	if (comparison.mismatchFraction > tolerances.maxMismatchFraction) {
+		comparison.failures.push_back(FormatFailure("mismatched crossings", comparison.mismatchFraction, tolerances.maxMismatchFraction));
+	}
+	if (comparison.tlRmsError > tolerances.tlRmsError) {
+		comparison.failures.push_back(FormatFailure("tl rms error", comparison.tlRmsError, tolerances.tlRmsError));
+	}
+	if (comparison.tlP95Error > tolerances.tlP95Error) {
+		comparison.failures.push_back(FormatFailure("tl p95 error", comparison.tlP95Error, tolerances.tlP95Error));
+	}
+
+	return comparison;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "GoldenScenarios.h"
+
+namespace SonarPropagation {
+	namespace Validation {
+
+		/// <summary>
+		/// A stored result. The text format is line based:
+		///   sonar-golden 1
+		///   scenario &lt;name&gt;
+		///   grid &lt;rangeCount&gt; &lt;depthCount&gt;
+		///   crossing &lt;column&gt; &lt;ray&gt; &lt;depth&gt; &lt;time&gt; &lt;surfaceBounces&gt; &lt;bottomBounces&gt;
+		///   tl &lt;column&gt; &lt;depthCount values&gt;
+		/// Values are written with enough digits to round-trip a double.
+		/// </summary>
+		struct GoldenReference {
+			std::string scenario;
+			uint32_t rangeCount = 0;
+			uint32_t depthCount = 0;
+			std::vector<Sonar::RayCrossing> crossings;
+			std::vector<float> transmissionLoss;
+		};
+
+		GoldenReference MakeGoldenReference(const GoldenScenario& scenario, const Sonar::PropagationResult& result);
+
+		void WriteGoldenReference(std::ostream& stream, const GoldenReference& reference);
+
+		/// <summary>
+		/// Throws std::runtime_error if the stream is not a reference in the format above.
+		/// </summary>
+		GoldenReference ReadGoldenReference(std::istream& stream);
+
+		struct GoldenComparison {
+			double maxDepthError = 0.0;
+			double rmsDepthError = 0.0;
+			double maxRelativeTimeError = 0.0;
+			double mismatchFraction = 0.0;
+			double tlRmsError = 0.0;
+			double tlP95Error = 0.0;
+			// One line per exceeded tolerance; empty if the result passed.
+			std::vector<std::string> failures;
+
+			bool Passed() const { return failures.empty(); }
+		};
+
+		/// <summary>
+		/// Pairs the crossings of both sides by (column, ray). Depth and time errors are taken over the
+		/// pairs that hit the boundaries equally often; every other crossing counts as a mismatch.
+		/// </summary>
+		GoldenComparison CompareToReference(const GoldenReference& reference, const GoldenReference& candidate,
+			const GoldenTolerances& tolerances);
+	}
+}
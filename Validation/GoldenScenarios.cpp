@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "GoldenScenarios.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	std::vector<SonarPropagation::Validation::GoldenScenario> MakeScenarios() {
+		using SonarPropagation::Validation::GoldenScenario;
+
+		std::vector<GoldenScenario> scenarios;
+
+		{
+			GoldenScenario scenario("isovelocity", Environment(SoundSpeedProfile::Isovelocity(1500.0)));
+			scenario.environment.bottomDepth = 1000.0;
+			scenario.fan.sourceDepth = 100.0;
+			scenario.fan.minAngle = -30.0;
+			scenario.fan.maxAngle = 30.0;
+			scenario.grid.maxRange = 10000.0;
+			scenario.grid.maxDepth = 1000.0;
+			scenario.grid.depthCount = 100;
+			scenarios.push_back(scenario);
+		}
+		{
+			GoldenScenario scenario("linear_gradient", Environment(SoundSpeedProfile::LinearGradient(1500.0, 0.017)));
+			scenario.environment.bottomDepth = 2000.0;
+			scenario.fan.sourceDepth = 100.0;
+			scenario.fan.minAngle = -20.0;
+			scenario.fan.maxAngle = 20.0;
+			scenario.grid.maxRange = 20000.0;
+			scenario.grid.maxDepth = 2000.0;
+			scenario.grid.depthCount = 100;
+			scenarios.push_back(scenario);
+		}
+		{
+			GoldenScenario scenario("munk", Environment(SoundSpeedProfile::Munk()));
+			scenario.environment.bottomDepth = 5000.0;
+			scenario.fan.sourceDepth = 1000.0;
+			scenario.fan.minAngle = -15.0;
+			scenario.fan.maxAngle = 15.0;
+			scenario.grid.maxRange = 50000.0;
+			scenario.grid.maxDepth = 5000.0;
+			scenario.grid.depthCount = 100;
+			scenarios.push_back(scenario);
+		}
+		{
+			// Mixed layer warming with pressure down to 100 m over a thermocline; the rays launched
+			// shallowest stay trapped in the layer.
+			const std::vector<double> depths = { 0.0, 100.0, 300.0, 1000.0 };
+			const std::vector<double> speeds = { 1500.0, 1501.6, 1491.6, 1502.8 };
+
+			GoldenScenario scenario("surface_duct", Environment(SoundSpeedProfile::FromSamples(depths, speeds, 1.0)));
+			scenario.environment.bottomDepth = 1000.0;
+			scenario.environment.surfaceLossDb = 0.1;
+			// The table is piecewise linear, so its gradient jumps at every node and no integrator
+			// does better than second order across them.
+			scenario.tolerances.maxDepthError = 2.5;
+			scenario.tolerances.rmsDepthError = 0.5;
+			scenario.fan.sourceDepth = 50.0;
+			scenario.fan.minAngle = -5.0;
+			scenario.fan.maxAngle = 5.0;
+			scenario.grid.maxRange = 10000.0;
+			scenario.grid.maxDepth = 1000.0;
+			scenario.grid.depthCount = 100;
+			scenarios.push_back(scenario);
+		}
+		{
+			GoldenScenario scenario("flat_bottom", Environment(SoundSpeedProfile::Isovelocity(1500.0)));
+			scenario.environment.bottomDepth = 200.0;
+			scenario.environment.bottomLossDb = 0.5;
+			scenario.fan.sourceDepth = 50.0;
+			scenario.fan.minAngle = -20.0;
+			scenario.fan.maxAngle = 20.0;
+			scenario.grid.maxRange = 5000.0;
+			scenario.grid.maxDepth = 200.0;
+			scenario.grid.depthCount = 40;
+			scenarios.push_back(scenario);
+		}
+		{
+			// Upslope wedge: every bottom reflection steepens the ray by twice the slope angle.
+			GoldenScenario scenario("sloped_bottom", Environment(SoundSpeedProfile::Isovelocity(1500.0)));
+			scenario.environment.bottomDepth = 200.0;
+			scenario.environment.bottomSlope = -0.02;
+			scenario.environment.bottomLossDb = 0.5;
+			scenario.fan.sourceDepth = 50.0;
+			scenario.fan.minAngle = -20.0;
+			scenario.fan.maxAngle = 20.0;
+			scenario.grid.maxRange = 4000.0;
+			scenario.grid.rangeCount = 8;
+			scenario.grid.maxDepth = 200.0;
+			scenario.grid.depthCount = 40;
+			scenarios.push_back(scenario);
+		}
+
+		return scenarios;
+	}
+}
+
+const std::vector<SonarPropagation::Validation::GoldenScenario>& SonarPropagation::Validation::GetGoldenScenarios()
+{
+	static const std::vector<GoldenScenario> scenarios = MakeScenarios();
+	return scenarios;
+}
+
+PropagationSettings SonarPropagation::Validation::GetReferenceSettings()
+{
+	PropagationSettings settings;
+	settings.mode = EngineMode::Analytic;
+	settings.stepSize = 0.5;
+	return settings;
+}
+
+PropagationSettings SonarPropagation::Validation::GetModeSettings(EngineMode mode)
+{
+	PropagationSettings settings;
+	settings.mode = mode;
+	settings.stepSize = 5.0;
+	return settings;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Sonar/PropagationEngine.h"
+
+namespace SonarPropagation {
+	namespace Validation {
+
+		/// <summary>
+		/// How far a mode may stray from the reference. Depths and times are compared per crossing,
+		/// transmission loss per cell, and only on cells the reference puts above tlCeiling.
+		/// </summary>
+		struct GoldenTolerances {
+			double maxDepthError = 1.0;
+			double rmsDepthError = 0.25;
+			// Relative to the travel time; single precision accumulates about 2e-4 over a long fan.
+			double maxRelativeTimeError = 5e-4;
+			// Crossings that are missing on one side or hit a boundary a different number of times.
+			double maxMismatchFraction = 0.01;
+			double tlRmsError = 0.5;
+			double tlP95Error = 1.0;
+			double tlCeiling = 120.0;
+		};
+
+		struct GoldenScenario {
+			GoldenScenario(const std::string& scenarioName, const Sonar::Environment& scenarioEnvironment)
+				: name(scenarioName), environment(scenarioEnvironment) {}
+
+			std::string name;
+			Sonar::Environment environment;
+			Sonar::LaunchFan fan;
+			Sonar::FieldGrid grid;
+			GoldenTolerances tolerances;
+		};
+
+		/// <summary>
+		/// The canonical scenarios: isovelocity, linear gradient, Munk, surface duct and a flat and a
+		/// sloped bottom. Built once.
+		/// </summary>
+		const std::vector<GoldenScenario>& GetGoldenScenarios();
+
+		/// <summary>
+		/// Settings the references are generated with: double precision with a fine fixed step and the
+		/// closed form arcs wherever the profile allows them.
+		/// </summary>
+		Sonar::PropagationSettings GetReferenceSettings();
+
+		/// <summary>
+		/// Settings of a mode under test; the step sizes are the ones the engine is meant to run at.
+		/// </summary>
+		Sonar::PropagationSettings GetModeSettings(Sonar::EngineMode mode);
+	}
+}
@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+#include "Sonar/HitMap.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	// A 400 m square and a 2 km by 300 m strip, both in world units.
+	std::vector<HitSurface> MakeSurfaces() {
+		return {
+			{ Matrix4x3::Identity(), 0.0, 0.0, 400.0, 400.0, 1.0, 1.0 },
+			{ Matrix4x3::Identity(), -1000.0, 0.0, 1000.0, 300.0, 1.0, 1.0 }
+		};
+	}
+
+	// Hits clustered along a few tracks, as rays leave them, with energies over nine decades; some
+	// fall outside the time window or on a surface that does not exist.
+	std::vector<SurfaceHit> MakeHits(size_t count) {
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<double> decades(-9.0, 0.0);
+
+		std::vector<SurfaceHit> hits;
+		for (size_t i = 0; i < count; ++i) {
+			const uint32_t track = static_cast<uint32_t>(i / 500);
+			SurfaceHit hit;
+			hit.surface = i % 97 == 0 ? 5 : track % 2;
+			hit.u = std::min(1.0f, 0.1f * (track % 10) + 0.05f * unit(random));
+			hit.v = unit(random);
+			hit.time = 10.0 * unit(random);
+			hit.energy = std::pow(10.0, decades(random));
+			hits.push_back(hit);
+		}
+		return hits;
+	}
+
+	void CheckIdentical(const HitMap& a, const HitMap& b) {
+		SONAR_CHECK(a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() && a.GetTexelSize() == b.GetTexelSize());
+		SONAR_CHECK(a.GetTiles().size() == b.GetTiles().size());
+		SONAR_CHECK(a.GetTiles().empty() || std::memcmp(a.GetTiles().data(), b.GetTiles().data(), a.GetTiles().size() * sizeof(HitMap::Tile)) == 0);
+	}
+
+	template <typename T>
+	void Put(std::ostream& stream, const T& value) {
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	// A version 2 header as WriteBinary() writes it.
+	std::string MakeHeader(uint32_t width, uint32_t height, uint64_t tileCount) {
+		std::ostringstream stream;
+		stream.write("SPHM", 4);
+		Put(stream, uint32_t(2));
+		Put(stream, width);
+		Put(stream, height);
+		Put(stream, 1.0);
+		Put(stream, tileCount);
+		return stream.str();
+	}
+
+	bool ReadFails(const std::string& bytes) {
+		std::istringstream stream(bytes);
+		try {
+			HitMap::ReadBinary(stream, "test");
+		}
+		catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	}
+}
+
+void SonarPropagation::Validation::AddHitMapTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "AccumulateHitMaps gives byte-identical maps on 1 and N threads", []() {
+		const std::vector<HitSurface> surfaces = MakeSurfaces();
+		const std::vector<SurfaceHit> hits = MakeHits(20000);
+
+		HitMapSettings settings;
+		settings.resolution = 512;
+		settings.endTime = 9.0;
+		const std::vector<HitMap> single = AccumulateHitMaps(hits, surfaces, settings);
+		SONAR_CHECK(single.size() == surfaces.size());
+		SONAR_CHECK(single[0].GetTiles().size() > 1 && single[1].GetTiles().size() > 1);
+
+		for (uint32_t threadCount : { 2u, 4u, 7u }) {
+			settings.threadCount = threadCount;
+			const std::vector<HitMap> parallel = AccumulateHitMaps(hits, surfaces, settings);
+			SONAR_CHECK(parallel.size() == single.size());
+			for (size_t surface = 0; surface < single.size(); ++surface) {
+				CheckIdentical(single[surface], parallel[surface]);
+			}
+		}
+
+		// Reordering the hits moves them between threads, which changes nothing either.
+		std::vector<SurfaceHit> reversed(hits.rbegin(), hits.rend());
+		const std::vector<HitMap> shuffled = AccumulateHitMaps(reversed, surfaces, settings);
+		for (size_t surface = 0; surface < single.size(); ++surface) {
+			CheckIdentical(single[surface], shuffled[surface]);
+		}
+	} });
+
+	tests.push_back({ "AccumulateHitMaps keeps every hit in the time window", []() {
+		const std::vector<HitSurface> surfaces = MakeSurfaces();
+		const std::vector<SurfaceHit> hits = MakeHits(5000);
+
+		HitMapSettings settings;
+		settings.resolution = 256;
+		settings.startTime = 1.0;
+		settings.endTime = 9.0;
+		settings.threadCount = 3;
+
+		uint64_t expected = 0;
+		for (const SurfaceHit& hit : hits) {
+			if (hit.surface < surfaces.size() && hit.time >= settings.startTime && hit.time < settings.endTime) {
+				++expected;
+			}
+		}
+
+		uint64_t total = 0;
+		for (const HitMap& map : AccumulateHitMaps(hits, surfaces, settings)) {
+			total += map.GetTotalHits();
+		}
+		SONAR_CHECK(total == expected);
+	} });
+
+	tests.push_back({ "HitMap reads back what it wrote", []() {
+		HitMapSettings settings;
+		settings.resolution = 512;
+		const std::vector<HitMap> maps = AccumulateHitMaps(MakeHits(5000), MakeSurfaces(), settings);
+
+		for (const HitMap& map : maps) {
+			std::stringstream stream;
+			map.WriteBinary(stream);
+			const HitMap read = HitMap::ReadBinary(stream, "test");
+			CheckIdentical(map, read);
+
+			// The index is rebuilt, not read.
+			for (const HitMap::Tile& tile : map.GetTiles()) {
+				SONAR_CHECK(read.FindTile(tile.x, tile.y) != nullptr);
+			}
+			SONAR_CHECK(read.GetTotalEnergy() == map.GetTotalEnergy());
+		}
+
+		std::stringstream stream;
+		HitMap().WriteBinary(stream);
+		SONAR_CHECK(HitMap::ReadBinary(stream, "test").GetTiles().empty());
+	} });
+
+	tests.push_back({ "HitMap rejects truncated and oversized files", []() {
+		HitMapSettings settings;
+		settings.resolution = 512;
+		std::stringstream written;
+		AccumulateHitMaps(MakeHits(5000), MakeSurfaces(), settings)[0].WriteBinary(written);
+		const std::string bytes = written.str();
+
+		SONAR_CHECK(ReadFails(bytes.substr(0, bytes.size() - 1)));
+		SONAR_CHECK(ReadFails(bytes.substr(0, 20)));
+		SONAR_CHECK(ReadFails("SPHX" + bytes.substr(4)));
+
+		// Larger than any layout: refused from the header alone, whatever the tiles it claims.
+		SONAR_CHECK(ReadFails(MakeHeader(0x7FFFFFFF, 0x7FFFFFFF, uint64_t(1) << 20)));
+		// More tiles than the map has.
+		SONAR_CHECK(ReadFails(MakeHeader(64, 64, 5)));
+		// A plausible header claiming millions of tiles the file does not have fails at the end of
+		// the stream, long before it could allocate their 17 GB.
+		SONAR_CHECK(ReadFails(MakeHeader(32u << 16, 32u << 16, uint64_t(1) << 21)));
+	} });
+}
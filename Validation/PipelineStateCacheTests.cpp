@@ -0,0 +1,210 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "DXR/PipelineStateCache.h"
+
+using namespace SonarPropagation::Graphics::DXR;
+
+namespace {
+
+	PipelineKey MakeKey(uint32_t recursionDepth = 1) {
+		PipelineKey key;
+		key.libraries.push_back({ "0123abcd", { L"CameraRayGen" } });
+		key.libraries.push_back({ "4567ef01", { L"MeshClosestHit", L"MeshMiss" } });
+		key.hitGroups.push_back({ L"HitGroup", L"MeshClosestHit", L"", L"" });
+		key.hitGroups.push_back({ L"HeightfieldHitGroup", L"HeightfieldClosestHit", L"", L"HeightfieldIntersection" });
+		key.maxPayloadSize = 16;
+		key.maxAttributeSize = 8;
+		key.maxRecursionDepth = recursionDepth;
+		return key;
+	}
+
+	// Builds pipelines numbered in build order, on the calling thread only.
+	class CountingCache {
+	public:
+		CountingCache(size_t capacity = 8)
+			: cache([this](const PipelineKey& key) { built.push_back(key.ToString()); return static_cast<int>(built.size()); }, capacity, false) {}
+
+		std::vector<std::string> built;
+		PipelineStateCache<int> cache;
+	};
+}
+
+void SonarPropagation::Validation::AddPipelineStateCacheTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "PipelineKey ignores the order of libraries, exports and hit groups", []() {
+		PipelineKey key = MakeKey();
+		PipelineKey reordered = key;
+		std::reverse(reordered.libraries.begin(), reordered.libraries.end());
+		std::reverse(reordered.libraries[0].exports.begin(), reordered.libraries[0].exports.end());
+		std::reverse(reordered.hitGroups.begin(), reordered.hitGroups.end());
+
+		SONAR_CHECK(key.ToString() == reordered.ToString());
+		SONAR_CHECK(key.ToString() == MakeKey().ToString());
+	} });
+
+	tests.push_back({ "PipelineKey tells pipelines apart", []() {
+		const std::string key = MakeKey().ToString();
+
+		PipelineKey other = MakeKey();
+		other.libraries[0].bytecodeHash = "0123abce";
+		SONAR_CHECK(other.ToString() != key);
+
+		other = MakeKey();
+		other.hitGroups[0].anyHit = L"MeshAnyHit";
+		SONAR_CHECK(other.ToString() != key);
+
+		other = MakeKey();
+		other.maxPayloadSize = 32;
+		SONAR_CHECK(other.ToString() != key);
+
+		SONAR_CHECK(MakeKey(2).ToString() != key);
+		SONAR_CHECK(MakeKey().WithRecursionDepth(2).ToString() == MakeKey(2).ToString());
+
+		// Export names are length prefixed, so moving a character between two names changes the key.
+		PipelineKey split = MakeKey();
+		split.hitGroups[0].name = L"HitGroupM";
+		split.hitGroups[0].closestHit = L"eshClosestHit";
+		SONAR_CHECK(split.ToString() != key);
+	} });
+
+	tests.push_back({ "PipelineStateCache builds a requested pipeline once", []() {
+		CountingCache counting;
+		PipelineStateCache<int>& cache = counting.cache;
+		const PipelineKey key = MakeKey();
+
+		int pipeline = 0;
+		SONAR_CHECK(!cache.TryAcquire(key, pipeline));
+		SONAR_CHECK(!cache.TryAcquire(key, pipeline));
+		cache.Prebuild(key);
+		SONAR_CHECK(cache.GetState(key) == PipelineBuildState::Queued);
+		SONAR_CHECK(cache.GetQueuedCount() == 1);
+
+		SONAR_CHECK(cache.RunOne());
+		SONAR_CHECK(!cache.RunOne());
+		SONAR_CHECK(counting.built.size() == 1);
+
+		SONAR_CHECK(cache.TryAcquire(key, pipeline));
+		SONAR_CHECK(pipeline == 1);
+		SONAR_CHECK(cache.GetOrBuild(key) == 1);
+		SONAR_CHECK(cache.GetStats().builds == 1);
+		SONAR_CHECK(cache.GetStats().misses == 2);
+		SONAR_CHECK(cache.GetStats().hits == 2);
+	} });
+
+	tests.push_back({ "PipelineStateCache builds requested pipelines before speculative ones", []() {
+		CountingCache counting;
+		PipelineStateCache<int>& cache = counting.cache;
+
+		cache.Prebuild(MakeKey(1));
+		cache.Prebuild(MakeKey(2));
+		cache.Prebuild(MakeKey(2));
+		SONAR_CHECK(cache.GetQueuedCount() == 2);
+
+		// Asking for a queued speculative build moves it ahead without queueing it twice.
+		int pipeline = 0;
+		SONAR_CHECK(!cache.TryAcquire(MakeKey(2), pipeline));
+		SONAR_CHECK(cache.GetQueuedCount() == 2);
+
+		while (cache.RunOne()) {
+		}
+		SONAR_CHECK(counting.built.size() == 2);
+		SONAR_CHECK(counting.built[0] == MakeKey(2).ToString());
+		SONAR_CHECK(counting.built[1] == MakeKey(1).ToString());
+	} });
+
+	tests.push_back({ "PipelineStateCache prebuilds one recursion level up and down", []() {
+		CountingCache counting;
+		PipelineStateCache<int>& cache = counting.cache;
+
+		const PipelineKey active = MakeKey(3);
+		SONAR_CHECK(cache.GetOrBuild(active) == 1);
+		for (const PipelineKey& key : GetNeighbouringPipelineKeys(active, 31)) {
+			cache.Prebuild(key);
+		}
+		SONAR_CHECK(cache.GetQueuedCount() == 2);
+		SONAR_CHECK(cache.GetState(MakeKey(4)) == PipelineBuildState::Queued);
+		SONAR_CHECK(cache.GetState(MakeKey(2)) == PipelineBuildState::Queued);
+
+		while (cache.RunOne()) {
+		}
+
+		// Switching to a neighbour is then a hit, and its own neighbours only add what is missing.
+		int pipeline = 0;
+		SONAR_CHECK(cache.TryAcquire(MakeKey(4), pipeline));
+		for (const PipelineKey& key : GetNeighbouringPipelineKeys(MakeKey(4), 31)) {
+			cache.Prebuild(key);
+		}
+		SONAR_CHECK(cache.GetQueuedCount() == 1);
+		SONAR_CHECK(cache.GetState(MakeKey(5)) == PipelineBuildState::Queued);
+	} });
+
+	tests.push_back({ "GetNeighbouringPipelineKeys stays within the recursion limits", []() {
+		std::vector<PipelineKey> keys = GetNeighbouringPipelineKeys(MakeKey(1), 31);
+		SONAR_CHECK(keys.size() == 1);
+		SONAR_CHECK(keys[0].maxRecursionDepth == 2);
+
+		keys = GetNeighbouringPipelineKeys(MakeKey(31), 31);
+		SONAR_CHECK(keys.size() == 1);
+		SONAR_CHECK(keys[0].maxRecursionDepth == 30);
+
+		keys = GetNeighbouringPipelineKeys(MakeKey(1), 1);
+		SONAR_CHECK(keys.empty());
+	} });
+
+	tests.push_back({ "PipelineStateCache keeps failed builds and rethrows their error", []() {
+		PipelineStateCache<int> cache([](const PipelineKey&) -> int { throw std::runtime_error("link failed"); }, 8, false);
+		const PipelineKey key = MakeKey();
+
+		bool threw = false;
+		try {
+			cache.GetOrBuild(key);
+		}
+		catch (const std::runtime_error&) {
+			threw = true;
+		}
+		SONAR_CHECK(threw);
+		SONAR_CHECK(cache.GetState(key) == PipelineBuildState::Failed);
+		SONAR_CHECK(cache.GetError(key) != nullptr);
+
+		int pipeline = 0;
+		SONAR_CHECK(!cache.TryAcquire(key, pipeline));
+		SONAR_CHECK(cache.GetQueuedCount() == 0);
+		SONAR_CHECK(cache.GetStats().failures == 1);
+	} });
+
+	tests.push_back({ "PipelineStateCache drops the least recently used pipeline", []() {
+		CountingCache counting(2);
+		PipelineStateCache<int>& cache = counting.cache;
+
+		cache.GetOrBuild(MakeKey(1));
+		cache.GetOrBuild(MakeKey(2));
+		int pipeline = 0;
+		SONAR_CHECK(cache.TryAcquire(MakeKey(1), pipeline));
+		cache.GetOrBuild(MakeKey(3));
+
+		SONAR_CHECK(cache.GetState(MakeKey(1)) == PipelineBuildState::Ready);
+		SONAR_CHECK(cache.GetState(MakeKey(2)) == PipelineBuildState::Missing);
+		SONAR_CHECK(cache.GetState(MakeKey(3)) == PipelineBuildState::Ready);
+		SONAR_CHECK(cache.GetStats().evictions == 1);
+	} });
+
+	tests.push_back({ "PipelineStateCache builds on its worker thread", []() {
+		std::atomic<uint32_t> builds(0);
+		PipelineStateCache<int> cache([&builds](const PipelineKey& key) { ++builds; return static_cast<int>(key.maxRecursionDepth); });
+
+		int pipeline = 0;
+		SONAR_CHECK(!cache.TryAcquire(MakeKey(5), pipeline));
+		for (int attempt = 0; attempt < 5000 && cache.GetState(MakeKey(5)) != PipelineBuildState::Ready; ++attempt) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		SONAR_CHECK(cache.TryAcquire(MakeKey(5), pipeline));
+		SONAR_CHECK(pipeline == 5);
+		SONAR_CHECK(builds == 1);
+	} });
+}
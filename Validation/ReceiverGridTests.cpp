@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+
+#include "Sonar/ReceiverGrid.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	// Receivers scattered over a 20 km by 5 km field with radii from 5 to 50 m, some on top of others.
+	std::vector<ReceiverPoint> MakeReceivers(size_t count) {
+		std::mt19937 random(11);
+		std::uniform_real_distribution<double> range(0.0, 20000.0);
+		std::uniform_real_distribution<double> depth(0.0, 5000.0);
+		std::uniform_real_distribution<double> radius(5.0, 50.0);
+
+		std::vector<ReceiverPoint> receivers;
+		for (size_t i = 0; i < count; ++i) {
+			receivers.push_back(i % 10 == 9 ? receivers[i - 1] : ReceiverPoint{ range(random), depth(random), radius(random) });
+		}
+		return receivers;
+	}
+
+	double GetDistance(const ReceiverPoint& point, double r0, double z0, double r1, double z1, double& t) {
+		const double dr = r1 - r0;
+		const double dz = z1 - z0;
+		const double lengthSquared = dr * dr + dz * dz;
+		t = lengthSquared > 0.0 ? std::max(0.0, std::min(1.0, ((point.range - r0) * dr + (point.depth - z0) * dz) / lengthSquared)) : 0.0;
+		return std::hypot(r0 + t * dr - point.range, z0 + t * dz - point.depth);
+	}
+
+	struct Segment {
+		double r0;
+		double z0;
+		double r1;
+		double z1;
+	};
+
+	// Short ray steps and long ones, at every slope, horizontal, vertical and empty ones included.
+	std::vector<Segment> MakeSegments() {
+		std::mt19937 random(5);
+		std::uniform_real_distribution<double> range(-500.0, 20500.0);
+		std::uniform_real_distribution<double> depth(-500.0, 5500.0);
+		std::uniform_real_distribution<double> step(-200.0, 200.0);
+
+		std::vector<Segment> segments = {
+			{ 0.0, 2500.0, 20000.0, 2500.0 },
+			{ 10000.0, 0.0, 10000.0, 5000.0 },
+			{ 0.0, 0.0, 20000.0, 5000.0 },
+			{ 20000.0, 100.0, 0.0, 4900.0 },
+			{ 7000.0, 1200.0, 7000.0, 1200.0 }
+		};
+		for (int i = 0; i < 2000; ++i) {
+			const double r = range(random);
+			const double z = depth(random);
+			if (i % 2) {
+				segments.push_back({ r, z, r + step(random), z + step(random) });
+			}
+			else {
+				segments.push_back({ r, z, range(random), depth(random) });
+			}
+		}
+		return segments;
+	}
+
+	// What ReceiverCapture has to find, from every receiver and every segment.
+	std::vector<ReceiverArrival> FindArrivals(const std::vector<ReceiverPoint>& receivers, const std::vector<Segment>& path,
+		const std::vector<double>& times, uint32_t ray) {
+		std::vector<ReceiverArrival> arrivals;
+		for (uint32_t receiver = 0; receiver < receivers.size(); ++receiver) {
+			bool passing = false;
+			ReceiverArrival closest = {};
+			for (size_t i = 0; i < path.size(); ++i) {
+				const Segment& segment = path[i];
+				double t;
+				const double distance = GetDistance(receivers[receiver], segment.r0, segment.z0, segment.r1, segment.z1, t);
+				if (distance > receivers[receiver].radius) {
+					if (passing) {
+						arrivals.push_back(closest);
+					}
+					passing = false;
+					continue;
+				}
+				if (!passing || distance < closest.distance) {
+					closest = { receiver, ray, times[i] + t * (times[i + 1] - times[i]), distance, 0, static_cast<uint32_t>(i), 1.0 };
+				}
+				passing = true;
+			}
+			if (passing) {
+				arrivals.push_back(closest);
+			}
+		}
+		return arrivals;
+	}
+
+	bool ArrivalBefore(const ReceiverArrival& a, const ReceiverArrival& b) {
+		return std::tie(a.receiver, a.time) < std::tie(b.receiver, b.time);
+	}
+}
+
+void SonarPropagation::Validation::AddReceiverGridTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "ReceiverGrid candidates cover every receiver a segment reaches, once", []() {
+		const std::vector<ReceiverPoint> receivers = MakeReceivers(20000);
+
+		for (double cellSize : { 0.0, 30.0, 400.0 }) {
+			const ReceiverGrid grid(receivers, cellSize);
+			double maxRadius = 0.0;
+			for (const ReceiverPoint& receiver : receivers) {
+				maxRadius = std::max(maxRadius, receiver.radius);
+			}
+			// A candidate sits in a cell within the largest radius of the segment.
+			const double reach = std::sqrt(2.0) * (maxRadius + grid.GetCellSize()) + 1e-6;
+
+			for (const Segment& segment : MakeSegments()) {
+				std::vector<uint32_t> candidates;
+				grid.ForEachCandidate(segment.r0, segment.z0, segment.r1, segment.z1, [&](uint32_t receiver) { candidates.push_back(receiver); });
+				std::sort(candidates.begin(), candidates.end());
+				SONAR_CHECK(std::adjacent_find(candidates.begin(), candidates.end()) == candidates.end());
+
+				for (uint32_t receiver = 0; receiver < receivers.size(); ++receiver) {
+					double t;
+					const double distance = GetDistance(receivers[receiver], segment.r0, segment.z0, segment.r1, segment.z1, t);
+					const bool candidate = std::binary_search(candidates.begin(), candidates.end(), receiver);
+					if (distance <= receivers[receiver].radius) {
+						SONAR_CHECK(candidate);
+					}
+					if (candidate) {
+						SONAR_CHECK(distance <= reach);
+					}
+				}
+			}
+		}
+	} });
+
+	tests.push_back({ "ReceiverCapture finds the arrivals of a brute force closest approach search", []() {
+		const std::vector<ReceiverPoint> receivers = MakeReceivers(20000);
+		const ReceiverGrid grid(receivers);
+
+		// A ray zigzagging between surface and bottom in uneven steps, some of them long.
+		std::mt19937 random(3);
+		std::uniform_real_distribution<double> step(1.0, 400.0);
+		std::vector<Segment> path;
+		std::vector<double> times = { 0.0 };
+		double r = 0.0;
+		double z = 1000.0;
+		double slope = 0.6;
+		while (r < 20000.0) {
+			const double dr = step(random);
+			double next = z + slope * dr;
+			if (next < 0.0 || next > 5000.0) {
+				slope = -slope;
+				next = std::max(0.0, std::min(5000.0, next));
+			}
+			path.push_back({ r, z, r + dr, next });
+			times.push_back(times.back() + std::hypot(dr, next - z) / 1500.0);
+			r += dr;
+			z = next;
+		}
+
+		std::vector<ReceiverArrival> arrivals;
+		ReceiverCapture capture(grid, 4, arrivals);
+		for (size_t i = 0; i < path.size(); ++i) {
+			capture.AddSegment(path[i].r0, path[i].z0, times[i], path[i].r1, path[i].z1, times[i + 1], 0, static_cast<uint32_t>(i), 1.0);
+		}
+		capture.Finish();
+
+		std::vector<ReceiverArrival> expected = FindArrivals(receivers, path, times, 4);
+		SONAR_CHECK(expected.size() > 100);
+		std::sort(arrivals.begin(), arrivals.end(), ArrivalBefore);
+		std::sort(expected.begin(), expected.end(), ArrivalBefore);
+
+		SONAR_CHECK(arrivals.size() == expected.size());
+		for (size_t i = 0; i < arrivals.size(); ++i) {
+			SONAR_CHECK(arrivals[i].receiver == expected[i].receiver && arrivals[i].ray == expected[i].ray);
+			SONAR_CHECK(arrivals[i].time == expected[i].time && arrivals[i].distance == expected[i].distance);
+			SONAR_CHECK(arrivals[i].bottomBounces == expected[i].bottomBounces);
+		}
+	} });
+}
@@ -0,0 +1,188 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include "DXR/DXRHelpers/ShaderCache.h"
+
+using namespace SonarPropagation::Graphics::Common;
+
+namespace {
+
+	// Scratch directory for the shader sources and the disk cache, relative to the working directory.
+	const std::wstring c_directory = L"ShaderCacheTests";
+
+	std::string Narrow(const std::wstring& value) {
+		return std::string(value.begin(), value.end());
+	}
+
+	// Stands in for DXC: the "bytecode" is the key, so every entry can be told apart.
+	ShaderBytecode CompileKey(const ShaderCompileRequest& request) {
+		const std::string key = ShaderCache::ComputeKey(request);
+		return ShaderBytecode(key.begin(), key.end());
+	}
+
+	void WriteSource(const std::wstring& name, const std::string& text) {
+		std::ofstream file(Narrow(c_directory + L"/" + name).c_str(), std::ios::binary | std::ios::trunc);
+		file << text;
+		if (!file) {
+			throw std::runtime_error("Cannot write the test shader " + Narrow(name));
+		}
+	}
+
+	// Main.hlsl includes Common.hlsl, which includes Config.hlsl: edits two levels down must miss the cache.
+	void WriteSources(const std::string& config = "#define SONAR_MAX_BOUNCES 8\n") {
+		// A cache with a directory creates it, portably.
+		ShaderCache scratch(c_directory, CompileKey);
+
+		WriteSource(L"Main.hlsl", "#include \"Common.hlsl\"\n[shader(\"raygeneration\")] void Main() {}\n");
+		WriteSource(L"Common.hlsl", "// #include \"Unused.hlsl\"\n#include \"Config.hlsl\"\nstruct Payload { float4 color; };\n");
+		WriteSource(L"Config.hlsl", config);
+	}
+
+	ShaderCompileRequest MakeRequest() {
+		ShaderCompileRequest request;
+		request.fileName = c_directory + L"/Main.hlsl";
+		request.defines = { { L"SONAR_PRECISION", L"0" } };
+		return request;
+	}
+
+	void RemoveDiskEntry(const ShaderCompileRequest& request) {
+		std::remove((Narrow(c_directory) + "/" + ShaderCache::ComputeKey(request) + ".dxil").c_str());
+	}
+}
+
+void SonarPropagation::Validation::AddShaderCacheTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "ShaderCache key is stable for an unchanged request", []() {
+		WriteSources();
+
+		const std::string key = ShaderCache::ComputeKey(MakeRequest());
+		SONAR_CHECK(key.size() == 32);
+		SONAR_CHECK(ShaderCache::ComputeKey(MakeRequest()) == key);
+
+		// Rewriting identical contents and spelling the path differently changes nothing.
+		WriteSources();
+		ShaderCompileRequest request = MakeRequest();
+		request.fileName = c_directory + L"/./Main.hlsl";
+		SONAR_CHECK(ShaderCache::ComputeKey(request) == key);
+	} });
+
+	tests.push_back({ "ShaderCache misses after an included file changes", []() {
+		std::atomic<uint32_t> compilations(0);
+		ShaderCache cache(L"", [&compilations](const ShaderCompileRequest& request) { ++compilations; return CompileKey(request); });
+		WriteSources();
+
+		const std::string key = ShaderCache::ComputeKey(MakeRequest());
+		ShaderBytecodePtr first = cache.GetOrCompile(MakeRequest());
+		SONAR_CHECK(cache.GetOrCompile(MakeRequest()) == first);
+		SONAR_CHECK(compilations == 1);
+
+		WriteSources("#define SONAR_MAX_BOUNCES 4\n");
+		SONAR_CHECK(ShaderCache::ComputeKey(MakeRequest()) != key);
+		SONAR_CHECK(cache.GetOrCompile(MakeRequest()) != first);
+		SONAR_CHECK(compilations == 2);
+
+		WriteSources();
+		SONAR_CHECK(ShaderCache::ComputeKey(MakeRequest()) == key);
+	} });
+
+	tests.push_back({ "ShaderCache misses after a define or a compiler argument changes", []() {
+		ShaderCache cache(L"", CompileKey);
+		WriteSources();
+
+		const ShaderCompileRequest base = MakeRequest();
+		const std::string key = ShaderCache::ComputeKey(base);
+
+		ShaderCompileRequest request = base;
+		request.defines[0].second = L"1";
+		SONAR_CHECK(ShaderCache::ComputeKey(request) != key);
+
+		request = base;
+		request.defines.push_back({ L"SONAR_MAX_STEPS", L"5000" });
+		SONAR_CHECK(ShaderCache::ComputeKey(request) != key);
+
+		request = base;
+		request.arguments = { L"-O3" };
+		SONAR_CHECK(ShaderCache::ComputeKey(request) != key);
+
+		request = base;
+		request.profile = L"lib_6_5";
+		SONAR_CHECK(ShaderCache::ComputeKey(request) != key);
+
+		request = base;
+		request.entryPoint = L"Main";
+		SONAR_CHECK(ShaderCache::ComputeKey(request) != key);
+
+		request = base;
+		request.arguments = { L"-Od" };
+		cache.GetOrCompile(base);
+		cache.GetOrCompile(request);
+		SONAR_CHECK(cache.GetStats().compilations == 2);
+		SONAR_CHECK(cache.GetStats().memoryHits == 0);
+	} });
+
+	tests.push_back({ "ShaderCache serves an entry written by another instance from disk", []() {
+		WriteSources();
+		const ShaderCompileRequest request = MakeRequest();
+
+		ShaderBytecode compiled;
+		{
+			ShaderCache cache(c_directory, CompileKey);
+			RemoveDiskEntry(request);
+			compiled = *cache.GetOrCompile(request);
+			SONAR_CHECK(cache.GetStats().compilations == 1);
+			SONAR_CHECK(cache.GetStats().diskHits == 0);
+		}
+
+		ShaderCache cache(c_directory, [](const ShaderCompileRequest&) -> ShaderBytecode {
+			throw std::runtime_error("compiled instead of reading the disk cache");
+		});
+		SONAR_CHECK(*cache.GetOrCompile(request) == compiled);
+		SONAR_CHECK(cache.GetStats().diskHits == 1);
+		SONAR_CHECK(cache.GetStats().compilations == 0);
+
+		// Dropping the memory entries falls back to the disk again.
+		cache.ClearMemory();
+		SONAR_CHECK(*cache.GetOrCompile(request) == compiled);
+		SONAR_CHECK(cache.GetStats().diskHits == 2);
+
+		RemoveDiskEntry(request);
+	} });
+
+	tests.push_back({ "ShaderCache compiles once for concurrent requests of the same key", []() {
+		WriteSources();
+		std::atomic<uint32_t> compilations(0);
+		ShaderCache cache(L"", [&compilations](const ShaderCompileRequest& request) {
+			++compilations;
+			// Long enough for the second request to arrive while the first one compiles.
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			return CompileKey(request);
+		});
+
+		ShaderBytecodePtr results[2];
+		std::thread threads[2];
+		for (int i = 0; i < 2; ++i) {
+			threads[i] = std::thread([&cache, &results, i]() { results[i] = cache.GetOrCompile(MakeRequest()); });
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		SONAR_CHECK(compilations == 1);
+		SONAR_CHECK(results[0] && results[0] == results[1]);
+		SONAR_CHECK(cache.GetStats().memoryHits == 1);
+
+		// GetOrCompileAll shares the compilation the same way.
+		ShaderCompileRequest other = MakeRequest();
+		other.arguments = { L"-O3" };
+		auto all = cache.GetOrCompileAll({ other, other, MakeRequest() });
+		SONAR_CHECK(compilations == 2);
+		SONAR_CHECK(all[0] == all[1]);
+		SONAR_CHECK(all[2] == results[0]);
+	} });
+}
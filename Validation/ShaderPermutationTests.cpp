@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <atomic>
+#include <set>
+
+#include "DXR/DXRHelpers/ShaderPermutation.h"
+
+using namespace SonarPropagation::Graphics::Common;
+
+namespace {
+
+	std::wstring FindDefine(const SonarKernelPermutation& permutation, const std::wstring& name) {
+		for (const auto& define : permutation.GetDefines()) {
+			if (define.first == name) {
+				return define.second;
+			}
+		}
+		return L"<missing>";
+	}
+
+	// Returns the permutation defines as the bytecode, so each library can be traced back to its request.
+	ShaderBytecode EchoDefines(const ShaderCompileRequest& request) {
+		std::string text(request.fileName.begin(), request.fileName.end());
+		for (const auto& define : request.defines) {
+			text += " " + std::string(define.first.begin(), define.first.end()) + "=" + std::string(define.second.begin(), define.second.end());
+		}
+		return ShaderBytecode(text.begin(), text.end());
+	}
+
+	std::vector<ShaderCompileRequest> MakeSources() {
+		ShaderCompileRequest rayGen;
+		rayGen.fileName = L"SonarRayGen.hlsl";
+		ShaderCompileRequest hit;
+		hit.fileName = L"SonarHit.hlsl";
+		return { rayGen, hit };
+	}
+}
+
+void SonarPropagation::Validation::AddShaderPermutationTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "Default permutation maps to the SonarConfig.hlsl defaults", []() {
+		const SonarKernelPermutation permutation;
+
+		SONAR_CHECK(permutation.GetDefines().size() == 8);
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_STEP_SIZE") == L"1.0");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_MAX_STEPS") == L"100000");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_MAX_DEPTH") == L"6800.0");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_BOUNDARY_OFFSET") == L"10.0");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_RK_TABLEAU") == L"2");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_SSP_MODEL") == L"0");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_MAX_BOUNCES") == L"8");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_PRECISION") == L"0");
+		SONAR_CHECK(permutation.GetKey() == L"rk4_mackenzie_h1.0_n100000_d6800.0_o10.0_b8_fp32");
+	} });
+
+	tests.push_back({ "Permutation defines follow the fields", []() {
+		SonarKernelPermutation permutation;
+		permutation.stepSize = 0.25f;
+		permutation.maxDepth = 1e9f;
+		permutation.tableau = IntegratorTableau::Euler;
+		permutation.soundSpeedModel = SoundSpeedModel::CompactMackenzie;
+		permutation.maxBounces = 3;
+		permutation.precision = KernelPrecision::Half;
+
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_STEP_SIZE") == L"0.25");
+		// Floats always stay floating point literals in HLSL.
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_MAX_DEPTH") == L"1e+09");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_RK_TABLEAU") == L"0");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_SSP_MODEL") == L"1");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_MAX_BOUNCES") == L"3");
+		SONAR_CHECK(FindDefine(permutation, L"SONAR_PRECISION") == L"1");
+		SONAR_CHECK(permutation.GetKey() == L"euler_compact_h0.25_n100000_d1e+09_o10.0_b3_fp16");
+	} });
+
+	tests.push_back({ "Permutation keys differ whenever the defines differ", []() {
+		std::vector<SonarKernelPermutation> permutations(9);
+		permutations[1].stepSize = 0.5f;
+		permutations[2].maxSteps = 5000;
+		permutations[3].maxDepth = 4000.0f;
+		permutations[4].boundaryOffset = 5.0f;
+		permutations[5].tableau = IntegratorTableau::Midpoint;
+		permutations[6].soundSpeedModel = SoundSpeedModel::CompactMackenzie;
+		permutations[7].maxBounces = 2;
+		permutations[8].precision = KernelPrecision::Half;
+
+		std::set<std::wstring> keys;
+		std::set<std::vector<std::pair<std::wstring, std::wstring>>> defines;
+		for (const auto& permutation : permutations) {
+			keys.insert(permutation.GetKey());
+			defines.insert(permutation.GetDefines());
+		}
+		SONAR_CHECK(keys.size() == permutations.size());
+		SONAR_CHECK(defines.size() == permutations.size());
+	} });
+
+	tests.push_back({ "Precompile compiles each distinct permutation once and Get finds it by key", []() {
+		std::atomic<uint32_t> compilations(0);
+		ShaderCache cache(L"", [&compilations](const ShaderCompileRequest& request) {
+			++compilations;
+			return EchoDefines(request);
+		});
+		ShaderPermutationLibrary library(cache, MakeSources());
+
+		SonarKernelPermutation rk4;
+		SonarKernelPermutation euler;
+		euler.tableau = IntegratorTableau::Euler;
+		SonarKernelPermutation half;
+		half.precision = KernelPrecision::Half;
+
+		library.Precompile({ rk4, euler, rk4, half });
+		SONAR_CHECK(library.GetPermutationCount() == 3);
+		SONAR_CHECK(compilations == 6);
+		SONAR_CHECK(library.Contains(euler));
+
+		const auto& libraries = library.Get(euler);
+		SONAR_CHECK(libraries.size() == 2);
+		const std::string rayGen(libraries[0]->begin(), libraries[0]->end());
+		const std::string hit(libraries[1]->begin(), libraries[1]->end());
+		SONAR_CHECK(rayGen.find("SonarRayGen.hlsl") == 0);
+		SONAR_CHECK(hit.find("SonarHit.hlsl") == 0);
+		SONAR_CHECK(rayGen.find("SONAR_RK_TABLEAU=0") != std::string::npos);
+		SONAR_CHECK(library.Get(rk4)[0] != libraries[0]);
+
+		// Already compiled permutations are not requested again.
+		library.Precompile({ rk4, euler });
+		SONAR_CHECK(compilations == 6);
+	} });
+
+	tests.push_back({ "Get compiles a permutation that was not precompiled", []() {
+		ShaderCache cache(L"", EchoDefines);
+		ShaderPermutationLibrary library(cache, MakeSources());
+
+		SonarKernelPermutation permutation;
+		permutation.maxBounces = 4;
+		SONAR_CHECK(!library.Contains(permutation));
+
+		const auto& libraries = library.Get(permutation);
+		SONAR_CHECK(libraries.size() == 2);
+		SONAR_CHECK(library.Contains(permutation));
+		SONAR_CHECK(cache.GetStats().compilations == 2);
+	} });
+
+	tests.push_back({ "Permutation requests keep the defines and arguments of their sources", []() {
+		std::vector<ShaderCompileRequest> sources = MakeSources();
+		sources[0].defines.push_back({ L"SONAR_DEBUG", L"1" });
+		sources[0].arguments = { L"-O3" };
+
+		ShaderCache cache(L"", EchoDefines);
+		ShaderPermutationLibrary library(cache, sources);
+
+		const auto requests = library.GetRequests(SonarKernelPermutation());
+		SONAR_CHECK(requests.size() == 2);
+		SONAR_CHECK(requests[0].defines.size() == 9);
+		SONAR_CHECK(requests[0].defines[0].first == L"SONAR_DEBUG");
+		SONAR_CHECK(requests[0].arguments == std::vector<std::wstring>{ L"-O3" });
+		SONAR_CHECK(requests[1].defines.size() == 8);
+	} });
+}
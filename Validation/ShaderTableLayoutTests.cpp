@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include "DXR/ShaderTableLayout.h"
+
+using namespace SonarPropagation::Graphics::DXR;
+
+void SonarPropagation::Validation::AddShaderTableLayoutTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "ShaderTableLayout sizes entries by the most root arguments of their section", []() {
+		ShaderTableLayout layout;
+		layout.AddRecord(ShaderTableSection::RayGeneration, L"RayGen", 1);
+		layout.AddRecord(ShaderTableSection::Miss, L"Miss", 0);
+		layout.AddRecord(ShaderTableSection::Miss, L"ShadowMiss", 0);
+		layout.AddRecord(ShaderTableSection::HitGroup, L"HitGroup", 2);
+		layout.AddRecord(ShaderTableSection::HitGroup, L"HeightfieldHitGroup", 3);
+		layout.AddRecord(ShaderTableSection::HitGroup, L"ShadowHitGroup", 5);
+		layout.Finalize();
+
+		// 32 byte identifiers plus 8 bytes per argument, rounded to 32 bytes.
+		SONAR_CHECK(layout.GetEntrySize(ShaderTableSection::RayGeneration) == 64);
+		SONAR_CHECK(layout.GetEntrySize(ShaderTableSection::Miss) == 32);
+		SONAR_CHECK(layout.GetEntrySize(ShaderTableSection::HitGroup) == 96);
+
+		SONAR_CHECK(layout.GetSectionSize(ShaderTableSection::Miss) == 64);
+		SONAR_CHECK(layout.GetSectionSize(ShaderTableSection::HitGroup) == 288);
+	} });
+
+	tests.push_back({ "ShaderTableLayout starts every section on a 64 byte boundary", []() {
+		ShaderTableLayout layout;
+		layout.AddRecord(ShaderTableSection::RayGeneration, L"RayGen", 0);
+		layout.AddRecord(ShaderTableSection::Miss, L"Miss", 0);
+		layout.AddRecord(ShaderTableSection::HitGroup, L"HitGroup", 1);
+		layout.Finalize();
+
+		SONAR_CHECK(layout.GetSectionOffset(ShaderTableSection::RayGeneration) == 0);
+		SONAR_CHECK(layout.GetSectionOffset(ShaderTableSection::Miss) == 64);
+		SONAR_CHECK(layout.GetSectionOffset(ShaderTableSection::HitGroup) == 128);
+		SONAR_CHECK(layout.GetTotalSize() == 256);
+
+		for (uint32_t section = 0; section < static_cast<uint32_t>(ShaderTableSection::Count); ++section) {
+			SONAR_CHECK(layout.GetSectionOffset(static_cast<ShaderTableSection>(section)) % ShaderTableLayout::c_tableAlignment == 0);
+		}
+	} });
+
+	tests.push_back({ "ShaderTableLayout places records at their section stride", []() {
+		ShaderTableLayout layout;
+		const uint32_t rayGen = layout.AddRecord(ShaderTableSection::RayGeneration, L"RayGen", 1);
+		std::vector<uint32_t> hitGroups;
+		for (uint32_t instance = 0; instance < 5; ++instance) {
+			hitGroups.push_back(layout.AddRecord(ShaderTableSection::HitGroup, L"HitGroup", instance % 3));
+		}
+		const uint32_t miss = layout.AddRecord(ShaderTableSection::Miss, L"Miss", 0);
+		layout.Finalize();
+
+		SONAR_CHECK(layout.GetRecordOffset(rayGen) == 0);
+		SONAR_CHECK(layout.GetRecordOffset(miss) == layout.GetSectionOffset(ShaderTableSection::Miss));
+
+		const uint32_t stride = layout.GetEntrySize(ShaderTableSection::HitGroup);
+		SONAR_CHECK(stride % ShaderTableLayout::c_recordAlignment == 0);
+		for (uint32_t instance = 0; instance < 5; ++instance) {
+			SONAR_CHECK(layout.GetRecordOffset(hitGroups[instance]) == layout.GetSectionOffset(ShaderTableSection::HitGroup) + instance * stride);
+			SONAR_CHECK(layout.GetArgumentCount(hitGroups[instance]) == instance % 3);
+		}
+		SONAR_CHECK(layout.GetTotalSize() % 256 == 0);
+		SONAR_CHECK(layout.GetTotalSize() >= layout.GetSectionOffset(ShaderTableSection::HitGroup) + layout.GetSectionSize(ShaderTableSection::HitGroup));
+	} });
+
+	tests.push_back({ "ShaderTableLayout counts generations and rejects records after Finalize", []() {
+		ShaderTableLayout layout;
+		layout.AddRecord(ShaderTableSection::RayGeneration, L"RayGen", 0);
+		layout.Finalize();
+		SONAR_CHECK(layout.IsFinalized());
+		SONAR_CHECK(layout.GetGeneration() == 1);
+
+		bool threw = false;
+		try {
+			layout.AddRecord(ShaderTableSection::Miss, L"Miss", 0);
+		}
+		catch (const std::logic_error&) {
+			threw = true;
+		}
+		SONAR_CHECK(threw);
+
+		layout.Reset();
+		SONAR_CHECK(!layout.IsFinalized());
+		SONAR_CHECK(layout.GetRecordCount() == 0);
+		layout.AddRecord(ShaderTableSection::RayGeneration, L"RayGen", 2);
+		layout.Finalize();
+		SONAR_CHECK(layout.GetGeneration() == 2);
+		SONAR_CHECK(layout.GetEntrySize(ShaderTableSection::RayGeneration) == 64);
+	} });
+}
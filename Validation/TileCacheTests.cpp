@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include "Sonar/TileCache.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	// A small grid whose height tells which tile it is.
+	Heightfield MakeTile(const TileKey& key) {
+		return Heightfield(4, 4, 10.0, std::vector<float>(16, -static_cast<float>(100 * key.column + key.row + 1)));
+	}
+
+	bool IsTile(const std::shared_ptr<const Heightfield>& tile, const TileKey& key) {
+		return tile && tile->GetHeight(0, 0) == -static_cast<float>(100 * key.column + key.row + 1);
+	}
+
+	// Counts its loads, and throws for as long as failures says so.
+	struct StubLoader {
+		std::atomic<uint32_t> loads{ 0 };
+		std::atomic<uint32_t> failures{ 0 };
+
+		TileCache::Loader Get() {
+			return [this](const TileKey& key) {
+				++loads;
+				if (failures > 0) {
+					--failures;
+					throw std::runtime_error("stub loader failed");
+				}
+				return MakeTile(key);
+			};
+		}
+	};
+
+	// The prefetch thread loads on its own time; its stats say when it is done.
+	void WaitForPrefetchLoads(const TileCache& cache, uint64_t count) {
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (cache.GetStats().prefetchLoads < count) {
+			SONAR_CHECK(std::chrono::steady_clock::now() < deadline);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	bool AcquireFails(TileCache& cache, const TileKey& key) {
+		try {
+			cache.Acquire(key);
+		}
+		catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	}
+
+	// The tiles of the index the segment enters, in order, from points a centimetre apart.
+	std::vector<TileKey> SampleTilesAlong(const TileSet& tiles, double originX, double originZ, double directionX, double directionZ,
+		double tFrom, double tTo) {
+		std::vector<TileKey> keys;
+		bool hasLast = false;
+		TileKey last = { 0, 0 };
+		const uint64_t steps = static_cast<uint64_t>(std::ceil((tTo - tFrom) / 0.01));
+		for (uint64_t i = 0; i <= steps; ++i) {
+			const double t = std::min(tTo, tFrom + 0.01 * i);
+			const TileKey key = tiles.GetTileAt(originX + t * directionX, originZ + t * directionZ);
+			if (!hasLast || key != last) {
+				if (tiles.HasTile(key)) {
+					keys.push_back(key);
+				}
+				last = key;
+				hasLast = true;
+			}
+		}
+		return keys;
+	}
+}
+
+void SonarPropagation::Validation::AddTileCacheTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "TileCache evicts the least recently acquired tile over its budget", []() {
+		const size_t tileBytes = MakeTile({ 0, 0 }).GetMemorySize();
+		StubLoader loader;
+		TileCache cache(loader.Get(), 2 * tileBytes);
+
+		SONAR_CHECK(IsTile(cache.Acquire({ 0, 0 }), { 0, 0 }));
+		SONAR_CHECK(IsTile(cache.Acquire({ 1, 0 }), { 1, 0 }));
+		// (0, 0) becomes the most recent, so (1, 0) is the one to go.
+		SONAR_CHECK(IsTile(cache.Acquire({ 0, 0 }), { 0, 0 }));
+		SONAR_CHECK(IsTile(cache.Acquire({ 2, 0 }), { 2, 0 }));
+		SONAR_CHECK(loader.loads == 3);
+
+		TileCacheStats stats = cache.GetStats();
+		SONAR_CHECK(stats.hits == 1 && stats.blockingLoads == 3 && stats.evictions == 1);
+		SONAR_CHECK(stats.residentBytes == 2 * tileBytes && stats.peakBytes == 3 * tileBytes);
+
+		cache.Acquire({ 0, 0 });
+		SONAR_CHECK(loader.loads == 3);
+		cache.Acquire({ 1, 0 });
+		SONAR_CHECK(loader.loads == 4);
+		SONAR_CHECK(cache.GetStats().evictions == 2);
+	} });
+
+	tests.push_back({ "TileCache keeps a tile that is still held past its budget", []() {
+		const size_t tileBytes = MakeTile({ 0, 0 }).GetMemorySize();
+		StubLoader loader;
+		TileCache cache(loader.Get(), tileBytes);
+
+		const std::shared_ptr<const Heightfield> held = cache.Acquire({ 0, 0 });
+		cache.Acquire({ 1, 0 });
+		cache.Acquire({ 2, 0 });
+		cache.Acquire({ 3, 0 });
+
+		// Only the tiles no one holds went; the held one stays even though it is the oldest.
+		TileCacheStats stats = cache.GetStats();
+		SONAR_CHECK(stats.evictions == 2);
+		SONAR_CHECK(stats.residentBytes == 2 * tileBytes);
+		SONAR_CHECK(IsTile(cache.Acquire({ 0, 0 }), { 0, 0 }));
+		SONAR_CHECK(loader.loads == 4 && cache.GetStats().hits == 1);
+		SONAR_CHECK(held.use_count() > 1);
+	} });
+
+	tests.push_back({ "TileCache counts a prefetched tile as a prefetch hit, not a blocking load", []() {
+		StubLoader loader;
+		TileCache cache(loader.Get(), 1 << 20);
+
+		cache.Prefetch({ { 0, 0 }, { 1, 0 } });
+		WaitForPrefetchLoads(cache, 2);
+		SONAR_CHECK(IsTile(cache.Acquire({ 1, 0 }), { 1, 0 }));
+		SONAR_CHECK(IsTile(cache.Acquire({ 2, 0 }), { 2, 0 }));
+		// A second acquire of a prefetched tile is a plain hit.
+		cache.Acquire({ 1, 0 });
+
+		const TileCacheStats stats = cache.GetStats();
+		SONAR_CHECK(stats.prefetchLoads == 2 && stats.prefetchHits == 1);
+		SONAR_CHECK(stats.blockingLoads == 1 && stats.hits == 2);
+		SONAR_CHECK(loader.loads == 3);
+
+		// Resident tiles are not queued again.
+		cache.Prefetch({ { 0, 0 }, { 1, 0 }, { 2, 0 } });
+		cache.Acquire({ 0, 0 });
+		SONAR_CHECK(loader.loads == 3 && cache.GetStats().prefetchLoads == 2);
+	} });
+
+	tests.push_back({ "TileCache reports a loader exception once and loads again on the next Acquire", []() {
+		StubLoader loader;
+		TileCache cache(loader.Get(), 1 << 20);
+
+		loader.failures = 1;
+		SONAR_CHECK(AcquireFails(cache, { 0, 0 }));
+		SONAR_CHECK(IsTile(cache.Acquire({ 0, 0 }), { 0, 0 }));
+		SONAR_CHECK(loader.loads == 2);
+
+		// A failed prefetch reaches the next Acquire(), once.
+		loader.failures = 1;
+		cache.Prefetch({ { 1, 0 } });
+		WaitForPrefetchLoads(cache, 1);
+		SONAR_CHECK(AcquireFails(cache, { 1, 0 }));
+		SONAR_CHECK(IsTile(cache.Acquire({ 1, 0 }), { 1, 0 }));
+		SONAR_CHECK(loader.loads == 4);
+
+		// Or is queued again by the next Prefetch() that asks for it.
+		loader.failures = 1;
+		cache.Prefetch({ { 2, 0 } });
+		WaitForPrefetchLoads(cache, 2);
+		cache.Prefetch({ { 2, 0 } });
+		WaitForPrefetchLoads(cache, 3);
+		SONAR_CHECK(IsTile(cache.Acquire({ 2, 0 }), { 2, 0 }));
+		SONAR_CHECK(loader.loads == 6 && cache.GetStats().prefetchHits == 1);
+	} });
+
+	tests.push_back({ "TileSet::GetTilesAlong visits the tiles a track enters in order", []() {
+		// 1 km tiles over a 6 x 5 km survey with a hole at (2, 2), placed off the world origin.
+		TileSet tiles(10.0, 100, -3000.0, 500.0);
+		for (int32_t row = 0; row < 5; ++row) {
+			for (int32_t column = 0; column < 6; ++column) {
+				if (column != 2 || row != 2) {
+					tiles.AddTile({ column, row }, "tile.asc");
+				}
+			}
+		}
+
+		struct Track {
+			double x;
+			double z;
+			double bearing;
+			double length;
+		};
+		const double pi = 3.14159265358979323846;
+		const Track tracks[] = {
+			// Along the axes, one of them on a tile edge, and through the hole.
+			{ -2900.0, 2900.0, 0.0, 5500.0 },
+			{ 2900.0, 1500.0, pi, 5500.0 },
+			{ -1500.0, 600.0, 0.5 * pi, 4800.0 },
+			{ -500.0, 5400.0, -0.5 * pi, 4800.0 },
+			// Diagonals in every quadrant, one starting off the survey.
+			{ -2950.0, 530.0, 0.62, 7000.0 },
+			{ 2800.0, 5300.0, pi + 0.9, 5000.0 },
+			{ -2700.0, 5100.0, -0.3, 6000.0 },
+			{ -4000.0, -200.0, 0.4, 9000.0 }
+		};
+
+		for (const Track& track : tracks) {
+			const double directionX = std::cos(track.bearing);
+			const double directionZ = std::sin(track.bearing);
+			for (double tFrom : { 0.0, 750.0 }) {
+				const std::vector<TileKey> keys = tiles.GetTilesAlong(track.x, track.z, directionX, directionZ, tFrom, track.length);
+				SONAR_CHECK(!keys.empty());
+				SONAR_CHECK(keys == SampleTilesAlong(tiles, track.x, track.z, directionX, directionZ, tFrom, track.length));
+			}
+		}
+
+		// An east-west track straight along a row of tiles, with the hole on the way.
+		const std::vector<TileKey> row = tiles.GetTilesAlong(-2500.0, 3000.0, 1.0, 0.0, 0.0, 5000.0);
+		const std::vector<TileKey> expected = { { 0, 2 }, { 1, 2 }, { 3, 2 }, { 4, 2 }, { 5, 2 } };
+		SONAR_CHECK(row == expected);
+		SONAR_CHECK(tiles.GetTilesAlong(-2500.0, 3000.0, 1.0, 0.0, 10.0, 0.0).empty());
+	} });
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "Common/TimingStats.h"
+
+using namespace SonarPropagation::Graphics::Utils;
+
+namespace {
+
+	bool IsEmpty(const TimingSummary& summary) {
+		return summary.count == 0 && summary.mean == 0.0 && summary.p50 == 0.0 && summary.p95 == 0.0 &&
+			summary.p99 == 0.0 && summary.max == 0.0;
+	}
+}
+
+void SonarPropagation::Validation::AddTimingStatsTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "RollingHistogram gives nearest-rank percentiles", []() {
+		// 1 to 100 ms in no particular order: the p-th percentile is the p-th smallest sample.
+		std::vector<double> samples;
+		for (int i = 1; i <= 100; ++i) {
+			samples.push_back(i);
+		}
+		std::shuffle(samples.begin(), samples.end(), std::mt19937(3));
+
+		RollingHistogram histogram(128);
+		for (double sample : samples) {
+			histogram.Add(sample);
+		}
+		TimingSummary summary = histogram.GetSummary();
+		SONAR_CHECK(summary.count == 100);
+		SONAR_CHECK(summary.mean == 50.5);
+		SONAR_CHECK(summary.p50 == 50.0 && summary.p95 == 95.0 && summary.p99 == 99.0 && summary.max == 100.0);
+
+		// With ten samples the rank rounds up: p95 and p99 are both the slowest one.
+		RollingHistogram small(16);
+		for (int i = 10; i >= 1; --i) {
+			small.Add(i);
+		}
+		summary = small.GetSummary();
+		SONAR_CHECK(summary.p50 == 5.0 && summary.p95 == 10.0 && summary.p99 == 10.0);
+
+		RollingHistogram single(4);
+		single.Add(2.5);
+		summary = single.GetSummary();
+		SONAR_CHECK(summary.count == 1 && summary.p50 == 2.5 && summary.p99 == 2.5 && summary.max == 2.5);
+	} });
+
+	tests.push_back({ "RollingHistogram keeps only the last window of samples", []() {
+		RollingHistogram histogram(10);
+		for (int i = 1; i <= 25; ++i) {
+			histogram.Add(i);
+		}
+
+		// 16 to 25 remain.
+		TimingSummary summary = histogram.GetSummary();
+		SONAR_CHECK(histogram.GetCount() == 10 && summary.count == 10);
+		SONAR_CHECK(summary.mean == 20.5);
+		SONAR_CHECK(summary.p50 == 20.0 && summary.p95 == 25.0 && summary.max == 25.0);
+
+		// A stall shows in max until ten more frames have pushed it out.
+		histogram.Add(1000.0);
+		SONAR_CHECK(histogram.GetSummary().max == 1000.0);
+		for (int i = 0; i < 9; ++i) {
+			histogram.Add(1.0);
+		}
+		SONAR_CHECK(histogram.GetSummary().max == 1000.0);
+		histogram.Add(1.0);
+		summary = histogram.GetSummary();
+		SONAR_CHECK(summary.max == 1.0 && summary.p99 == 1.0 && summary.mean == 1.0);
+	} });
+
+	tests.push_back({ "RollingHistogram summarises an empty window as zeros", []() {
+		RollingHistogram histogram(8);
+		SONAR_CHECK(histogram.GetCount() == 0);
+		SONAR_CHECK(IsEmpty(histogram.GetSummary()));
+
+		histogram.Add(4.0);
+		histogram.Add(6.0);
+		histogram.Clear();
+		SONAR_CHECK(histogram.GetCount() == 0);
+		SONAR_CHECK(IsEmpty(histogram.GetSummary()));
+
+		// Samples from before Clear() do not come back as the window fills again.
+		histogram.Add(1.0);
+		const TimingSummary summary = histogram.GetSummary();
+		SONAR_CHECK(summary.count == 1 && summary.max == 1.0);
+
+		bool threw = false;
+		try {
+			RollingHistogram none(0);
+		}
+		catch (const std::invalid_argument&) {
+			threw = true;
+		}
+		SONAR_CHECK(threw);
+
+		// Stages without samples get no CSV row.
+		FrameTimingStats stats(8);
+		stats.AddGpuSample(TimingStage::Dispatch, 3.0);
+		std::ostringstream csv;
+		stats.WriteCsv(csv);
+		SONAR_CHECK(csv.str() == "stage,timeline,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\nDispatch,gpu,1,3,3,3,3,3\n");
+	} });
+}
@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <cmath>
+
+#include "Sonar/RayMarch.h"
+#include "Sonar/TrajectoryStore.h"
+
+using namespace SonarPropagation::Sonar;
+
+namespace {
+
+	// A ray that bends like a refracted one, with a reflection and a change of intensity every 2 km.
+	std::vector<PathPoint> MakeSyntheticPath() {
+		std::vector<PathPoint> points;
+		for (uint32_t i = 0; i <= 4000; ++i) {
+			const double range = 2.5 * i;
+			const uint32_t bounces = static_cast<uint32_t>(range / 2000.0);
+			PathPoint point;
+			point.range = range;
+			point.depth = 1000.0 + 400.0 * std::sin(range / 1500.0) + 0.01 * std::sin(range);
+			point.time = range / 1500.0 + 1e-6 * std::sin(range / 50.0);
+			point.intensity = std::pow(0.9, bounces);
+			point.surfaceBounces = (bounces + 1) / 2;
+			point.bottomBounces = bounces / 2;
+			points.push_back(point);
+		}
+		return points;
+	}
+
+	// Every step of a steep ray through the Munk profile, reflecting off the surface and a 4 km bottom.
+	std::vector<PathPoint> MarchMunkRay(double launchAngle) {
+		const SoundSpeedProfile profile = SoundSpeedProfile::Munk();
+		RayMarchConfig config;
+		config.stepSize = 5.0;
+		config.bottomDepth = 4000.0;
+		config.maxRange = 30000.0;
+
+		const RayState start = InitializeRay(profile, 0.0, 1000.0, launchAngle);
+		std::vector<PathPoint> points = { { start.r, start.z, start.tau, 1.0, 0, 0 } };
+		RayMarch(profile, start, config, [&points](const RayState&, const RayState& to, const RayMarchResult& progress) {
+			const uint32_t bounces = progress.surfaceBounces + progress.bottomBounces;
+			points.push_back({ to.r, to.z, to.tau, std::pow(0.8, progress.bottomBounces), progress.surfaceBounces, progress.bottomBounces });
+			return bounces < 8;
+		});
+		return points;
+	}
+
+	RayPath RoundTrip(const std::vector<PathPoint>& points, const PathTolerance& tolerance) {
+		PathEncoder encoder(tolerance);
+		for (const PathPoint& point : points) {
+			encoder.Add(point);
+		}
+		encoder.Finish();
+		SONAR_CHECK(encoder.GetStepCount() + 1 == points.size());
+
+		TrajectoryStore store(tolerance);
+		// An earlier path in the same arena, so the decoded one does not start at offset 0.
+		store.Add(encoder);
+		const uint32_t index = store.Add(encoder);
+
+		RayPath path;
+		store.Decode(index, path);
+		SONAR_CHECK(path.points.size() == encoder.GetPointCount());
+		SONAR_CHECK(path.points.size() < points.size());
+		return path;
+	}
+
+	// Every step has to lie within the tolerance of the segment of the decoded path covering it, keep
+	// the time interpolated at its distance along the segment, and carry its bounce counts and intensity.
+	void CheckWithinTolerance(const std::vector<PathPoint>& points, const RayPath& path, const PathTolerance& tolerance) {
+		const PathPoint& source = path.points.front();
+		SONAR_CHECK(std::abs(source.range - points.front().range) <= tolerance.position);
+		SONAR_CHECK(std::abs(source.depth - points.front().depth) <= tolerance.position);
+
+		// Kept points are steps of the ray: a segment ends at the step that rounds to its end point.
+		const double quantum = 0.25 * tolerance.position;
+		auto endsSegment = [quantum](const PathPoint& step, const PathPoint& end) {
+			return std::llround(step.range / quantum) * quantum == end.range && std::llround(step.depth / quantum) * quantum == end.depth;
+		};
+
+		size_t segment = 1;
+		for (size_t i = 1; i < points.size(); ++i) {
+			const PathPoint& step = points[i];
+			SONAR_CHECK(segment < path.points.size());
+			const PathPoint& a = path.points[segment - 1];
+			const PathPoint& b = path.points[segment];
+			const double dx = b.range - a.range;
+			const double dy = b.depth - a.depth;
+			const double length = std::hypot(dx, dy);
+			SONAR_CHECK(length > 0.0);
+
+			double u = ((step.range - a.range) * dx + (step.depth - a.depth) * dy) / (length * length);
+			u = std::min(std::max(u, 0.0), 1.0);
+			SONAR_CHECK(std::hypot(a.range + u * dx - step.range, a.depth + u * dy - step.depth) <= tolerance.position);
+
+			const double fraction = std::hypot(step.range - a.range, step.depth - a.depth) / length;
+			SONAR_CHECK(std::abs(a.time + fraction * (b.time - a.time) - step.time) <= tolerance.time);
+			SONAR_CHECK(step.surfaceBounces == b.surfaceBounces && step.bottomBounces == b.bottomBounces);
+			SONAR_CHECK(step.intensity == b.intensity);
+
+			if (endsSegment(step, b)) {
+				++segment;
+			}
+		}
+		SONAR_CHECK(segment == path.points.size());
+	}
+}
+
+void SonarPropagation::Validation::AddTrajectoryStoreTests(std::vector<UnitTest>& tests)
+{
+	tests.push_back({ "A decoded synthetic path keeps every step within the tolerance", []() {
+		const std::vector<PathPoint> points = MakeSyntheticPath();
+		for (double position : { 0.05, 0.5 }) {
+			PathTolerance tolerance;
+			tolerance.position = position;
+			CheckWithinTolerance(points, RoundTrip(points, tolerance), tolerance);
+		}
+	} });
+
+	tests.push_back({ "A decoded marched ray keeps every step within the tolerance", []() {
+		const PathTolerance tolerance;
+		for (double launchAngle : { -0.25, 0.05, 0.3 }) {
+			const std::vector<PathPoint> points = MarchMunkRay(launchAngle);
+			CheckWithinTolerance(points, RoundTrip(points, tolerance), tolerance);
+		}
+	} });
+
+	tests.push_back({ "TrajectoryStore rejects a path encoded with other tolerances", []() {
+		PathTolerance coarse;
+		coarse.position = 1.0;
+		PathEncoder encoder(coarse);
+		encoder.Add({ 0.0, 0.0, 0.0, 1.0, 0, 0 });
+		encoder.Finish();
+
+		TrajectoryStore store;
+		bool threw = false;
+		try {
+			store.Add(encoder);
+		}
+		catch (const std::invalid_argument&) {
+			threw = true;
+		}
+		SONAR_CHECK(threw);
+		SONAR_CHECK(store.GetPathCount() == 0);
+	} });
+}
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "UnitTests.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace SonarPropagation::Validation;
+
+namespace {
+
+	void PrintUsage() {
+		std::cout <<
+			"Usage: SonarUnitTests [options]\n"
+			"  --filter <text>        run only the tests whose name contains the text\n"
+			"  --list                 print the test names and exit\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	bool list = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+
+		if (!std::strcmp(argv[i], "--filter") && hasValue) {
+			filter = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "--list")) {
+			list = true;
+		}
+		else {
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	std::vector<UnitTest> tests;
+	AddAllocatorTests(tests);
+	AddAllocationCountTests(tests);
+	AddShaderTableLayoutTests(tests);
+	AddPipelineStateCacheTests(tests);
+	AddFrameRingTests(tests);
+	AddShaderCacheTests(tests);
+	AddShaderPermutationTests(tests);
+	AddTrajectoryStoreTests(tests);
+	AddHitMapTests(tests);
+	AddReceiverGridTests(tests);
+	AddTileCacheTests(tests);
+	AddTimingStatsTests(tests);
+
+	uint32_t failures = 0;
+	uint32_t run = 0;
+
+	for (const UnitTest& test : tests) {
+		if (!filter.empty() && test.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		if (list) {
+			std::cout << test.name << '\n';
+			continue;
+		}
+
+		++run;
+		try {
+			test.run();
+			std::cout << "PASS " << test.name << '\n';
+		}
+		catch (const std::exception& exception) {
+			std::cout << "FAIL " << test.name << "\n    " << exception.what() << '\n';
+			++failures;
+		}
+	}
+
+	if (!list) {
+		std::cout << run - failures << " of " << run << " tests passed\n";
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace SonarPropagation {
+	namespace Validation {
+
+		/// <summary>
+		/// A check of a device independent part of the tree. Fails by throwing, usually through SONAR_CHECK.
+		/// </summary>
+		struct UnitTest {
+			std::string name;
+			std::function<void()> run;
+		};
+
+		/// <summary>
+		/// Thrown by SONAR_CHECK with the file, line and expression that failed.
+		/// </summary>
+		class UnitTestFailure : public std::runtime_error {
+		public:
+			UnitTestFailure(const char* file, int line, const char* expression)
+				: std::runtime_error(std::string(file) + ":" + std::to_string(line) + ": " + expression) {}
+		};
+
+		void AddAllocatorTests(std::vector<UnitTest>& tests);
+		void AddAllocationCountTests(std::vector<UnitTest>& tests);
+		void AddShaderTableLayoutTests(std::vector<UnitTest>& tests);
+		void AddPipelineStateCacheTests(std::vector<UnitTest>& tests);
+		void AddFrameRingTests(std::vector<UnitTest>& tests);
+		void AddShaderCacheTests(std::vector<UnitTest>& tests);
+		void AddShaderPermutationTests(std::vector<UnitTest>& tests);
+		void AddTrajectoryStoreTests(std::vector<UnitTest>& tests);
+		void AddHitMapTests(std::vector<UnitTest>& tests);
+		void AddReceiverGridTests(std::vector<UnitTest>& tests);
+		void AddTileCacheTests(std::vector<UnitTest>& tests);
+		void AddTimingStatsTests(std::vector<UnitTest>& tests);
+	}
+}
+
+#define SONAR_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			throw ::SonarPropagation::Validation::UnitTestFailure(__FILE__, __LINE__, #condition); \
+		} \
+	} while (false)